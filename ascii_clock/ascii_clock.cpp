@@ -9,9 +9,9 @@
 #include <time.h>
 #include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
-#include "lwip/dns.h"
-#include "lwip/pbuf.h"
-#include "lwip/udp.h"
+#include "font.h"
+#include "timesync.h"
+#include "led_pattern.h"
 
 #ifdef USE_UART
 #include "hardware/uart.h"
@@ -26,11 +26,11 @@
 #define WIFI_PASSWORD "YOUR_PASS"
 // ==============================================
 
-#define NTP_SERVER "pool.ntp.org"
-#define NTP_PORT 123
-#define NTP_DELTA 2208988800
 #define UK_TIMEZONE_OFFSET 0
 
+// Time comes from the shared time service (pico-shell-based-os/timesync.h)
+static const char *const NTP_SERVERS[] = { "0.pool.ntp.org", "1.pool.ntp.org", "2.pool.ntp.org" };
+
 // ===== TERMINAL LAYOUT =====
 #define TERMINAL_WIDTH 80
 #define CLOCK_WIDTH 43
@@ -42,49 +42,16 @@ typedef struct {
 } datetime_t;
 
 datetime_t current_time;
-bool time_synced = false;
-
-// ================= ASCII DIGITS =================
-const char* DIGITS[10][5] = {
-    {" ### ", "#   #", "#   #", "#   #", " ### "},
-    {"  #  ", " ##  ", "  #  ", "  #  ", "#####"},
-    {" ### ", "#   #", "  ## ", " #   ", "#####"},
-    {" ### ", "#   #", "  ## ", "#   #", " ### "},
-    {"#   #", "#   #", "#####", "    #", "    #"},
-    {"#####", "#    ", "#### ", "    #", "#### "},
-    {" ### ", "#    ", "#### ", "#   #", " ### "},
-    {"#####", "    #", "   # ", "  #  ", " #   "},
-    {" ### ", "#   #", " ### ", "#   #", " ### "},
-    {" ### ", "#   #", " ####", "    #", " ### "}
-};
-
-const char* COLON[5] = {"  ", " #", "  ", " #", "  "};
-
-// ================= NTP =================
-typedef struct {
-    uint8_t li_vn_mode;
-    uint8_t stratum, poll, precision;
-    uint32_t root_delay, root_dispersion, ref_id;
-    uint32_t ref_ts[2], org_ts[2], rx_ts[2], tx_ts[2];
-} ntp_packet_t;
-
-static struct {
-    ip_addr_t addr;
-    struct udp_pcb *pcb;
-} ntp_state;
 
 // ================= HELPERS =================
 void pad() {
     for (int i = 0; i < CLOCK_PADDING; i++) putchar(' ');
 }
 
+// Plays in the background (led_pattern.h), so the connect and sync below
+// run while it blinks; a later call replaces an unfinished one
 void wifi_blink(int times, int on_ms, int off_ms) {
-    for (int i = 0; i < times; i++) {
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-        sleep_ms(on_ms);
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
-        sleep_ms(off_ms);
-    }
+    led_pattern_blink(times, on_ms, off_ms);
 }
 
 bool is_leap_year(int y) {
@@ -96,26 +63,17 @@ int days_in_month(int m, int y) {
     return (m == 2 && is_leap_year(y)) ? 29 : d[m - 1];
 }
 
-void tick_time() {
-    if (++current_time.sec < 60) return;
-    current_time.sec = 0;
-    if (++current_time.min < 60) return;
-    current_time.min = 0;
-    if (++current_time.hour < 24) return;
-    current_time.hour = 0;
-    current_time.day++;
-    current_time.dotw = (current_time.dotw + 1) % 7;
-    if (current_time.day > days_in_month(current_time.month, current_time.year)) {
-        current_time.day = 1;
-        if (++current_time.month > 12) {
-            current_time.month = 1;
-            current_time.year++;
-        }
-    }
+time_t datetime_to_timestamp(const datetime_t *dt) {
+    int64_t days = dt->day - 1;
+    for (int y = 1970; y < dt->year; y++) days += is_leap_year(y) ? 366 : 365;
+    for (int m = 1; m < dt->month; m++) days += days_in_month(m, dt->year);
+    return (time_t)(((days * 24 + dt->hour) * 60 + dt->min) * 60 + dt->sec);
 }
 
+// Manual fallback: set the service's clock (NTP still wins if it answers later)
 void init_time(int y,int m,int d,int w,int h,int mi,int s) {
     current_time = {y,m,d,w,h,mi,s};
+    timesync_set_unix(datetime_to_timestamp(&current_time) - UK_TIMEZONE_OFFSET);
 }
 
 void timestamp_to_datetime(time_t t) {
@@ -129,58 +87,20 @@ void timestamp_to_datetime(time_t t) {
     current_time.sec = tm->tm_sec;
 }
 
-// ================= NTP CALLBACKS =================
-static void ntp_recv(void*, udp_pcb*, pbuf *p, const ip_addr_t*, u16_t) {
-    if (p->tot_len == sizeof(ntp_packet_t)) {
-        auto *pkt = (ntp_packet_t*)p->payload;
-        uint32_t sec1900 = ntohl(pkt->tx_ts[0]);
-        time_t unix_time = sec1900 - NTP_DELTA + UK_TIMEZONE_OFFSET;
-        timestamp_to_datetime(unix_time);
-        time_synced = true;
-    }
-    pbuf_free(p);
-}
-
-static void dns_found(const char*, const ip_addr_t *ip, void*) {
-    if (ip) ntp_state.addr = *ip;
-}
-
-bool ntp_init() {
-    ntp_state.pcb = udp_new();
-    if (!ntp_state.pcb) return false;
-    udp_recv(ntp_state.pcb, ntp_recv, nullptr);
-    dns_gethostbyname(NTP_SERVER, &ntp_state.addr, dns_found, nullptr);
-    return true;
-}
-
-void ntp_request() {
-    pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(ntp_packet_t), PBUF_RAM);
-    auto *pkt = (ntp_packet_t*)p->payload;
-    memset(pkt, 0, sizeof(*pkt));
-    pkt->li_vn_mode = 0x1b;
-    udp_sendto(ntp_state.pcb, p, &ntp_state.addr, NTP_PORT);
-    pbuf_free(p);
-}
-
 // ================= DISPLAY =================
 void clear_screen() { printf("\033[2J\033[H"); }
 
 void display_clock() {
     printf("\033[H\n");
 
-    int h1=current_time.hour/10, h2=current_time.hour%10;
-    int m1=current_time.min/10,  m2=current_time.min%10;
-    int s1=current_time.sec/10,  s2=current_time.sec%10;
+    char text[9];
+    snprintf(text, sizeof(text), "%02d:%02d:%02d",
+        current_time.hour, current_time.min, current_time.sec);
 
     pad(); printf("Pico 2 W ASCII Clock\n\n");
 
-    for (int r=0;r<5;r++) {
-        pad();
-        printf("%s %s %s %s %s %s %s %s\n",
-            DIGITS[h1][r], DIGITS[h2][r], COLON[r],
-            DIGITS[m1][r], DIGITS[m2][r], COLON[r],
-            DIGITS[s1][r], DIGITS[s2][r]);
-    }
+    // Digits come from the shared block font (pico-shell-based-os/font.h)
+    font_print(&font_block, text, CLOCK_PADDING);
 
     pad();
     printf("\n%04d-%02d-%02d  (Day %d)\n",
@@ -190,7 +110,7 @@ void display_clock() {
         current_time.dotw);
 
     pad();
-    printf(time_synced ? "Time source: NTP\n" : "Time source: MANUAL\n");
+    printf(timesync_synced() ? "Time source: NTP\n" : "Time source: MANUAL\n");
 }
 
 // ================= MAIN =================
@@ -206,9 +126,11 @@ int main() {
 #endif
 
     int wifi_result = 0;
+    timesync_init();
 
     if (cyw43_arch_init()) goto manual_time;
     cyw43_arch_enable_sta_mode();
+    led_pattern_init();
 
     wifi_blink(2, 300, 300); // connecting indicator
 
@@ -224,12 +146,10 @@ int main() {
 
     wifi_blink(5, 80, 80); // success
 
-    if (!ntp_init()) goto manual_time;
-    sleep_ms(2000);
-    ntp_request();
+    if (!timesync_start(NTP_SERVERS, sizeof(NTP_SERVERS) / sizeof(NTP_SERVERS[0]))) goto manual_time;
 
-    for (int i=0;i<50 && !time_synced;i++) sleep_ms(100);
-    if (!time_synced) goto manual_time;
+    for (int i=0;i<70 && !timesync_synced();i++) sleep_ms(100);
+    if (!timesync_synced()) goto manual_time;
 
     goto start_clock;
 
@@ -238,12 +158,13 @@ manual_time:
 
 start_clock:
     clear_screen();
-    absolute_time_t last = get_absolute_time();
 
     while (true) {
+        // Redraw just after each second boundary of the disciplined clock,
+        // so the display follows NTP time instead of counting sleeps
+        timestamp_to_datetime(timesync_unix() + UK_TIMEZONE_OFFSET);
         display_clock();
-        sleep_until(delayed_by_ms(last, 1000));
-        last = get_absolute_time();
-        tick_time();
+        int64_t into_second = timesync_time_us() % 1000000;
+        sleep_us(1000000 - into_second + 1000);
     }
 }
@@ -0,0 +1,134 @@
+/**
+ * FreeRTOS configuration for the pico_os_freertos build
+ *
+ * SMP across both RP2350 cores. Tasks float between the cores unless
+ * something pins them, so whichever core is free picks up the next ready
+ * task; priorities decide who waits:
+ *
+ *   cyw43 driver task, lwIP tcpip thread   4   (CYW43_TASK_PRIORITY, lwipopts.h)
+ *   filesystem service                     2
+ *   shell, background processes            1   (time sliced)
+ *   idle                                   0
+ *
+ * The HTTP server, NTP client and DNS cache use lwIP's raw API, so they run
+ * in the two network tasks above and a long shell command can no longer
+ * delay a web request: it is preempted, or simply runs on the other core.
+ *
+ * The SDK's pico_sync and pico_time primitives are made task-aware
+ * (configSUPPORT_PICO_*_INTEROP), so semaphores, queues and sleep_ms()
+ * block the calling task instead of spinning the core. Task switches are
+ * traced into cpu_load.cpp, which charges each task to the activity in its
+ * application tag.
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+// Scheduler
+#define configUSE_PREEMPTION                    1
+#define configUSE_TICKLESS_IDLE                 0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_PASSIVE_IDLE_HOOK             0
+#define configUSE_TICK_HOOK                     0
+#define configTICK_RATE_HZ                      ((TickType_t)1000)
+#define configMAX_PRIORITIES                    8
+#define configMINIMAL_STACK_SIZE                ((configSTACK_DEPTH_TYPE)256)
+#define configUSE_16_BIT_TICKS                  0
+#define configIDLE_SHOULD_YIELD                 1
+#define configUSE_TIME_SLICING                  1
+#define configMAX_TASK_NAME_LEN                 12
+#define configSTACK_DEPTH_TYPE                  uint32_t
+#define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
+
+// Synchronisation
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             1
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configUSE_QUEUE_SETS                    1
+#define configQUEUE_REGISTRY_SIZE               8
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configUSE_APPLICATION_TASK_TAG          1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
+#define configUSE_NEWLIB_REENTRANT              0
+#define configENABLE_BACKWARD_COMPATIBILITY     1
+
+// Memory: heap_4, holding every task stack and lwIP's mailboxes
+#define configSUPPORT_STATIC_ALLOCATION         0
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configTOTAL_HEAP_SIZE                   (64 * 1024)
+#define configAPPLICATION_ALLOCATED_HEAP        0
+
+// Checks
+#define configCHECK_FOR_STACK_OVERFLOW          2
+#define configUSE_MALLOC_FAILED_HOOK            0
+#define configUSE_DAEMON_TASK_STARTUP_HOOK      0
+
+// Run-time stats for 'top', counted in microseconds
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+#define configUSE_TRACE_FACILITY                1
+#define configUSE_STATS_FORMATTING_FUNCTIONS    0
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        time_us_64()
+
+// Software timers (lwIP's sys_timeout runs in the tcpip thread instead)
+#define configUSE_CO_ROUTINES                   0
+#define configUSE_TIMERS                        1
+#define configTIMER_TASK_PRIORITY               (configMAX_PRIORITIES - 1)
+#define configTIMER_QUEUE_LENGTH                10
+#define configTIMER_TASK_STACK_DEPTH            1024
+
+// SMP
+#define configNUMBER_OF_CORES                   2
+#define configTICK_CORE                         0
+#define configRUN_MULTIPLE_PRIORITIES           1
+#define configUSE_CORE_AFFINITY                 1  // flash_safe_execute() pins its helper tasks
+
+// RP2350 port
+#define configSUPPORT_PICO_SYNC_INTEROP         1
+#define configSUPPORT_PICO_TIME_INTEROP         1
+#define configENABLE_FPU                        1
+#define configENABLE_MPU                        0
+#define configENABLE_TRUSTZONE                  0
+#define configRUN_FREERTOS_SECURE_ONLY          1
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY    16
+
+#include <assert.h>
+#define configASSERT(x)                         assert(x)
+
+// Optional API
+#define INCLUDE_vTaskPrioritySet                1
+#define INCLUDE_uxTaskPriorityGet               1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_vTaskDelayUntil                 1
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
+#define INCLUDE_eTaskGetState                   1
+#define INCLUDE_xTimerPendFunctionCall          1
+#define INCLUDE_xTaskAbortDelay                 1
+#define INCLUDE_xTaskGetHandle                  1
+#define INCLUDE_xTaskResumeFromISR              1
+#define INCLUDE_xQueueGetMutexHolder            1
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#include "hardware/timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void cpu_load_task_switched_in(uint32_t tag);
+#ifdef __cplusplus
+}
+#endif
+
+// Expanded inside tasks.c, where the task control blocks are visible
+#define traceTASK_SWITCHED_IN() \
+    cpu_load_task_switched_in((uint32_t)(uintptr_t)pxCurrentTCBs[portGET_CORE_ID()]->pxTaskTag)
+#endif
+
+#endif // FREERTOS_CONFIG_H
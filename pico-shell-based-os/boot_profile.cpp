@@ -0,0 +1,99 @@
+/**
+ * Boot profiler - see boot_profile.h
+ */
+
+#include "boot_profile.h"
+#include "pico_os.h"
+#include "pico/sync.h"
+
+#define BOOT_TIMELINE_WIDTH 32
+
+struct boot_stage {
+    const char *name;
+    uint8_t core;
+    uint64_t start_us;
+    uint64_t end_us;            // 0 while running
+};
+
+static struct boot_stage stages[BOOT_MAX_STAGES];
+static int stage_count = 0;
+static uint64_t ready_us = 0;
+static critical_section_t stage_lock;
+
+void boot_profile_init() {
+    critical_section_init(&stage_lock);
+    // Everything before main(): boot ROM, flash setup, runtime init
+    stages[0].name = "reset to main";
+    stages[0].core = 0;
+    stages[0].start_us = 0;
+    stages[0].end_us = time_us_64();
+    stage_count = 1;
+}
+
+int boot_stage_begin(const char *name) {
+    critical_section_enter_blocking(&stage_lock);
+    int stage = stage_count < BOOT_MAX_STAGES ? stage_count++ : -1;
+    if (stage >= 0) {
+        stages[stage].name = name;
+        stages[stage].core = (uint8_t)get_core_num();
+        stages[stage].start_us = time_us_64();
+        stages[stage].end_us = 0;
+    }
+    critical_section_exit(&stage_lock);
+    return stage;
+}
+
+void boot_stage_end(int stage) {
+    if (stage >= 0) {
+        stages[stage].end_us = time_us_64();
+    }
+}
+
+void boot_profile_ready() {
+    ready_us = time_us_64();
+}
+
+void boot_profile_print() {
+    uint64_t total = ready_us ? ready_us : time_us_64();
+
+    printf("\n" ANSI_BOLD "Boot profile" ANSI_RESET " (ms since reset)\n");
+    printf("  %-16s %4s %8s %8s  %s\n", "Stage", "Core", "Start", "Time", "Timeline");
+    for (int i = 0; i < stage_count; i++) {
+        const struct boot_stage *stage = &stages[i];
+        uint64_t end = stage->end_us ? stage->end_us : total;
+        uint32_t start_us = (uint32_t)stage->start_us;
+        uint32_t time_us = (uint32_t)(end - stage->start_us);
+
+        // One column per 1/BOOT_TIMELINE_WIDTH of the boot, at least one mark
+        char timeline[BOOT_TIMELINE_WIDTH + 1];
+        int from = (int)(stage->start_us * BOOT_TIMELINE_WIDTH / total);
+        int to = (int)(end * BOOT_TIMELINE_WIDTH / total);
+        if (to <= from) {
+            to = from + 1;
+        }
+        for (int col = 0; col < BOOT_TIMELINE_WIDTH; col++) {
+            timeline[col] = col >= from && col < to ? (stage->core ? '=' : '#') : '.';
+        }
+        timeline[BOOT_TIMELINE_WIDTH] = '\0';
+
+        printf("  %-16s %4u %5lu.%lu %5lu.%lu  %s%s\n", stage->name, stage->core,
+               (unsigned long)(start_us / 1000), (unsigned long)(start_us % 1000 / 100),
+               (unsigned long)(time_us / 1000), (unsigned long)(time_us % 1000 / 100),
+               timeline, stage->end_us ? "" : " (running)");
+    }
+    printf("  Shell ready at %lu.%lu ms ('#' core 0, '=' core 1)\n\n",
+           (unsigned long)(total / 1000), (unsigned long)(total % 1000 / 100));
+}
+
+void boot_profile_log() {
+    char msg[96];
+    for (int i = 0; i < stage_count; i++) {
+        const struct boot_stage *stage = &stages[i];
+        uint32_t time_us = stage->end_us ? (uint32_t)(stage->end_us - stage->start_us) : 0;
+        snprintf(msg, sizeof(msg), "Boot: %s %lu.%lu ms (core %u)", stage->name,
+                 (unsigned long)(time_us / 1000), (unsigned long)(time_us % 1000 / 100), stage->core);
+        log_message(msg);
+    }
+    snprintf(msg, sizeof(msg), "Boot: shell ready at %lu ms", (unsigned long)(ready_us / 1000));
+    log_message(msg);
+}
@@ -0,0 +1,33 @@
+/**
+ * Boot profiler - timestamped start-up stages
+ *
+ * Each stage records the core it ran on and its start and end against the
+ * hardware timer, which starts at reset, so the first row ("reset to
+ * main") is the boot ROM and runtime init. Stages may overlap: fast boot
+ * mounts the filesystem on core 1 while core 0 starts the WiFi driver, and
+ * the table's timeline column shows that directly.
+ *
+ * Begin/end are safe from both cores. The table is printed once the
+ * console is up and kept in the system log; 'bootprof' prints it again.
+ */
+
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#define BOOT_MAX_STAGES 16
+
+// First thing in main()
+void boot_profile_init();
+
+// Returns a handle for boot_stage_end(), -1 if the table is full. name
+// must be a string literal (or otherwise outlive the profile).
+int boot_stage_begin(const char *name);
+void boot_stage_end(int stage);
+
+// Boot is complete: the shell is about to take input
+void boot_profile_ready();
+
+void boot_profile_print();
+void boot_profile_log();
+
+#endif // BOOT_PROFILE_H
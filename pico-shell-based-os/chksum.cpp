@@ -0,0 +1,434 @@
+/**
+ * Internet checksum for lwIP - see chksum.h
+ *
+ * Every implementation shares the same frame: a leading odd byte and
+ * halfword bring the source to a word boundary, the words are summed (and
+ * copied) by the fast loop, the tail is added, and the result is folded
+ * and byte-swapped back when the buffer started on an odd address, just
+ * as lwIP's algorithm 3 does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "chksum.h"
+
+#ifdef CHKSUM_HOST_TEST
+#include <stdlib.h>
+#include <time.h>
+#else
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#endif
+
+#define FOLD(s) (((s) >> 16) + ((s) & 0xffffu))
+#define SWAP_BYTES(w) ((((w) & 0xffu) << 8) | (((w) & 0xff00u) >> 8))
+
+// Words with end-around carry, folded into 32 bits
+static inline uint32_t fold64(uint64_t acc) {
+    acc = (acc & 0xffffffffu) + (acc >> 32);
+    acc = (acc & 0xffffffffu) + (acc >> 32);
+    return (uint32_t)acc;
+}
+
+static uint32_t sum_words_c(const uint32_t *src, uint32_t *dst, uint32_t words, uint32_t sum) {
+    uint64_t acc = sum;
+    if (dst) {
+        while (words >= 4) {
+            uint32_t a = src[0], b = src[1], c = src[2], d = src[3];
+            dst[0] = a;
+            dst[1] = b;
+            dst[2] = c;
+            dst[3] = d;
+            acc += (uint64_t)a + b + c + d;
+            src += 4;
+            dst += 4;
+            words -= 4;
+        }
+        while (words--) {
+            acc += *dst++ = *src++;
+        }
+    } else {
+        while (words >= 4) {
+            acc += (uint64_t)src[0] + src[1] + src[2] + src[3];
+            src += 4;
+            words -= 4;
+        }
+        while (words--) {
+            acc += *src++;
+        }
+    }
+    return fold64(acc);
+}
+
+#if CHKSUM_ARM_ASM
+// Eight words per pass: four LDRD (and STRD when copying), then one
+// ADDS/ADCS chain with the final carry folded back in. Both pointers must
+// be word aligned, as LDRD/STRD do not take unaligned addresses.
+static uint32_t sum_words_arm(const uint32_t *src, uint32_t *dst, uint32_t words, uint32_t sum) {
+    uint32_t a, b, c, d;
+    if (dst) {
+        for (; words >= 8; words -= 8) {
+            __asm__ volatile(
+                "ldrd  %[a], %[b], [%[src]], #8\n\t"
+                "ldrd  %[c], %[d], [%[src]], #8\n\t"
+                "strd  %[a], %[b], [%[dst]], #8\n\t"
+                "strd  %[c], %[d], [%[dst]], #8\n\t"
+                "adds  %[sum], %[sum], %[a]\n\t"
+                "adcs  %[sum], %[sum], %[b]\n\t"
+                "adcs  %[sum], %[sum], %[c]\n\t"
+                "adcs  %[sum], %[sum], %[d]\n\t"
+                "adc   %[sum], %[sum], #0\n\t"
+                "ldrd  %[a], %[b], [%[src]], #8\n\t"
+                "ldrd  %[c], %[d], [%[src]], #8\n\t"
+                "strd  %[a], %[b], [%[dst]], #8\n\t"
+                "strd  %[c], %[d], [%[dst]], #8\n\t"
+                "adds  %[sum], %[sum], %[a]\n\t"
+                "adcs  %[sum], %[sum], %[b]\n\t"
+                "adcs  %[sum], %[sum], %[c]\n\t"
+                "adcs  %[sum], %[sum], %[d]\n\t"
+                "adc   %[sum], %[sum], #0\n\t"
+                : [sum] "+r"(sum), [src] "+r"(src), [dst] "+r"(dst),
+                  [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d)
+                :
+                : "cc", "memory");
+        }
+    } else {
+        for (; words >= 8; words -= 8) {
+            __asm__ volatile(
+                "ldrd  %[a], %[b], [%[src]], #8\n\t"
+                "ldrd  %[c], %[d], [%[src]], #8\n\t"
+                "adds  %[sum], %[sum], %[a]\n\t"
+                "adcs  %[sum], %[sum], %[b]\n\t"
+                "adcs  %[sum], %[sum], %[c]\n\t"
+                "adcs  %[sum], %[sum], %[d]\n\t"
+                "ldrd  %[a], %[b], [%[src]], #8\n\t"
+                "ldrd  %[c], %[d], [%[src]], #8\n\t"
+                "adcs  %[sum], %[sum], %[a]\n\t"
+                "adcs  %[sum], %[sum], %[b]\n\t"
+                "adcs  %[sum], %[sum], %[c]\n\t"
+                "adcs  %[sum], %[sum], %[d]\n\t"
+                "adc   %[sum], %[sum], #0\n\t"
+                : [sum] "+r"(sum), [src] "+r"(src),
+                  [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d)
+                :
+                : "cc", "memory");
+        }
+    }
+    return sum_words_c(src, dst, words, sum);
+}
+#endif
+
+typedef uint32_t (*sum_words_fn)(const uint32_t *src, uint32_t *dst, uint32_t words, uint32_t sum);
+
+// dst is NULL when only summing; when copying it must share src's
+// alignment within a word
+static inline __attribute__((always_inline))
+uint16_t chksum_span(uint8_t *dst, const uint8_t *src, int len, sum_words_fn sum_words) {
+    uint8_t tail[2] = {0, 0};
+    uint32_t sum = 0;
+    int odd = (uintptr_t)src & 1;
+
+    // Like lwIP: the odd leading byte goes in the high half of a word
+    // (in memory order) and the result is swapped back at the end
+    if (odd && len > 0) {
+        tail[1] = *src++;
+        if (dst) {
+            *dst++ = tail[1];
+        }
+        len--;
+    }
+    if (((uintptr_t)src & 2) && len > 1) {
+        uint16_t half;
+        memcpy(&half, src, 2);
+        if (dst) {
+            memcpy(dst, &half, 2);
+            dst += 2;
+        }
+        sum += half;
+        src += 2;
+        len -= 2;
+    }
+
+    uint32_t words = (uint32_t)len >> 2;
+    sum = sum_words((const uint32_t *)(const void *)src, (uint32_t *)(void *)dst, words, sum);
+    src += words * 4;
+    if (dst) {
+        dst += words * 4;
+    }
+    len &= 3;
+    sum = FOLD(sum);
+
+    if (len > 1) {
+        uint16_t half;
+        memcpy(&half, src, 2);
+        if (dst) {
+            memcpy(dst, &half, 2);
+            dst += 2;
+        }
+        sum += half;
+        src += 2;
+        len -= 2;
+    }
+    if (len > 0) {
+        tail[0] = *src;
+        if (dst) {
+            *dst = tail[0];
+        }
+    }
+    uint16_t last;
+    memcpy(&last, tail, 2);
+    sum += last;
+    sum = FOLD(sum);
+    sum = FOLD(sum);
+    if (odd) {
+        sum = SWAP_BYTES(sum);
+    }
+    return (uint16_t)sum;
+}
+
+uint16_t chksum_portable(const void *dataptr, int len) {
+    return chksum_span(NULL, (const uint8_t *)dataptr, len, sum_words_c);
+}
+
+uint16_t chksum_copy_portable(void *dst, const void *src, uint16_t len) {
+    if (((uintptr_t)dst ^ (uintptr_t)src) & 3) {
+        // Word loads and stores cannot both be aligned: copy, then sum
+        memcpy(dst, src, len);
+        return chksum_portable(dst, len);
+    }
+    return chksum_span((uint8_t *)dst, (const uint8_t *)src, len, sum_words_c);
+}
+
+#if CHKSUM_ARM_ASM
+uint16_t pico_chksum(const void *dataptr, int len) {
+    return chksum_span(NULL, (const uint8_t *)dataptr, len, sum_words_arm);
+}
+
+uint16_t pico_chksum_copy(void *dst, const void *src, uint16_t len) {
+    if (((uintptr_t)dst ^ (uintptr_t)src) & 3) {
+        memcpy(dst, src, len);
+        return pico_chksum(dst, len);
+    }
+    return chksum_span((uint8_t *)dst, (const uint8_t *)src, len, sum_words_arm);
+}
+#else
+uint16_t pico_chksum(const void *dataptr, int len) {
+    return chksum_portable(dataptr, len);
+}
+
+uint16_t pico_chksum_copy(void *dst, const void *src, uint16_t len) {
+    return chksum_copy_portable(dst, src, len);
+}
+#endif
+
+// lwip_standard_chksum() from core/inet_chksum.c, LWIP_CHKSUM_ALGORITHM 3
+uint16_t chksum_reference(const void *dataptr, int len) {
+    const uint8_t *pb = (const uint8_t *)dataptr;
+    const uint16_t *ps;
+    uint16_t t = 0;
+    const uint32_t *pl;
+    uint32_t sum = 0, tmp;
+    int odd = ((uintptr_t)pb & 1);
+
+    if (odd && len > 0) {
+        ((uint8_t *)&t)[1] = *pb++;
+        len--;
+    }
+    ps = (const uint16_t *)(const void *)pb;
+    if (((uintptr_t)ps & 3) && len > 1) {
+        sum += *ps++;
+        len -= 2;
+    }
+    pl = (const uint32_t *)(const void *)ps;
+    while (len > 7) {
+        tmp = sum + *pl++;
+        if (tmp < sum) {
+            tmp++;
+        }
+        sum = tmp + *pl++;
+        if (sum < tmp) {
+            sum++;
+        }
+        len -= 8;
+    }
+    sum = FOLD(sum);
+    ps = (const uint16_t *)pl;
+    while (len > 1) {
+        sum += *ps++;
+        len -= 2;
+    }
+    if (len > 0) {
+        ((uint8_t *)&t)[0] = *(const uint8_t *)ps;
+    }
+    sum += t;
+    sum = FOLD(sum);
+    sum = FOLD(sum);
+    if (odd) {
+        sum = SWAP_BYTES(sum);
+    }
+    return (uint16_t)sum;
+}
+
+// ---------------------------------------------------------------------------
+// Verification and benchmark
+// ---------------------------------------------------------------------------
+
+#define VERIFY_REPORT 8             // Mismatches printed
+#define GUARD 8                     // Bytes checked around each copy
+#define BENCH_BYTES (256 * 1024)    // Summed per size and implementation
+
+static uint32_t rng_state;
+
+static uint32_t rng_next() {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+static uint64_t now_us() {
+#ifdef CHKSUM_HOST_TEST
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+#else
+    return time_us_64();
+#endif
+}
+
+// Word aligned, with room for the offsets and the guard bytes
+static uint32_t src_words[(CHKSUM_TEST_MAX_LEN + 2 * GUARD + 8) / 4];
+static uint32_t dst_words[(CHKSUM_TEST_MAX_LEN + 2 * GUARD + 8) / 4];
+
+static bool copy_ok(const uint8_t *dst, const uint8_t *src, int len) {
+    if (memcmp(dst, src, len) != 0) {
+        return false;
+    }
+    for (int i = 1; i <= GUARD; i++) {
+        if (dst[-i] != 0xA5 || dst[len - 1 + i] != 0xA5) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t chksum_verify(uint32_t iterations, uint32_t seed) {
+    uint8_t *src_base = (uint8_t *)src_words;
+    uint8_t *dst_base = (uint8_t *)dst_words;
+    uint32_t failures = 0;
+    rng_state = seed ? seed : 1;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        int len = (int)(rng_next() % (CHKSUM_TEST_MAX_LEN + 1));
+        uint8_t *src = src_base + GUARD + (rng_next() & 7);
+        uint8_t *dst = dst_base + GUARD + (rng_next() & 7);
+
+        // Mostly random bytes; all-ones and all-zero runs hit the carry
+        // and fold edge cases (0x0000 vs 0xffff)
+        uint32_t pattern = rng_next() & 15;
+        for (int j = 0; j < len; j++) {
+            src[j] = pattern == 0 ? 0xFF : pattern == 1 ? 0x00 : (uint8_t)rng_next();
+        }
+
+        uint16_t want = chksum_reference(src, len);
+        uint16_t got[4];
+        bool copied[2];
+        got[0] = pico_chksum(src, len);
+        got[1] = chksum_portable(src, len);
+        memset(dst_base, 0xA5, sizeof(dst_words));
+        got[2] = pico_chksum_copy(dst, src, (uint16_t)len);
+        copied[0] = copy_ok(dst, src, len);
+        memset(dst_base, 0xA5, sizeof(dst_words));
+        got[3] = chksum_copy_portable(dst, src, (uint16_t)len);
+        copied[1] = copy_ok(dst, src, len);
+
+        bool ok = copied[0] && copied[1];
+        for (int k = 0; k < 4; k++) {
+            ok = ok && got[k] == want;
+        }
+        if (!ok) {
+            if (failures < VERIFY_REPORT) {
+                printf("  mismatch: len %d src+%u dst+%u: ref %04x fast %04x c %04x "
+                       "copy %04x%s c-copy %04x%s\n",
+                       len, (unsigned)((uintptr_t)src & 7), (unsigned)((uintptr_t)dst & 7),
+                       want, got[0], got[1], got[2], copied[0] ? "" : " (bad copy)",
+                       got[3], copied[1] ? "" : " (bad copy)");
+            }
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static volatile uint32_t bench_sink;
+
+static void bench_row(const char *name, int len, bool copy, uint16_t (*sum_fn)(const void *, int),
+                      uint16_t (*copy_fn)(void *, const void *, uint16_t)) {
+    const uint8_t *src = (const uint8_t *)src_words;
+    uint8_t *dst = (uint8_t *)dst_words;
+    uint32_t rounds = BENCH_BYTES / (uint32_t)len;
+    uint32_t acc = 0;
+
+    uint64_t start = now_us();
+    for (uint32_t r = 0; r < rounds; r++) {
+        if (copy_fn) {
+            acc += copy_fn(dst, src, (uint16_t)len);
+        } else if (copy) {
+            // Two passes: what lwIP does without LWIP_CHECKSUM_ON_COPY
+            memcpy(dst, src, len);
+            acc += sum_fn(dst, len);
+        } else {
+            acc += sum_fn(src, len);
+        }
+    }
+    uint64_t us = now_us() - start;
+    bench_sink = acc;
+
+    uint64_t bytes = (uint64_t)rounds * (uint32_t)len;
+    uint32_t mbps10 = us ? (uint32_t)(bytes * 10 / us) : 0;     // MB/s x10
+#ifdef CHKSUM_HOST_TEST
+    printf("  %-16s %5d %6lu.%lu MB/s\n", name, len, (unsigned long)(mbps10 / 10),
+           (unsigned long)(mbps10 % 10));
+#else
+    uint64_t cycles = us * (clock_get_hz(clk_sys) / 1000000u);
+    uint32_t cpb100 = bytes ? (uint32_t)(cycles * 100 / bytes) : 0;
+    printf("  %-16s %5d %6lu.%lu MB/s %3lu.%02lu cycles/byte\n", name, len,
+           (unsigned long)(mbps10 / 10), (unsigned long)(mbps10 % 10),
+           (unsigned long)(cpb100 / 100), (unsigned long)(cpb100 % 100));
+#endif
+}
+
+void chksum_bench() {
+    static const int sizes[] = {20, 64, 256, 576, 1460};
+    rng_state = 0x9E3779B9u;
+    uint8_t *src = (uint8_t *)src_words;
+    for (int j = 0; j < CHKSUM_TEST_MAX_LEN; j++) {
+        src[j] = (uint8_t)rng_next();
+    }
+
+    printf("  %-16s %5s %11s\n", "", "bytes", "throughput");
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int len = sizes[i];
+        bench_row("lwIP algorithm 3", len, false, chksum_reference, NULL);
+        bench_row("portable C", len, false, chksum_portable, NULL);
+#if CHKSUM_ARM_ASM
+        bench_row("M33 ADCS", len, false, pico_chksum, NULL);
+#endif
+        bench_row("memcpy + sum", len, true, pico_chksum, NULL);
+        bench_row("copy-and-sum", len, true, NULL, pico_chksum_copy);
+    }
+}
+
+#ifdef CHKSUM_HOST_TEST
+int main(int argc, char *argv[]) {
+    uint32_t iterations = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1000000;
+    uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : (uint32_t)time(NULL);
+
+    printf("Verifying %lu random buffers (seed 0x%08lx)\n", (unsigned long)iterations, (unsigned long)seed);
+    uint32_t failures = chksum_verify(iterations, seed);
+    printf("%lu mismatches\n", (unsigned long)failures);
+    chksum_bench();
+    return failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,65 @@
+/**
+ * Internet checksum for lwIP - LWIP_CHKSUM and LWIP_CHKSUM_COPY overrides
+ *
+ * Drop-in replacements for lwip_standard_chksum() and lwip_chksum_copy():
+ * same arguments, same result (the ones' complement sum of the bytes as
+ * stored, folded to 16 bits and not inverted), including odd start
+ * addresses and odd lengths. lwipopts.h points lwIP at these, and with
+ * LWIP_CHECKSUM_ON_COPY the TCP payload is checksummed while tcp_write()
+ * copies it, so outgoing segments are read once instead of twice.
+ *
+ * On Thumb-2 cores (the RP2350's Cortex-M33) the word loop is an
+ * ADDS/ADCS carry chain over LDRD pairs, eight words per iteration, so the
+ * carry flag does the end-around carry for free. The portable C version,
+ * used elsewhere (the RP2350's RISC-V cores, the RP2040's Cortex-M0+, the
+ * host test) sums words into a 64-bit accumulator.
+ *
+ * chksum_verify() checks both against a copy of lwIP's algorithm 3 on
+ * random data, lengths and alignments; chksum_bench() times them. With
+ * CHKSUM_HOST_TEST defined, chksum.cpp builds a host program that runs
+ * the verification for longer and benchmarks the portable path:
+ *
+ *     c++ -O2 -DCHKSUM_HOST_TEST chksum.cpp -o chksum && ./chksum [iterations] [seed]
+ */
+
+#ifndef CHKSUM_H
+#define CHKSUM_H
+
+#include <stdint.h>
+
+#if defined(__thumb2__) && !defined(CHKSUM_HOST_TEST)
+#define CHKSUM_ARM_ASM 1
+#else
+#define CHKSUM_ARM_ASM 0
+#endif
+
+#define CHKSUM_TEST_MAX_LEN 1600        // Random lengths 0..this
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// lwIP types are not defined yet where lwipopts.h includes this, so the
+// prototypes use the stdint equivalents of u16_t
+uint16_t pico_chksum(const void *dataptr, int len);
+uint16_t pico_chksum_copy(void *dst, const void *src, uint16_t len);
+
+#ifdef __cplusplus
+}
+
+// Portable C paths, also what pico_chksum() runs when CHKSUM_ARM_ASM is 0
+uint16_t chksum_portable(const void *dataptr, int len);
+uint16_t chksum_copy_portable(void *dst, const void *src, uint16_t len);
+
+// lwIP's LWIP_CHKSUM_ALGORITHM 3, kept as the reference
+uint16_t chksum_reference(const void *dataptr, int len);
+
+// Compare every implementation (and the copies) with the reference on
+// random buffers; prints the first few mismatches and returns their count
+uint32_t chksum_verify(uint32_t iterations, uint32_t seed);
+
+// Throughput of each implementation at typical packet sizes
+void chksum_bench();
+#endif
+
+#endif // CHKSUM_H
@@ -0,0 +1,141 @@
+/**
+ * CPU load accounting - see cpu_load.h
+ */
+
+#include "cpu_load.h"
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#if PICO_OS_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#else
+#include "pico/async_context_threadsafe_background.h"
+#include "hardware/irq.h"
+#endif
+
+#define SWITCH_MEASURE_COUNT 1000
+
+struct core_load {
+    volatile uint32_t seq;      // Odd while an update is in progress
+    uint8_t current;            // enum cpu_activity
+    uint32_t since_us;          // When current began
+    uint32_t switches;
+    uint64_t us[CPU_ACTIVITIES];
+};
+
+static struct core_load cores[CPU_LOAD_CORES];
+#if !PICO_OS_FREERTOS
+static irq_handler_t net_handler;      // The driver's own low-priority IRQ handler
+#endif
+
+static const char *const activity_names[CPU_ACTIVITIES] = {
+    "idle", "net", "shell", "flash", "fs", "tasks", "other"
+};
+
+void cpu_load_init() {
+    uint32_t now = time_us_32();
+    for (int i = 0; i < CPU_LOAD_CORES; i++) {
+        cores[i].current = CPU_OTHER;
+        cores[i].since_us = now;
+    }
+}
+
+// Called from interrupt handlers and the flash path, so kept in RAM
+enum cpu_activity __not_in_flash_func(cpu_enter)(enum cpu_activity activity) {
+    uint32_t save = save_and_disable_interrupts();
+    struct core_load *core = &cores[get_core_num()];
+    uint32_t now = time_us_32();
+    enum cpu_activity previous = (enum cpu_activity)core->current;
+    core->seq++;
+    __dmb();
+    core->us[previous] += now - core->since_us;
+    core->since_us = now;
+    core->current = (uint8_t)activity;
+    core->switches++;
+    __dmb();
+    core->seq++;
+    restore_interrupts(save);
+    return previous;
+}
+
+#if PICO_OS_FREERTOS
+// Tags hold activity + 1, so the untagged driver, tcpip and timer tasks
+// come out as 0 and are charged to the network
+void __not_in_flash_func(cpu_load_task_switched_in)(uint32_t tag) {
+    cpu_enter(tag ? (enum cpu_activity)(tag - 1) : CPU_NET);
+}
+
+void cpu_load_tag_task(void *task, enum cpu_activity activity) {
+    TaskHandle_t handle = task ? (TaskHandle_t)task : xTaskGetCurrentTaskHandle();
+    vTaskSetApplicationTaskTag(handle, (TaskHookFunction_t)(uintptr_t)(activity + 1));
+    if (handle == xTaskGetCurrentTaskHandle()) {
+        cpu_enter(activity);
+    }
+}
+
+// The idle tasks only exist once the scheduler runs, so they are tagged
+// here rather than in cpu_load_init()
+bool cpu_load_hook_net() {
+    for (int i = 0; i < configNUMBER_OF_CORES; i++) {
+        cpu_load_tag_task(xTaskGetIdleTaskHandleForCore(i), CPU_IDLE);
+    }
+    return true;
+}
+#else
+static void __not_in_flash_func(net_irq)() {
+    enum cpu_activity previous = cpu_enter(CPU_NET);
+    net_handler();
+    cpu_enter(previous);
+}
+
+bool cpu_load_hook_net() {
+    async_context_threadsafe_background_t *context =
+        (async_context_threadsafe_background_t *)cyw43_arch_async_context();
+    uint irq = context->low_priority_irq_num;
+    irq_handler_t handler = irq_get_exclusive_handler(irq);
+    if (!handler || handler == net_irq) {
+        return false;
+    }
+    // Pending work stays pending while the handler is swapped
+    bool enabled = irq_is_enabled(irq);
+    irq_set_enabled(irq, false);
+    net_handler = handler;
+    irq_remove_handler(irq, handler);
+    irq_set_exclusive_handler(irq, net_irq);
+    irq_set_enabled(irq, enabled);
+    return true;
+}
+#endif
+
+void cpu_load_sample(struct cpu_load_sample *sample) {
+    for (int i = 0; i < CPU_LOAD_CORES; i++) {
+        struct core_load *core = &cores[i];
+        uint32_t seq;
+        do {
+            while ((seq = core->seq) & 1) {
+                tight_loop_contents();
+            }
+            __dmb();
+            for (int a = 0; a < CPU_ACTIVITIES; a++) {
+                sample->us[i][a] = core->us[a];
+            }
+            sample->us[i][core->current] += time_us_32() - core->since_us;
+            sample->switches[i] = core->switches;
+            __dmb();
+        } while (core->seq != seq);
+    }
+    sample->at_us = time_us_64();
+}
+
+uint32_t cpu_load_switch_ns() {
+    uint32_t start = time_us_32();
+    for (int i = 0; i < SWITCH_MEASURE_COUNT / 2; i++) {
+        cpu_enter(cpu_enter(CPU_OTHER));
+    }
+    return (time_us_32() - start) * 1000 / SWITCH_MEASURE_COUNT;
+}
+
+const char *cpu_activity_name(enum cpu_activity activity) {
+    return activity < CPU_ACTIVITIES ? activity_names[activity] : "?";
+}
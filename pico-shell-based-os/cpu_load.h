@@ -0,0 +1,81 @@
+/**
+ * CPU load accounting - where each core's time goes
+ *
+ * Each core is always in exactly one activity. Code that changes what a
+ * core is doing calls cpu_enter(), which charges the time since the last
+ * change to the old activity and returns it so the caller can go back to
+ * it. That is one timer read and a few adds with interrupts masked, so the
+ * accounting stays on in every build; 'top' shows what it costs.
+ *
+ * The activities come from a handful of places:
+ * - the shell loop and read_line() are idle while they wait for a key;
+ *   core 1's service loop is idle in its WFE
+ * - cpu_load_hook_net() wraps the async context's low-priority IRQ, where
+ *   the threadsafe_background driver runs every lwIP callback and timer
+ * - commands run as shell, filesystem writes as flash (the other core is
+ *   parked meanwhile and keeps whatever activity it had)
+ * - core 1 splits its work between the fs worker and background tasks,
+ *   which pico_os.cpp also times one by one for 'top'
+ *
+ * In the FreeRTOS build the marks above still apply inside a task, and on
+ * top of that every task switch lands in cpu_load_task_switched_in():
+ * each task carries its activity in its application tag (idle tasks are
+ * idle, untagged driver and lwIP tasks are net), so time is charged to
+ * whatever the core switched to even when the task did not mark it.
+ *
+ * Each core updates only its own totals, under a sequence count, so
+ * cpu_load_sample() can read both cores from either without a lock.
+ */
+
+#ifndef CPU_LOAD_H
+#define CPU_LOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CPU_LOAD_CORES 2
+
+enum cpu_activity {
+    CPU_IDLE,
+    CPU_NET,                    // lwIP callbacks and timers
+    CPU_SHELL,                  // Shell commands and apps
+    CPU_FLASH,                  // Flash erase/program
+    CPU_FS,                     // Filesystem worker
+    CPU_TASKS,                  // Background processes
+    CPU_OTHER,                  // Boot, and anything not marked
+    CPU_ACTIVITIES
+};
+
+struct cpu_load_sample {
+    uint64_t at_us;
+    uint64_t us[CPU_LOAD_CORES][CPU_ACTIVITIES];
+    uint32_t switches[CPU_LOAD_CORES];
+};
+
+// Both cores start in CPU_OTHER at boot
+void cpu_load_init();
+
+// Switch the calling core to activity; returns the one it left
+enum cpu_activity cpu_enter(enum cpu_activity activity);
+
+// Core 0, after cyw43_arch_init(): charge the lwIP IRQ to CPU_NET.
+// FreeRTOS: from a task, once the scheduler runs; tags the idle tasks.
+bool cpu_load_hook_net();
+
+#if PICO_OS_FREERTOS
+// Charge task (NULL: the calling task) to activity whenever it runs
+void cpu_load_tag_task(void *task, enum cpu_activity activity);
+
+// traceTASK_SWITCHED_IN() hook, see FreeRTOSConfig.h
+extern "C" void cpu_load_task_switched_in(uint32_t tag);
+#endif
+
+// Totals for both cores so far, including the activity in progress
+void cpu_load_sample(struct cpu_load_sample *sample);
+
+// Cost of one cpu_enter(), in nanoseconds, measured on the calling core
+uint32_t cpu_load_switch_ns();
+
+const char *cpu_activity_name(enum cpu_activity activity);
+
+#endif // CPU_LOAD_H
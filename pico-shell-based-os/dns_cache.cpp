@@ -0,0 +1,655 @@
+/**
+ * DNS resolver cache - see dns_cache.h
+ *
+ * All state lives in lwIP context. One UDP pcb carries every query; a
+ * reply is matched to its entry by transaction ID, server and question.
+ * A single timer drives retransmission while queries are in flight and
+ * the prefetch sweep while prefetched names exist.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "lwip/dns.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/timeouts.h"
+#include "dns_cache.h"
+
+#define DNS_PORT 53
+#define DNS_HEADER_SIZE 12
+#define DNS_MSG_MAX 512
+#define DNS_TICK_MS 100                 // While queries are in flight
+#define DNS_SWEEP_MS 1000               // Only prefetched names to watch
+#define DNS_REFRESH_DIVISOR 10          // Refresh in the last tenth of the TTL
+
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_SOA 6
+#define DNS_CLASS_IN 1
+
+enum entry_state {
+    ENTRY_FREE,
+    ENTRY_PENDING,          // No usable answer yet, waiters attached
+    ENTRY_POSITIVE,
+    ENTRY_NEGATIVE
+};
+
+struct dns_entry {
+    char name[DNS_CACHE_NAME_MAX];      // Lower case, no trailing dot
+    enum entry_state state;
+    enum dns_result negative;           // NXDOMAIN or FAIL when ENTRY_NEGATIVE
+    ip_addr_t addr;
+    uint32_t ttl;
+    uint64_t expires_us;
+    uint64_t last_used_us;
+    uint32_t hits;
+    bool prefetch;
+
+    // Query in flight: the first resolution (ENTRY_PENDING) or a refresh
+    // of an entry that keeps answering meanwhile
+    bool querying;
+    uint16_t txid;
+    uint8_t tries;
+    uint8_t server;
+    ip_addr_t server_addr;
+    uint64_t retry_us;
+};
+
+struct dns_waiter {
+    struct dns_entry *entry;            // NULL = free slot
+    dns_cache_fn fn;
+    void *arg;
+};
+
+static struct dns_entry entries[DNS_CACHE_SIZE];
+static struct dns_waiter waiters[DNS_CACHE_MAX_WAITERS];
+static struct dns_cache_stats stats;
+static struct udp_pcb *dns_pcb = NULL;
+static uint8_t rx_buf[DNS_MSG_MAX];     // Replies are parsed one at a time
+
+static void dns_tick(void *arg);
+static void dns_send(struct dns_entry *entry);
+static void dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
+
+static inline uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Lower-case copy without a trailing dot; false if empty or too long
+static bool dns_normalize(const char *name, char *out) {
+    size_t len = strlen(name);
+    if (len > 0 && name[len - 1] == '.') {
+        len--;
+    }
+    if (len == 0 || len >= DNS_CACHE_NAME_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        out[i] = (char)tolower((unsigned char)name[i]);
+    }
+    out[len] = '\0';
+    return true;
+}
+
+static struct dns_entry *dns_find(const char *name) {
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (entries[i].state != ENTRY_FREE && strcmp(entries[i].name, name) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// A free slot, else the least recently used idle entry (expired first).
+// Entries in flight and prefetched names are never evicted.
+static struct dns_entry *dns_alloc(const char *name, uint64_t now) {
+    struct dns_entry *victim = NULL;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        struct dns_entry *entry = &entries[i];
+        if (entry->state == ENTRY_FREE) {
+            victim = entry;
+            break;
+        }
+        if (entry->querying || entry->prefetch) {
+            continue;
+        }
+        bool expired = now >= entry->expires_us;
+        bool victim_expired = victim && now >= victim->expires_us;
+        if (!victim || (expired && !victim_expired) ||
+            (expired == victim_expired && entry->last_used_us < victim->last_used_us)) {
+            victim = entry;
+        }
+    }
+    if (!victim) {
+        return NULL;
+    }
+    if (victim->state != ENTRY_FREE) {
+        stats.evictions++;
+    }
+    memset(victim, 0, sizeof(*victim));
+    strcpy(victim->name, name);
+    victim->state = ENTRY_PENDING;
+    return victim;
+}
+
+static void dns_schedule() {
+    bool querying = false;
+    bool prefetching = false;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        querying |= entries[i].querying;
+        prefetching |= entries[i].prefetch;
+    }
+    sys_untimeout(dns_tick, NULL);
+    if (querying || prefetching) {
+        sys_timeout(querying ? DNS_TICK_MS : DNS_SWEEP_MS, dns_tick, NULL);
+    }
+}
+
+// Finish the entry's query and run its waiters. ttl_s 0 means the failure
+// says nothing about the name (no server configured): a refresh keeps its
+// old answer and a new entry is dropped rather than cached.
+static void dns_complete(struct dns_entry *entry, enum dns_result result, const ip_addr_t *addr, uint32_t ttl_s) {
+    uint64_t now = time_us_64();
+    entry->querying = false;
+
+    bool keep_old = entry->state == ENTRY_POSITIVE && now < entry->expires_us;
+    if (result == DNS_RESULT_OK) {
+        entry->state = ENTRY_POSITIVE;
+        ip_addr_copy(entry->addr, *addr);
+    } else if (keep_old) {
+        // Refresh failed: serve what we have until it expires
+        result = DNS_RESULT_OK;
+        ttl_s = 0;
+    } else if (ttl_s == 0 && !entry->prefetch) {
+        entry->state = ENTRY_FREE;
+    } else {
+        entry->state = ENTRY_NEGATIVE;
+        entry->negative = result;
+        if (ttl_s == 0) {
+            ttl_s = DNS_CACHE_FAIL_TTL;
+        }
+    }
+
+    if (ttl_s) {
+        if (ttl_s < DNS_CACHE_MIN_TTL) {
+            ttl_s = DNS_CACHE_MIN_TTL;
+        } else if (ttl_s > DNS_CACHE_MAX_TTL) {
+            ttl_s = DNS_CACHE_MAX_TTL;
+        }
+        entry->ttl = ttl_s;
+        entry->expires_us = now + (uint64_t)ttl_s * 1000000;
+    }
+
+    // Copy the name out: a waiter may reuse the entry for a new lookup
+    char name[DNS_CACHE_NAME_MAX];
+    strcpy(name, entry->name);
+    ip_addr_t answer = entry->addr;
+    for (int i = 0; i < DNS_CACHE_MAX_WAITERS; i++) {
+        if (waiters[i].entry == entry) {
+            struct dns_waiter waiter = waiters[i];
+            waiters[i].entry = NULL;
+            waiter.fn(name, result, result == DNS_RESULT_OK ? &answer : NULL, waiter.arg);
+        }
+    }
+}
+
+static bool dns_pcb_ready() {
+    if (!dns_pcb) {
+        dns_pcb = udp_new();
+        if (!dns_pcb) {
+            return false;
+        }
+        udp_bind(dns_pcb, IP_ADDR_ANY, 0);      // Ephemeral source port
+        udp_recv(dns_pcb, dns_recv, NULL);
+    }
+    return true;
+}
+
+static void dns_start_query(struct dns_entry *entry) {
+    entry->querying = true;
+    entry->txid = (uint16_t)LWIP_RAND();
+    entry->tries = 0;
+    entry->server = 0;
+    dns_send(entry);
+    dns_schedule();
+}
+
+// Send (or resend) the entry's query to the next configured server
+static void dns_send(struct dns_entry *entry) {
+    const ip_addr_t *server = NULL;
+    for (int i = 0; i < DNS_MAX_SERVERS; i++) {
+        const ip_addr_t *candidate = dns_getserver((u8_t)((entry->server + i) % DNS_MAX_SERVERS));
+        if (candidate && !ip_addr_isany(candidate)) {
+            entry->server = (uint8_t)((entry->server + i) % DNS_MAX_SERVERS);
+            server = candidate;
+            break;
+        }
+    }
+    if (!server || !dns_pcb_ready()) {
+        dns_complete(entry, DNS_RESULT_FAIL, NULL, 0);
+        return;
+    }
+
+    // Header, QNAME (one length byte per label plus the root), QTYPE, QCLASS
+    size_t name_len = strlen(entry->name);
+    u16_t len = (u16_t)(DNS_HEADER_SIZE + name_len + 2 + 4);
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if (!p) {
+        entry->retry_us = time_us_64() + DNS_TICK_MS * 1000ULL;     // Retry next tick
+        return;
+    }
+    uint8_t *msg = (uint8_t*)p->payload;
+    memset(msg, 0, DNS_HEADER_SIZE);
+    msg[0] = (uint8_t)(entry->txid >> 8);
+    msg[1] = (uint8_t)entry->txid;
+    msg[2] = DNS_FLAG_RD >> 8;
+    msg[5] = 1;                         // QDCOUNT
+
+    uint8_t *out = msg + DNS_HEADER_SIZE;
+    const char *label = entry->name;
+    while (*label) {
+        const char *dot = strchr(label, '.');
+        size_t label_len = dot ? (size_t)(dot - label) : strlen(label);
+        if (label_len == 0 || label_len > 63) {
+            pbuf_free(p);
+            dns_complete(entry, DNS_RESULT_NXDOMAIN, NULL, DNS_CACHE_NEG_TTL);
+            return;
+        }
+        *out++ = (uint8_t)label_len;
+        memcpy(out, label, label_len);
+        out += label_len;
+        label += label_len + (dot ? 1 : 0);
+    }
+    *out++ = 0;
+    *out++ = 0;
+    *out++ = DNS_TYPE_A;
+    *out++ = 0;
+    *out++ = DNS_CLASS_IN;
+
+    ip_addr_copy(entry->server_addr, *server);
+    entry->retry_us = time_us_64() + ((uint64_t)DNS_CACHE_TIMEOUT_MS << entry->tries) * 1000;
+    entry->tries++;
+    stats.queries++;
+    udp_sendto(dns_pcb, p, server, DNS_PORT);
+    pbuf_free(p);
+}
+
+// Try the next server, or give up after DNS_CACHE_TRIES
+static void dns_retry(struct dns_entry *entry) {
+    if (entry->tries >= DNS_CACHE_TRIES) {
+        dns_complete(entry, DNS_RESULT_FAIL, NULL, DNS_CACHE_FAIL_TTL);
+        return;
+    }
+    entry->server++;
+    dns_send(entry);
+}
+
+// ===== RESPONSE PARSING =====
+
+// Offset just past a (possibly compressed) name, 0 if malformed
+static int dns_skip_name(const uint8_t *msg, int len, int off) {
+    while (off < len) {
+        uint8_t label_len = msg[off];
+        if (label_len == 0) {
+            return off + 1;
+        }
+        if ((label_len & 0xC0) == 0xC0) {
+            return off + 2 <= len ? off + 2 : 0;
+        }
+        if (label_len & 0xC0) {
+            return 0;
+        }
+        off += 1 + label_len;
+    }
+    return 0;
+}
+
+// Check the echoed question name against ours; offset past it, 0 if not ours
+static int dns_match_name(const uint8_t *msg, int len, int off, const char *name) {
+    const char *p = name;
+    while (off < len) {
+        uint8_t label_len = msg[off++];
+        if (label_len == 0) {
+            return *p == '\0' ? off : 0;
+        }
+        if ((label_len & 0xC0) || off + label_len > len) {
+            return 0;
+        }
+        if (p != name && *p++ != '.') {
+            return 0;
+        }
+        for (int i = 0; i < label_len; i++) {
+            if (!p[i] || tolower(msg[off + i]) != p[i]) {
+                return 0;
+            }
+        }
+        p += label_len;
+        off += label_len;
+    }
+    return 0;
+}
+
+// Negative caching time from the authority section's SOA (RFC 2308):
+// the smaller of the record's TTL and its MINIMUM field
+static uint32_t dns_negative_ttl(const uint8_t *msg, int len, int off, int nscount) {
+    for (int i = 0; i < nscount; i++) {
+        off = dns_skip_name(msg, len, off);
+        if (!off || off + 10 > len) {
+            break;
+        }
+        uint16_t type = get16(msg + off);
+        uint32_t ttl = get32(msg + off + 4);
+        uint16_t rdlen = get16(msg + off + 8);
+        off += 10;
+        if (off + rdlen > len) {
+            break;
+        }
+        if (type == DNS_TYPE_SOA) {
+            int rdata = dns_skip_name(msg, len, off);               // MNAME
+            rdata = rdata ? dns_skip_name(msg, len, rdata) : 0;     // RNAME
+            if (rdata && rdata + 20 <= off + rdlen) {
+                uint32_t minimum = get32(msg + rdata + 16);
+                return ttl < minimum ? ttl : minimum;
+            }
+        }
+        off += rdlen;
+    }
+    return DNS_CACHE_NEG_TTL;
+}
+
+static void dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    int len = pbuf_copy_partial(p, rx_buf, sizeof(rx_buf), 0);
+    pbuf_free(p);
+    if (port != DNS_PORT || len < DNS_HEADER_SIZE) {
+        return;
+    }
+
+    uint16_t txid = get16(rx_buf);
+    uint16_t flags = get16(rx_buf + 2);
+    struct dns_entry *entry = NULL;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (entries[i].querying && entries[i].txid == txid && ip_addr_cmp(&entries[i].server_addr, addr)) {
+            entry = &entries[i];
+            break;
+        }
+    }
+    if (!entry || !(flags & DNS_FLAG_QR) || get16(rx_buf + 4) != 1) {
+        return;
+    }
+    int off = dns_match_name(rx_buf, len, DNS_HEADER_SIZE, entry->name);
+    if (!off || off + 4 > len || get16(rx_buf + off) != DNS_TYPE_A || get16(rx_buf + off + 2) != DNS_CLASS_IN) {
+        return;
+    }
+    off += 4;
+
+    uint8_t rcode = flags & 0x0F;
+    if ((flags & DNS_FLAG_TC) || (rcode != 0 && rcode != DNS_RCODE_NXDOMAIN)) {
+        // Server trouble, not an answer about the name
+        dns_retry(entry);
+        dns_schedule();
+        return;
+    }
+
+    // Answers: the first A record, cached for the shortest TTL along the
+    // CNAME chain
+    int ancount = get16(rx_buf + 6);
+    uint32_t ttl = UINT32_MAX;
+    bool found = false;
+    ip_addr_t answer;
+    int parsed = 0;
+    for (; parsed < ancount; parsed++) {
+        off = dns_skip_name(rx_buf, len, off);
+        if (!off || off + 10 > len) {
+            break;
+        }
+        uint16_t type = get16(rx_buf + off);
+        uint16_t rclass = get16(rx_buf + off + 2);
+        uint32_t rttl = get32(rx_buf + off + 4);
+        uint16_t rdlen = get16(rx_buf + off + 8);
+        off += 10;
+        if (off + rdlen > len) {
+            break;
+        }
+        if (rclass == DNS_CLASS_IN && (type == DNS_TYPE_A || type == DNS_TYPE_CNAME)) {
+            if (rttl < ttl) {
+                ttl = rttl;
+            }
+            if (type == DNS_TYPE_A && rdlen == 4 && !found) {
+                uint32_t ip;
+                memcpy(&ip, rx_buf + off, 4);       // Already network order
+                ip_addr_set_ip4_u32(&answer, ip);
+                found = true;
+            }
+        }
+        off += rdlen;
+    }
+
+    bool complete = parsed == ancount;
+    if (found) {
+        dns_complete(entry, DNS_RESULT_OK, &answer, ttl);
+    } else if (rcode == DNS_RCODE_NXDOMAIN || complete) {
+        // NXDOMAIN, or the name exists without an A record
+        uint32_t neg_ttl = complete ? dns_negative_ttl(rx_buf, len, off, get16(rx_buf + 8)) : DNS_CACHE_NEG_TTL;
+        dns_complete(entry, DNS_RESULT_NXDOMAIN, NULL, neg_ttl);
+    } else {
+        // A malformed or cut-short answer says nothing about the name
+        dns_retry(entry);
+    }
+    dns_schedule();
+}
+
+// ===== TIMER =====
+
+static void dns_tick(void *arg) {
+    uint64_t now = time_us_64();
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        struct dns_entry *entry = &entries[i];
+        if (entry->querying) {
+            if (now >= entry->retry_us) {
+                if (entry->tries >= DNS_CACHE_TRIES) {
+                    stats.timeouts++;
+                }
+                dns_retry(entry);
+            }
+        } else if (entry->prefetch) {
+            uint64_t refresh_us = (uint64_t)entry->ttl * 1000000 / DNS_REFRESH_DIVISOR;
+            if (entry->state == ENTRY_POSITIVE ? now + refresh_us >= entry->expires_us
+                                               : now >= entry->expires_us) {
+                stats.prefetches++;
+                dns_start_query(entry);
+            }
+        }
+    }
+    dns_schedule();
+}
+
+// ===== PUBLIC API =====
+
+enum dns_result dns_cache_lookup(const char *name, ip_addr_t *addr, dns_cache_fn fn, void *arg) {
+    if (ipaddr_aton(name, addr)) {
+        return DNS_RESULT_OK;
+    }
+    char key[DNS_CACHE_NAME_MAX];
+    if (!dns_normalize(name, key)) {
+        return DNS_RESULT_FAIL;
+    }
+    stats.lookups++;
+
+    uint64_t now = time_us_64();
+    struct dns_entry *entry = dns_find(key);
+    if (entry && now < entry->expires_us) {
+        if (entry->state == ENTRY_POSITIVE) {
+            stats.hits++;
+            entry->hits++;
+            entry->last_used_us = now;
+            ip_addr_copy(*addr, entry->addr);
+            // Refresh in use entries before they expire
+            uint64_t refresh_us = (uint64_t)entry->ttl * 1000000 / DNS_REFRESH_DIVISOR;
+            if (!entry->querying && now + refresh_us >= entry->expires_us) {
+                stats.prefetches++;
+                dns_start_query(entry);
+            }
+            return DNS_RESULT_OK;
+        }
+        if (entry->state == ENTRY_NEGATIVE) {
+            stats.negative_hits++;
+            entry->hits++;
+            entry->last_used_us = now;
+            return entry->negative;
+        }
+    }
+
+    // Miss: start a query, or join the one in flight
+    if (!entry) {
+        entry = dns_alloc(key, now);
+        if (!entry) {
+            return DNS_RESULT_FAIL;
+        }
+    }
+    entry->state = ENTRY_PENDING;
+    entry->last_used_us = now;
+
+    int slot = -1;
+    for (int i = 0; i < DNS_CACHE_MAX_WAITERS && slot < 0; i++) {
+        if (!waiters[i].entry) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        if (!entry->querying && !entry->prefetch) {
+            entry->state = ENTRY_FREE;
+        }
+        return DNS_RESULT_FAIL;
+    }
+
+    if (entry->querying) {
+        stats.joined++;
+    } else {
+        stats.misses++;
+        dns_start_query(entry);
+        // No server configured: settled on the spot, fn is not called
+        if (!entry->querying) {
+            return entry->state == ENTRY_NEGATIVE ? entry->negative : DNS_RESULT_FAIL;
+        }
+    }
+    waiters[slot].entry = entry;
+    waiters[slot].fn = fn;
+    waiters[slot].arg = arg;
+    return DNS_RESULT_PENDING;
+}
+
+void dns_cache_cancel(dns_cache_fn fn, void *arg) {
+    for (int i = 0; i < DNS_CACHE_MAX_WAITERS; i++) {
+        if (waiters[i].entry && waiters[i].fn == fn && waiters[i].arg == arg) {
+            waiters[i].entry = NULL;
+        }
+    }
+}
+
+bool dns_cache_prefetch(const char *name) {
+    ip_addr_t literal;
+    char key[DNS_CACHE_NAME_MAX];
+    if (ipaddr_aton(name, &literal) || !dns_normalize(name, key)) {
+        return false;
+    }
+    cyw43_arch_lwip_begin();
+    struct dns_entry *entry = dns_find(key);
+    if (!entry) {
+        entry = dns_alloc(key, time_us_64());
+    }
+    if (entry) {
+        entry->prefetch = true;
+        // A new entry has expires_us 0, so the sweep resolves it
+        dns_schedule();
+    }
+    cyw43_arch_lwip_end();
+    return entry != NULL;
+}
+
+static void dns_future_done(const char *name, enum dns_result result, const ip_addr_t *addr, void *arg) {
+    struct dns_future *future = (struct dns_future*)arg;
+    if (addr) {
+        ip_addr_copy(future->addr, *addr);
+    }
+    __dmb();
+    future->result = result;
+}
+
+void dns_cache_resolve(const char *name, struct dns_future *future) {
+    future->result = DNS_RESULT_PENDING;
+    future->cached = false;
+    cyw43_arch_lwip_begin();
+    enum dns_result result = dns_cache_lookup(name, &future->addr, dns_future_done, future);
+    if (result != DNS_RESULT_PENDING) {
+        future->cached = true;
+        future->result = result;
+    }
+    cyw43_arch_lwip_end();
+}
+
+void dns_future_cancel(struct dns_future *future) {
+    cyw43_arch_lwip_begin();
+    dns_cache_cancel(dns_future_done, future);
+    cyw43_arch_lwip_end();
+}
+
+void dns_cache_flush() {
+    cyw43_arch_lwip_begin();
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        struct dns_entry *entry = &entries[i];
+        if (entry->querying) {
+            continue;
+        }
+        if (entry->prefetch) {
+            entry->state = ENTRY_PENDING;
+            entry->expires_us = 0;      // Sweep re-resolves it
+        } else {
+            entry->state = ENTRY_FREE;
+        }
+    }
+    dns_schedule();
+    cyw43_arch_lwip_end();
+}
+
+void dns_cache_get_stats(struct dns_cache_stats *out) {
+    cyw43_arch_lwip_begin();
+    *out = stats;
+    cyw43_arch_lwip_end();
+}
+
+bool dns_cache_get_entry(int index, struct dns_cache_info *info) {
+    cyw43_arch_lwip_begin();
+    int seen = 0;
+    bool found = false;
+    uint64_t now = time_us_64();
+    for (int i = 0; i < DNS_CACHE_SIZE && !found; i++) {
+        const struct dns_entry *entry = &entries[i];
+        if (entry->state == ENTRY_FREE || seen++ != index) {
+            continue;
+        }
+        found = true;
+        memset(info, 0, sizeof(*info));
+        strcpy(info->name, entry->name);
+        info->result = entry->state == ENTRY_POSITIVE ? DNS_RESULT_OK
+                     : entry->state == ENTRY_NEGATIVE ? entry->negative : DNS_RESULT_PENDING;
+        ip_addr_copy(info->addr, entry->addr);
+        info->ttl = entry->ttl;
+        info->ttl_left = entry->expires_us > now ? (uint32_t)((entry->expires_us - now) / 1000000) : 0;
+        info->hits = entry->hits;
+        info->prefetch = entry->prefetch;
+        info->refreshing = entry->querying && entry->state != ENTRY_PENDING;
+    }
+    cyw43_arch_lwip_end();
+    return found;
+}
@@ -0,0 +1,100 @@
+/**
+ * DNS resolver cache - shared, non-blocking A record lookups
+ *
+ * A small stub resolver on lwIP raw UDP that queries the DHCP-provided
+ * servers itself, so it sees record TTLs (lwIP's dns_gethostbyname()
+ * hides them). Answers are cached for their TTL; NXDOMAIN and empty
+ * answers are cached negatively for the SOA minimum (RFC 2308), and
+ * timeouts/SERVFAIL briefly, so a dead name is not queried on every use.
+ * Concurrent lookups of one name share a single query.
+ *
+ * Hits in the last tenth of a TTL refresh the entry in the background, and
+ * names registered with dns_cache_prefetch() (NTP servers and anything else
+ * used on a schedule) are refreshed before they expire even when nobody
+ * asks, so scheduled users always hit.
+ *
+ * dns_cache_lookup() is for lwIP context (callback API); the shell uses
+ * dns_cache_resolve() and polls the future, so it never blocks on DNS.
+ */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/ip_addr.h"
+
+#define DNS_CACHE_SIZE 16
+#define DNS_CACHE_NAME_MAX 64           // Longer names are not cached or looked up
+#define DNS_CACHE_MAX_WAITERS 8
+#define DNS_CACHE_MIN_TTL 5             // Seconds
+#define DNS_CACHE_MAX_TTL 86400
+#define DNS_CACHE_NEG_TTL 60            // NXDOMAIN without an SOA
+#define DNS_CACHE_FAIL_TTL 10           // Timeout or server failure
+#define DNS_CACHE_TIMEOUT_MS 1000       // Per try, doubled on each retry
+#define DNS_CACHE_TRIES 3               // Rotating over the configured servers
+
+enum dns_result {
+    DNS_RESULT_OK,
+    DNS_RESULT_NXDOMAIN,        // Name (or its A record) does not exist
+    DNS_RESULT_FAIL,            // No server, timeout, server error, cache full
+    DNS_RESULT_PENDING
+};
+
+// Called in lwIP context; addr is valid for DNS_RESULT_OK only
+typedef void (*dns_cache_fn)(const char *name, enum dns_result result, const ip_addr_t *addr, void *arg);
+
+// lwIP context. A cached answer (positive or negative) is returned at once
+// with addr filled in and fn is not called; otherwise DNS_RESULT_PENDING
+// and fn(arg) runs when the query completes.
+enum dns_result dns_cache_lookup(const char *name, ip_addr_t *addr, dns_cache_fn fn, void *arg);
+
+// lwIP context. Drop pending callbacks for (fn, arg), e.g. before freeing arg
+void dns_cache_cancel(dns_cache_fn fn, void *arg);
+
+// Keep name fresh in the background (used on a schedule); false if the
+// cache is full of other prefetched names. Any context.
+bool dns_cache_prefetch(const char *name);
+
+// Future for the shell and other non-lwIP callers
+struct dns_future {
+    volatile enum dns_result result;    // DNS_RESULT_PENDING until done
+    ip_addr_t addr;
+    bool cached;                        // Answered without a query
+};
+
+// Any context. Starts or joins a lookup; poll future->result meanwhile.
+// Cancel a future that is abandoned while still pending.
+void dns_cache_resolve(const char *name, struct dns_future *future);
+void dns_future_cancel(struct dns_future *future);
+
+// Drop every entry that is not in flight; prefetched names are re-resolved
+void dns_cache_flush();
+
+struct dns_cache_stats {
+    uint32_t lookups;
+    uint32_t hits;              // Positive answers from the cache
+    uint32_t negative_hits;     // Negative answers from the cache
+    uint32_t joined;            // Attached to a query already in flight
+    uint32_t misses;            // Started a query
+    uint32_t queries;           // Packets sent, retries included
+    uint32_t timeouts;
+    uint32_t prefetches;        // Background refreshes
+    uint32_t evictions;
+};
+
+struct dns_cache_info {
+    char name[DNS_CACHE_NAME_MAX];
+    enum dns_result result;     // PENDING while the first query is in flight
+    ip_addr_t addr;
+    uint32_t ttl;               // As received (clamped)
+    uint32_t ttl_left;
+    uint32_t hits;
+    bool prefetch;
+    bool refreshing;
+};
+
+void dns_cache_get_stats(struct dns_cache_stats *stats);
+bool dns_cache_get_entry(int index, struct dns_cache_info *info);
+
+#endif // DNS_CACHE_H
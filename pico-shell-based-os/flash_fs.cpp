@@ -0,0 +1,75 @@
+/**
+ * Flash filesystem - see flash_fs.h
+ */
+
+#include "flash_fs.h"
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+#define FLASH_FS_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_FS_SIZE)
+
+static struct lfs_config config;
+static uint8_t read_buffer[FLASH_FS_CACHE_SIZE];
+static uint8_t prog_buffer[FLASH_FS_CACHE_SIZE];
+static uint8_t lookahead_buffer[128];
+
+struct flash_op {
+    uint32_t addr;
+    const uint8_t *data;
+    size_t size;
+};
+
+static void __not_in_flash_func(flash_prog_safe)(void *param) {
+    struct flash_op *op = (struct flash_op*)param;
+    flash_range_program(op->addr, op->data, op->size);
+}
+
+static void __not_in_flash_func(flash_erase_safe)(void *param) {
+    struct flash_op *op = (struct flash_op*)param;
+    flash_range_erase(op->addr, op->size);
+}
+
+static int flash_read(const struct lfs_config *c, lfs_block_t block,
+                      lfs_off_t off, void *buffer, lfs_size_t size) {
+    memcpy(buffer, (const uint8_t*)XIP_BASE + FLASH_FS_OFFSET + block * c->block_size + off, size);
+    return 0;
+}
+
+static int flash_prog(const struct lfs_config *c, lfs_block_t block,
+                      lfs_off_t off, const void *buffer, lfs_size_t size) {
+    struct flash_op op = { FLASH_FS_OFFSET + block * c->block_size + off, (const uint8_t*)buffer, size };
+    return flash_safe_execute(flash_prog_safe, &op, UINT32_MAX) == PICO_OK ? 0 : LFS_ERR_IO;
+}
+
+static int flash_erase(const struct lfs_config *c, lfs_block_t block) {
+    struct flash_op op = { FLASH_FS_OFFSET + block * c->block_size, NULL, c->block_size };
+    return flash_safe_execute(flash_erase_safe, &op, UINT32_MAX) == PICO_OK ? 0 : LFS_ERR_IO;
+}
+
+static int flash_sync(const struct lfs_config *c) {
+    return 0;
+}
+
+bool flash_fs_mount(lfs_t *lfs) {
+    config.read = flash_read;
+    config.prog = flash_prog;
+    config.erase = flash_erase;
+    config.sync = flash_sync;
+    config.read_size = 1;
+    config.prog_size = FLASH_PAGE_SIZE;
+    config.block_size = FLASH_FS_BLOCK_SIZE;
+    config.block_count = FLASH_FS_SIZE / FLASH_FS_BLOCK_SIZE;
+    config.cache_size = FLASH_FS_CACHE_SIZE;
+    config.lookahead_size = sizeof(lookahead_buffer);
+    config.block_cycles = 500;
+    config.read_buffer = read_buffer;
+    config.prog_buffer = prog_buffer;
+    config.lookahead_buffer = lookahead_buffer;
+
+    if (lfs_mount(lfs, &config) == 0) {
+        return true;
+    }
+    return lfs_format(lfs, &config) == 0 && lfs_mount(lfs, &config) == 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * Flash filesystem - LittleFS in the last FLASH_FS_SIZE bytes of flash
+ *
+ * For the single-purpose firmwares (pico_os, to-do-pico) that need a few
+ * files but no shell. The region and geometry match the shell OS's own
+ * filesystem (pico_os.h), so files such as the to-do store are still
+ * there after flashing one firmware over another.
+ *
+ * Programs and erases go through flash_safe_execute(), which holds off
+ * interrupts (and parks the other core, if it is running) while flash is
+ * unreadable. There is no locking: use the filesystem from one context.
+ */
+
+#ifndef FLASH_FS_H
+#define FLASH_FS_H
+
+#include <stdbool.h>
+#include "lfs.h"
+
+#define FLASH_FS_SIZE (512 * 1024)
+#define FLASH_FS_BLOCK_SIZE 4096
+#define FLASH_FS_CACHE_SIZE 256
+
+// Mounts the filesystem, formatting the region first if it holds none
+// (erasing whatever else was there). False if that fails too.
+bool flash_fs_mount(lfs_t *lfs);
+
+#endif // FLASH_FS_H
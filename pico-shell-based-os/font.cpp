@@ -0,0 +1,363 @@
+/**
+ * Glyph font engine - see font.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "font.h"
+
+// ===== SLASH FONT =====
+// The ASCII converter's letters; the space glyph plus one column of
+// spacing keeps a word gap four columns wide
+
+static constexpr struct font_glyph_src slash_src[] = {
+    {' ', {"   ", "   ", "   ", "   ", "   "}},
+    {'!', {"|", "|", "|", " ", "o"}},
+    {'-', {"   ", "   ", "---", "   ", "   "}},
+    {'.', {" ", " ", " ", " ", "o"}},
+    {'0', {" /==\\", "|  0|", "|  0|", "|  0|", " \\==/"}},
+    {'1', {" /==\\", "|  1|", "|  1|", "|  1|", " \\==/"}},
+    {'2', {" /==\\", "|  2|", "|  2|", "|  2|", " \\==/"}},
+    {'3', {" /==\\", "|  3|", "|  3|", "|  3|", " \\==/"}},
+    {'4', {" /==\\", "|  4|", "|  4|", "|  4|", " \\==/"}},
+    {'5', {" /==\\", "|  5|", "|  5|", "|  5|", " \\==/"}},
+    {'6', {" /==\\", "|  6|", "|  6|", "|  6|", " \\==/"}},
+    {'7', {" /==\\", "|  7|", "|  7|", "|  7|", " \\==/"}},
+    {'8', {" /==\\", "|  8|", "|  8|", "|  8|", " \\==/"}},
+    {'9', {" /==\\", "|  9|", "|  9|", "|  9|", " \\==/"}},
+    {'A', {" /\\ ", "/  \\", "/==\\", "|  |", "|  |"}},
+    {'B', {"/==\\", "|-- ", "|==\\", "|  |", "\\==/"}},
+    {'C', {" /==", "|   ", "|   ", "|   ", " \\=="}},
+    {'D', {"/==\\", "|  \\", "|  |", "|  /", "\\==/"}},
+    {'E', {"/===", "|-- ", "|-- ", "|   ", "\\==="}},
+    {'F', {"/===", "|-- ", "|   ", "|   ", "|   "}},
+    {'G', {" /==", "|   ", "| -+", "|  |", " \\=="}},
+    {'H', {"/  \\", "|--|", "|  |", "|  |", "|  |"}},
+    {'I', {"===", " | ", " | ", " | ", "==="}},
+    {'J', {"  /", "  |", "  |", "\\ |", " \\/ "}},
+    {'K', {"/  \\", "|-/ ", "|-\\ ", "| \\", "|  \\"}},
+    {'L', {"/   ", "|   ", "|   ", "|   ", "\\___"}},
+    {'M', {"/\\  /\\", "| \\/ |", "|    |", "|    |", "|    |"}},
+    {'N', {"/\\  \\", "| \\ |", "|  \\|", "|   |", "|   |"}},
+    {'O', {" /\\ ", "|  |", "|  |", "|  |", " \\/ "}},
+    {'P', {"/==\\", "|--/", "|   ", "|   ", "|   "}},
+    {'Q', {" /\\ ", "|  |", "| \\|", " \\|\\", "  \\_\\"}},
+    {'R', {"/==\\", "|--/", "|-\\ ", "| \\", "|  \\"}},
+    {'S', {" /==", "\\__ ", " __/", "\\  \\", "\\==/"}},
+    {'T', {"===", " | ", " | ", " | ", " | "}},
+    {'U', {"\\  /", "|  |", "|  |", "|  |", " \\/ "}},
+    {'V', {"\\  /", " \\/", " /\\", "/  \\", "|  |"}},
+    {'W', {"\\    /", " \\  / ", "  \\/  ", " /  \\ ", "/    \\"}},
+    {'X', {"\\  /", " \\/ ", " /\\ ", "/  \\", "|  |"}},
+    {'Y', {"\\ /", " | ", " | ", " | ", " | "}},
+    {'Z', {"===", " / ", "/  ", "/   ", "==="}},
+};
+
+// ===== BLOCK FONT =====
+// The clock digits
+
+static constexpr struct font_glyph_src block_src[] = {
+    {' ', {"  ", "  ", "  ", "  ", "  "}},
+    {'-', {"    ", "    ", "####", "    ", "    "}},
+    {'0', {" ### ", "#   #", "#   #", "#   #", " ### "}},
+    {'1', {"  #  ", " ##  ", "  #  ", "  #  ", "#####"}},
+    {'2', {" ### ", "#   #", "  ## ", " #   ", "#####"}},
+    {'3', {" ### ", "#   #", "  ## ", "#   #", " ### "}},
+    {'4', {"#   #", "#   #", "#####", "    #", "    #"}},
+    {'5', {"#####", "#    ", "#### ", "    #", "#### "}},
+    {'6', {" ### ", "#    ", "#### ", "#   #", " ### "}},
+    {'7', {"#####", "    #", "   # ", "  #  ", " #   "}},
+    {'8', {" ### ", "#   #", " ### ", "#   #", " ### "}},
+    {'9', {" ### ", "#   #", " ####", "    #", " ### "}},
+    {':', {"  ", " #", "  ", " #", "  "}},
+};
+
+FONT_ATLAS(slash_atlas, slash_src, 5);
+FONT_ATLAS(block_atlas, block_src, 5);
+
+const struct font font_slash = { "slash", 5, 1, slash_atlas.glyphs, slash_atlas.pixels };
+const struct font font_block = { "block", 5, 1, block_atlas.glyphs, block_atlas.pixels };
+
+// ===== RENDERING =====
+
+size_t font_text_width(const struct font *font, const char *text) {
+    size_t width = 0;
+    bool first = true;
+    for (; *text; text++) {
+        const struct font_glyph *glyph = font_glyph_for(font, *text);
+        if (!glyph) continue;
+        width += glyph->width + (first ? 0 : font->spacing);
+        first = false;
+    }
+    return width;
+}
+
+size_t font_render_line(const struct font *font, const char *text, int row,
+                        char *buf, size_t cap) {
+    if (cap == 0) {
+        return 0;
+    }
+    size_t len = 0;
+    if (row >= 0 && row < font->height) {
+        bool first = true;
+        for (; *text; text++) {
+            const struct font_glyph *glyph = font_glyph_for(font, *text);
+            if (!glyph) continue;
+            size_t gap = first ? 0 : font->spacing;
+            if (len + gap + glyph->width >= cap) {
+                break;
+            }
+            memset(buf + len, ' ', gap);
+            memcpy(buf + len + gap, font->pixels + glyph->offset + row * glyph->width, glyph->width);
+            len += gap + glyph->width;
+            first = false;
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+void font_print(const struct font *font, const char *text, int indent) {
+    char line[FONT_LINE_MAX];
+    if (indent < 0) indent = 0;
+    if (indent > FONT_LINE_MAX / 2) indent = FONT_LINE_MAX / 2;
+    memset(line, ' ', indent);
+
+    for (int row = 0; row < font->height; row++) {
+        // Leave room for the newline
+        size_t len = indent + font_render_line(font, text, row, line + indent,
+                                               sizeof(line) - indent - 1);
+        line[len++] = '\n';
+        fwrite(line, 1, len, stdout);
+    }
+}
+
+// ===== LOADED FONTS =====
+
+struct font *font_parse(const uint8_t *data, size_t len, const char *name) {
+    if (len < 8 || len > FONT_FILE_MAX || memcmp(data, FONT_MAGIC, 4) != 0 ||
+        data[4] != FONT_VERSION) {
+        return NULL;
+    }
+    uint8_t height = data[5];
+    uint8_t spacing = data[6];
+    uint8_t count = data[7];
+    if (height == 0 || height > FONT_MAX_HEIGHT || count == 0 || count > FONT_GLYPHS ||
+        len < 8 + 2u * count) {
+        return NULL;
+    }
+
+    const uint8_t *table = data + 8;
+    size_t pixel_bytes = 0;
+    for (int i = 0; i < count; i++) {
+        uint8_t code = table[2 * i];
+        if (code < FONT_FIRST || code > FONT_LAST || table[2 * i + 1] == 0) {
+            return NULL;
+        }
+        pixel_bytes += (size_t)table[2 * i + 1] * height;
+    }
+    if (8 + 2u * count + pixel_bytes != len) {
+        return NULL;
+    }
+
+    // Font, glyph table and pixels in one block
+    size_t size = sizeof(struct font) + FONT_GLYPHS * sizeof(struct font_glyph) + pixel_bytes;
+    uint8_t *block = (uint8_t*)calloc(1, size);
+    if (!block) {
+        return NULL;
+    }
+    struct font *font = (struct font*)block;
+    struct font_glyph *glyphs = (struct font_glyph*)(block + sizeof(struct font));
+    char *pixels = (char*)(glyphs + FONT_GLYPHS);
+
+    strncpy(font->name, name, sizeof(font->name) - 1);
+    font->height = height;
+    font->spacing = spacing;
+    font->glyphs = glyphs;
+    font->pixels = pixels;
+
+    memcpy(pixels, table + 2 * count, pixel_bytes);
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        struct font_glyph *glyph = &glyphs[table[2 * i] - FONT_FIRST];
+        glyph->offset = (uint16_t)offset;
+        glyph->width = table[2 * i + 1];
+        offset += (size_t)glyph->width * height;
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        if (glyphs[c - FONT_FIRST].width == 0) {
+            glyphs[c - FONT_FIRST] = glyphs[c - 'a' + 'A' - FONT_FIRST];
+        }
+    }
+    return font;
+}
+
+void font_free(struct font *font) {
+    free(font);
+}
+
+// ===== REGISTRY =====
+
+#define FONT_BUILTINS 2
+
+static const struct font *fonts[FONT_MAX_FONTS] = { &font_slash, &font_block };
+static int fonts_count = FONT_BUILTINS;
+
+bool font_register(struct font *font) {
+    for (int i = 0; i < fonts_count; i++) {
+        if (strcmp(fonts[i]->name, font->name) != 0) continue;
+        if (i < FONT_BUILTINS) {
+            return false;
+        }
+        font_free((struct font*)fonts[i]);
+        fonts[i] = font;
+        return true;
+    }
+    if (fonts_count >= FONT_MAX_FONTS) {
+        return false;
+    }
+    fonts[fonts_count++] = font;
+    return true;
+}
+
+const struct font *font_find(const char *name) {
+    for (int i = 0; i < fonts_count; i++) {
+        if (strcmp(fonts[i]->name, name) == 0) {
+            return fonts[i];
+        }
+    }
+    return NULL;
+}
+
+int font_count() {
+    return fonts_count;
+}
+
+const struct font *font_get(int index) {
+    return index >= 0 && index < fonts_count ? fonts[index] : NULL;
+}
+
+#ifdef FONT_HOST_TOOL
+// Text description -> binary font. Format:
+//
+//     height 5
+//     spacing 1
+//     glyph A          (a single character, or a code point like 0x20)
+//     <height rows, used verbatim; ragged rows are padded with spaces>
+//
+// Lines starting with # outside a glyph are comments.
+
+static bool read_row(FILE *in, char *row, size_t cap) {
+    if (!fgets(row, (int)cap, in)) {
+        return false;
+    }
+    row[strcspn(row, "\r\n")] = '\0';
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s font.txt font.fnt\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    static char rows[FONT_GLYPHS][FONT_MAX_HEIGHT][256];
+    uint8_t codes[FONT_GLYPHS];
+    uint8_t widths[FONT_GLYPHS];
+    int count = 0;
+    int height = 0;
+    int spacing = 1;
+    char line[256];
+
+    while (read_row(in, line, sizeof(line))) {
+        char name[16];
+        if (line[0] == '#' || line[0] == '\0') continue;
+        if (sscanf(line, "height %d", &height) == 1 || sscanf(line, "spacing %d", &spacing) == 1) {
+            continue;
+        }
+        if (strncmp(line, "glyph ", 6) != 0 || height < 1 || height > FONT_MAX_HEIGHT) {
+            fprintf(stderr, "bad line (height must come first): %s\n", line);
+            return 1;
+        }
+        strncpy(name, line + 6, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        int code = strlen(name) == 1 ? (unsigned char)name[0] : (int)strtol(name, NULL, 0);
+        if (code < FONT_FIRST || code > FONT_LAST || count >= FONT_GLYPHS) {
+            fprintf(stderr, "bad glyph: %s\n", name);
+            return 1;
+        }
+
+        size_t width = 0;
+        for (int r = 0; r < height; r++) {
+            if (!read_row(in, rows[count][r], sizeof(rows[count][r]))) {
+                rows[count][r][0] = '\0';
+            }
+            size_t n = strlen(rows[count][r]);
+            if (n > width) width = n;
+        }
+        if (width == 0) {
+            width = 1;  // Blank glyph (e.g. space)
+        }
+        if (width > 255) {
+            fprintf(stderr, "glyph %s: bad width\n", name);
+            return 1;
+        }
+        codes[count] = (uint8_t)code;
+        widths[count] = (uint8_t)width;
+        count++;
+    }
+    fclose(in);
+
+    static uint8_t out[FONT_FILE_MAX];
+    size_t len = 0;
+    memcpy(out, FONT_MAGIC, 4);
+    out[4] = FONT_VERSION;
+    out[5] = (uint8_t)height;
+    out[6] = (uint8_t)spacing;
+    out[7] = (uint8_t)count;
+    len = 8;
+    for (int i = 0; i < count; i++) {
+        out[len++] = codes[i];
+        out[len++] = widths[i];
+    }
+    for (int i = 0; i < count; i++) {
+        for (int r = 0; r < height; r++) {
+            if (len + widths[i] > sizeof(out)) {
+                fprintf(stderr, "font larger than %d bytes\n", FONT_FILE_MAX);
+                return 1;
+            }
+            size_t n = strlen(rows[i][r]);
+            for (size_t x = 0; x < widths[i]; x++) {
+                out[len++] = x < n ? rows[i][r][x] : ' ';
+            }
+        }
+    }
+
+    // Round-trip through the loader the board uses
+    struct font *font = font_parse(out, len, "check");
+    if (!font) {
+        fprintf(stderr, "generated font failed to parse\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        char text[2] = { (char)codes[i], '\0' };
+        font_print(font, text, 2);
+    }
+    font_free(font);
+
+    FILE *f = fopen(argv[2], "wb");
+    if (!f || fwrite(out, 1, len, f) != len) {
+        perror(argv[2]);
+        return 1;
+    }
+    fclose(f);
+    printf("%d glyphs, height %d, %zu bytes\n", count, height, len);
+    return 0;
+}
+#endif
@@ -0,0 +1,177 @@
+/**
+ * Glyph font engine - shared by the ASCII converter, banners and clocks
+ *
+ * A font is a lookup table indexed by code point (0x20..0x7E) giving each
+ * glyph's width and the offset of its pixels in one packed array; row r of
+ * a glyph is `width` characters at pixels + offset + r * width. Rendering
+ * a line is a table lookup and a memcpy per glyph, and a whole text row
+ * is built in a buffer and written in one go.
+ *
+ * Built-in fonts are compiled from readable row strings into their packed
+ * form at compile time (FONT_ATLAS below), so they cost no RAM. More fonts
+ * can be loaded from a compact binary image:
+ *
+ *     offset  size  field
+ *     0       4     "PFNT"
+ *     4       1     version (1)
+ *     5       1     height (rows, 1..FONT_MAX_HEIGHT)
+ *     6       1     spacing (blank columns between glyphs)
+ *     7       1     glyph count N
+ *     8       2N    (code point, width) per glyph
+ *     8+2N    ...   pixels: per glyph in table order, height rows of width bytes
+ *
+ * No Pico SDK dependencies: the same file builds for the board, for the
+ * clock project and, with FONT_HOST_TOOL defined, as a host converter from
+ * a text description to the binary format:
+ *
+ *     c++ -O2 -DFONT_HOST_TOOL font.cpp -o mkfont
+ *     ./mkfont font.txt font.fnt
+ */
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FONT_FIRST 0x20
+#define FONT_LAST 0x7E
+#define FONT_GLYPHS (FONT_LAST - FONT_FIRST + 1)
+#define FONT_MAX_HEIGHT 8
+#define FONT_NAME_LEN 16
+#define FONT_MAX_FONTS 8            // Registered fonts, built-in ones included
+#define FONT_FILE_MAX 4096          // Largest binary font accepted
+#define FONT_LINE_MAX 256           // font_print() row buffer
+
+#define FONT_MAGIC "PFNT"
+#define FONT_VERSION 1
+
+struct font_glyph {
+    uint16_t offset;        // Into font::pixels
+    uint8_t width;          // 0 = not in this font
+};
+
+struct font {
+    char name[FONT_NAME_LEN];
+    uint8_t height;
+    uint8_t spacing;
+    const struct font_glyph *glyphs;    // FONT_GLYPHS entries, from FONT_FIRST
+    const char *pixels;
+};
+
+// ===== COMPILE-TIME ATLAS =====
+
+// Readable source form of a glyph; rows may be ragged, short rows are
+// padded with spaces to the widest one
+struct font_glyph_src {
+    char code;
+    const char *rows[FONT_MAX_HEIGHT];
+};
+
+constexpr size_t font_strlen(const char *s) {
+    size_t n = 0;
+    while (s && s[n]) n++;
+    return n;
+}
+
+constexpr size_t font_src_width(const struct font_glyph_src &g, int height) {
+    size_t w = 0;
+    for (int r = 0; r < height; r++) {
+        size_t n = font_strlen(g.rows[r]);
+        if (n > w) w = n;
+    }
+    return w;
+}
+
+template <size_t N>
+constexpr size_t font_src_pixels(const struct font_glyph_src (&src)[N], int height) {
+    size_t total = 0;
+    for (size_t i = 0; i < N; i++) {
+        total += font_src_width(src[i], height) * height;
+    }
+    return total;
+}
+
+template <size_t PIXELS>
+struct font_atlas {
+    struct font_glyph glyphs[FONT_GLYPHS];
+    char pixels[PIXELS > 0 ? PIXELS : 1];
+};
+
+// Pack a source table. Lower-case letters without a glyph of their own
+// share the upper-case one, so lookups never need to fold case.
+template <size_t PIXELS, size_t N>
+constexpr font_atlas<PIXELS> font_pack(const struct font_glyph_src (&src)[N], int height) {
+    font_atlas<PIXELS> atlas{};
+    size_t offset = 0;
+    for (size_t i = 0; i < N; i++) {
+        size_t width = font_src_width(src[i], height);
+        int index = src[i].code - FONT_FIRST;
+        atlas.glyphs[index].offset = (uint16_t)offset;
+        atlas.glyphs[index].width = (uint8_t)width;
+        for (int r = 0; r < height; r++) {
+            const char *row = src[i].rows[r];
+            size_t n = font_strlen(row);
+            for (size_t x = 0; x < width; x++) {
+                atlas.pixels[offset + x] = x < n ? row[x] : ' ';
+            }
+            offset += width;
+        }
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        if (atlas.glyphs[c - FONT_FIRST].width == 0) {
+            atlas.glyphs[c - FONT_FIRST] = atlas.glyphs[c - 'a' + 'A' - FONT_FIRST];
+        }
+    }
+    return atlas;
+}
+
+// Declare a packed atlas named `name` from a constexpr font_glyph_src table
+#define FONT_ATLAS(name, src, height) \
+    constexpr auto name = font_pack<font_src_pixels(src, height)>(src, height)
+
+// ===== BUILT-IN FONTS =====
+
+extern const struct font font_slash;    // 5 rows, / and \ letters (ASCII converter)
+extern const struct font font_block;    // 5 rows, # digits (clocks)
+
+// ===== RENDERING =====
+
+// O(1) glyph lookup, NULL if the font has no glyph for c
+static inline const struct font_glyph *font_glyph_for(const struct font *font, char c) {
+    unsigned index = (unsigned char)c - FONT_FIRST;
+    if (index >= FONT_GLYPHS || font->glyphs[index].width == 0) {
+        return NULL;
+    }
+    return &font->glyphs[index];
+}
+
+// Columns taken by text (missing glyphs are skipped)
+size_t font_text_width(const struct font *font, const char *text);
+
+// Render row `row` of text into buf (NUL-terminated, no newline) and
+// return its length; output stops at the last glyph that fits in cap
+size_t font_render_line(const struct font *font, const char *text, int row,
+                        char *buf, size_t cap);
+
+// Print all rows of text, each row built in a buffer and written at once.
+// indent spaces are put in front of every row.
+void font_print(const struct font *font, const char *text, int indent);
+
+// ===== LOADED FONTS =====
+
+// Validate a binary image and build a font from it (one malloc, owned by
+// the caller, release with font_free). NULL if the image is malformed.
+struct font *font_parse(const uint8_t *data, size_t len, const char *name);
+void font_free(struct font *font);
+
+// Font registry: the built-ins are always present. font_register() takes
+// ownership of a parsed font; one with the same name as an earlier loaded
+// font replaces (and frees) it, built-in names cannot be replaced.
+bool font_register(struct font *font);
+const struct font *font_find(const char *name);
+int font_count();
+const struct font *font_get(int index);
+
+#endif // FONT_H
@@ -0,0 +1,224 @@
+/**
+ * Filesystem worker - runs LittleFS I/O on core 1
+ * See fs_worker.h for the threading model.
+ */
+
+#include "fs_worker.h"
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "pico/util/queue.h"
+
+// Jobs travel as pointers; both queues are multicore safe
+static queue_t request_queue;
+static queue_t completion_queue;
+static async_context_t *lwip_context = NULL;
+
+// Runs in lwIP context (async context on core 0) whenever core 1 has
+// posted completions
+static void fs_completion_work(async_context_t *context, async_when_pending_worker_t *worker) {
+    struct fs_job *job;
+    while (queue_try_remove(&completion_queue, &job)) {
+        if (job->done) {
+            job->done(job);
+        }
+    }
+}
+
+static async_when_pending_worker_t completion_worker = {
+    .next = NULL,
+    .do_work = fs_completion_work,
+    .work_pending = false,
+    .user_data = NULL
+};
+
+void fs_worker_init() {
+    queue_init(&request_queue, sizeof(struct fs_job*), FS_WORKER_MAX_JOBS);
+    queue_init(&completion_queue, sizeof(struct fs_job*), FS_WORKER_MAX_JOBS);
+    // No async context if the WiFi driver failed to start; there is no
+    // network client to complete to in that case
+    lwip_context = cyw43_arch_async_context();
+    if (lwip_context) {
+        async_context_add_when_pending_worker(lwip_context, &completion_worker);
+    }
+}
+
+bool fs_worker_submit(struct fs_job *job) {
+    return queue_try_add(&request_queue, &job);
+}
+
+// The job's cache buffer, and its stamp as the file's FS_ATTR_STAMP: read
+// when opened read-only, written with the data when opened for writing
+static void fs_job_file_cfg(struct fs_job *job) {
+    job->stamp_attr.type = FS_ATTR_STAMP;
+    job->stamp_attr.buffer = &job->stamp;
+    job->stamp_attr.size = sizeof(job->stamp);
+    memset(&job->file_cfg, 0, sizeof(job->file_cfg));
+    job->file_cfg.buffer = job->file_cache;
+    job->file_cfg.attrs = &job->stamp_attr;
+    job->file_cfg.attr_count = 1;
+}
+
+static void fs_job_run(struct fs_job *job) {
+    switch (job->op) {
+        case FS_OP_OPEN_READ:
+            if (job->file_open) {
+                lfs_file_close(&lfs, &job->file);
+                job->file_open = false;
+            }
+            job->stamp = 0;
+            fs_job_file_cfg(job);
+            job->result = lfs_file_opencfg(&lfs, &job->file, job->path, LFS_O_RDONLY, &job->file_cfg);
+            if (job->result >= 0) {
+                job->file_open = true;
+                job->size = lfs_file_size(&lfs, &job->file);
+                if (job->size < 0) {
+                    job->result = (int)job->size;
+                }
+            }
+            break;
+
+        case FS_OP_READ:
+            if (!job->file_open) {
+                job->result = LFS_ERR_BADF;
+                break;
+            }
+            job->result = (int)lfs_file_seek(&lfs, &job->file, job->offset, LFS_SEEK_SET);
+            if (job->result >= 0) {
+                job->result = (int)lfs_file_read(&lfs, &job->file, job->buf, job->len);
+            }
+            break;
+
+        case FS_OP_CLOSE:
+            job->result = 0;
+            if (job->file_open) {
+                job->result = lfs_file_close(&lfs, &job->file);
+                job->file_open = false;
+            }
+            if (job->dir_open) {
+                lfs_dir_close(&lfs, &job->dir);
+                job->dir_open = false;
+            }
+            break;
+
+        case FS_OP_OPEN_WRITE: {
+            if (job->file_open) {
+                lfs_file_close(&lfs, &job->file);
+                job->file_open = false;
+            }
+            // Need room for the new copy while the old file still exists,
+            // plus a couple of blocks of metadata headroom
+            lfs_ssize_t used = lfs_fs_size(&lfs);
+            if (used < 0) {
+                job->result = (int)used;
+                break;
+            }
+            lfs_size_t free_bytes = (lfs_cfg.block_count - (lfs_size_t)used) * lfs_cfg.block_size;
+            if ((lfs_size_t)job->size + 2 * lfs_cfg.block_size > free_bytes) {
+                job->result = LFS_ERR_NOSPC;
+                break;
+            }
+            job->stamp = time_us_64();
+            fs_job_file_cfg(job);
+            job->result = lfs_file_opencfg(&lfs, &job->file, job->path,
+                                           LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC, &job->file_cfg);
+            job->file_open = job->result >= 0;
+            break;
+        }
+
+        case FS_OP_WRITE:
+            if (!job->file_open) {
+                job->result = LFS_ERR_BADF;
+                break;
+            }
+            job->result = (int)lfs_file_write(&lfs, &job->file, job->buf, job->len);
+            break;
+
+        case FS_OP_COMMIT:
+            if (!job->file_open) {
+                job->result = LFS_ERR_BADF;
+                break;
+            }
+            job->result = lfs_file_close(&lfs, &job->file);
+            job->file_open = false;
+            if (job->result >= 0) {
+                // LittleFS renames are atomic and replace an existing file
+                job->result = lfs_rename(&lfs, job->path, job->dest_path);
+            }
+            if (job->result < 0) {
+                lfs_remove(&lfs, job->path);
+            }
+            break;
+
+        case FS_OP_ABORT:
+            if (job->file_open) {
+                lfs_file_close(&lfs, &job->file);
+                job->file_open = false;
+            }
+            lfs_remove(&lfs, job->path);
+            job->result = 0;
+            break;
+
+        case FS_OP_DIR_OPEN:
+            if (job->dir_open) {
+                lfs_dir_close(&lfs, &job->dir);
+                job->dir_open = false;
+            }
+            job->result = lfs_dir_open(&lfs, &job->dir, job->path);
+            job->dir_open = job->result >= 0;
+            break;
+
+        case FS_OP_DIR_READ: {
+            if (!job->dir_open) {
+                job->result = LFS_ERR_BADF;
+                break;
+            }
+            struct lfs_info *entries = (struct lfs_info*)job->buf;
+            int max = (int)(job->len / sizeof(struct lfs_info));
+            int count = 0;
+            int err = 0;
+            while (count < max && (err = lfs_dir_read(&lfs, &job->dir, &entries[count])) > 0) {
+                count++;
+            }
+            job->result = err < 0 ? err : count;
+            break;
+        }
+
+        case FS_OP_FS_STAT:
+            job->result = (int)lfs_fs_size(&lfs);
+            break;
+
+        case FS_OP_CALL:
+            job->call(job);
+            break;
+    }
+}
+
+static void fs_job_complete(struct fs_job *job) {
+    fs_job_run(job);
+
+    // Completion queue is sized to hold every job, so this never blocks
+    queue_add_blocking(&completion_queue, &job);
+    if (lwip_context) {
+        async_context_set_work_pending(lwip_context, &completion_worker);
+    }
+}
+
+bool fs_worker_service() {
+    struct fs_job *job;
+    if (!queue_try_remove(&request_queue, &job)) {
+        return false;
+    }
+    fs_job_complete(job);
+    return true;
+}
+
+#if PICO_OS_FREERTOS
+void fs_worker_run() {
+    while (true) {
+        struct fs_job *job;
+        // Blocks the task, not the core (configSUPPORT_PICO_SYNC_INTEROP)
+        queue_remove_blocking(&request_queue, &job);
+        fs_job_complete(job);
+    }
+}
+#endif
@@ -0,0 +1,94 @@
+/**
+ * Filesystem worker - runs LittleFS I/O on core 1
+ *
+ * Flash reads, programs and erases are slow and (for writes) stall XIP,
+ * so they must never run inside an lwIP callback. Callers fill in an
+ * fs_job and submit it from lwIP context; core 1 performs the operation
+ * into the job's pre-allocated buffers and the completion callback is
+ * then run back in lwIP context (async context worker on core 0), where
+ * it is safe to call tcp_write().
+ *
+ * In the FreeRTOS build the worker is a task instead (fs_worker_run()),
+ * free to run on either core, and completions go to the driver's task.
+ *
+ * A job owns at most one open file and may be resubmitted as many times
+ * as needed (open, read, read, ..., close). Only one operation per job
+ * may be outstanding at a time.
+ */
+
+#ifndef FS_WORKER_H
+#define FS_WORKER_H
+
+#include "pico_os.h"
+
+#define FS_WORKER_MAX_JOBS 8
+#define FS_PATH_MAX 144
+
+enum fs_op {
+    FS_OP_OPEN_READ,    // Open path read-only, result = 0 or LFS error, size = file size,
+                        // stamp = its FS_ATTR_STAMP
+    FS_OP_READ,         // Read up to len bytes at offset into buf, result = bytes read
+    FS_OP_CLOSE,        // Close the job's file, result = 0 or LFS error
+    FS_OP_OPEN_WRITE,   // Create/truncate path for writing; size = bytes that will be
+                        // written, checked against free space (LFS_ERR_NOSPC). The
+                        // file gets a new FS_ATTR_STAMP, committed with the data
+    FS_OP_WRITE,        // Append len bytes from buf, result = bytes written
+    FS_OP_COMMIT,       // Close and atomically rename path over dest_path
+    FS_OP_ABORT,        // Close and remove path (discard a partial write)
+    FS_OP_DIR_OPEN,     // Open directory path, result = 0 or LFS error
+    FS_OP_DIR_READ,     // Next entries into the struct lfs_info array buf (len bytes),
+                        // result = entries read, 0 at the end
+    FS_OP_FS_STAT,      // result = blocks in use (lfs_fs_size) or LFS error
+    FS_OP_CALL          // Run call(job) on core 1, e.g. to scan the open file
+};
+
+struct fs_job;
+typedef void (*fs_job_done_fn)(struct fs_job *job);
+typedef void (*fs_job_call_fn)(struct fs_job *job);
+
+struct fs_job {
+    // Request - filled in by the submitter
+    enum fs_op op;
+    char path[FS_PATH_MAX];
+    char dest_path[FS_PATH_MAX];    // FS_OP_COMMIT rename target
+    uint8_t *buf;
+    lfs_size_t len;
+    lfs_soff_t offset;
+    fs_job_done_fn done;
+    void *arg;
+    fs_job_call_fn call;            // FS_OP_CALL function, sets result itself
+    void *call_arg;
+
+    // Result - filled in by the worker
+    int result;
+    lfs_soff_t size;
+    uint64_t stamp;
+
+    // Worker-owned file state (pre-allocated, no heap use on core 1)
+    bool file_open;
+    lfs_file_t file;
+    struct lfs_file_config file_cfg;
+    struct lfs_attr stamp_attr;     // FS_ATTR_STAMP in stamp
+    uint8_t file_cache[LFS_CACHE_SIZE];
+    bool dir_open;                  // Closed by FS_OP_CLOSE as well
+    lfs_dir_t dir;
+};
+
+// Called once on core 0 before core 1 is launched
+void fs_worker_init();
+
+// Queue a job for core 1. Safe from lwIP context and the shell.
+// Returns false if the request queue is full.
+bool fs_worker_submit(struct fs_job *job);
+
+// Core 1 service function - runs at most one queued job.
+// Returns true if a job was processed.
+bool fs_worker_service();
+
+#if PICO_OS_FREERTOS
+// FreeRTOS build: body of the filesystem service task, which takes the
+// place of core 1's loop. Sleeps until a job is queued; never returns.
+void fs_worker_run();
+#endif
+
+#endif // FS_WORKER_H
@@ -0,0 +1,368 @@
+/**
+ * Web API - streaming JSON endpoints
+ * See http_api.h for the endpoint list and http_server.h for the
+ * generator contract.
+ *
+ * Generators emit whole records only: a record that does not fit in the
+ * remaining chunk space is rolled back and emitted first in the next call.
+ */
+
+#include <stdarg.h>
+#include "http_api.h"
+
+// Generator phase shared by all endpoints once the closing bracket is out
+#define API_PHASE_DONE 100
+
+// ===== JSON OUTPUT =====
+
+struct json_out {
+    char *buf;
+    size_t cap;
+    size_t len;
+};
+
+// All-or-nothing formatted append
+static bool json_printf(struct json_out *out, const char *fmt, ...) {
+    size_t room = out->cap - out->len;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(out->buf + out->len, room, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= room) {
+        return false;
+    }
+    out->len += n;
+    return true;
+}
+
+// All-or-nothing quoted, escaped string
+static bool json_string(struct json_out *out, const char *str) {
+    size_t mark = out->len;
+    if (out->len >= out->cap) {
+        return false;
+    }
+    out->buf[out->len++] = '"';
+    for (const char *c = str; *c; c++) {
+        char esc[8];
+        size_t n;
+        if (*c == '"' || *c == '\\') {
+            esc[0] = '\\';
+            esc[1] = *c;
+            n = 2;
+        } else if ((unsigned char)*c < 0x20) {
+            n = snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)(unsigned char)*c);
+        } else {
+            esc[0] = *c;
+            n = 1;
+        }
+        if (out->cap - out->len < n) {
+            out->len = mark;
+            return false;
+        }
+        memcpy(out->buf + out->len, esc, n);
+        out->len += n;
+    }
+    if (out->len >= out->cap) {
+        out->len = mark;
+        return false;
+    }
+    out->buf[out->len++] = '"';
+    return true;
+}
+
+// Generator return value for a call that produced out->len bytes
+static int json_result(struct json_out *out, struct http_stream *stream) {
+    if (out->len > 0) {
+        return (int)out->len;
+    }
+    return stream->phase == API_PHASE_DONE ? 0 : HTTP_GEN_WAIT;
+}
+
+// ===== /api/log =====
+
+static int api_log_gen(struct http_stream *stream, char *buf, size_t cap) {
+    struct json_out out = { buf, cap, 0 };
+
+    if (stream->phase == 0) {
+        if (!json_printf(&out, "{\"entries\":[")) {
+            return 0;
+        }
+        // Stop at what was logged when the request came in; the log keeps
+        // growing while we stream (not least with our own HTTP lines)
+        stream->cursor = log_first_sequence();
+        stream->limit = log_next_sequence();
+        stream->phase = 1;
+    }
+
+    while (stream->phase == 1) {
+        if (stream->cursor == stream->limit) {
+            if (json_printf(&out, "]}\n")) {
+                stream->phase = API_PHASE_DONE;
+            }
+            break;
+        }
+
+        char entry[128];
+        if (!log_get_entry(stream->cursor, entry, sizeof(entry))) {
+            // Overwritten by newer entries while streaming
+            stream->cursor++;
+            continue;
+        }
+
+        size_t mark = out.len;
+        if (!(json_printf(&out, "%s{\"seq\":%lu,\"text\":", stream->count ? "," : "",
+                          (unsigned long)stream->cursor) &&
+              json_string(&out, entry) &&
+              json_printf(&out, "}"))) {
+            out.len = mark;
+            break;
+        }
+        stream->cursor++;
+        stream->count++;
+    }
+
+    return json_result(&out, stream);
+}
+
+// ===== /api/processes =====
+
+static int api_processes_gen(struct http_stream *stream, char *buf, size_t cap) {
+    struct json_out out = { buf, cap, 0 };
+
+    if (stream->phase == 0) {
+        if (!json_printf(&out, "{\"processes\":[")) {
+            return 0;
+        }
+        stream->limit = process_get_count();
+        stream->phase = 1;
+    }
+
+    uint32_t now = to_ms_since_boot(get_absolute_time()) / 1000;
+    while (stream->phase == 1) {
+        if (stream->cursor == stream->limit) {
+            if (json_printf(&out, "]}\n")) {
+                stream->phase = API_PHASE_DONE;
+            }
+            break;
+        }
+
+        char name[32];
+        bool running;
+        uint32_t start_time;
+        if (!process_get_info(stream->cursor, name, sizeof(name), &running, &start_time)) {
+            stream->cursor++;
+            continue;
+        }
+
+        size_t mark = out.len;
+        if (!(json_printf(&out, "%s{\"pid\":%lu,\"name\":", stream->count ? "," : "",
+                          (unsigned long)stream->cursor) &&
+              json_string(&out, name) &&
+              json_printf(&out, ",\"running\":%s,\"uptime_s\":%lu}",
+                          running ? "true" : "false", (unsigned long)(now - start_time)))) {
+            out.len = mark;
+            break;
+        }
+        stream->cursor++;
+        stream->count++;
+    }
+
+    return json_result(&out, stream);
+}
+
+// ===== /api/storage =====
+
+static int api_storage_gen(struct http_stream *stream, char *buf, size_t cap) {
+    struct json_out out = { buf, cap, 0 };
+
+    switch (stream->phase) {
+        case 0:
+            // Counting used blocks walks the filesystem - leave it to core 1
+            if (!http_stream_submit(stream, FS_OP_FS_STAT)) {
+                json_printf(&out, "{\"error\":\"busy\"}\n");
+                stream->phase = API_PHASE_DONE;
+                break;
+            }
+            stream->phase = 1;
+            break;
+
+        case 1: {
+            int used = stream->job->result;
+            if (used < 0) {
+                json_printf(&out, "{\"error\":%d}\n", used);
+            } else {
+                uint32_t total = lfs_cfg.block_count * lfs_cfg.block_size;
+                uint32_t used_bytes = (uint32_t)used * lfs_cfg.block_size;
+                json_printf(&out,
+                    "{\"block_size\":%lu,\"block_count\":%lu,\"used_blocks\":%d,"
+                    "\"total_bytes\":%lu,\"used_bytes\":%lu,\"free_bytes\":%lu}\n",
+                    (unsigned long)lfs_cfg.block_size, (unsigned long)lfs_cfg.block_count, used,
+                    (unsigned long)total, (unsigned long)used_bytes,
+                    (unsigned long)(total - used_bytes));
+            }
+            stream->phase = API_PHASE_DONE;
+            break;
+        }
+    }
+
+    return json_result(&out, stream);
+}
+
+// ===== /api/files =====
+
+enum {
+    FILES_OPEN,         // Directory open queued
+    FILES_HEADER,       // Open finished, emit the header
+    FILES_BATCH,        // Directory read finished, take the batch
+    FILES_ENTRIES       // Emitting entries[cursor..limit)
+};
+
+// Queue the next batch of directory entries
+static bool api_files_read(struct http_stream *stream) {
+    stream->job->buf = (uint8_t*)stream->entries;
+    stream->job->len = sizeof(stream->entries);
+    if (!http_stream_submit(stream, FS_OP_DIR_READ)) {
+        return false;
+    }
+    stream->phase = FILES_BATCH;
+    return true;
+}
+
+static int api_files_gen(struct http_stream *stream, char *buf, size_t cap) {
+    struct json_out out = { buf, cap, 0 };
+    struct fs_job *job = stream->job;
+
+    switch (stream->phase) {
+        case FILES_OPEN:
+            if (!http_stream_submit(stream, FS_OP_DIR_OPEN)) {
+                json_printf(&out, "{\"error\":\"busy\"}\n");
+                stream->phase = API_PHASE_DONE;
+                break;
+            }
+            stream->phase = FILES_HEADER;
+            break;
+
+        case FILES_HEADER:
+            if (job->result < 0) {
+                json_printf(&out, "{\"path\":");
+                json_string(&out, job->path);
+                json_printf(&out, ",\"error\":%d}\n", job->result);
+                stream->phase = API_PHASE_DONE;
+                break;
+            }
+            json_printf(&out, "{\"path\":");
+            json_string(&out, job->path);
+            json_printf(&out, ",\"entries\":[");
+            if (!api_files_read(stream)) {
+                json_printf(&out, "],\"error\":\"busy\"}\n");
+                stream->phase = API_PHASE_DONE;
+            }
+            break;
+
+        case FILES_BATCH:
+            if (job->result <= 0) {
+                if (job->result < 0) {
+                    json_printf(&out, "],\"error\":%d}\n", job->result);
+                } else {
+                    json_printf(&out, "]}\n");
+                }
+                stream->phase = API_PHASE_DONE;
+                break;
+            }
+            stream->cursor = 0;
+            stream->limit = job->result;
+            stream->phase = FILES_ENTRIES;
+            // fall through
+
+        case FILES_ENTRIES:
+            while (stream->cursor < stream->limit) {
+                const struct lfs_info *info = &stream->entries[stream->cursor];
+                if (strcmp(info->name, ".") == 0 || strcmp(info->name, "..") == 0) {
+                    stream->cursor++;
+                    continue;
+                }
+                size_t mark = out.len;
+                if (!(json_printf(&out, "%s{\"name\":", stream->count ? "," : "") &&
+                      json_string(&out, info->name) &&
+                      json_printf(&out, ",\"type\":\"%s\",\"size\":%lu}",
+                                  info->type == LFS_TYPE_DIR ? "dir" : "file",
+                                  (unsigned long)(info->type == LFS_TYPE_DIR ? 0 : info->size)))) {
+                    out.len = mark;
+                    if (mark == 0) {
+                        // Can't fit even in an empty chunk - leave it out
+                        stream->cursor++;
+                        continue;
+                    }
+                    return json_result(&out, stream);
+                }
+                stream->cursor++;
+                stream->count++;
+            }
+            if (!api_files_read(stream)) {
+                json_printf(&out, "],\"error\":\"busy\"}\n");
+                stream->phase = API_PHASE_DONE;
+            }
+            break;
+    }
+
+    return json_result(&out, stream);
+}
+
+// Copy the value of query parameter name into out, decoding %XX and '+'
+static bool api_query_param(const char *query, const char *name, char *out, size_t len) {
+    size_t name_len = strlen(name);
+    const char *p = query;
+    while (p && *p) {
+        if (strncmp(p, name, name_len) == 0 && p[name_len] == '=') {
+            p += name_len + 1;
+            size_t n = 0;
+            while (*p && *p != '&' && n < len - 1) {
+                if (*p == '%' && p[1] && p[2]) {
+                    char hex[3] = { p[1], p[2], '\0' };
+                    out[n++] = (char)strtol(hex, NULL, 16);
+                    p += 3;
+                } else {
+                    out[n++] = *p == '+' ? ' ' : *p;
+                    p++;
+                }
+            }
+            out[n] = '\0';
+            return true;
+        }
+        p = strchr(p, '&');
+        if (p) p++;
+    }
+    return false;
+}
+
+// ===== ROUTING =====
+
+static const struct {
+    const char *path;
+    http_stream_gen_fn gen;
+} api_endpoints[] = {
+    { "/api/log",       api_log_gen },
+    { "/api/files",     api_files_gen },
+    { "/api/processes", api_processes_gen },
+    { "/api/storage",   api_storage_gen },
+};
+
+bool http_api_open(const char *path, struct http_stream *stream) {
+    const char *query = strchr(path, '?');
+    size_t path_len = query ? (size_t)(query - path) : strlen(path);
+    query = query ? query + 1 : "";
+
+    for (size_t i = 0; i < sizeof(api_endpoints) / sizeof(api_endpoints[0]); i++) {
+        if (strlen(api_endpoints[i].path) == path_len &&
+            strncmp(api_endpoints[i].path, path, path_len) == 0) {
+            stream->gen = api_endpoints[i].gen;
+            stream->content_type = "application/json";
+            if (stream->gen == api_files_gen &&
+                !api_query_param(query, "path", stream->job->path, sizeof(stream->job->path))) {
+                strcpy(stream->job->path, "/");
+            }
+            return true;
+        }
+    }
+    return false;
+}
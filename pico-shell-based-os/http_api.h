@@ -0,0 +1,23 @@
+/**
+ * Web API - streaming JSON endpoints served under /api/
+ *
+ *   /api/log                  System log, oldest entry first
+ *   /api/files?path=/web      Directory listing (default "/")
+ *   /api/processes            Background process table
+ *   /api/storage              LittleFS usage
+ *
+ * Every endpoint is a generator for the chunked response writer in
+ * http_server.cpp, so output is produced a chunk at a time and never held
+ * in RAM in full.
+ */
+
+#ifndef HTTP_API_H
+#define HTTP_API_H
+
+#include "http_server.h"
+
+// Set up stream (already zeroed, with job/conn/chunked filled in) for the
+// endpoint named by the request path. Returns false for unknown endpoints.
+bool http_api_open(const char *path, struct http_stream *stream);
+
+#endif // HTTP_API_H
@@ -0,0 +1,1365 @@
+/**
+ * HTTP server - serves /web/ from LittleFS
+ *
+ * Single byte ranges (Range: bytes=a-b, a-, -n) are answered with 206 and
+ * only the requested bytes are read from flash, so interrupted downloads
+ * can resume where they stopped.
+ *
+ * Request pipeline:
+ *   1. http_recv_callback (lwIP) collects the request header and queues an
+ *      open on the core 1 filesystem worker - no flash access here.
+ *   2. The worker opens/reads the file into one of the connection's two
+ *      chunk buffers and posts a completion.
+ *   3. http_job_done (lwIP context again) hands the filled buffer to
+ *      tcp_write() by reference and asks for the next chunk into the other
+ *      buffer, so flash reads overlap with transmission.
+ *   4. http_sent_callback releases buffers as the client ACKs them and the
+ *      connection is closed once the whole body has been acknowledged.
+ *
+ * PUT/POST uploads run the same buffers the other way: received segments
+ * are copied into one buffer while the worker programs the other to a temp
+ * file, and tcp_recved() is only called for bytes that found a buffer, so
+ * the TCP window throttles the client to flash speed. The temp file is
+ * renamed over the target only once the full Content-Length is on flash.
+ */
+
+#include <ctype.h>
+#include <strings.h>
+#include "http_server.h"
+#include "http_api.h"
+#include "http_template.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+
+#define HTTP_REQUEST_MAX HTTP_BUFFER_SIZE
+
+enum http_buf_state {
+    HTTP_BUF_FREE,      // Available for the worker to fill
+    HTTP_BUF_FILLING,   // Worker is reading flash into it
+    HTTP_BUF_READY,     // Filled, waiting for TCP send buffer space
+    HTTP_BUF_INFLIGHT,  // Queued with tcp_write(), waiting for ACK
+    HTTP_BUF_FLUSHING   // Upload data being programmed to flash by the worker
+};
+
+// Single byte range from a "Range: bytes=..." header
+struct http_range {
+    bool present;
+    bool suffix;                    // bytes=-N : last N bytes
+    bool open_ended;                // bytes=N- : from N to the end
+    uint32_t first;
+    uint32_t last;                  // Inclusive; for suffix ranges, N
+};
+
+// HTTP connection state
+struct http_conn {
+    bool in_use;
+    struct tcp_pcb *pcb;            // NULL once the TCP side has gone away
+    uint8_t idle_polls;
+
+    // Request header accumulation
+    char request[HTTP_REQUEST_MAX];
+    size_t request_len;
+    bool request_handled;
+    bool http10;                    // Client spoke HTTP/1.0 (no chunked encoding)
+
+    // Outstanding filesystem work (at most one job in flight)
+    struct fs_job job;
+    bool job_busy;
+
+    // Requested byte range (Range header), resolved once the size is known
+    struct http_range range;
+
+    // Response body streaming
+    lfs_soff_t body_end;            // File offset one past the last body byte
+    lfs_soff_t read_offset;         // Next file offset to ask the worker for
+    uint32_t unacked_header;
+    uint8_t bufs[2][HTTP_CHUNK_SIZE];
+    uint16_t buf_len[2];
+    http_buf_state buf_state[2];
+    uint8_t fill_idx;
+    uint8_t send_idx;
+    uint8_t ack_idx;
+
+    // Request body upload (PUT/POST), reusing bufs[] in the other direction:
+    // lwIP fills bufs[fill_idx] while the worker flushes bufs[send_idx]
+    bool uploading;
+    uint32_t upload_expected;       // Content-Length
+    uint32_t upload_received;       // Body bytes copied into bufs[]
+    uint32_t upload_written;        // Body bytes programmed to flash
+    struct pbuf *rx_pending;        // Received but not yet copied (window held)
+    absolute_time_t upload_start;
+
+    // Generated (chunked) response, filled into bufs[] on demand
+    bool streaming;
+    struct http_stream stream;
+};
+
+// Web server globals
+static bool http_server_running = false;
+static struct tcp_pcb *http_server_pcb = NULL;
+static int active_connections = 0;
+static struct http_conn http_conns[MAX_HTTP_CONNECTIONS];
+
+static void http_job_done(struct fs_job *job);
+
+// ===== WEB SERVER - HTTP SERVER FROM LITTLEFS =====
+
+// Get MIME type from file extension
+const char* get_mime_type(const char* filename) {
+    const char* ext = strrchr(filename, '.');
+    if (!ext) return "text/plain";
+    
+    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0 || strcmp(ext, ".shtml") == 0) return "text/html";
+    if (strcmp(ext, ".css") == 0) return "text/css";
+    if (strcmp(ext, ".js") == 0) return "application/javascript";
+    if (strcmp(ext, ".json") == 0) return "application/json";
+    if (strcmp(ext, ".png") == 0) return "image/png";
+    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "image/jpeg";
+    if (strcmp(ext, ".gif") == 0) return "image/gif";
+    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
+    if (strcmp(ext, ".txt") == 0) return "text/plain";
+    
+    return "application/octet-stream";
+}
+
+// HTTP error response
+err_t send_http_error(struct tcp_pcb *pcb, int code, const char* message) {
+    char response[256];
+    int len = snprintf(response, sizeof(response),
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: text/html\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "<html><body><h1>%d %s</h1></body></html>\r\n",
+        code, message, code, message);
+    
+    err_t err = tcp_write(pcb, response, len, TCP_WRITE_FLAG_COPY);
+    tcp_output(pcb);
+    
+    return err;
+}
+
+// ===== CONNECTION POOL =====
+
+static struct http_conn* http_conn_alloc() {
+    for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
+        if (!http_conns[i].in_use) {
+            struct http_conn *conn = &http_conns[i];
+            conn->in_use = true;
+            conn->pcb = NULL;
+            conn->idle_polls = 0;
+            conn->request_len = 0;
+            conn->request_handled = false;
+            conn->http10 = false;
+            conn->job_busy = false;
+            conn->job.file_open = false;
+            conn->job.dir_open = false;
+            conn->job.done = http_job_done;
+            conn->job.arg = conn;
+            conn->range.present = false;
+            conn->body_end = 0;
+            conn->read_offset = 0;
+            conn->unacked_header = 0;
+            conn->buf_len[0] = conn->buf_len[1] = 0;
+            conn->buf_state[0] = conn->buf_state[1] = HTTP_BUF_FREE;
+            conn->fill_idx = conn->send_idx = conn->ack_idx = 0;
+            conn->uploading = false;
+            conn->upload_expected = conn->upload_received = conn->upload_written = 0;
+            conn->rx_pending = NULL;
+            conn->streaming = false;
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+static bool http_conn_submit(struct http_conn *conn, enum fs_op op) {
+    conn->job.op = op;
+    if (!fs_worker_submit(&conn->job)) {
+        return false;
+    }
+    conn->job_busy = true;
+    return true;
+}
+
+// Return the slot to the pool once neither lwIP nor the worker reference it
+static void http_conn_try_release(struct http_conn *conn) {
+    if (conn->pcb || conn->job_busy) {
+        return;
+    }
+    if (conn->rx_pending) {
+        pbuf_free(conn->rx_pending);
+        conn->rx_pending = NULL;
+    }
+    if (conn->job.file_open || conn->job.dir_open) {
+        // An upload that never committed leaves only its temp file behind
+        http_conn_submit(conn, conn->uploading ? FS_OP_ABORT : FS_OP_CLOSE);
+        return;
+    }
+    if (conn->streaming && conn->stream.release) {
+        conn->stream.release(&conn->stream);
+    }
+    conn->in_use = false;
+}
+
+// Close the TCP side. Returns ERR_ABRT if the PCB had to be aborted.
+static err_t http_conn_close(struct http_conn *conn) {
+    struct tcp_pcb *pcb = conn->pcb;
+    if (!pcb) {
+        return ERR_OK;
+    }
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    conn->pcb = NULL;
+    active_connections--;
+
+    err_t result = ERR_OK;
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        result = ERR_ABRT;
+    }
+
+    http_conn_try_release(conn);
+    return result;
+}
+
+// Reset the connection without closing it cleanly, so the client sees
+// the response as cut short. Returns ERR_ABRT.
+static err_t http_conn_abort(struct http_conn *conn) {
+    struct tcp_pcb *pcb = conn->pcb;
+    tcp_arg(pcb, NULL);             // No error callback for our own abort
+    tcp_abort(pcb);
+    conn->pcb = NULL;
+    active_connections--;
+    conn->buf_state[0] = conn->buf_state[1] = HTTP_BUF_FREE;
+    http_conn_try_release(conn);
+    return ERR_ABRT;
+}
+
+// ===== RESPONSE STREAMING =====
+
+static err_t http_upload_pump(struct http_conn *conn);
+static err_t http_stream_pump(struct http_conn *conn);
+
+// Hand filled buffers to lwIP by reference, in order. more: further body
+// data will follow. Returns ERR_ABRT if the connection had to be aborted.
+static err_t http_conn_send_ready(struct http_conn *conn, bool more) {
+    struct tcp_pcb *pcb = conn->pcb;
+    bool wrote = false;
+    while (conn->buf_state[conn->send_idx] == HTTP_BUF_READY) {
+        uint8_t idx = conn->send_idx;
+        uint16_t len = conn->buf_len[idx];
+        if (tcp_sndbuf(pcb) < len) {
+            break;  // http_sent_callback will pump again
+        }
+        err_t err = tcp_write(pcb, conn->bufs[idx], len, more ? TCP_WRITE_FLAG_MORE : 0);
+        if (err == ERR_MEM) {
+            break;
+        }
+        if (err != ERR_OK) {
+            tcp_abort(pcb);
+            conn->pcb = NULL;
+            active_connections--;
+            http_conn_try_release(conn);
+            return ERR_ABRT;
+        }
+        conn->buf_state[idx] = HTTP_BUF_INFLIGHT;
+        conn->send_idx ^= 1;
+        wrote = true;
+    }
+    if (wrote) {
+        tcp_output(pcb);
+    }
+    return ERR_OK;
+}
+
+// Move the response forward: queue ready buffers, request the next chunk,
+// and close once everything has been sent and acknowledged.
+static err_t http_conn_pump(struct http_conn *conn) {
+    if (conn->uploading) {
+        return http_upload_pump(conn);
+    }
+    if (conn->streaming) {
+        return http_stream_pump(conn);
+    }
+
+    if (!conn->pcb) {
+        http_conn_try_release(conn);
+        return ERR_OK;
+    }
+
+    if (http_conn_send_ready(conn, conn->read_offset < conn->body_end) == ERR_ABRT) {
+        return ERR_ABRT;
+    }
+
+    if (!conn->job_busy) {
+        if (conn->read_offset < conn->body_end) {
+            // Ask core 1 for the next chunk while the previous one transmits
+            uint8_t idx = conn->fill_idx;
+            if (conn->buf_state[idx] == HTTP_BUF_FREE) {
+                lfs_soff_t remaining = conn->body_end - conn->read_offset;
+                conn->job.buf = conn->bufs[idx];
+                conn->job.len = remaining < HTTP_CHUNK_SIZE ? (lfs_size_t)remaining : HTTP_CHUNK_SIZE;
+                conn->job.offset = conn->read_offset;
+                if (http_conn_submit(conn, FS_OP_READ)) {
+                    conn->buf_state[idx] = HTTP_BUF_FILLING;
+                }
+            }
+        } else if (conn->job.file_open) {
+            // Whole body read - release the LittleFS handle early
+            http_conn_submit(conn, FS_OP_CLOSE);
+        }
+    }
+
+    bool body_done = conn->read_offset >= conn->body_end &&
+                     conn->buf_state[0] == HTTP_BUF_FREE &&
+                     conn->buf_state[1] == HTTP_BUF_FREE;
+    if (body_done && conn->unacked_header == 0 && !conn->job_busy) {
+        return http_conn_close(conn);
+    }
+    return ERR_OK;
+}
+
+// Find a request header by name (case-insensitive). Returns a pointer to
+// the value with leading spaces skipped, or NULL.
+static const char* http_find_header(const char *request, const char *name) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1;
+            while (*value == ' ' || *value == '\t') value++;
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+// Parse "bytes=first-last", "bytes=first-" or "bytes=-suffix". Anything else
+// (including multiple ranges) is ignored and the full file is sent, which
+// RFC 9110 allows.
+static void http_parse_range(const char *value, struct http_range *range) {
+    range->present = false;
+    if (!value || strncmp(value, "bytes=", 6) != 0) {
+        return;
+    }
+    const char *p = value + 6;
+    const char *end = strpbrk(p, "\r\n");
+    const char *comma = strchr(p, ',');
+    if (comma && (!end || comma < end)) {
+        return;
+    }
+
+    char *next;
+    range->suffix = false;
+    range->open_ended = false;
+    if (*p == '-') {
+        if (!isdigit((unsigned char)p[1])) return;
+        range->suffix = true;
+        range->last = strtoul(p + 1, &next, 10);
+    } else {
+        if (!isdigit((unsigned char)*p)) return;
+        range->first = strtoul(p, &next, 10);
+        if (*next != '-') return;
+        next++;
+        if (isdigit((unsigned char)*next)) {
+            range->last = strtoul(next, &next, 10);
+            if (range->last < range->first) return;
+        } else {
+            range->open_ended = true;
+        }
+    }
+    if (*next != '\r' && *next != '\n' && *next != '\0' && *next != ' ') {
+        return;
+    }
+    range->present = true;
+}
+
+// Resolve the requested range against the file size. Returns false if the
+// range cannot be satisfied (416).
+static bool http_resolve_range(struct http_conn *conn, lfs_soff_t size) {
+    struct http_range *range = &conn->range;
+    conn->read_offset = 0;
+    conn->body_end = size;
+    if (!range->present) {
+        return true;
+    }
+
+    if (range->suffix) {
+        if (range->last == 0 || size == 0) return false;
+        conn->read_offset = (lfs_soff_t)range->last < size ? size - (lfs_soff_t)range->last : 0;
+    } else {
+        if ((lfs_soff_t)range->first >= size) return false;
+        conn->read_offset = range->first;
+        if (!range->open_ended && (lfs_soff_t)range->last < size - 1) {
+            conn->body_end = (lfs_soff_t)range->last + 1;
+        }
+    }
+    return true;
+}
+
+static void http_send_file_header(struct http_conn *conn, const char *filepath, lfs_soff_t size) {
+    const char* mime = get_mime_type(filepath);
+    char header[320];
+    int header_len;
+    if (conn->range.present) {
+        header_len = snprintf(header, sizeof(header),
+            "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %ld\r\n"
+            "Content-Range: bytes %ld-%ld/%ld\r\n"
+            "Accept-Ranges: bytes\r\n"
+            "Connection: close\r\n"
+            "\r\n",
+            mime, (long)(conn->body_end - conn->read_offset),
+            (long)conn->read_offset, (long)(conn->body_end - 1), (long)size);
+    } else {
+        header_len = snprintf(header, sizeof(header),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %ld\r\n"
+            "Accept-Ranges: bytes\r\n"
+            "Connection: close\r\n"
+            "\r\n",
+            mime, (long)size);
+    }
+
+    if (tcp_write(conn->pcb, header, header_len, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) == ERR_OK) {
+        conn->unacked_header = header_len;
+    }
+}
+
+static void http_send_range_not_satisfiable(struct tcp_pcb *pcb, lfs_soff_t size) {
+    char response[160];
+    int len = snprintf(response, sizeof(response),
+        "HTTP/1.1 416 Range Not Satisfiable\r\n"
+        "Content-Range: bytes */%ld\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        (long)size);
+    tcp_write(pcb, response, len, TCP_WRITE_FLAG_COPY);
+    tcp_output(pcb);
+}
+
+// ===== STREAMING RESPONSES =====
+
+bool http_stream_submit(struct http_stream *stream, enum fs_op op) {
+    return http_conn_submit((struct http_conn*)stream->conn, op);
+}
+
+// Run the generator into bufs[idx], adding chunk framing. Returns the
+// buffer length, 0 if there is nothing to send, HTTP_GEN_WAIT or
+// HTTP_GEN_ERROR.
+static int http_stream_fill(struct http_conn *conn, uint8_t idx) {
+    struct http_stream *stream = &conn->stream;
+    char *buf = (char*)conn->bufs[idx];
+    // Chunk size is written as exactly three hex digits ("5ad\r\n")
+    size_t head = stream->chunked ? 5 : 0;
+    size_t tail = stream->chunked ? 2 : 0;
+
+    int n = stream->gen(stream, buf + head, HTTP_CHUNK_SIZE - head - tail);
+    if (n == HTTP_GEN_WAIT || n == HTTP_GEN_ERROR) {
+        return n;
+    }
+    if (n == 0) {
+        stream->done = true;
+        if (!stream->chunked) {
+            return 0;
+        }
+        memcpy(buf, "0\r\n\r\n", 5);
+        conn->buf_len[idx] = 5;
+        return 5;
+    }
+
+    if (stream->chunked) {
+        static const char hex[] = "0123456789abcdef";
+        buf[0] = hex[(n >> 8) & 0xF];
+        buf[1] = hex[(n >> 4) & 0xF];
+        buf[2] = hex[n & 0xF];
+        buf[3] = '\r';
+        buf[4] = '\n';
+        buf[head + n] = '\r';
+        buf[head + n + 1] = '\n';
+    }
+    conn->buf_len[idx] = head + n + tail;
+    return conn->buf_len[idx];
+}
+
+// Generate into whichever buffers the client has ACKed, send them, and
+// close once the terminating chunk has been acknowledged
+static err_t http_stream_pump(struct http_conn *conn) {
+    if (!conn->pcb) {
+        http_conn_try_release(conn);
+        return ERR_OK;
+    }
+
+    struct http_stream *stream = &conn->stream;
+    while (!stream->done && !conn->job_busy && conn->buf_state[conn->fill_idx] == HTTP_BUF_FREE) {
+        uint8_t idx = conn->fill_idx;
+        int n = http_stream_fill(conn, idx);
+        if (n == HTTP_GEN_WAIT) {
+            break;
+        }
+        if (n == HTTP_GEN_ERROR) {
+            log_message("HTTP: Generated response failed");
+            return http_conn_abort(conn);
+        }
+        if (n > 0) {
+            conn->buf_state[idx] = HTTP_BUF_READY;
+            conn->fill_idx ^= 1;
+        }
+    }
+
+    if (http_conn_send_ready(conn, !stream->done) == ERR_ABRT) {
+        return ERR_ABRT;
+    }
+
+    if (stream->done && !conn->job_busy && (conn->job.file_open || conn->job.dir_open)) {
+        http_conn_submit(conn, FS_OP_CLOSE);
+    }
+
+    bool body_done = stream->done &&
+                     conn->buf_state[0] == HTTP_BUF_FREE &&
+                     conn->buf_state[1] == HTTP_BUF_FREE;
+    if (body_done && conn->unacked_header == 0 && !conn->job_busy) {
+        return http_conn_close(conn);
+    }
+    return ERR_OK;
+}
+
+static struct http_stream* http_stream_init(struct http_conn *conn) {
+    struct http_stream *stream = &conn->stream;
+    memset(stream, 0, sizeof(*stream));
+    stream->job = &conn->job;
+    stream->conn = conn;
+    // HTTP/1.0 has no chunked encoding; the close marks the end instead
+    stream->chunked = !conn->http10;
+    return stream;
+}
+
+// Send the response header for a generated body and start pumping
+static err_t http_stream_start(struct http_conn *conn) {
+    struct http_stream *stream = &conn->stream;
+    char header[192];
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "%s"
+        "Cache-Control: no-store\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        stream->content_type,
+        stream->chunked ? "Transfer-Encoding: chunked\r\n" : "");
+
+    if (tcp_write(conn->pcb, header, header_len, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK) {
+        return http_conn_close(conn);
+    }
+    conn->unacked_header = header_len;
+    conn->streaming = true;
+    return http_stream_pump(conn);
+}
+
+// ===== STREAMING UPLOAD =====
+
+// Copy body bytes into the fill buffer(s). Returns how many were taken;
+// fewer than len means both buffers are waiting on flash.
+static size_t http_upload_consume(struct http_conn *conn, const struct pbuf *p,
+                                  const uint8_t *data, size_t len) {
+    size_t taken = 0;
+    while (taken < len && conn->upload_received < conn->upload_expected) {
+        uint8_t idx = conn->fill_idx;
+        if (conn->buf_state[idx] != HTTP_BUF_FREE) {
+            break;
+        }
+        size_t space = HTTP_CHUNK_SIZE - conn->buf_len[idx];
+        size_t body_left = conn->upload_expected - conn->upload_received;
+        size_t n = len - taken;
+        if (n > space) n = space;
+        if (n > body_left) n = body_left;
+
+        if (p) {
+            pbuf_copy_partial(p, conn->bufs[idx] + conn->buf_len[idx], (u16_t)n, (u16_t)taken);
+        } else {
+            memcpy(conn->bufs[idx] + conn->buf_len[idx], data + taken, n);
+        }
+        conn->buf_len[idx] += n;
+        conn->upload_received += n;
+        taken += n;
+
+        if (conn->buf_len[idx] == HTTP_CHUNK_SIZE || conn->upload_received == conn->upload_expected) {
+            conn->buf_state[idx] = HTTP_BUF_READY;
+            conn->fill_idx ^= 1;
+        }
+    }
+    return taken;
+}
+
+static err_t http_upload_fail(struct http_conn *conn, int code, const char *message) {
+    char log_msg[96];
+    snprintf(log_msg, sizeof(log_msg), "HTTP: Upload failed (%d %s)", code, message);
+    log_message(log_msg);
+    send_http_error(conn->pcb, code, message);
+    return http_conn_close(conn);
+}
+
+// Drain held pbufs into free buffers, then keep the worker busy: flush the
+// next full buffer, or commit once every body byte is on flash.
+static err_t http_upload_pump(struct http_conn *conn) {
+    struct tcp_pcb *pcb = conn->pcb;
+    if (!pcb) {
+        http_conn_try_release(conn);
+        return ERR_OK;
+    }
+
+    while (conn->rx_pending) {
+        struct pbuf *p = conn->rx_pending;
+        size_t taken = http_upload_consume(conn, p, NULL, p->tot_len);
+        if (taken == p->tot_len || conn->upload_received == conn->upload_expected) {
+            // Anything past Content-Length is dropped
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
+            conn->rx_pending = NULL;
+            break;
+        }
+        if (taken == 0) {
+            break;
+        }
+        // Only now open the window for what was consumed, so the sender
+        // is paced by flash programming speed
+        tcp_recved(pcb, (u16_t)taken);
+        conn->rx_pending = pbuf_free_header(p, (u16_t)taken);
+    }
+
+    if (conn->job_busy || !conn->job.file_open) {
+        return ERR_OK;
+    }
+
+    uint8_t idx = conn->send_idx;
+    if (conn->buf_state[idx] == HTTP_BUF_READY) {
+        conn->job.buf = conn->bufs[idx];
+        conn->job.len = conn->buf_len[idx];
+        if (http_conn_submit(conn, FS_OP_WRITE)) {
+            conn->buf_state[idx] = HTTP_BUF_FLUSHING;
+        }
+    } else if (conn->upload_written == conn->upload_expected) {
+        http_conn_submit(conn, FS_OP_COMMIT);
+    }
+    return ERR_OK;
+}
+
+static void http_upload_job_done(struct http_conn *conn, struct fs_job *job) {
+    switch (job->op) {
+        case FS_OP_OPEN_WRITE:
+            if (job->result < 0) {
+                if (job->result == LFS_ERR_NOSPC) {
+                    http_upload_fail(conn, 507, "Insufficient Storage");
+                } else {
+                    http_upload_fail(conn, 500, "Internal Server Error");
+                }
+                return;
+            }
+            break;
+
+        case FS_OP_WRITE: {
+            uint8_t idx = conn->send_idx;
+            if (job->result != (int)job->len) {
+                http_upload_fail(conn, job->result == LFS_ERR_NOSPC ? 507 : 500,
+                                 job->result == LFS_ERR_NOSPC ? "Insufficient Storage" : "Internal Server Error");
+                return;
+            }
+            conn->upload_written += job->len;
+            conn->buf_len[idx] = 0;
+            conn->buf_state[idx] = HTTP_BUF_FREE;
+            conn->send_idx ^= 1;
+            break;
+        }
+
+        case FS_OP_COMMIT: {
+            if (job->result < 0) {
+                http_upload_fail(conn, 500, "Internal Server Error");
+                return;
+            }
+            uint32_t elapsed_ms = (uint32_t)(absolute_time_diff_us(conn->upload_start, get_absolute_time()) / 1000);
+            char body[192];
+            int body_len = snprintf(body, sizeof(body),
+                "{\"path\":\"%s\",\"bytes\":%lu,\"ms\":%lu}\n",
+                job->dest_path, (unsigned long)conn->upload_written, (unsigned long)elapsed_ms);
+            char header[160];
+            int header_len = snprintf(header, sizeof(header),
+                "HTTP/1.1 201 Created\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: %d\r\n"
+                "Connection: close\r\n"
+                "\r\n",
+                body_len);
+            tcp_write(conn->pcb, header, header_len, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+            tcp_write(conn->pcb, body, body_len, TCP_WRITE_FLAG_COPY);
+            tcp_output(conn->pcb);
+
+            char log_msg[160];
+            snprintf(log_msg, sizeof(log_msg), "HTTP: Uploaded %s (%lu bytes, %lu KB/s)",
+                     job->dest_path, (unsigned long)conn->upload_written,
+                     (unsigned long)(elapsed_ms ? conn->upload_written / elapsed_ms : 0));
+            log_message(log_msg);
+
+            http_conn_close(conn);
+            return;
+        }
+
+        default:
+            break;
+    }
+
+    http_upload_pump(conn);
+}
+
+// Validate an upload request and start streaming its body to a temp file.
+// body/body_len are bytes that arrived in the header buffer after the
+// blank line; rest is any further pbuf data from the same segment.
+static err_t http_upload_start(struct http_conn *conn, const char *filepath,
+                               const char *body, size_t body_len, struct pbuf *rest) {
+    if (rest) {
+        conn->rx_pending = rest;
+    }
+
+    const char *length = http_find_header(conn->request, "Content-Length");
+    if (!length || !isdigit((unsigned char)*length)) {
+        // Chunked request bodies are not supported
+        return http_upload_fail(conn, 411, "Length Required");
+    }
+    unsigned long expected = strtoul(length, NULL, 10);
+    if (expected > HTTP_UPLOAD_MAX) {
+        return http_upload_fail(conn, 413, "Content Too Large");
+    }
+    const char *name = strrchr(filepath, '/');
+    if (strncmp(filepath, "/web/", 5) != 0 || strstr(filepath, "..") || !name ||
+        name[1] == '\0' || name[1] == '.') {
+        return http_upload_fail(conn, 400, "Bad Request");
+    }
+
+    conn->uploading = true;
+    conn->upload_expected = expected;
+    conn->upload_start = get_absolute_time();
+    http_upload_consume(conn, NULL, (const uint8_t*)body, body_len);
+
+    int slot = (int)(conn - http_conns);
+    snprintf(conn->job.path, sizeof(conn->job.path), "/web/.upload%d.tmp", slot);
+    strncpy(conn->job.dest_path, filepath, sizeof(conn->job.dest_path) - 1);
+    conn->job.dest_path[sizeof(conn->job.dest_path) - 1] = '\0';
+    conn->job.size = expected;
+    if (!http_conn_submit(conn, FS_OP_OPEN_WRITE)) {
+        return http_upload_fail(conn, 503, "Service Unavailable");
+    }
+
+    // curl and friends wait for this before sending large bodies
+    const char *expect = http_find_header(conn->request, "Expect");
+    if (expect && strncasecmp(expect, "100-continue", 12) == 0) {
+        static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (tcp_write(conn->pcb, cont, sizeof(cont) - 1, 0) == ERR_OK) {
+            conn->unacked_header += sizeof(cont) - 1;
+            tcp_output(conn->pcb);
+        }
+    }
+    return ERR_OK;
+}
+
+// Filesystem job completion - runs in lwIP context
+static void http_job_done(struct fs_job *job) {
+    struct http_conn *conn = (struct http_conn*)job->arg;
+    conn->job_busy = false;
+
+    if (!conn->pcb) {
+        // Client went away while core 1 was busy
+        conn->buf_state[0] = conn->buf_state[1] = HTTP_BUF_FREE;
+        http_conn_try_release(conn);
+        return;
+    }
+
+    if (conn->uploading) {
+        http_upload_job_done(conn, job);
+        return;
+    }
+    if (conn->streaming) {
+        // The generator picks up the job result when it is called again
+        http_stream_pump(conn);
+        return;
+    }
+
+    switch (job->op) {
+        case FS_OP_OPEN_READ: {
+            if (job->result < 0) {
+                log_message("HTTP: File not found");
+                send_http_error(conn->pcb, 404, "Not Found");
+                http_conn_close(conn);
+                return;
+            }
+            if (template_is_template(job->path)) {
+                // Output length depends on live values - no ranges, chunked
+                template_open(http_stream_init(conn), job->size);
+                http_stream_start(conn);
+                return;
+            }
+            if (!http_resolve_range(conn, job->size)) {
+                log_message("HTTP: Range not satisfiable");
+                http_send_range_not_satisfiable(conn->pcb, job->size);
+                http_conn_close(conn);
+                return;
+            }
+            http_send_file_header(conn, job->path, job->size);
+
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "HTTP: Served %s (%ld bytes)",
+                     job->path, (long)(conn->body_end - conn->read_offset));
+            log_message(log_msg);
+            break;
+        }
+
+        case FS_OP_READ: {
+            uint8_t idx = conn->fill_idx;
+            if (job->result <= 0) {
+                // Headers are already out, so the only honest option is to abort
+                log_message("HTTP: Read error while streaming");
+                tcp_abort(conn->pcb);
+                conn->pcb = NULL;
+                active_connections--;
+                conn->buf_state[idx] = HTTP_BUF_FREE;
+                http_conn_try_release(conn);
+                return;
+            }
+            conn->buf_len[idx] = (uint16_t)job->result;
+            conn->buf_state[idx] = HTTP_BUF_READY;
+            conn->read_offset += job->result;
+            conn->fill_idx ^= 1;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    http_conn_pump(conn);
+}
+
+// Parse a complete request header and start the response. rest is any
+// received data that did not fit in the request buffer (request body).
+static err_t http_handle_request(struct http_conn *conn, struct pbuf *rest) {
+    conn->request_handled = true;
+
+    // Extract request path
+    char method[16], path[128], version[16];
+    if (sscanf(conn->request, "%15s %127s %15s", method, path, version) != 3) {
+        if (rest) pbuf_free(rest);
+        send_http_error(conn->pcb, 400, "Bad Request");
+        return http_conn_close(conn);
+    }
+    
+    // Log request
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "HTTP: %s %s", method, path);
+    log_message(log_msg);
+    
+    // Paths map onto /web by prefixing it, which only stays inside /web
+    // for an absolute path ("x" would become "/webx")
+    if (path[0] != '/') {
+        if (rest) pbuf_free(rest);
+        send_http_error(conn->pcb, 400, "Bad Request");
+        return http_conn_close(conn);
+    }
+    
+    // Uploads go to the same place a GET of that URL would read from
+    if (strcmp(method, "PUT") == 0 || strcmp(method, "POST") == 0) {
+        char filepath[FS_PATH_MAX];
+        snprintf(filepath, sizeof(filepath), "/web%s", path);
+        const char *header_end = strstr(conn->request, "\r\n\r\n");
+        const char *body = header_end ? header_end + 4 : conn->request + conn->request_len;
+        return http_upload_start(conn, filepath, body,
+                                 conn->request + conn->request_len - body, rest);
+    }
+
+    if (rest) {
+        // Body of a request we don't accept one for
+        tcp_recved(conn->pcb, rest->tot_len);
+        pbuf_free(rest);
+    }
+
+    // Handle request
+    if (strcmp(method, "GET") != 0) {
+        send_http_error(conn->pcb, 405, "Method Not Allowed");
+        return http_conn_close(conn);
+    }
+
+    conn->http10 = strcmp(version, "HTTP/1.0") == 0;
+
+    if (strncmp(path, "/api/", 5) == 0) {
+        struct http_stream *stream = http_stream_init(conn);
+        if (!http_api_open(path, stream)) {
+            send_http_error(conn->pcb, 404, "Not Found");
+            return http_conn_close(conn);
+        }
+        return http_stream_start(conn);
+    }
+
+    // Map URL to file
+    if (strcmp(path, "/") == 0) {
+        strcpy(conn->job.path, "/web/index.html");
+    } else {
+        snprintf(conn->job.path, sizeof(conn->job.path), "/web%s", path);
+    }
+
+    http_parse_range(http_find_header(conn->request, "Range"), &conn->range);
+
+    if (!http_conn_submit(conn, FS_OP_OPEN_READ)) {
+        send_http_error(conn->pcb, 503, "Service Unavailable");
+        return http_conn_close(conn);
+    }
+    return ERR_OK;
+}
+
+// ===== LWIP CALLBACKS =====
+
+// HTTP request received callback
+static err_t http_recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    struct http_conn *conn = (struct http_conn*)arg;
+
+    if (p == NULL) {
+        // Connection closed by client
+        return http_conn_close(conn);
+    }
+    
+    if (err != ERR_OK) {
+        pbuf_free(p);
+        return http_conn_close(conn);
+    }
+
+    conn->idle_polls = 0;
+
+    if (conn->request_handled) {
+        if (conn->uploading) {
+            // Held (and not acknowledged to the window) until a buffer frees up
+            if (conn->rx_pending) {
+                pbuf_cat(conn->rx_pending, p);
+            } else {
+                conn->rx_pending = p;
+            }
+            return http_upload_pump(conn);
+        }
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+        return ERR_OK;
+    }
+
+    // Accumulate until the end of the header; whatever doesn't fit is kept
+    // for http_handle_request() as the start of the request body
+    size_t space = sizeof(conn->request) - 1 - conn->request_len;
+    size_t len = p->tot_len < space ? p->tot_len : space;
+    pbuf_copy_partial(p, conn->request + conn->request_len, len, 0);
+    conn->request_len += len;
+    conn->request[conn->request_len] = '\0';
+    tcp_recved(pcb, len);
+
+    struct pbuf *rest = NULL;
+    if (len < p->tot_len) {
+        rest = pbuf_free_header(p, len);
+    } else {
+        pbuf_free(p);
+    }
+
+    bool header_complete = strstr(conn->request, "\r\n\r\n") != NULL;
+    if (header_complete || conn->request_len >= sizeof(conn->request) - 1) {
+        return http_handle_request(conn, rest);
+    }
+    return ERR_OK;
+}
+
+// Client ACKed data - free buffers and keep the stream moving
+static err_t http_sent_callback(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    struct http_conn *conn = (struct http_conn*)arg;
+    conn->idle_polls = 0;
+
+    uint32_t acked = len;
+    uint32_t header_part = acked < conn->unacked_header ? acked : conn->unacked_header;
+    conn->unacked_header -= header_part;
+    acked -= header_part;
+
+    while (acked > 0 && conn->buf_state[conn->ack_idx] == HTTP_BUF_INFLIGHT) {
+        uint8_t idx = conn->ack_idx;
+        uint32_t part = acked < conn->buf_len[idx] ? acked : conn->buf_len[idx];
+        conn->buf_len[idx] -= part;
+        acked -= part;
+        if (conn->buf_len[idx] == 0) {
+            conn->buf_state[idx] = HTTP_BUF_FREE;
+            conn->ack_idx ^= 1;
+        }
+    }
+
+    return http_conn_pump(conn);
+}
+
+// Drop connections that stop making progress
+static err_t http_poll_callback(void *arg, struct tcp_pcb *pcb) {
+    struct http_conn *conn = (struct http_conn*)arg;
+    if (++conn->idle_polls < HTTP_IDLE_POLLS) {
+        return ERR_OK;
+    }
+    log_message("HTTP: Idle connection dropped");
+    tcp_abort(pcb);
+    conn->pcb = NULL;
+    active_connections--;
+    conn->buf_state[0] = conn->buf_state[1] = HTTP_BUF_FREE;
+    http_conn_try_release(conn);
+    return ERR_ABRT;
+}
+
+// HTTP connection error callback - lwIP has already freed the PCB
+static void http_err_callback(void *arg, err_t err) {
+    struct http_conn *conn = (struct http_conn*)arg;
+    if (!conn) {
+        return;
+    }
+    conn->pcb = NULL;
+    if (active_connections > 0) {
+        active_connections--;
+    }
+    if (!conn->job_busy) {
+        conn->buf_state[0] = conn->buf_state[1] = HTTP_BUF_FREE;
+    }
+    http_conn_try_release(conn);
+}
+
+// New connection accepted
+static err_t http_accept_callback(void *arg, struct tcp_pcb *newpcb, err_t err) {
+    if (err != ERR_OK || newpcb == NULL) {
+        return ERR_VAL;
+    }
+    
+    struct http_conn *conn = http_conn_alloc();
+    if (!conn) {
+        tcp_abort(newpcb);
+        return ERR_ABRT;
+    }
+    
+    conn->pcb = newpcb;
+    active_connections++;
+    
+    tcp_setprio(newpcb, TCP_PRIO_MIN);
+    tcp_arg(newpcb, conn);
+    tcp_recv(newpcb, http_recv_callback);
+    tcp_sent(newpcb, http_sent_callback);
+    tcp_poll(newpcb, http_poll_callback, 4);  // 4 x 500ms
+    tcp_err(newpcb, http_err_callback);
+    
+    return ERR_OK;
+}
+
+// Start HTTP server
+void start_http_server() {
+    if (!wifi_connected) {
+        printf(ANSI_RED "Error: WiFi not connected!\n" ANSI_RESET);
+        printf("Connect to WiFi first using the 'wifi' command\n");
+        return;
+    }
+    
+    if (http_server_running) {
+        printf(ANSI_YELLOW "Web server is already running\n" ANSI_RESET);
+        return;
+    }
+
+    template_init();
+    
+    // Create listening PCB
+    http_server_pcb = tcp_new();
+    if (!http_server_pcb) {
+        printf(ANSI_RED "Failed to create server PCB\n" ANSI_RESET);
+        return;
+    }
+    
+    err_t err = tcp_bind(http_server_pcb, IP_ADDR_ANY, HTTP_SERVER_PORT);
+    if (err != ERR_OK) {
+        printf(ANSI_RED "Failed to bind to port %d\n" ANSI_RESET, HTTP_SERVER_PORT);
+        tcp_close(http_server_pcb);
+        http_server_pcb = NULL;
+        return;
+    }
+    
+    http_server_pcb = tcp_listen(http_server_pcb);
+    tcp_accept(http_server_pcb, http_accept_callback);
+    
+    http_server_running = true;
+    active_connections = 0;
+    
+    // Get IP address
+    char ip_str[16];
+    const ip4_addr_t *addr = netif_ip4_addr(netif_list);
+    snprintf(ip_str, sizeof(ip_str), "%s", ip4addr_ntoa(addr));
+    
+    printf(ANSI_CLEAR_SCREEN);
+    printf(ANSI_BOLD ANSI_GREEN);
+    printf("╔═══════════════════════════════════════════════╗\n");
+    printf("║        WEB SERVER STARTED - VERSION 2.0       ║\n");
+    printf("╚═══════════════════════════════════════════════╝\n");
+    printf(ANSI_RESET "\n");
+    
+    printf(ANSI_BOLD "Server Status:\n" ANSI_RESET);
+    printf("  • Running on:    http://%s:%d\n", ip_str, HTTP_SERVER_PORT);
+    printf("  • Document root: /web/ (on LittleFS)\n");
+    printf("  • Max connections: %d\n\n", MAX_HTTP_CONNECTIONS);
+    
+    printf(ANSI_CYAN "How to access:\n" ANSI_RESET);
+    printf("  1. Open a web browser on your device\n");
+    printf("  2. Navigate to: " ANSI_BOLD "http://%s" ANSI_RESET "\n", ip_str);
+    printf("  3. Your HTML/CSS files from /web/ will be served\n\n");
+    
+    printf(ANSI_YELLOW "Quick Start:\n" ANSI_RESET);
+    printf("  • Create HTML files: nano /web/index.html\n");
+    printf("  • Create CSS files:  nano /web/style.css\n");
+    printf("  • List web files:    ls\n");
+    printf("  • Stop server:       Press Ctrl+C or type 'stopweb'\n\n");
+    
+    log_message("HTTP server started");
+    
+    printf(ANSI_GREEN "Server is running! Access it from your browser.\n" ANSI_RESET);
+    printf("Type 'stopweb' to stop the server, or any command to continue.\n\n");
+}
+
+// Stop HTTP server
+void stop_http_server() {
+    if (!http_server_running) {
+        printf(ANSI_YELLOW "Web server is not running\n" ANSI_RESET);
+        return;
+    }
+    
+    if (http_server_pcb) {
+        tcp_close(http_server_pcb);
+        http_server_pcb = NULL;
+    }
+    
+    http_server_running = false;
+    active_connections = 0;
+    
+    printf(ANSI_GREEN "Web server stopped\n" ANSI_RESET);
+    log_message("HTTP server stopped");
+}
+
+// Create default website files
+void create_default_website() {
+    printf("Creating default website in /web/...\n");
+    
+    // Create /web directory
+    lfs_mkdir(&lfs, "/web");
+    
+    // Create index.html
+    lfs_file_t file;
+    const char* index_html = 
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head>\n"
+        "    <meta charset=\"UTF-8\">\n"
+        "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+        "    <title>Pico OS v2.0 - Web Server</title>\n"
+        "    <link rel=\"stylesheet\" href=\"style.css\">\n"
+        "</head>\n"
+        "<body>\n"
+        "    <div class=\"container\">\n"
+        "        <header>\n"
+        "            <h1>🚀 Welcome to Pico OS v2.0</h1>\n"
+        "            <p class=\"subtitle\">Raspberry Pi Pico 2 W Web Server</p>\n"
+        "        </header>\n"
+        "        \n"
+        "        <main>\n"
+        "            <div class=\"card\">\n"
+        "                <h2>✨ Features</h2>\n"
+        "                <ul>\n"
+        "                    <li>HTTP Web Server running on Pico 2 W</li>\n"
+        "                    <li>HTML & CSS support from LittleFS flash</li>\n"
+        "                    <li>Dual-core processing architecture</li>\n"
+        "                    <li>Real-time file system storage</li>\n"
+        "                </ul>\n"
+        "            </div>\n"
+        "            \n"
+        "            <div class=\"card\">\n"
+        "                <h2>📝 Getting Started</h2>\n"
+        "                <p>Edit this page using the nano editor:</p>\n"
+        "                <code>nano /web/index.html</code>\n"
+        "                <p>Customize the CSS stylesheet:</p>\n"
+        "                <code>nano /web/style.css</code>\n"
+        "                <p>Live values are on the <a href=\"status.shtml\">status page</a>.</p>\n"
+        "            </div>\n"
+        "            \n"
+        "            <div class=\"card\">\n"
+        "                <h2>💡 System Info</h2>\n"
+        "                <p><strong>Platform:</strong> Raspberry Pi Pico 2 W</p>\n"
+        "                <p><strong>RAM:</strong> 520 KB</p>\n"
+        "                <p><strong>Flash:</strong> 512 KB (for filesystem)</p>\n"
+        "                <p><strong>WiFi:</strong> 2.4 GHz 802.11n</p>\n"
+        "            </div>\n"
+        "        </main>\n"
+        "        \n"
+        "        <footer>\n"
+        "            <p>Pico OS Version 2.0 | Powered by LittleFS & lwIP</p>\n"
+        "        </footer>\n"
+        "    </div>\n"
+        "</body>\n"
+        "</html>\n";
+    
+    if (lfs_file_open(&lfs, &file, "/web/index.html", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
+        lfs_file_write(&lfs, &file, index_html, strlen(index_html));
+        lfs_file_close(&lfs, &file);
+        printf("[OK] Created /web/index.html\n");
+    }
+    
+    // Create style.css
+    const char* style_css = 
+        "* {\n"
+        "    margin: 0;\n"
+        "    padding: 0;\n"
+        "    box-sizing: border-box;\n"
+        "}\n"
+        "\n"
+        "body {\n"
+        "    font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif;\n"
+        "    background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);\n"
+        "    min-height: 100vh;\n"
+        "    display: flex;\n"
+        "    justify-content: center;\n"
+        "    align-items: center;\n"
+        "    padding: 20px;\n"
+        "}\n"
+        "\n"
+        ".container {\n"
+        "    max-width: 800px;\n"
+        "    background: white;\n"
+        "    border-radius: 20px;\n"
+        "    box-shadow: 0 20px 60px rgba(0,0,0,0.3);\n"
+        "    overflow: hidden;\n"
+        "}\n"
+        "\n"
+        "header {\n"
+        "    background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);\n"
+        "    color: white;\n"
+        "    padding: 40px;\n"
+        "    text-align: center;\n"
+        "}\n"
+        "\n"
+        "header h1 {\n"
+        "    font-size: 2.5em;\n"
+        "    margin-bottom: 10px;\n"
+        "}\n"
+        "\n"
+        ".subtitle {\n"
+        "    font-size: 1.2em;\n"
+        "    opacity: 0.9;\n"
+        "}\n"
+        "\n"
+        "main {\n"
+        "    padding: 40px;\n"
+        "}\n"
+        "\n"
+        ".card {\n"
+        "    background: #f8f9fa;\n"
+        "    border-radius: 10px;\n"
+        "    padding: 25px;\n"
+        "    margin-bottom: 20px;\n"
+        "}\n"
+        "\n"
+        ".card h2 {\n"
+        "    color: #667eea;\n"
+        "    margin-bottom: 15px;\n"
+        "    font-size: 1.5em;\n"
+        "}\n"
+        "\n"
+        ".card ul {\n"
+        "    list-style: none;\n"
+        "    padding-left: 0;\n"
+        "}\n"
+        "\n"
+        ".card li {\n"
+        "    padding: 8px 0;\n"
+        "    padding-left: 25px;\n"
+        "    position: relative;\n"
+        "}\n"
+        "\n"
+        ".card li:before {\n"
+        "    content: '✓';\n"
+        "    position: absolute;\n"
+        "    left: 0;\n"
+        "    color: #667eea;\n"
+        "    font-weight: bold;\n"
+        "}\n"
+        "\n"
+        "code {\n"
+        "    background: #2d3748;\n"
+        "    color: #68d391;\n"
+        "    padding: 8px 12px;\n"
+        "    border-radius: 5px;\n"
+        "    display: block;\n"
+        "    margin: 10px 0;\n"
+        "    font-family: 'Courier New', monospace;\n"
+        "}\n"
+        "\n"
+        "footer {\n"
+        "    background: #2d3748;\n"
+        "    color: white;\n"
+        "    text-align: center;\n"
+        "    padding: 20px;\n"
+        "    font-size: 0.9em;\n"
+        "}\n";
+    
+    if (lfs_file_open(&lfs, &file, "/web/style.css", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
+        lfs_file_write(&lfs, &file, style_css, strlen(style_css));
+        lfs_file_close(&lfs, &file);
+        printf("[OK] Created /web/style.css\n");
+    }
+    
+    // Create status.shtml - {{name}} placeholders are filled in per request
+    const char* status_shtml =
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head>\n"
+        "    <meta charset=\"UTF-8\">\n"
+        "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+        "    <title>Pico OS v2.0 - Status</title>\n"
+        "    <link rel=\"stylesheet\" href=\"style.css\">\n"
+        "</head>\n"
+        "<body>\n"
+        "    <div class=\"container\">\n"
+        "        <header>\n"
+        "            <h1>📊 System Status</h1>\n"
+        "            <p class=\"subtitle\">Rendered at {{time}}</p>\n"
+        "        </header>\n"
+        "        \n"
+        "        <main>\n"
+        "            <div class=\"card\">\n"
+        "                <p><strong>Uptime:</strong> {{uptime}}</p>\n"
+        "                <p><strong>IP Address:</strong> {{ip}}</p>\n"
+        "                <p><strong>WiFi:</strong> {{ssid}}</p>\n"
+        "                <p><strong>Storage:</strong> {{storage_used}} used, {{storage_free}} free of {{storage_total}}</p>\n"
+        "            </div>\n"
+        "        </main>\n"
+        "        \n"
+        "        <footer>\n"
+        "            <p><a href=\"/\">Home</a></p>\n"
+        "        </footer>\n"
+        "    </div>\n"
+        "</body>\n"
+        "</html>\n";
+
+    if (lfs_file_open(&lfs, &file, "/web/status.shtml", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
+        lfs_file_write(&lfs, &file, status_shtml, strlen(status_shtml));
+        lfs_file_close(&lfs, &file);
+        fs_stamp("/web/status.shtml");
+        printf("[OK] Created /web/status.shtml\n");
+    }
+    
+    printf(ANSI_GREEN "\nDefault website created successfully!\n" ANSI_RESET);
+    printf("Start the web server with: " ANSI_BOLD "localhost\n" ANSI_RESET);
+}
+
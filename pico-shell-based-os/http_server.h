@@ -0,0 +1,78 @@
+/**
+ * HTTP server - serves /web/ from LittleFS
+ *
+ * lwIP callbacks only parse requests and queue filesystem work; file
+ * contents are read by the core 1 filesystem worker (fs_worker.h) into
+ * per-connection double buffers and handed to tcp_write() without
+ * copying once they come back. PUT/POST bodies stream the other way into
+ * a temp file that replaces the target once complete.
+ */
+
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include "pico_os.h"
+
+// Bytes read from flash per worker round trip (one TCP segment)
+#define HTTP_CHUNK_SIZE 1460
+
+// Largest PUT/POST body accepted (a quarter of the filesystem)
+#define HTTP_UPLOAD_MAX (LFS_BLOCK_COUNT * LFS_BLOCK_SIZE / 4)
+
+// Idle connections are dropped after HTTP_IDLE_POLLS * 2 seconds
+#define HTTP_IDLE_POLLS 5
+
+// ===== STREAMING RESPONSES =====
+// Bodies of unknown length are sent with Transfer-Encoding: chunked (raw
+// until close for HTTP/1.0 clients). Instead of rendering the whole body,
+// the server calls the generator each time one of the connection's chunk
+// buffers is free again, i.e. as the client ACKs earlier data, so memory
+// use is the same whatever the size of the output.
+
+#include "fs_worker.h"
+
+// Generator return value: data needs a worker job submitted with
+// http_stream_submit(); the generator is called again when it completes,
+// with the same buf whose contents are left untouched in between (so a
+// job may read straight into it)
+#define HTTP_GEN_WAIT (-1)
+
+// Generator return value: the body cannot be completed (flash read or
+// worker queue failure). The headers are already out, so the connection
+// is aborted rather than ending a half-sent body as if it were whole.
+#define HTTP_GEN_ERROR (-2)
+
+struct http_stream;
+
+// Write up to cap bytes of body into buf. Returns the number of bytes
+// written, 0 when the body is complete, HTTP_GEN_WAIT or HTTP_GEN_ERROR.
+typedef int (*http_stream_gen_fn)(struct http_stream *stream, char *buf, size_t cap);
+
+// Directory entries fetched per worker round trip
+#define HTTP_STREAM_DIR_BATCH 4
+
+struct http_stream {
+    http_stream_gen_fn gen;
+    const char *content_type;
+    int phase;                  // Generator-defined state
+    uint32_t cursor;            // Generator-defined position...
+    uint32_t limit;             // ...and end
+    uint32_t count;             // Generator-defined counter
+    struct fs_job *job;         // The connection's worker job
+    struct lfs_info entries[HTTP_STREAM_DIR_BATCH]; // FS_OP_DIR_READ scratch
+    void *ctx;                  // Generator-defined context
+    void (*release)(struct http_stream *stream); // Optional, when the connection is freed
+    bool chunked;
+    bool done;
+    void *conn;
+};
+
+// Queue a worker job on behalf of a generator (which should then return
+// HTTP_GEN_WAIT). Returns false if the worker queue is full.
+bool http_stream_submit(struct http_stream *stream, enum fs_op op);
+
+void start_http_server();
+void stop_http_server();
+void create_default_website();
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,618 @@
+/**
+ * Server-side templates - see http_template.h
+ *
+ * Cache entries are keyed by path and ETag. LittleFS keeps no modification
+ * times, so the ETag is the file size plus its write stamp (FS_ATTR_STAMP,
+ * set by uploads and the shell's editor): writes to other files, such as
+ * a saved config or to-do list, leave the cached templates alone.
+ */
+
+#include <ctype.h>
+#include "http_template.h"
+
+#ifdef TEMPLATE_HOST_TEST
+#include <stdlib.h>
+#define FS_PATH_MAX 144             // As in fs_worker.h
+#else
+#include "lwip/netif.h"
+#include "timecache.h"
+
+#if TEMPLATE_CACHE_SLOTS < MAX_HTTP_CONNECTIONS
+#error "Every connection must be able to hold a template cache slot"
+#endif
+#endif
+
+#define TEMPLATE_LITERAL 0xFF
+
+struct template_segment {
+    uint32_t offset;                // Literal: position in the file
+    uint32_t length;                // Literal: bytes
+    int16_t inline_at;              // Literal: offset in pool, or -1 to read from flash
+    uint8_t provider;               // Provider index or TEMPLATE_LITERAL
+};
+
+enum template_state {
+    TEMPLATE_EMPTY,
+    TEMPLATE_SCANNING,              // Worker is filling the entry
+    TEMPLATE_READY
+};
+
+struct template_entry {
+    enum template_state state;
+    char path[FS_PATH_MAX];
+    uint32_t etag_size;
+    uint64_t etag_stamp;
+    uint8_t users;                  // Responses currently walking the table
+    uint32_t last_used;
+    bool needs_fs_usage;
+    uint16_t segment_count;
+    struct template_segment segments[TEMPLATE_MAX_SEGMENTS];
+    uint16_t pool_used;
+    char pool[TEMPLATE_INLINE_POOL];
+};
+
+struct template_provider {
+    char name[TEMPLATE_NAME_MAX];
+    template_provider_fn fn;
+    bool needs_fs_usage;
+};
+
+static struct template_provider providers[TEMPLATE_MAX_PROVIDERS];
+static int provider_count = 0;
+
+// Response phases
+enum {
+    TPL_SCAN,           // Queue the scan of an uncached template
+    TPL_SCANNED,        // Scan finished
+    TPL_PREPARE,        // Gather context values
+    TPL_CONTEXT,        // FS_OP_FS_STAT finished
+    TPL_EMIT,           // Walking segments
+    TPL_READ,           // Flash read into the chunk buffer finished
+    TPL_DONE
+};
+
+// ===== PROVIDERS =====
+
+#ifndef TEMPLATE_HOST_TEST
+static struct template_entry template_cache[TEMPLATE_CACHE_SLOTS];
+static uint32_t template_clock = 0;
+
+
+static int provide_uptime(char *buf, size_t cap, const struct template_ctx *ctx) {
+    uint32_t up = to_ms_since_boot(get_absolute_time()) / 1000;
+    return snprintf(buf, cap, "%lud %02lu:%02lu:%02lu",
+                    (unsigned long)(up / 86400), (unsigned long)((up % 86400) / 3600),
+                    (unsigned long)((up % 3600) / 60), (unsigned long)(up % 60));
+}
+
+static int provide_time(char *buf, size_t cap, const struct template_ctx *ctx) {
+    char hms[9] = "--:--:--";
+    timecache_hms(hms);
+    return snprintf(buf, cap, "%s", hms);
+}
+
+static int provide_ip(char *buf, size_t cap, const struct template_ctx *ctx) {
+    if (!netif_default) {
+        return snprintf(buf, cap, "0.0.0.0");
+    }
+    return snprintf(buf, cap, "%s", ip4addr_ntoa(netif_ip4_addr(netif_default)));
+}
+
+static int provide_ssid(char *buf, size_t cap, const struct template_ctx *ctx) {
+    return snprintf(buf, cap, "%s", wifi_connected ? wifi_ssid : "(not connected)");
+}
+
+static int provide_storage_used(char *buf, size_t cap, const struct template_ctx *ctx) {
+    if (ctx->fs_used_blocks < 0) {
+        return snprintf(buf, cap, "?");
+    }
+    return snprintf(buf, cap, "%lu KB",
+                    (unsigned long)(ctx->fs_used_blocks * lfs_cfg.block_size / 1024));
+}
+
+static int provide_storage_free(char *buf, size_t cap, const struct template_ctx *ctx) {
+    if (ctx->fs_used_blocks < 0) {
+        return snprintf(buf, cap, "?");
+    }
+    return snprintf(buf, cap, "%lu KB",
+                    (unsigned long)((lfs_cfg.block_count - ctx->fs_used_blocks) * lfs_cfg.block_size / 1024));
+}
+
+static int provide_storage_total(char *buf, size_t cap, const struct template_ctx *ctx) {
+    return snprintf(buf, cap, "%lu KB",
+                    (unsigned long)(lfs_cfg.block_count * lfs_cfg.block_size / 1024));
+}
+
+void template_init() {
+    if (provider_count > 0) {
+        return;
+    }
+    template_register("uptime", provide_uptime, false);
+    template_register("time", provide_time, false);
+    template_register("ip", provide_ip, false);
+    template_register("ssid", provide_ssid, false);
+    template_register("storage_used", provide_storage_used, true);
+    template_register("storage_free", provide_storage_free, true);
+    template_register("storage_total", provide_storage_total, false);
+}
+#endif
+
+bool template_register(const char *name, template_provider_fn fn, bool needs_fs_usage) {
+    if (provider_count >= TEMPLATE_MAX_PROVIDERS || strlen(name) >= TEMPLATE_NAME_MAX) {
+        return false;
+    }
+    struct template_provider *p = &providers[provider_count];
+    strcpy(p->name, name);
+    p->fn = fn;
+    p->needs_fs_usage = needs_fs_usage;
+    provider_count++;
+    return true;
+}
+
+static int template_find_provider(const char *name) {
+    for (int i = 0; i < provider_count; i++) {
+        if (strcmp(providers[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool template_is_template(const char *path) {
+    size_t len = strlen(path);
+    return len > 6 && strcmp(path + len - 6, ".shtml") == 0;
+}
+
+// ===== SCANNER (core 1) =====
+
+enum template_scan_state { S_TEXT, S_OPEN, S_NAME, S_CLOSE };
+
+struct template_scanner {
+    enum template_scan_state state;
+    uint32_t pos;                   // File position of the next byte
+    uint32_t literal_start;
+    uint32_t tag_start;             // Where the "{{" of the tag being read is
+    char name[TEMPLATE_NAME_MAX];
+    int name_len;
+    bool name_long;                 // Too long for any provider: the tag is text
+};
+
+static void template_add_literal(struct template_entry *entry, uint32_t offset, uint32_t length) {
+    if (length == 0) {
+        return;
+    }
+    struct template_segment *seg = &entry->segments[entry->segment_count++];
+    seg->offset = offset;
+    seg->length = length;
+    seg->inline_at = -1;
+    seg->provider = TEMPLATE_LITERAL;
+}
+
+static void template_scan_begin(struct template_entry *entry, struct template_scanner *sc) {
+    entry->segment_count = 0;
+    entry->pool_used = 0;
+    entry->needs_fs_usage = false;
+    memset(sc, 0, sizeof(*sc));
+}
+
+// "}}" seen: the tag from tag_start to pos becomes a placeholder if it
+// names a provider
+static void template_scan_tag(struct template_entry *entry, struct template_scanner *sc) {
+    if (sc->name_long) {
+        return;
+    }
+    sc->name[sc->name_len] = '\0';
+    int provider = template_find_provider(sc->name);
+    // Keep room for this literal, the placeholder and the tail; past the
+    // table size further tags are sent as text
+    if (provider < 0 || entry->segment_count + 3 > TEMPLATE_MAX_SEGMENTS) {
+        return;
+    }
+    template_add_literal(entry, sc->literal_start, sc->tag_start - sc->literal_start);
+    struct template_segment *seg = &entry->segments[entry->segment_count++];
+    seg->offset = 0;
+    seg->length = 0;
+    seg->inline_at = -1;
+    seg->provider = (uint8_t)provider;
+    entry->needs_fs_usage |= providers[provider].needs_fs_usage;
+    sc->literal_start = sc->pos + 1;
+}
+
+// The next n bytes of the file; tags may span calls
+static void template_scan_bytes(struct template_entry *entry, struct template_scanner *sc,
+                                const uint8_t *data, size_t n) {
+    for (size_t i = 0; i < n; i++, sc->pos++) {
+        char c = (char)data[i];
+        switch (sc->state) {
+            case S_TEXT:
+                if (c == '{') {
+                    sc->state = S_OPEN;
+                    sc->tag_start = sc->pos;
+                }
+                break;
+
+            case S_OPEN:
+                if (c == '{') {
+                    sc->state = S_NAME;
+                    sc->name_len = 0;
+                    sc->name_long = false;
+                } else {
+                    sc->state = S_TEXT;
+                }
+                break;
+
+            case S_NAME:
+                if (c == '}') {
+                    sc->state = S_CLOSE;
+                } else if (isalnum((unsigned char)c) || c == '_') {
+                    if (sc->name_len < TEMPLATE_NAME_MAX - 1) {
+                        sc->name[sc->name_len++] = c;
+                    } else {
+                        sc->name_long = true;
+                    }
+                } else if (c == '{' && sc->name_len == 0) {
+                    // "{{{": the first brace is text, the tag opens one later
+                    sc->tag_start = sc->pos - 1;
+                } else if (c == '{') {
+                    sc->state = S_OPEN;
+                    sc->tag_start = sc->pos;
+                } else {
+                    sc->state = S_TEXT;
+                }
+                break;
+
+            case S_CLOSE:
+                if (c == '}') {
+                    sc->state = S_TEXT;
+                    template_scan_tag(entry, sc);
+                } else if (c == '{') {
+                    sc->state = S_OPEN;
+                    sc->tag_start = sc->pos;
+                } else {
+                    sc->state = S_TEXT;
+                }
+                break;
+        }
+    }
+}
+
+static void template_scan_end(struct template_entry *entry, struct template_scanner *sc) {
+    template_add_literal(entry, sc->literal_start, sc->pos - sc->literal_start);
+}
+
+#ifndef TEMPLATE_HOST_TEST
+// FS_OP_CALL: build the offset table for the file open in job
+static void template_scan(struct fs_job *job) {
+    struct template_entry *entry = (struct template_entry*)job->call_arg;
+    struct template_scanner sc;
+    template_scan_begin(entry, &sc);
+
+    int err = (int)lfs_file_seek(&lfs, &job->file, 0, LFS_SEEK_SET);
+    uint8_t chunk[256];
+    while (err >= 0) {
+        lfs_ssize_t n = lfs_file_read(&lfs, &job->file, chunk, sizeof(chunk));
+        if (n <= 0) {
+            err = (int)n;
+            break;
+        }
+        template_scan_bytes(entry, &sc, chunk, (size_t)n);
+    }
+    if (err < 0) {
+        job->result = err;
+        return;
+    }
+    template_scan_end(entry, &sc);
+
+    // Second pass: pull short runs (typically the markup between two
+    // placeholders) into RAM so they cost no flash round trip per request
+    for (int i = 0; i < entry->segment_count; i++) {
+        struct template_segment *seg = &entry->segments[i];
+        if (seg->provider != TEMPLATE_LITERAL || seg->length > TEMPLATE_INLINE_MAX ||
+            entry->pool_used + seg->length > TEMPLATE_INLINE_POOL) {
+            continue;
+        }
+        if (lfs_file_seek(&lfs, &job->file, seg->offset, LFS_SEEK_SET) < 0 ||
+            lfs_file_read(&lfs, &job->file, entry->pool + entry->pool_used, seg->length) != (lfs_ssize_t)seg->length) {
+            continue;
+        }
+        seg->inline_at = (int16_t)entry->pool_used;
+        entry->pool_used += seg->length;
+    }
+    job->result = 0;
+}
+
+// ===== CACHE =====
+
+static struct template_entry* template_lookup(const char *path, uint32_t size, uint64_t stamp) {
+    for (int i = 0; i < TEMPLATE_CACHE_SLOTS; i++) {
+        struct template_entry *entry = &template_cache[i];
+        if (entry->state == TEMPLATE_READY && entry->etag_size == size &&
+            entry->etag_stamp == stamp && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Least recently used slot that nobody is reading or scanning
+static struct template_entry* template_evict() {
+    struct template_entry *victim = NULL;
+    for (int i = 0; i < TEMPLATE_CACHE_SLOTS; i++) {
+        struct template_entry *entry = &template_cache[i];
+        if (entry->users > 0) {
+            continue;
+        }
+        if (!victim || entry->state == TEMPLATE_EMPTY ||
+            (victim->state != TEMPLATE_EMPTY && entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+    return victim;
+}
+
+static void template_release(struct http_stream *stream) {
+    struct template_entry *entry = (struct template_entry*)stream->ctx;
+    if (entry->state == TEMPLATE_SCANNING) {
+        entry->state = TEMPLATE_EMPTY;
+    }
+    entry->users--;
+}
+
+// ===== RENDERING (lwIP context) =====
+
+// Provider values (an SSID, say) are text, never markup
+static const char* template_entity(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        case '\'': return "&#39;";
+        default: return NULL;
+    }
+}
+
+static size_t template_escaped_length(const char *value, int n) {
+    size_t length = 0;
+    for (int i = 0; i < n; i++) {
+        const char *entity = template_entity(value[i]);
+        length += entity ? strlen(entity) : 1;
+    }
+    return length;
+}
+
+static void template_escape(char *out, const char *value, int n) {
+    for (int i = 0; i < n; i++) {
+        const char *entity = template_entity(value[i]);
+        if (entity) {
+            size_t m = strlen(entity);
+            memcpy(out, entity, m);
+            out += m;
+        } else {
+            *out++ = value[i];
+        }
+    }
+}
+
+static int template_gen(struct http_stream *stream, char *buf, size_t cap) {
+    struct template_entry *entry = (struct template_entry*)stream->ctx;
+    struct fs_job *job = stream->job;
+    size_t len = 0;
+
+    switch (stream->phase) {
+        case TPL_SCAN:
+            job->call = template_scan;
+            job->call_arg = entry;
+            if (!http_stream_submit(stream, FS_OP_CALL)) {
+                stream->phase = TPL_DONE;
+                return HTTP_GEN_ERROR;
+            }
+            stream->phase = TPL_SCANNED;
+            return HTTP_GEN_WAIT;
+
+        case TPL_SCANNED:
+            if (job->result < 0) {
+                log_message("HTTP: Template scan failed");
+                stream->phase = TPL_DONE;
+                return HTTP_GEN_ERROR;
+            }
+            entry->state = TEMPLATE_READY;
+            stream->phase = TPL_PREPARE;
+            // fall through
+
+        case TPL_PREPARE:
+            stream->count = (uint32_t)-1;
+            if (entry->needs_fs_usage && http_stream_submit(stream, FS_OP_FS_STAT)) {
+                stream->phase = TPL_CONTEXT;
+                return HTTP_GEN_WAIT;
+            }
+            stream->phase = TPL_EMIT;
+            break;
+
+        case TPL_CONTEXT:
+            stream->count = (uint32_t)job->result;
+            stream->phase = TPL_EMIT;
+            break;
+
+        case TPL_READ:
+            // The worker read straight into buf
+            if (job->result <= 0) {
+                stream->phase = TPL_DONE;
+                return HTTP_GEN_ERROR;
+            }
+            len = job->result;
+            stream->limit += job->result;
+            if (stream->limit >= entry->segments[stream->cursor].length) {
+                stream->cursor++;
+                stream->limit = 0;
+            }
+            stream->phase = TPL_EMIT;
+            break;
+
+        case TPL_DONE:
+            return 0;
+    }
+
+    struct template_ctx ctx = { (int)stream->count };
+    while (stream->cursor < entry->segment_count && len < cap) {
+        const struct template_segment *seg = &entry->segments[stream->cursor];
+
+        if (seg->provider != TEMPLATE_LITERAL) {
+            char value[96];
+            int n = providers[seg->provider].fn(value, sizeof(value), &ctx);
+            if (n < 0) n = 0;
+            if (n > (int)sizeof(value) - 1) n = sizeof(value) - 1;
+            size_t escaped = template_escaped_length(value, n);
+            if (escaped > cap - len) {
+                break;
+            }
+            template_escape(buf + len, value, n);
+            len += escaped;
+            stream->cursor++;
+            continue;
+        }
+
+        uint32_t remaining = seg->length - stream->limit;
+        if (seg->inline_at >= 0) {
+            uint32_t n = remaining < cap - len ? remaining : (uint32_t)(cap - len);
+            memcpy(buf + len, entry->pool + seg->inline_at + stream->limit, n);
+            len += n;
+            stream->limit += n;
+        } else {
+            if (len > 0) {
+                // Send what we have; the next buffer is read from flash whole
+                break;
+            }
+            job->buf = (uint8_t*)buf;
+            job->len = remaining < cap ? remaining : (lfs_size_t)cap;
+            job->offset = seg->offset + stream->limit;
+            if (!http_stream_submit(stream, FS_OP_READ)) {
+                stream->phase = TPL_DONE;
+                return HTTP_GEN_ERROR;
+            }
+            stream->phase = TPL_READ;
+            return HTTP_GEN_WAIT;
+        }
+        if (stream->limit >= seg->length) {
+            stream->cursor++;
+            stream->limit = 0;
+        }
+    }
+
+    if (stream->cursor >= entry->segment_count) {
+        stream->phase = TPL_DONE;
+    }
+    return (int)len;
+}
+
+void template_open(struct http_stream *stream, lfs_soff_t size) {
+    const char *path = stream->job->path;
+    uint64_t stamp = stream->job->stamp;
+
+    struct template_entry *entry = template_lookup(path, (uint32_t)size, stamp);
+    if (entry) {
+        stream->phase = TPL_PREPARE;
+    } else {
+        // Always succeeds: there are at least as many slots as connections
+        entry = template_evict();
+        entry->state = TEMPLATE_SCANNING;
+        strcpy(entry->path, path);
+        entry->etag_size = (uint32_t)size;
+        entry->etag_stamp = stamp;
+        stream->phase = TPL_SCAN;
+    }
+    entry->users++;
+    entry->last_used = ++template_clock;
+
+    stream->gen = template_gen;
+    stream->content_type = "text/html";
+    stream->ctx = entry;
+    stream->release = template_release;
+}
+
+#else // TEMPLATE_HOST_TEST
+
+// ===== HOST TEST =====
+
+static int provide_test(char *buf, size_t cap, const struct template_ctx *ctx) {
+    return snprintf(buf, cap, "?");
+}
+
+// The scanned table written back out, placeholders as [name]
+static void render(const struct template_entry *entry, const char *text, char *out, size_t cap) {
+    size_t len = 0;
+    for (int i = 0; i < entry->segment_count; i++) {
+        const struct template_segment *seg = &entry->segments[i];
+        if (seg->provider == TEMPLATE_LITERAL) {
+            len += snprintf(out + len, cap - len, "%.*s", (int)seg->length, text + seg->offset);
+        } else {
+            len += snprintf(out + len, cap - len, "[%s]", providers[seg->provider].name);
+        }
+        if (len >= cap) {
+            len = cap - 1;
+        }
+    }
+    out[len] = '\0';
+}
+
+int main() {
+    // A name one character too long for TEMPLATE_NAME_MAX, whose
+    // truncation is a provider
+    char long_name[TEMPLATE_NAME_MAX + 1];
+    memset(long_name, 'x', TEMPLATE_NAME_MAX);
+    long_name[TEMPLATE_NAME_MAX] = '\0';
+    char long_text[TEMPLATE_NAME_MAX + 8];
+    snprintf(long_text, sizeof(long_text), "a{{%s}}b", long_name);
+    long_name[TEMPLATE_NAME_MAX - 1] = '\0';
+
+    template_register("ip", provide_test, false);
+    template_register("time", provide_test, false);
+    template_register(long_name, provide_test, false);
+
+    static const struct { const char *text; const char *expect; } cases[] = {
+        { "plain text", "plain text" },
+        { "{{ip}}", "[ip]" },
+        { "IP {{ip}} at {{time}}.", "IP [ip] at [time]." },
+        { "{{unknown}} {{ip}}", "{{unknown}} [ip]" },
+        { "{{{ip}}", "{[ip]" },                 // Literal brace before a tag
+        { "{{{{ip}}}}", "{{[ip]}}" },
+        { "{{ip} }}", "{{ip} }}" },
+        { "{{ip}{{time}}", "{{ip}[time]" },
+        { "{{i p}}", "{{i p}}" },
+        { "{{ip", "{{ip" },
+        { "x{", "x{" },
+        { NULL, NULL },                         // Over-long name: stays text
+    };
+    int count = sizeof(cases) / sizeof(cases[0]);
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        const char *text = cases[i].text ? cases[i].text : long_text;
+        const char *expect = cases[i].expect ? cases[i].expect : long_text;
+        size_t n = strlen(text);
+        // Whole, then a byte per call as if every byte were its own flash read
+        for (int bytewise = 0; bytewise < 2; bytewise++) {
+            static struct template_entry entry;
+            struct template_scanner sc;
+            template_scan_begin(&entry, &sc);
+            if (bytewise) {
+                for (size_t j = 0; j < n; j++) {
+                    template_scan_bytes(&entry, &sc, (const uint8_t*)text + j, 1);
+                }
+            } else {
+                template_scan_bytes(&entry, &sc, (const uint8_t*)text, n);
+            }
+            template_scan_end(&entry, &sc);
+
+            char out[256];
+            render(&entry, text, out, sizeof(out));
+            if (strcmp(out, expect) != 0) {
+                printf("FAIL %-24s %s: got \"%s\", want \"%s\"\n", text,
+                       bytewise ? "bytewise" : "whole", out, expect);
+                failed++;
+            }
+        }
+    }
+    printf("%d cases, %d failures\n", count, failed);
+    return failed ? 1 : 0;
+}
+#endif
@@ -0,0 +1,64 @@
+/**
+ * Server-side templates - live values in pages served from LittleFS
+ *
+ * Files ending in .shtml go through the template engine: every {{name}}
+ * is replaced by the output of the provider registered under that name
+ * (unknown names are sent unchanged).
+ *
+ * The first request for a template has the core 1 worker scan it once
+ * into an offset table of literal runs and placeholders, cached per path
+ * and ETag. Responses then just walk the table: short literals come from
+ * the RAM cache, longer runs are read from flash straight into the chunk
+ * buffer, and placeholders are evaluated as they are reached. Nothing is
+ * buffered beyond the chunk being sent.
+ *
+ * With TEMPLATE_HOST_TEST defined, http_template.cpp builds the scanner on
+ * its own and checks it against a table of cases, fed whole and a byte at
+ * a time:
+ *
+ *     c++ -O2 -DTEMPLATE_HOST_TEST http_template.cpp -o template_test && ./template_test
+ */
+
+#ifndef HTTP_TEMPLATE_H
+#define HTTP_TEMPLATE_H
+
+#ifdef TEMPLATE_HOST_TEST
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#else
+#include "http_server.h"
+#endif
+
+#define TEMPLATE_CACHE_SLOTS 4
+#define TEMPLATE_MAX_SEGMENTS 48
+#define TEMPLATE_MAX_PROVIDERS 16
+#define TEMPLATE_NAME_MAX 24
+#define TEMPLATE_INLINE_MAX 64      // Literal runs up to this size are cached in RAM
+#define TEMPLATE_INLINE_POOL 512    // RAM per cache slot for those runs
+
+// Values gathered once per response, before the page is sent
+struct template_ctx {
+    int fs_used_blocks;             // Only filled in if a provider asked for it
+};
+
+// Write the value into buf (snprintf semantics). Runs in lwIP context.
+typedef int (*template_provider_fn)(char *buf, size_t cap, const struct template_ctx *ctx);
+
+// Register the built-in providers (uptime, time, ip, ssid, storage_*)
+void template_init();
+
+// Add a provider. needs_fs_usage: ctx->fs_used_blocks must be valid,
+// which costs a filesystem walk on the worker per response.
+bool template_register(const char *name, template_provider_fn fn, bool needs_fs_usage);
+
+bool template_is_template(const char *path);
+
+#ifndef TEMPLATE_HOST_TEST
+// Set up stream (zeroed, with job/conn/chunked filled in) to render the
+// template already opened in stream->job, which is size bytes long
+void template_open(struct http_stream *stream, lfs_soff_t size);
+#endif
+
+#endif // HTTP_TEMPLATE_H
@@ -0,0 +1,200 @@
+/**
+ * Input subsystem - see input.h
+ */
+
+#include "input.h"
+#include "cpu_load.h"
+#include "pico/sync.h"
+#include "pico/util/queue.h"
+#include "hardware/sync.h"
+
+enum esc_state {
+    ESC_NONE,
+    ESC_GOT_ESC,        // ESC
+    ESC_CSI,            // ESC [ params...
+    ESC_SS3             // ESC O
+};
+
+static queue_t key_queue;
+static bool input_active = false;
+static critical_section_t decoder_lock;   // Decoder runs from the RX callback and input_poll()
+
+static enum esc_state esc_state = ESC_NONE;
+static int esc_param = 0;
+static uint64_t esc_time_us = 0;
+
+static void input_emit(uint16_t key, uint64_t now) {
+    struct key_event event = { key, now };
+    // Full queue: drop the newest key rather than block the RX path
+    queue_try_add(&key_queue, &event);
+}
+
+// Final byte of a CSI / SS3 sequence
+static void input_finish_sequence(char c, uint64_t now) {
+    uint16_t key = 0;
+    switch (c) {
+        case 'A': key = KEY_UP; break;
+        case 'B': key = KEY_DOWN; break;
+        case 'C': key = KEY_RIGHT; break;
+        case 'D': key = KEY_LEFT; break;
+        case 'H': key = KEY_HOME; break;
+        case 'F': key = KEY_END; break;
+        case '~':
+            // VT-style: ESC [ n ~
+            switch (esc_param) {
+                case 1: case 7: key = KEY_HOME; break;
+                case 2: key = KEY_INSERT; break;
+                case 3: key = KEY_DELETE; break;
+                case 4: case 8: key = KEY_END; break;
+                case 5: key = KEY_PAGE_UP; break;
+                case 6: key = KEY_PAGE_DOWN; break;
+            }
+            break;
+    }
+    if (key) {
+        input_emit(key, now);
+    }
+    esc_state = ESC_NONE;
+}
+
+// Feed one received byte through the decoder (decoder_lock held)
+static void input_decode(int c, uint64_t now) {
+    switch (esc_state) {
+        case ESC_NONE:
+            if (c == 0x1B) {
+                esc_state = ESC_GOT_ESC;
+                esc_time_us = now;
+            } else {
+                input_emit((uint16_t)c, now);
+            }
+            break;
+
+        case ESC_GOT_ESC:
+            if (c == '[') {
+                esc_state = ESC_CSI;
+                esc_param = 0;
+            } else if (c == 'O') {
+                esc_state = ESC_SS3;
+            } else {
+                // Not a sequence: the ESC was a key of its own
+                input_emit(KEY_ESC, esc_time_us);
+                esc_state = ESC_NONE;
+                input_decode(c, now);
+            }
+            break;
+
+        case ESC_CSI:
+            if (c >= '0' && c <= '9') {
+                esc_param = esc_param * 10 + (c - '0');
+            } else if (c == ';') {
+                esc_param = 0;  // Modifiers are ignored
+            } else if (c >= 0x40 && c <= 0x7E) {
+                input_finish_sequence((char)c, now);
+            } else {
+                esc_state = ESC_NONE;
+            }
+            break;
+
+        case ESC_SS3:
+            input_finish_sequence((char)c, now);
+            break;
+    }
+}
+
+// stdio RX callback - runs as soon as characters arrive
+static void input_chars_available(void *param) {
+    uint64_t now = time_us_64();
+    critical_section_enter_blocking(&decoder_lock);
+    int c;
+    while ((c = getchar_timeout_us(0)) >= 0) {
+        input_decode(c, now);
+    }
+    critical_section_exit(&decoder_lock);
+    // Wake game_loop_wait()
+    __sev();
+}
+
+void input_begin() {
+    static bool initialized = false;
+    if (!initialized) {
+        queue_init(&key_queue, sizeof(struct key_event), INPUT_QUEUE_SIZE);
+        critical_section_init(&decoder_lock);
+        initialized = true;
+    }
+
+    struct key_event stale;
+    while (queue_try_remove(&key_queue, &stale)) {
+    }
+    esc_state = ESC_NONE;
+    input_active = true;
+    stdio_set_chars_available_callback(input_chars_available, NULL);
+    // Pick up anything typed before the callback was installed
+    input_chars_available(NULL);
+}
+
+void input_end() {
+    if (!input_active) {
+        return;
+    }
+    stdio_set_chars_available_callback(NULL, NULL);
+    input_active = false;
+
+    struct key_event stale;
+    while (queue_try_remove(&key_queue, &stale)) {
+    }
+}
+
+bool input_poll(struct key_event *event) {
+    if (queue_try_remove(&key_queue, event)) {
+        return true;
+    }
+
+    // Lone ESC: nothing followed it in time
+    critical_section_enter_blocking(&decoder_lock);
+    if (esc_state == ESC_GOT_ESC && time_us_64() - esc_time_us >= INPUT_ESC_TIMEOUT_US) {
+        input_emit(KEY_ESC, esc_time_us);
+        esc_state = ESC_NONE;
+    }
+    critical_section_exit(&decoder_lock);
+    return queue_try_remove(&key_queue, event);
+}
+
+// ===== FIXED TIMESTEP LOOP =====
+
+static bool game_loop_tick(repeating_timer_t *timer) {
+    struct game_loop *loop = (struct game_loop*)timer->user_data;
+    loop->ticks_pending++;
+    __sev();
+    return true;
+}
+
+bool game_loop_start(struct game_loop *loop, uint32_t tick_us) {
+    loop->tick_us = tick_us;
+    loop->ticks_pending = 0;
+    // Negative delay: period measured start to start, so ticks don't drift
+    if (!add_repeating_timer_us(-(int64_t)tick_us, game_loop_tick, loop, &loop->timer)) {
+        return false;
+    }
+    input_begin();
+    return true;
+}
+
+void game_loop_stop(struct game_loop *loop) {
+    cancel_repeating_timer(&loop->timer);
+    input_end();
+}
+
+uint32_t game_loop_wait(struct game_loop *loop) {
+    // A pending lone ESC is flushed by input_poll() after the next tick
+    enum cpu_activity previous = cpu_enter(CPU_IDLE);
+    while (loop->ticks_pending == 0 && queue_is_empty(&key_queue)) {
+        __wfe();
+    }
+    cpu_enter(previous);
+
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t ticks = loop->ticks_pending;
+    loop->ticks_pending = 0;
+    restore_interrupts(save);
+    return ticks;
+}
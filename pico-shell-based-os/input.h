@@ -0,0 +1,71 @@
+/**
+ * Input subsystem - timestamped key events for full-screen apps
+ *
+ * While active, characters are pulled from stdio as soon as they arrive
+ * (stdio chars-available callback), run through an ANSI escape decoder and
+ * queued as key events stamped with the arrival time, so nothing is lost
+ * while the app is busy drawing. Arrow keys and friends arrive as single
+ * KEY_* codes instead of three separate characters.
+ *
+ * The game loop half runs a fixed timestep off a repeating hardware alarm:
+ * game_loop_wait() sleeps until the next tick *or* the next key, so input
+ * is handled as it arrives rather than on the next frame.
+ *
+ * Only one user at a time (the foreground app); the shell keeps using
+ * plain stdio while the input layer is inactive.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "pico_os.h"
+
+#define INPUT_QUEUE_SIZE 32
+
+// A lone ESC is only reported once no sequence has followed for this long
+#define INPUT_ESC_TIMEOUT_US 30000
+
+// Key codes: plain characters use their byte value (0x00-0xFF)
+enum {
+    KEY_UP = 0x100,
+    KEY_DOWN,
+    KEY_RIGHT,
+    KEY_LEFT,
+    KEY_HOME,
+    KEY_END,
+    KEY_INSERT,
+    KEY_DELETE,
+    KEY_PAGE_UP,
+    KEY_PAGE_DOWN,
+    KEY_ESC
+};
+
+struct key_event {
+    uint16_t key;
+    uint64_t time_us;       // When the (last byte of the) key arrived
+};
+
+// Start/stop capturing stdio input. input_end() discards unread events.
+void input_begin();
+void input_end();
+
+// Take the next event, false if none is queued
+bool input_poll(struct key_event *event);
+
+// ===== FIXED TIMESTEP LOOP =====
+
+struct game_loop {
+    uint32_t tick_us;
+    volatile uint32_t ticks_pending;
+    repeating_timer_t timer;
+};
+
+// Start ticking every tick_us (also starts input capture)
+bool game_loop_start(struct game_loop *loop, uint32_t tick_us);
+void game_loop_stop(struct game_loop *loop);
+
+// Sleep until at least one tick is due or a key event is queued.
+// Returns the number of ticks to simulate (0 if woken by input only).
+uint32_t game_loop_wait(struct game_loop *loop);
+
+#endif // INPUT_H
@@ -0,0 +1,169 @@
+/**
+ * LED pattern engine - see led_pattern.h
+ */
+
+#include "led_pattern.h"
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+
+static async_context_t *context = NULL;
+static struct led_pattern pattern;
+static uint8_t step;                // Current step; even steps are on
+static uint16_t plays;              // Completed passes through the steps
+static bool playing = false;
+static uint64_t next_us;            // When the current hold ends
+
+static bool level_known = false;    // Unknown until the first write
+static bool level = false;
+
+static struct {
+    uint32_t writes;
+    uint32_t coalesced;
+    uint32_t second;                // Second this_second counts
+    uint32_t this_second;
+    uint32_t last_second;           // Writes in the second before it
+} stats;
+
+static async_at_time_worker_t worker;   // do_work set by led_pattern_init()
+
+// Driver context (lock held) from here on
+
+static void led_write(bool on) {
+    if (level_known && level == on) {
+        stats.coalesced++;
+        return;
+    }
+    cyw43_gpio_set(&cyw43_state, CYW43_WL_GPIO_LED_PIN, on);
+    level = on;
+    level_known = true;
+
+    uint32_t second = (uint32_t)(time_us_64() / 1000000);
+    if (second != stats.second) {
+        stats.last_second = second == stats.second + 1 ? stats.this_second : 0;
+        stats.second = second;
+        stats.this_second = 0;
+    }
+    stats.this_second++;
+    stats.writes++;
+}
+
+static bool step_on() {
+    return playing && step % 2 == 0;
+}
+
+// Zero-length steps are skipped over; play() made sure one is not
+static void next_step() {
+    do {
+        if (++step == pattern.step_count) {
+            step = 0;
+            if (pattern.repeat && ++plays == pattern.repeat) {
+                playing = false;
+            }
+        }
+    } while (playing && pattern.steps_ms[step] == 0);
+}
+
+// Set the level of the current step, then sleep until the level changes
+static void led_advance() {
+    bool on = step_on();
+    led_write(on);
+    if (!playing) {
+        return;
+    }
+
+    // Merge following steps of the same level into one hold; a pattern
+    // that never changes level wakes once a pass to count its plays
+    uint32_t hold_ms = 0;
+    int merged = 0;
+    do {
+        hold_ms += pattern.steps_ms[step];
+        next_step();
+    } while (playing && step_on() == on && ++merged < pattern.step_count);
+
+    // Fell a whole hold behind: resume from now rather than racing through
+    // the missed steps, which would only cost more bus writes
+    uint64_t now = time_us_64();
+    next_us += (uint64_t)hold_ms * 1000;
+    if (next_us < now) {
+        next_us = now;
+    }
+    async_context_add_at_time_worker_at(context, &worker, from_us_since_boot(next_us));
+}
+
+static void led_worker(async_context_t *context, async_at_time_worker_t *worker) {
+    led_advance();
+}
+
+// Public API - any context
+
+bool led_pattern_init() {
+    worker.do_work = led_worker;
+    context = cyw43_arch_async_context();
+    return context != NULL;
+}
+
+bool led_pattern_play(const struct led_pattern *p) {
+    if (!context || p->step_count == 0 || p->step_count > LED_PATTERN_MAX_STEPS) {
+        return false;
+    }
+    uint32_t total_ms = 0;
+    for (int i = 0; i < p->step_count; i++) {
+        total_ms += p->steps_ms[i];
+    }
+    if (total_ms == 0) {
+        return false;
+    }
+
+    async_context_acquire_lock_blocking(context);
+    async_context_remove_at_time_worker(context, &worker);
+    pattern = *p;
+    for (int i = 0; i < pattern.step_count; i++) {
+        if (pattern.steps_ms[i] && pattern.steps_ms[i] < LED_PATTERN_MIN_MS) {
+            pattern.steps_ms[i] = LED_PATTERN_MIN_MS;
+        }
+    }
+    step = 0;
+    plays = 0;
+    playing = true;
+    if (pattern.steps_ms[0] == 0) {
+        next_step();                    // Some later step is not empty
+    }
+    next_us = time_us_64();
+    led_advance();
+    async_context_release_lock(context);
+    return true;
+}
+
+bool led_pattern_blink(uint16_t times, uint16_t on_ms, uint16_t off_ms) {
+    struct led_pattern blink = {};
+    blink.steps_ms[0] = on_ms;
+    blink.steps_ms[1] = off_ms;
+    blink.step_count = 2;
+    blink.repeat = times;
+    return led_pattern_play(&blink);
+}
+
+void led_pattern_set(bool on) {
+    if (!context) {
+        return;
+    }
+    async_context_acquire_lock_blocking(context);
+    async_context_remove_at_time_worker(context, &worker);
+    playing = false;
+    led_write(on);
+    async_context_release_lock(context);
+}
+
+void led_pattern_get_stats(struct led_pattern_stats *out) {
+    uint32_t second = (uint32_t)(time_us_64() / 1000000);
+    out->writes = stats.writes;
+    out->coalesced = stats.coalesced;
+    if (second == stats.second) {
+        out->writes_per_s = stats.last_second;
+    } else if (second == stats.second + 1) {
+        out->writes_per_s = stats.this_second;
+    } else {
+        out->writes_per_s = 0;
+    }
+    out->playing = playing;
+}
@@ -0,0 +1,63 @@
+/**
+ * LED pattern engine - the Pico W LED with as few CYW43 bus writes as possible
+ *
+ * The onboard LED hangs off the WiFi chip: every change is a GPIO ioctl
+ * over the same SPI bus that carries the network traffic, and the caller
+ * waits for the chip to answer it. Blinking from a loop that calls
+ * cyw43_arch_gpio_put() also takes the driver lock each time and, with
+ * sleep_ms() between writes, blocks whoever is blinking.
+ *
+ * A pattern is a list of alternating on/off durations played a number of
+ * times. One at-time worker on the driver's own async context plays it,
+ * so writes happen in lwIP context between packets rather than contending
+ * for the lock, and the caller never waits. The worker only wakes when the
+ * level actually changes: steps of the same level (zero-length gaps, an
+ * odd step count wrapping round) are merged, and a write that would not
+ * change the LED is dropped and counted instead. Steps shorter than
+ * LED_PATTERN_MIN_MS are stretched to it, which caps the bus writes at
+ * 1000 / LED_PATTERN_MIN_MS a second whatever a caller asks for.
+ *
+ * Deadlines advance from the previous one, so a pattern keeps its rhythm
+ * when network work delays a step; one delayed past a whole step carries
+ * on from there instead of racing through the missed ones. Safe to call
+ * from the main loop and from lwIP callbacks.
+ */
+
+#ifndef LED_PATTERN_H
+#define LED_PATTERN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LED_PATTERN_MAX_STEPS 8
+#define LED_PATTERN_MIN_MS 20
+
+struct led_pattern {
+    uint16_t steps_ms[LED_PATTERN_MAX_STEPS];   // On, off, on, off, ...
+    uint8_t step_count;
+    uint16_t repeat;                            // Plays, 0 = until replaced
+};
+
+struct led_pattern_stats {
+    uint32_t writes;            // Bus transactions since boot
+    uint32_t coalesced;         // Writes dropped because the LED already had that level
+    uint32_t writes_per_s;      // Bus transactions in the last whole second
+    bool playing;
+};
+
+// After cyw43_arch_init(); false without the driver
+bool led_pattern_init();
+
+// Replace whatever is playing; the pattern is copied. The LED is off once
+// a finite pattern ends. False if there is nothing to play.
+bool led_pattern_play(const struct led_pattern *pattern);
+
+// times x (on_ms, off_ms); times 0 blinks until replaced
+bool led_pattern_blink(uint16_t times, uint16_t on_ms, uint16_t off_ms);
+
+// Stop any pattern and hold the LED at on
+void led_pattern_set(bool on);
+
+void led_pattern_get_stats(struct led_pattern_stats *stats);
+
+#endif // LED_PATTERN_H
@@ -4,6 +4,22 @@
 // Common settings used in most of the pico_w examples
 // (see https://www.nongnu.org/lwip/2_1_x/group__lwip__opts.html for details)
 
+// FreeRTOS build: lwIP runs in its own tcpip thread, and the driver task
+// delivers packets under the core lock instead of queueing them to it
+#if PICO_OS_FREERTOS
+#define NO_SYS                      0
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 1
+#define LWIP_TIMEVAL_PRIVATE        0
+#define TCPIP_THREAD_STACKSIZE      1024    // Words
+#define TCPIP_THREAD_PRIO           4       // Above the shell and fs service
+#define TCPIP_MBOX_SIZE             16
+#define DEFAULT_THREAD_STACKSIZE    1024
+#define DEFAULT_RAW_RECVMBOX_SIZE   8
+#define DEFAULT_UDP_RECVMBOX_SIZE   8
+#define DEFAULT_TCP_RECVMBOX_SIZE   8
+#define DEFAULT_ACCEPTMBOX_SIZE     8
+#endif
+
 // allow override in some examples
 #ifndef NO_SYS
 #define NO_SYS                      1
@@ -24,6 +40,7 @@
 #define MEMP_NUM_TCP_PCB            16
 #define MEMP_NUM_SYS_TIMEOUT        32
 #define MEMP_NUM_ARP_QUEUE          10
+#define MEMP_NUM_UDP_PCB            8   // DHCP, DNS, NTP, netperf, UDP port scan
 #define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
 #define LWIP_ETHERNET               1
@@ -42,7 +59,12 @@
 #define MEMP_STATS                  0
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
-#define LWIP_CHKSUM_ALGORITHM       3
+// Internet checksum from chksum.cpp (ADCS loop on the M33); TCP data is
+// checksummed while tcp_write() copies it
+#define LWIP_CHKSUM                 pico_chksum
+#define LWIP_CHKSUM_COPY(dst, src, len) pico_chksum_copy(dst, src, len)
+#define LWIP_CHECKSUM_ON_COPY       1
+#include "chksum.h"
 #define LWIP_DHCP                   1
 #define LWIP_IPV4                   1
 #define LWIP_TCP                    1
@@ -0,0 +1,1113 @@
+/**
+ * Network throughput tester - see netperf.h
+ *
+ * The protocol helpers at the top are shared; the device implementation
+ * (lwIP raw API, driven from its callbacks) and the host peer (POSIX
+ * sockets, NETPERF_HOST_PEER) follow.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "netperf.h"
+
+void netperf_udp_rx_reset(struct netperf_udp_rx *rx) {
+    memset(rx, 0, sizeof(*rx));
+}
+
+void netperf_udp_rx_account(struct netperf_udp_rx *rx, uint32_t seq, uint32_t send_us,
+                            uint64_t now_us, uint32_t len) {
+    if (rx->packets == 0) {
+        rx->first_us = now_us;
+    }
+    rx->packets++;
+    rx->bytes += len;
+    rx->last_us = now_us;
+
+    if (seq >= rx->expected) {
+        rx->lost += seq - rx->expected;
+        rx->expected = seq + 1;
+    } else {
+        // Counted as lost when the gap opened; it arrived after all
+        rx->reordered++;
+        if (rx->lost > 0) {
+            rx->lost--;
+        }
+    }
+
+    // RFC 3550: J += (|D| - J) / 16. The clocks differ by a constant,
+    // which cancels out in the transit time difference.
+    int32_t transit = (int32_t)((uint32_t)now_us - send_us);
+    if (rx->packets > 1) {
+        int32_t d = transit - rx->last_transit_us;
+        // In sixteenths: 16J' = 16J + |D| - 16J/16
+        rx->jitter_us16 += (uint32_t)(d < 0 ? -d : d) - rx->jitter_us16 / 16;
+    }
+    rx->last_transit_us = transit;
+}
+
+void netperf_udp_report_pack(const struct netperf_udp_rx *rx, uint8_t *out) {
+    netperf_put32(out, NETPERF_MAGIC);
+    netperf_put32(out + 4, NETPERF_FLAG_REPORT);
+    netperf_put32(out + 8, rx->packets);
+    netperf_put32(out + 12, rx->lost);
+    netperf_put32(out + 16, rx->reordered);
+    netperf_put32(out + 20, (uint32_t)(rx->bytes >> 32));
+    netperf_put32(out + 24, (uint32_t)rx->bytes);
+    netperf_put32(out + 28, rx->jitter_us16 >> 4);
+    netperf_put32(out + 32, (uint32_t)(rx->last_us - rx->first_us));
+}
+
+void netperf_format_rate(char *out, int len, uint64_t bytes, uint64_t us) {
+    // Bits per microsecond is Mbit/s
+    uint64_t centi = us ? bytes * 800 / us : 0;
+    snprintf(out, len, "%lu.%02lu Mbit/s", (unsigned long)(centi / 100), (unsigned long)(centi % 100));
+}
+
+void netperf_udp_report_print(const uint8_t *report) {
+    uint32_t packets = netperf_get32(report + 8);
+    uint32_t lost = netperf_get32(report + 12);
+    uint32_t reordered = netperf_get32(report + 16);
+    uint64_t bytes = (uint64_t)netperf_get32(report + 20) << 32 | netperf_get32(report + 24);
+    uint32_t jitter_us = netperf_get32(report + 28);
+    uint32_t duration_us = netperf_get32(report + 32);
+    char rate[32];
+    netperf_format_rate(rate, sizeof(rate), bytes, duration_us);
+    uint32_t expected = packets + lost;
+    printf("Receiver: %lu datagrams, %lu.%02lu MBytes in %lu.%03lu s = %s\n",
+           (unsigned long)packets, (unsigned long)(bytes / 1000000), (unsigned long)(bytes % 1000000 / 10000),
+           (unsigned long)(duration_us / 1000000), (unsigned long)(duration_us % 1000000 / 1000), rate);
+    printf("          lost %lu/%lu (%lu.%02lu%%), %lu reordered, jitter %lu.%03lu ms\n",
+           (unsigned long)lost, (unsigned long)expected,
+           (unsigned long)(expected ? (uint64_t)lost * 100 / expected : 0),
+           (unsigned long)(expected ? (uint64_t)lost * 10000 / expected % 100 : 0),
+           (unsigned long)reordered, (unsigned long)(jitter_us / 1000), (unsigned long)(jitter_us % 1000));
+}
+
+#ifndef NETPERF_HOST_PEER
+
+// ===== DEVICE =====
+
+#include "pico_os.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/timeouts.h"
+
+#define NP_CHECK_US 10000               // Shell: key, deadline and report checks
+#define NP_CALIBRATE_US 10000
+#define NP_UDP_TICK_MS 1
+#define NP_UDP_BURST 8                  // Datagrams per tick at most
+#define NP_FIN_INTERVAL_US 100000
+#define NP_QUIET_US 3000000             // UDP server: sender gone without FIN
+#define NP_GRACE_US 5000000             // Client: past the duration, give up
+
+enum np_state {
+    NP_IDLE,
+    NP_LISTENING,           // Server between tests
+    NP_CONNECTING,
+    NP_WAIT_HELLO,
+    NP_RUNNING,
+    NP_FINISHING,           // UDP client: sending FIN, waiting for the report
+    NP_DONE                 // Test over, shell prints the summary
+};
+
+static struct {
+    struct netperf_options opt;         // Server: hello fills in the test
+    volatile enum np_state state;
+    bool sending;                       // This end generates the data
+    struct tcp_pcb *listen_pcb;
+    struct tcp_pcb *pcb;
+    struct udp_pcb *udp;
+    ip_addr_t peer;
+    u16_t peer_port;
+    uint8_t hello[NETPERF_HELLO_SIZE];
+    int hello_len;
+    uint32_t hello_unacked;             // Client: hello bytes not to count
+    uint64_t start_us;
+    uint64_t deadline_us;
+    uint64_t end_us;
+    uint64_t bytes;
+    uint32_t retransmits;
+    uint8_t last_nrtx;
+    bool fast_recovery;
+    uint32_t send_errors;
+    const char *error;
+
+    // UDP
+    struct netperf_udp_rx rx;
+    uint32_t seq;
+    uint64_t credit;                    // Send credit in 1/1000 byte
+    uint64_t last_tick_us;
+    uint64_t next_fin_us;
+    int fin_tries;
+    bool have_report;
+    uint8_t report[NETPERF_REPORT_SIZE];
+} np;
+
+static uint8_t np_pattern[NETPERF_MAX_TCP_LEN];
+
+void netperf_options_default(struct netperf_options *options) {
+    memset(options, 0, sizeof(*options));
+    options->port = NETPERF_PORT;
+    options->seconds = NETPERF_DEFAULT_SECONDS;
+    options->len = NETPERF_DEFAULT_TCP_LEN;
+    options->rate_kbps = NETPERF_DEFAULT_UDP_KBPS;
+}
+
+// ----- TCP (lwIP context) -----
+
+static void np_tcp_detach(struct tcp_pcb *pcb) {
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+}
+
+// lwIP keeps no retransmit total without MIB2 statistics, so sample the
+// PCB from every callback: nrtx counts timeouts of the oldest segment and
+// clears on the next ACK, and each entry into fast recovery is one fast
+// retransmit
+static void np_sample_rexmit(struct tcp_pcb *pcb) {
+    if (pcb->nrtx > np.last_nrtx) {
+        np.retransmits += pcb->nrtx - np.last_nrtx;
+    }
+    np.last_nrtx = pcb->nrtx;
+    bool fast_recovery = (pcb->flags & TF_INFR) != 0;
+    if (fast_recovery && !np.fast_recovery) {
+        np.retransmits++;
+    }
+    np.fast_recovery = fast_recovery;
+}
+
+// Returns ERR_ABRT if the PCB had to be aborted: an lwIP callback for it
+// must then return ERR_ABRT too
+static err_t np_finish(const char *error) {
+    if (np.state == NP_DONE || np.state == NP_IDLE || np.state == NP_LISTENING) {
+        return ERR_OK;
+    }
+    np.end_us = time_us_64();
+    if (!np.start_us) {
+        np.start_us = np.end_us;
+    }
+    np.error = error;
+    err_t result = ERR_OK;
+    if (np.pcb) {
+        np_sample_rexmit(np.pcb);
+        np_tcp_detach(np.pcb);
+        if (tcp_close(np.pcb) != ERR_OK) {
+            tcp_abort(np.pcb);
+            result = ERR_ABRT;
+        }
+        np.pcb = NULL;
+    }
+    np.state = NP_DONE;
+    return result;
+}
+
+// Queue as much as the send buffer takes, straight from the pattern.
+// Returns ERR_ABRT if finishing the test aborted the PCB.
+static err_t np_tcp_fill(struct tcp_pcb *pcb) {
+    if (np.state != NP_RUNNING || !np.sending) {
+        return ERR_OK;
+    }
+    if (time_us_64() >= np.deadline_us) {
+        return np_finish(NULL);
+    }
+    bool queued = false;
+    while (true) {
+        u16_t room = tcp_sndbuf(pcb);
+        u16_t n = np.opt.len < room ? (u16_t)np.opt.len : room;
+        // Wait for room for a full write, or at least a full segment
+        if (n == 0 || (n < np.opt.len && n < TCP_MSS)) {
+            break;
+        }
+        if (tcp_write(pcb, np_pattern, n, 0) != ERR_OK) {
+            break;
+        }
+        queued = true;
+    }
+    if (queued) {
+        tcp_output(pcb);
+    }
+    return ERR_OK;
+}
+
+static err_t np_tcp_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    uint32_t skip = len < np.hello_unacked ? len : np.hello_unacked;
+    np.hello_unacked -= skip;
+    np.bytes += len - skip;
+    np_sample_rexmit(pcb);
+    return np_tcp_fill(pcb);
+}
+
+static err_t np_tcp_poll(void *arg, struct tcp_pcb *pcb) {
+    np_sample_rexmit(pcb);
+    return np_tcp_fill(pcb);
+}
+
+static void np_tcp_error(void *arg, err_t err) {
+    np.pcb = NULL;          // Already freed by lwIP
+    np_finish(np.state == NP_CONNECTING ? "connection refused" : "connection reset");
+}
+
+// Server: the hello names the test
+static bool np_tcp_hello(struct tcp_pcb *pcb) {
+    uint32_t flags = netperf_get32(np.hello + 4);
+    uint32_t seconds = netperf_get32(np.hello + 8);
+    uint32_t len = netperf_get32(np.hello + 12);
+    if (netperf_get32(np.hello) != NETPERF_MAGIC || seconds == 0 || seconds > NETPERF_MAX_SECONDS ||
+        len == 0) {
+        return false;
+    }
+    np.opt.reverse = (flags & NETPERF_FLAG_REVERSE) != 0;
+    np.opt.seconds = seconds;
+    np.opt.len = len > NETPERF_MAX_TCP_LEN ? NETPERF_MAX_TCP_LEN : len;
+    np.sending = np.opt.reverse;
+    np.start_us = time_us_64();
+    np.deadline_us = np.start_us + (uint64_t)seconds * 1000000;
+    np.state = NP_RUNNING;
+    return true;        // The caller starts sending, if this end sends
+}
+
+static err_t np_tcp_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    if (!p) {
+        return np_finish(NULL);     // Peer closed: the test is over
+    }
+    u16_t len = p->tot_len;
+    u16_t offset = 0;
+    if (np.state == NP_WAIT_HELLO) {
+        offset = (u16_t)(NETPERF_HELLO_SIZE - np.hello_len);
+        if (offset > len) {
+            offset = len;
+        }
+        pbuf_copy_partial(p, np.hello + np.hello_len, offset, 0);
+        np.hello_len += offset;
+        if (np.hello_len == NETPERF_HELLO_SIZE && !np_tcp_hello(pcb)) {
+            tcp_recved(pcb, len);
+            pbuf_free(p);
+            return np_finish("bad hello");
+        }
+    }
+    // Sink: count and free, the payload is never touched
+    if (np.state == NP_RUNNING) {
+        np.bytes += len - offset;
+    }
+    tcp_recved(pcb, len);
+    pbuf_free(p);
+    return np_tcp_fill(pcb);
+}
+
+static void np_tcp_attach(struct tcp_pcb *pcb) {
+    np.pcb = pcb;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, np_tcp_recv);
+    tcp_sent(pcb, np_tcp_sent);
+    tcp_err(pcb, np_tcp_error);
+    tcp_poll(pcb, np_tcp_poll, 2);      // Every second
+    tcp_nagle_disable(pcb);
+}
+
+static err_t np_tcp_connected(void *arg, struct tcp_pcb *pcb, err_t err) {
+    uint8_t hello[NETPERF_HELLO_SIZE];
+    netperf_put32(hello, NETPERF_MAGIC);
+    netperf_put32(hello + 4, np.opt.reverse ? NETPERF_FLAG_REVERSE : 0);
+    netperf_put32(hello + 8, np.opt.seconds);
+    netperf_put32(hello + 12, np.opt.len);
+    if (tcp_write(pcb, hello, sizeof(hello), TCP_WRITE_FLAG_COPY) != ERR_OK) {
+        return np_finish("send failed");
+    }
+    np.hello_unacked = sizeof(hello);
+    np.sending = !np.opt.reverse;
+    np.start_us = time_us_64();
+    np.deadline_us = np.start_us + (uint64_t)np.opt.seconds * 1000000;
+    np.state = NP_RUNNING;
+    if (np_tcp_fill(pcb) == ERR_ABRT) {
+        return ERR_ABRT;
+    }
+    tcp_output(pcb);
+    return ERR_OK;
+}
+
+static err_t np_tcp_accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    if (err != ERR_OK || !pcb) {
+        return ERR_VAL;
+    }
+    if (np.state != NP_LISTENING) {
+        tcp_abort(pcb);     // One test at a time
+        return ERR_ABRT;
+    }
+    np.hello_len = 0;
+    np.bytes = 0;
+    np.retransmits = 0;
+    np.last_nrtx = 0;
+    np.error = NULL;
+    np.fast_recovery = false;
+    np.start_us = 0;
+    ip_addr_copy(np.peer, pcb->remote_ip);
+    np.state = NP_WAIT_HELLO;
+    np_tcp_attach(pcb);
+    return ERR_OK;
+}
+
+// ----- UDP (lwIP context) -----
+
+static bool np_udp_send(uint32_t flags) {
+    struct pbuf *head = pbuf_alloc(PBUF_TRANSPORT, NETPERF_UDP_HEADER, PBUF_RAM);
+    if (!head) {
+        return false;
+    }
+    uint8_t *header = (uint8_t*)head->payload;
+    netperf_put32(header, NETPERF_MAGIC);
+    netperf_put32(header + 4, np.seq);
+    netperf_put32(header + 8, (uint32_t)time_us_64());
+    netperf_put32(header + 12, flags);
+    if (!(flags & NETPERF_FLAG_FIN) && np.opt.len > NETPERF_UDP_HEADER) {
+        // Body by reference to the pattern: no copy on our side
+        struct pbuf *body = pbuf_alloc(PBUF_RAW, (u16_t)(np.opt.len - NETPERF_UDP_HEADER), PBUF_REF);
+        if (!body) {
+            pbuf_free(head);
+            return false;
+        }
+        body->payload = np_pattern;
+        pbuf_cat(head, body);
+    }
+    err_t err = udp_sendto(np.udp, head, &np.peer, np.opt.port);
+    pbuf_free(head);
+    if (err != ERR_OK) {
+        return false;
+    }
+    if (!(flags & NETPERF_FLAG_FIN)) {
+        np.seq++;
+        np.bytes += np.opt.len;
+    }
+    return true;
+}
+
+static void np_udp_tick(void *arg) {
+    uint64_t now = time_us_64();
+    if (np.state == NP_RUNNING) {
+        if (now >= np.deadline_us) {
+            np.end_us = now;
+            np.state = NP_FINISHING;
+            np.next_fin_us = now;
+        } else {
+            // Token bucket: rate_kbps bits per ms is rate_kbps/8 bytes per
+            // ms, i.e. rate_kbps/8 thousandths of a byte per us
+            uint64_t cost = (uint64_t)np.opt.len * 1000;
+            if (np.opt.rate_kbps) {
+                np.credit += (now - np.last_tick_us) * np.opt.rate_kbps / 8;
+                if (np.credit > cost * NP_UDP_BURST) {
+                    np.credit = cost * NP_UDP_BURST;
+                }
+            }
+            for (int i = 0; i < NP_UDP_BURST && (!np.opt.rate_kbps || np.credit >= cost); i++) {
+                if (!np_udp_send(0)) {
+                    np.send_errors++;
+                    break;      // Out of buffers, try next tick
+                }
+                if (np.opt.rate_kbps) {
+                    np.credit -= cost;
+                }
+            }
+        }
+        np.last_tick_us = now;
+    }
+    if (np.state == NP_FINISHING) {
+        if (np.have_report || np.fin_tries >= NETPERF_FIN_TRIES) {
+            np.error = np.have_report ? NULL : "no report from the server";
+            np.state = NP_DONE;
+            return;
+        }
+        if (now >= np.next_fin_us) {
+            np_udp_send(NETPERF_FLAG_FIN);
+            np.fin_tries++;
+            np.next_fin_us = now + NP_FIN_INTERVAL_US;
+        }
+    }
+    sys_timeout(NP_UDP_TICK_MS, np_udp_tick, NULL);
+}
+
+static void np_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    uint64_t now = time_us_64();
+    uint8_t header[NETPERF_UDP_HEADER];
+    u16_t len = p->tot_len;
+    if (pbuf_copy_partial(p, header, sizeof(header), 0) != sizeof(header) ||
+        netperf_get32(header) != NETPERF_MAGIC) {
+        pbuf_free(p);
+        return;
+    }
+    uint32_t flags = netperf_get32(header + 12);
+
+    if (!np.opt.server) {
+        if ((flags & NETPERF_FLAG_REPORT) && len >= NETPERF_REPORT_SIZE) {
+            pbuf_copy_partial(p, np.report, NETPERF_REPORT_SIZE, 0);
+            np.have_report = true;
+        }
+        pbuf_free(p);
+        return;
+    }
+    pbuf_free(p);
+
+    if (flags & NETPERF_FLAG_FIN) {
+        if (np.state == NP_RUNNING && ip_addr_cmp(addr, &np.peer)) {
+            netperf_udp_report_pack(&np.rx, np.report);
+            np.have_report = true;
+            np.start_us = np.rx.first_us;
+            np.end_us = np.rx.last_us;
+            np.state = NP_DONE;
+        }
+        // Repeated FINs get the last report again
+        if (np.have_report) {
+            struct pbuf *reply = pbuf_alloc(PBUF_TRANSPORT, NETPERF_REPORT_SIZE, PBUF_RAM);
+            if (reply) {
+                memcpy(reply->payload, np.report, NETPERF_REPORT_SIZE);
+                udp_sendto(pcb, reply, addr, port);
+                pbuf_free(reply);
+            }
+        }
+        return;
+    }
+
+    if (np.state == NP_LISTENING) {
+        netperf_udp_rx_reset(&np.rx);
+        ip_addr_copy(np.peer, *addr);
+        np.peer_port = port;
+        np.have_report = false;
+        np.error = NULL;
+        np.start_us = now;
+        np.state = NP_RUNNING;
+    }
+    if (np.state == NP_RUNNING && ip_addr_cmp(addr, &np.peer) && port == np.peer_port) {
+        netperf_udp_rx_account(&np.rx, netperf_get32(header + 4), netperf_get32(header + 8), now, len);
+        np.bytes = np.rx.bytes;
+    }
+}
+
+// ----- SHELL -----
+
+// Spin until until_us; the count is what core 0 had left over
+static uint32_t np_idle_until(uint64_t until_us) {
+    uint32_t spins = 0;
+    while (time_us_64() < until_us) {
+        spins++;
+    }
+    return spins;
+}
+
+static uint32_t np_calibrate() {
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t spins = np_idle_until(time_us_64() + NP_CALIBRATE_US);
+    restore_interrupts(irq);
+    return spins;
+}
+
+static uint32_t np_load_percent(uint64_t idle_spins, uint64_t us, uint32_t calib_spins) {
+    uint64_t capacity = (uint64_t)calib_spins * us / NP_CALIBRATE_US;
+    if (capacity == 0 || idle_spins >= capacity) {
+        return 0;
+    }
+    return (uint32_t)(100 - idle_spins * 100 / capacity);
+}
+
+static void np_cleanup() {
+    cyw43_arch_lwip_begin();
+    sys_untimeout(np_udp_tick, NULL);
+    if (np.pcb) {
+        np_tcp_detach(np.pcb);
+        tcp_abort(np.pcb);
+        np.pcb = NULL;
+    }
+    if (np.listen_pcb) {
+        tcp_close(np.listen_pcb);
+        np.listen_pcb = NULL;
+    }
+    if (np.udp) {
+        udp_remove(np.udp);
+        np.udp = NULL;
+    }
+    np.state = NP_IDLE;
+    cyw43_arch_lwip_end();
+}
+
+static bool np_setup(const ip_addr_t *peer) {
+    bool ok = true;
+    cyw43_arch_lwip_begin();
+    if (np.opt.udp) {
+        np.udp = udp_new();
+        ok = np.udp && udp_bind(np.udp, IP_ADDR_ANY, np.opt.server ? np.opt.port : 0) == ERR_OK;
+        if (ok) {
+            udp_recv(np.udp, np_udp_recv, NULL);
+            if (np.opt.server) {
+                np.state = NP_LISTENING;
+            } else {
+                ip_addr_copy(np.peer, *peer);
+                np.start_us = time_us_64();
+                np.last_tick_us = np.start_us;
+                np.deadline_us = np.start_us + (uint64_t)np.opt.seconds * 1000000;
+                np.state = NP_RUNNING;
+                sys_timeout(NP_UDP_TICK_MS, np_udp_tick, NULL);
+            }
+        }
+    } else if (np.opt.server) {
+        struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+        ok = pcb && tcp_bind(pcb, IP_ANY_TYPE, np.opt.port) == ERR_OK;
+        if (ok) {
+            np.listen_pcb = tcp_listen_with_backlog(pcb, 1);
+            ok = np.listen_pcb != NULL;
+        }
+        if (ok) {
+            tcp_accept(np.listen_pcb, np_tcp_accept);
+            np.state = NP_LISTENING;
+        } else if (pcb) {
+            tcp_close(pcb);
+        }
+    } else {
+        struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+        ok = pcb != NULL;
+        if (ok) {
+            ip_addr_copy(np.peer, *peer);
+            np.start_us = time_us_64();     // Connect timeout; reset once connected
+            np.state = NP_CONNECTING;
+            np_tcp_attach(pcb);
+            ok = tcp_connect(pcb, peer, np.opt.port, np_tcp_connected) == ERR_OK;
+            if (!ok) {
+                np_tcp_detach(pcb);
+                tcp_abort(pcb);
+                np.pcb = NULL;
+            }
+        }
+    }
+    cyw43_arch_lwip_end();
+    return ok;
+}
+
+static void np_print_summary(uint32_t load) {
+    uint64_t us = np.end_us - np.start_us;
+    char rate[32];
+    netperf_format_rate(rate, sizeof(rate), np.bytes, us);
+    if (np.error) {
+        printf(ANSI_YELLOW "Test ended: %s\n" ANSI_RESET, np.error);
+    }
+    printf(ANSI_BOLD "%s %lu.%02lu MBytes in %lu.%03lu s = %s" ANSI_RESET,
+           np.sending ? "Sent" : "Received",
+           (unsigned long)(np.bytes / 1000000), (unsigned long)(np.bytes % 1000000 / 10000),
+           (unsigned long)(us / 1000000), (unsigned long)(us % 1000000 / 1000), rate);
+    if (!np.opt.udp) {
+        printf(", %lu retransmits", (unsigned long)np.retransmits);
+    } else if (np.sending) {
+        printf(", %lu datagrams (%lu send stalls)", (unsigned long)np.seq, (unsigned long)np.send_errors);
+    }
+    printf(", core 0 load %lu%%\n", (unsigned long)load);
+    if (np.opt.udp && np.have_report) {
+        netperf_udp_report_print(np.report);
+    }
+}
+
+bool netperf_run(const ip_addr_t *peer, const struct netperf_options *options) {
+    for (int i = 0; i < NETPERF_MAX_TCP_LEN; i++) {
+        np_pattern[i] = (uint8_t)('0' + i % 64);
+    }
+    uint32_t calib = np_calibrate();
+
+    memset(&np, 0, sizeof(np));
+    np.opt = *options;
+    np.sending = !options->server && (options->udp || !options->reverse);
+    if (!np_setup(peer)) {
+        printf(ANSI_RED "netperf: cannot open %s port %u\n" ANSI_RESET, options->udp ? "UDP" : "TCP", options->port);
+        np_cleanup();
+        return false;
+    }
+
+    if (options->server) {
+        printf("netperf %s server on port %u, press any key to stop\n", options->udp ? "UDP" : "TCP", options->port);
+    } else {
+        printf("netperf %s to %s port %u: %lu s, %lu byte %s", options->udp ? "UDP" : "TCP",
+               ipaddr_ntoa(peer), options->port, (unsigned long)options->seconds, (unsigned long)options->len,
+               options->udp ? "datagrams" : "writes");
+        if (options->udp) {
+            printf(" at %lu kbit/s", (unsigned long)options->rate_kbps);
+        } else if (options->reverse) {
+            printf(", reverse");
+        }
+        printf("\n");
+    }
+    printf("  %-13s %12s %16s %8s %5s\n", "Interval", "Transfer", "Bandwidth",
+           options->udp ? "Lost" : "Retr", "Load");
+
+    bool reporting = false;
+    uint64_t interval_start = 0, next_report = 0, last_bytes = 0;
+    uint32_t last_rexmit = 0, last_lost = 0;
+    uint64_t idle = 0, test_idle = 0;
+    int index = 0;
+
+    while (true) {
+        uint32_t spins = np_idle_until(time_us_64() + NP_CHECK_US);
+        idle += spins;
+        test_idle += spins;
+        bool key = getchar_timeout_us(0) != PICO_ERROR_TIMEOUT;
+        uint64_t now = time_us_64();
+
+        cyw43_arch_lwip_begin();
+        if (key) {
+            np_finish("stopped");
+        } else if (!options->server && np.state != NP_DONE &&
+                   now > np.start_us + (uint64_t)options->seconds * 1000000 + NP_GRACE_US) {
+            np_finish("no progress");
+        } else if (np.state == NP_RUNNING && np.sending && !options->udp && np.pcb) {
+            np_tcp_fill(np.pcb);        // Deadline even if the send window stalls
+        } else if (options->server && options->udp && np.state == NP_RUNNING &&
+                   np.rx.packets > 0 && now - np.rx.last_us > NP_QUIET_US) {
+            netperf_udp_report_pack(&np.rx, np.report);
+            np.have_report = true;
+            np_finish("sender went quiet");
+            np.start_us = np.rx.first_us;
+            np.end_us = np.rx.last_us;
+        }
+        enum np_state state = np.state;
+        uint64_t bytes = np.bytes;
+        uint64_t start_us = np.start_us;
+        uint32_t rexmit = np.retransmits;
+        uint32_t lost = np.rx.lost;
+        cyw43_arch_lwip_end();
+
+        if (!reporting && (state == NP_RUNNING || state == NP_FINISHING)) {
+            reporting = true;
+            interval_start = start_us;
+            next_report = start_us + 1000000;
+            last_bytes = 0;
+            last_rexmit = 0;
+            last_lost = 0;
+            idle = 0;
+            test_idle = 0;
+            index = 0;
+            if (options->server) {
+                printf("Test from %s\n", ipaddr_ntoa(&np.peer));
+            }
+        }
+        if (reporting && state == NP_RUNNING && now >= next_report) {
+            char rate[32];
+            uint64_t us = now - interval_start;
+            netperf_format_rate(rate, sizeof(rate), bytes - last_bytes, us);
+            uint64_t delta = bytes - last_bytes;
+            printf("  %3d.00-%3d.00 s %5lu.%02lu MBytes %16s %8lu %4lu%%\n", index, index + 1,
+                   (unsigned long)(delta / 1000000), (unsigned long)(delta % 1000000 / 10000), rate,
+                   (unsigned long)(options->udp ? lost - last_lost : rexmit - last_rexmit),
+                   (unsigned long)np_load_percent(idle, us, calib));
+            index++;
+            interval_start = now;
+            next_report += 1000000;
+            last_bytes = bytes;
+            last_rexmit = rexmit;
+            last_lost = lost;
+            idle = 0;
+        }
+
+        if (state == NP_DONE) {
+            uint64_t test_us = reporting ? now - start_us : 0;
+            np_print_summary(np_load_percent(test_idle, test_us, calib));
+            reporting = false;
+            if (!options->server || key) {
+                break;
+            }
+            cyw43_arch_lwip_begin();
+            np.state = NP_LISTENING;
+            np.bytes = 0;
+            cyw43_arch_lwip_end();
+            printf("\n");
+        } else if (key) {
+            break;
+        }
+    }
+
+    np_cleanup();
+    printf("\n");
+    return true;
+}
+
+#else // NETPERF_HOST_PEER
+
+// ===== HOST PEER =====
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+struct host_options {
+    bool server;
+    bool udp;
+    bool reverse;
+    const char *host;
+    int port;
+    uint32_t seconds;
+    uint32_t len;
+    uint32_t rate_kbps;
+};
+
+static uint8_t host_pattern[NETPERF_MAX_TCP_LEN > NETPERF_MAX_UDP_LEN ? NETPERF_MAX_TCP_LEN : NETPERF_MAX_UDP_LEN];
+
+static uint64_t host_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t host_cpu_us() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static uint32_t host_retransmits(int fd) {
+#ifdef TCP_INFO
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+        return info.tcpi_total_retrans;
+    }
+#endif
+    return 0;
+}
+
+static void host_timeout(int fd, uint32_t us) {
+    struct timeval tv = { (time_t)(us / 1000000), (suseconds_t)(us % 1000000) };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// Per-second lines, as the device prints them
+struct host_meter {
+    uint64_t start_us;
+    uint64_t interval_start;
+    uint64_t next_us;
+    uint64_t last_bytes;
+    uint64_t cpu_start;
+    uint64_t cpu_last;
+    int index;
+};
+
+static void host_meter_start(struct host_meter *meter, bool udp) {
+    meter->start_us = meter->interval_start = host_us();
+    meter->next_us = meter->start_us + 1000000;
+    meter->last_bytes = 0;
+    meter->cpu_start = meter->cpu_last = host_cpu_us();
+    meter->index = 0;
+    printf("  %-13s %12s %16s %8s %5s\n", "Interval", "Transfer", "Bandwidth", udp ? "Lost" : "Retr", "CPU");
+}
+
+static void host_meter_tick(struct host_meter *meter, uint64_t bytes, uint32_t extra) {
+    uint64_t now = host_us();
+    if (now < meter->next_us) {
+        return;
+    }
+    uint64_t cpu = host_cpu_us();
+    uint64_t us = now - meter->interval_start;
+    uint64_t delta = bytes - meter->last_bytes;
+    char rate[32];
+    netperf_format_rate(rate, sizeof(rate), delta, us);
+    printf("  %3d.00-%3d.00 s %5lu.%02lu MBytes %16s %8lu %4lu%%\n", meter->index, meter->index + 1,
+           (unsigned long)(delta / 1000000), (unsigned long)(delta % 1000000 / 10000), rate,
+           (unsigned long)extra, (unsigned long)((cpu - meter->cpu_last) * 100 / us));
+    fflush(stdout);
+    meter->index++;
+    meter->interval_start = now;
+    meter->next_us += 1000000;
+    meter->last_bytes = bytes;
+    meter->cpu_last = cpu;
+}
+
+static void host_summary(const struct host_meter *meter, bool sent, uint64_t bytes, const char *extra) {
+    uint64_t us = host_us() - meter->start_us;
+    uint64_t cpu = host_cpu_us() - meter->cpu_start;
+    char rate[32];
+    netperf_format_rate(rate, sizeof(rate), bytes, us);
+    printf("%s %lu.%02lu MBytes in %lu.%03lu s = %s%s, cpu %lu%%\n", sent ? "Sent" : "Received",
+           (unsigned long)(bytes / 1000000), (unsigned long)(bytes % 1000000 / 10000),
+           (unsigned long)(us / 1000000), (unsigned long)(us % 1000000 / 1000), rate, extra,
+           (unsigned long)(us ? cpu * 100 / us : 0));
+    fflush(stdout);
+}
+
+// Stream for seconds (sender) or until the peer closes (sink)
+static void host_tcp_transfer(int fd, bool send_side, uint32_t seconds, uint32_t len) {
+    struct host_meter meter;
+    uint64_t bytes = 0;
+    uint32_t rexmit_base = host_retransmits(fd);
+    host_timeout(fd, 100000);
+    host_meter_start(&meter, false);
+    uint64_t deadline = meter.start_us + (uint64_t)seconds * 1000000;
+    while (!send_side || host_us() < deadline) {
+        ssize_t n = send_side ? send(fd, host_pattern, len, MSG_NOSIGNAL)
+                              : recv(fd, host_pattern, sizeof(host_pattern), 0);
+        if (n > 0) {
+            bytes += (uint64_t)n;
+        } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            break;
+        }
+        host_meter_tick(&meter, bytes, host_retransmits(fd) - rexmit_base);
+    }
+    char extra[48];
+    snprintf(extra, sizeof(extra), ", %lu retransmits", (unsigned long)(host_retransmits(fd) - rexmit_base));
+    host_summary(&meter, send_side, bytes, send_side ? extra : "");
+}
+
+static int host_tcp_server(int fd) {
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int conn = accept(fd, (struct sockaddr*)&from, &from_len);
+        if (conn < 0) {
+            perror("accept");
+            return 1;
+        }
+        printf("Test from %s\n", inet_ntoa(from.sin_addr));
+        uint8_t hello[NETPERF_HELLO_SIZE];
+        size_t have = 0;
+        host_timeout(conn, 5000000);
+        while (have < sizeof(hello)) {
+            ssize_t n = recv(conn, hello + have, sizeof(hello) - have, 0);
+            if (n <= 0) {
+                break;
+            }
+            have += (size_t)n;
+        }
+        uint32_t seconds = netperf_get32(hello + 8);
+        uint32_t len = netperf_get32(hello + 12);
+        if (have < sizeof(hello) || netperf_get32(hello) != NETPERF_MAGIC || seconds == 0 ||
+            seconds > NETPERF_MAX_SECONDS || len == 0) {
+            printf("Bad hello\n");
+        } else {
+            if (len > NETPERF_MAX_TCP_LEN) {
+                len = NETPERF_MAX_TCP_LEN;
+            }
+            host_tcp_transfer(conn, (netperf_get32(hello + 4) & NETPERF_FLAG_REVERSE) != 0, seconds, len);
+        }
+        close(conn);
+        printf("\n");
+    }
+}
+
+static int host_udp_server(int fd) {
+    struct netperf_udp_rx rx;
+    netperf_udp_rx_reset(&rx);
+    uint8_t report[NETPERF_REPORT_SIZE];
+    bool have_report = false;
+    bool running = false;
+    struct sockaddr_in peer;
+    struct host_meter meter;
+    memset(&peer, 0, sizeof(peer));
+    memset(&meter, 0, sizeof(meter));
+    host_timeout(fd, 100000);
+
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd, host_pattern, sizeof(host_pattern), 0, (struct sockaddr*)&from, &from_len);
+        uint64_t now = host_us();
+        if (running) {
+            host_meter_tick(&meter, rx.bytes, rx.lost);
+            if (now - rx.last_us > 3000000) {
+                printf("Sender went quiet\n");
+                running = false;
+            }
+        }
+        if (n < NETPERF_UDP_HEADER || netperf_get32(host_pattern) != NETPERF_MAGIC) {
+            continue;
+        }
+        uint32_t flags = netperf_get32(host_pattern + 12);
+        if (flags & NETPERF_FLAG_FIN) {
+            if (running && from.sin_addr.s_addr == peer.sin_addr.s_addr) {
+                netperf_udp_report_pack(&rx, report);
+                have_report = true;
+                running = false;
+                netperf_udp_report_print(report);
+                printf("\n");
+                fflush(stdout);
+            }
+            if (have_report) {
+                sendto(fd, report, sizeof(report), 0, (struct sockaddr*)&from, from_len);
+            }
+            continue;
+        }
+        if (!running) {
+            netperf_udp_rx_reset(&rx);
+            peer = from;
+            running = true;
+            have_report = false;
+            printf("Test from %s\n", inet_ntoa(from.sin_addr));
+            host_meter_start(&meter, true);
+        }
+        if (from.sin_addr.s_addr == peer.sin_addr.s_addr && from.sin_port == peer.sin_port) {
+            netperf_udp_rx_account(&rx, netperf_get32(host_pattern + 4), netperf_get32(host_pattern + 8),
+                                   now, (uint32_t)n);
+        }
+    }
+}
+
+static int host_udp_client(const struct host_options *options, int fd) {
+    struct host_meter meter;
+    uint64_t bytes = 0;
+    uint32_t seq = 0;
+    uint8_t *packet = host_pattern;
+    host_meter_start(&meter, true);
+    uint64_t deadline = meter.start_us + (uint64_t)options->seconds * 1000000;
+    uint64_t gap_us = options->rate_kbps ? (uint64_t)options->len * 8000 / options->rate_kbps : 0;
+    uint64_t next = meter.start_us;
+
+    for (uint64_t now = host_us(); now < deadline; now = host_us()) {
+        if (gap_us && now < next) {
+            if (next - now > 200) {
+                usleep((useconds_t)(next - now - 100));
+            }
+            continue;
+        }
+        netperf_put32(packet, NETPERF_MAGIC);
+        netperf_put32(packet + 4, seq);
+        netperf_put32(packet + 8, (uint32_t)now);
+        netperf_put32(packet + 12, 0);
+        if (send(fd, packet, options->len, 0) == (ssize_t)options->len) {
+            seq++;
+            bytes += options->len;
+        }
+        next += gap_us;
+        host_meter_tick(&meter, bytes, 0);
+    }
+    char extra[48];
+    snprintf(extra, sizeof(extra), ", %lu datagrams", (unsigned long)seq);
+    host_summary(&meter, true, bytes, extra);
+
+    uint8_t report[NETPERF_REPORT_SIZE];
+    host_timeout(fd, 100000);
+    for (int i = 0; i < NETPERF_FIN_TRIES; i++) {
+        netperf_put32(packet + 4, seq);
+        netperf_put32(packet + 8, (uint32_t)host_us());
+        netperf_put32(packet + 12, NETPERF_FLAG_FIN);
+        send(fd, packet, NETPERF_UDP_HEADER, 0);
+        ssize_t n = recv(fd, report, sizeof(report), 0);
+        if (n >= NETPERF_REPORT_SIZE && netperf_get32(report) == NETPERF_MAGIC &&
+            (netperf_get32(report + 4) & NETPERF_FLAG_REPORT)) {
+            netperf_udp_report_print(report);
+            return 0;
+        }
+    }
+    printf("No report from the server\n");
+    return 1;
+}
+
+static void host_usage() {
+    printf("Usage: netperf -s [-u] [-p port]\n");
+    printf("       netperf -c <host> [-u] [-R] [-t seconds] [-l bytes] [-b kbit/s] [-p port]\n");
+}
+
+int main(int argc, char **argv) {
+    struct host_options options = { false, false, false, NULL, NETPERF_PORT, NETPERF_DEFAULT_SECONDS, 0,
+                                    NETPERF_DEFAULT_UDP_KBPS };
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-s") == 0) {
+            options.server = true;
+        } else if (strcmp(arg, "-u") == 0) {
+            options.udp = true;
+        } else if (strcmp(arg, "-R") == 0) {
+            options.reverse = true;
+        } else if (value && strcmp(arg, "-c") == 0) {
+            options.host = value;
+            i++;
+        } else if (value && strcmp(arg, "-p") == 0) {
+            options.port = atoi(value);
+            i++;
+        } else if (value && strcmp(arg, "-t") == 0) {
+            options.seconds = (uint32_t)atoi(value);
+            i++;
+        } else if (value && strcmp(arg, "-l") == 0) {
+            options.len = (uint32_t)atoi(value);
+            i++;
+        } else if (value && strcmp(arg, "-b") == 0) {
+            options.rate_kbps = (uint32_t)atoi(value);
+            i++;
+        } else {
+            host_usage();
+            return 2;
+        }
+    }
+    if (options.server == (options.host != NULL) || options.seconds == 0 || options.seconds > NETPERF_MAX_SECONDS) {
+        host_usage();
+        return 2;
+    }
+    uint32_t max_len = options.udp ? NETPERF_MAX_UDP_LEN : NETPERF_MAX_TCP_LEN;
+    if (options.len == 0) {
+        options.len = options.udp ? NETPERF_DEFAULT_UDP_LEN : NETPERF_DEFAULT_TCP_LEN;
+    }
+    if (options.len > max_len || (options.udp && options.len < NETPERF_UDP_HEADER)) {
+        printf("Length must be %d..%lu bytes\n", options.udp ? NETPERF_UDP_HEADER : 1, (unsigned long)max_len);
+        return 2;
+    }
+    for (size_t i = 0; i < sizeof(host_pattern); i++) {
+        host_pattern[i] = (uint8_t)('0' + i % 64);
+    }
+
+    int fd = socket(AF_INET, options.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)options.port);
+
+    if (options.server) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || (!options.udp && listen(fd, 1) < 0)) {
+            perror("bind");
+            return 1;
+        }
+        printf("netperf %s server on port %d\n", options.udp ? "UDP" : "TCP", options.port);
+        return options.udp ? host_udp_server(fd) : host_tcp_server(fd);
+    }
+
+    struct hostent *host = gethostbyname(options.host);
+    if (!host || host->h_addrtype != AF_INET) {
+        printf("Cannot resolve %s\n", options.host);
+        return 1;
+    }
+    memcpy(&addr.sin_addr, host->h_addr_list[0], sizeof(addr.sin_addr));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return 1;
+    }
+    printf("netperf %s to %s port %d: %lu s, %lu byte %s\n", options.udp ? "UDP" : "TCP",
+           inet_ntoa(addr.sin_addr), options.port, (unsigned long)options.seconds, (unsigned long)options.len,
+           options.udp ? "datagrams" : "writes");
+    if (options.udp) {
+        return host_udp_client(&options, fd);
+    }
+
+    uint8_t hello[NETPERF_HELLO_SIZE];
+    netperf_put32(hello, NETPERF_MAGIC);
+    netperf_put32(hello + 4, options.reverse ? NETPERF_FLAG_REVERSE : 0);
+    netperf_put32(hello + 8, options.seconds);
+    netperf_put32(hello + 12, options.len);
+    if (send(fd, hello, sizeof(hello), MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) {
+        perror("send");
+        return 1;
+    }
+    host_tcp_transfer(fd, !options.reverse, options.seconds, options.len);
+    close(fd);
+    return 0;
+}
+
+#endif // NETPERF_HOST_PEER
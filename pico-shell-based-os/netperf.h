@@ -0,0 +1,108 @@
+/**
+ * Network throughput tester - iperf-style TCP and UDP client and server
+ *
+ * TCP: the client sends a hello (mode, duration, buffer size) and then
+ * either streams data to the server or, reversed, sinks what the server
+ * streams back. Senders refill from the lwIP sent callback straight out of
+ * a static pattern buffer; sinks count and free the pbufs in the receive
+ * callback, so no test data is copied by this code.
+ *
+ * UDP: the client paces numbered, timestamped datagrams at the requested
+ * rate, then sends FIN until the server returns its report: datagrams and
+ * bytes received, loss, reordering and RFC 3550 interarrival jitter.
+ *
+ * Both ends print throughput every second. The device also reports the
+ * load on core 0, where lwIP runs: the shell spins an idle counter while
+ * the test runs and compares it with a loop rate calibrated up front with
+ * interrupts off. TCP retransmissions (timeouts and fast retransmits) are
+ * sampled from the PCB in every callback.
+ *
+ * With NETPERF_HOST_PEER defined, netperf.cpp builds the matching peer for
+ * a desktop or CI machine on POSIX sockets (it also talks to itself):
+ *
+ *     c++ -O2 -DNETPERF_HOST_PEER netperf.cpp -o netperf
+ *     ./netperf -s [-u] [-p port]
+ *     ./netperf -c <host> [-u] [-R] [-t seconds] [-l bytes] [-b kbit/s] [-p port]
+ */
+
+#ifndef NETPERF_H
+#define NETPERF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NETPERF_PORT 5201
+#define NETPERF_MAGIC 0x4E504631u           // "NPF1"
+#define NETPERF_DEFAULT_SECONDS 10
+#define NETPERF_MAX_SECONDS 3600
+#define NETPERF_DEFAULT_TCP_LEN 2920        // Two full segments per write
+#define NETPERF_MAX_TCP_LEN 4096
+#define NETPERF_DEFAULT_UDP_LEN 1470
+#define NETPERF_MAX_UDP_LEN 1472
+#define NETPERF_DEFAULT_UDP_KBPS 10000
+#define NETPERF_FIN_TRIES 10                // UDP FIN, 100 ms apart
+
+// Wire format, all fields big-endian 32-bit words
+#define NETPERF_HELLO_SIZE 16       // magic, flags, seconds, len
+#define NETPERF_UDP_HEADER 16       // magic, seq, send time (us), flags
+#define NETPERF_REPORT_SIZE 36      // magic, flags, packets, lost, reordered,
+                                    // bytes hi, bytes lo, jitter us, duration us
+
+#define NETPERF_FLAG_REVERSE 0x01   // Hello: server sends, client sinks
+#define NETPERF_FLAG_FIN 0x02       // UDP: end of test, please report
+#define NETPERF_FLAG_REPORT 0x04    // UDP: server report
+
+static inline void netperf_put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline uint32_t netperf_get32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// UDP receive accounting, shared by the device and the host peer
+struct netperf_udp_rx {
+    uint32_t packets;
+    uint32_t lost;
+    uint32_t reordered;
+    uint64_t bytes;
+    uint32_t expected;          // Next sequence number
+    int32_t last_transit_us;
+    uint32_t jitter_us16;       // Jitter in 1/16 us, as RFC 3550 keeps it
+    uint64_t first_us;
+    uint64_t last_us;
+};
+
+void netperf_udp_rx_reset(struct netperf_udp_rx *rx);
+void netperf_udp_rx_account(struct netperf_udp_rx *rx, uint32_t seq, uint32_t send_us,
+                            uint64_t now_us, uint32_t len);
+void netperf_udp_report_pack(const struct netperf_udp_rx *rx, uint8_t *out);
+void netperf_udp_report_print(const uint8_t *report);
+
+// "12.34 Mbit/s" for bytes moved in us
+void netperf_format_rate(char *out, int len, uint64_t bytes, uint64_t us);
+
+#ifndef NETPERF_HOST_PEER
+#include "lwip/ip_addr.h"
+
+struct netperf_options {
+    bool server;
+    bool udp;
+    bool reverse;               // TCP client: server sends
+    uint16_t port;
+    uint32_t seconds;
+    uint32_t len;               // Bytes per write / datagram
+    uint32_t rate_kbps;         // UDP client send rate, 0 = as fast as possible
+};
+
+void netperf_options_default(struct netperf_options *options);
+
+// Shell. Client: run one test against peer. Server: serve tests until a
+// key is pressed. Prints per-second and summary lines; false on setup error.
+bool netperf_run(const ip_addr_t *peer, const struct netperf_options *options);
+#endif
+
+#endif // NETPERF_H
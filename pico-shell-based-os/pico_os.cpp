@@ -5,7 +5,8 @@
  * Communicates over USB serial (TTY)
  * 
  * FEATURES:
- * - Dual-core processing (Core 0: Shell, Core 1: Background tasks)
+ * - Dual-core processing (Core 0: Shell, Core 1: Background tasks), or
+ *   FreeRTOS SMP tasks across both cores (pico_os_freertos build)
  * - LittleFS filesystem on flash
  * - WiFi networking with NTP time sync
  * - Local HTTP web server (command: localhost)
@@ -23,77 +24,93 @@
 #include "pico/cyw43_arch.h"
 #include "pico/time.h"
 #include "pico/multicore.h"
+#include "pico/mutex.h"
+#include "pico/sync.h"
+#include "pico/flash.h"
+#include "pico/stdio_usb.h"
 #include "pico/util/datetime.h"
 #include "hardware/watchdog.h"
 #include "hardware/flash.h"
+#include "hardware/sync.h"
 #include "lwip/apps/sntp.h"
 #include "lwip/dns.h"
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
 #include "lwip/tcp.h"
-#include "lwip/raw.h"
-#include "lwip/icmp.h"
-#include "lwip/inet_chksum.h"
-
-// LittleFS includes
-extern "C" {
-#include "lfs.h"
-}
-
-// System configuration
-#define MAX_COMMAND_LEN 256
-#define MAX_ARGS 16
-#define MAX_PROCESSES 8
-#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES - (512 * 1024)) // Last 512KB for filesystem
-#define LFS_BLOCK_SIZE 4096
-#define LFS_BLOCK_COUNT 128
-
-// Web server configuration
-#define HTTP_SERVER_PORT 80
-#define MAX_HTTP_CONNECTIONS 4
-#define HTTP_BUFFER_SIZE 1536
-
-// ANSI color codes for terminal
-#define ANSI_RESET "\033[0m"
-#define ANSI_BOLD "\033[1m"
-#define ANSI_RED "\033[31m"
-#define ANSI_GREEN "\033[32m"
-#define ANSI_YELLOW "\033[33m"
-#define ANSI_BLUE "\033[34m"
-#define ANSI_MAGENTA "\033[35m"
-#define ANSI_CYAN "\033[36m"
-#define ANSI_CLEAR_SCREEN "\033[2J\033[H"
-
-// Tetris configuration
-#define TETRIS_WIDTH 10
-#define TETRIS_HEIGHT 20
-#define TETRIS_PREVIEW_SIZE 4
+
+#include "pico_os.h"
+#include "fs_worker.h"
+#include "http_server.h"
+#include "tetris.h"
+#include "input.h"
+#include "font.h"
+#include "timesync.h"
+#include "timecache.h"
+#include "wifi_manager.h"
+#include "boot_profile.h"
+#include "dns_cache.h"
+#include "ping.h"
+#include "netperf.h"
+#include "chksum.h"
+#include "port_scan.h"
+#include "cpu_load.h"
+#include "todo_store.h"
+#if PICO_OS_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#endif
+
+// Core 1 runs the filesystem worker and background processes; LittleFS
+// calls need more than the default 1KB core 1 stack
+#define CORE1_STACK_SIZE 4096
+
+// Fast boot: storage comes up on core 1 while core 0 starts the WiFi
+// driver, and the console waits for the USB host by event instead of
+// fixed delays (set from CMake, option PICO_OS_FAST_BOOT)
+#ifndef PICO_OS_FAST_BOOT
+#define PICO_OS_FAST_BOOT 1
+#endif
+#define BOOT_USB_WAIT_MS 2000       // Longest wait for a terminal to open the port
+
+#if PICO_OS_FREERTOS
+// FreeRTOS build: each service is a task and the scheduler spreads them
+// over both cores. lwIP's tcpip thread and the cyw43 driver task run above
+// all of these (lwipopts.h), so network work preempts a busy shell.
+#define TASK_PRIORITY_SHELL     (tskIDLE_PRIORITY + 1)
+#define TASK_PRIORITY_PROCESSES (tskIDLE_PRIORITY + 1)
+#define TASK_PRIORITY_FS        (tskIDLE_PRIORITY + 2)
+#define SHELL_TASK_STACK        2048    // Words
+#define FS_TASK_STACK           1024
+#define PROCESSES_TASK_STACK    512
+#define PROCESSES_POLL_MS       10
+#endif
+
 
 // Snake configuration
 #define SNAKE_WIDTH 20
 #define SNAKE_HEIGHT 15
 #define SNAKE_MAX_LENGTH 100
 
-// Process structure
+// Games run a fixed timestep on a hardware alarm (see input.h)
+#define GAME_TICK_MS 10
+
+// Binary fonts loaded at boot (see font.h)
+#define FONT_DIR "/fonts"
+
+// How long the 'wifi' command watches a new connection before handing
+// it over to the background manager
+#define WIFI_CONNECT_WAIT_MS 15000
+
+// Process structure - func is polled from the core 1 service loop and
+// must return promptly
 struct Process {
     char name[32];
     bool running;
     uint32_t start_time;
     void (*func)(void);
-};
-
-// Todo item structure
-struct TodoItem {
-    char text[100];
-    bool completed;
-    bool active;
-};
-
-// Tetris piece structure
-struct TetrisPiece {
-    int shape[4][4];
-    int x, y;
-    int type;
+    volatile uint32_t run_us;   // Time in func, written by core 1; wraps, read as deltas
+    volatile uint32_t calls;
 };
 
 // Snake structure
@@ -101,61 +118,66 @@ struct SnakeSegment {
     int x, y;
 };
 
-// HTTP connection state
-struct http_conn_state {
-    struct pbuf *p;
-    int sent;
-    bool close_after_send;
-};
-
 // Global variables
 static char command_buffer[MAX_COMMAND_LEN];
 static int cmd_index = 0;
 static Process processes[MAX_PROCESSES];
 static int process_count = 0;
 static absolute_time_t boot_time;
-static bool wifi_connected = false;
-static char wifi_ssid[64] = "";
+volatile bool wifi_connected = false;     // Mirrors the WiFi manager (see wifi_event)
+char wifi_ssid[64] = "";
 static char wifi_password[64] = "";
 static char timezone_str[32] = "GMT";
 static int timezone_offset = 0; // UK timezone (will be +1 during BST)
-static bool ntp_synced = false;
-static time_t system_time_offset = 0; // Offset from boot time to actual time
-static absolute_time_t time_sync_base; // When we last synced time
 
-// Web server globals
-static bool http_server_running = false;
-static struct tcp_pcb *http_server_pcb = NULL;
-static int active_connections = 0;
+// NTP servers polled by the time service (see timesync.h)
+static const char *const ntp_servers[] = { "0.pool.ntp.org", "1.pool.ntp.org", "time.nist.gov" };
+static bool ntp_started = false;
 
 // LittleFS variables
-static lfs_t lfs;
-static struct lfs_config lfs_cfg;
+lfs_t lfs;
+struct lfs_config lfs_cfg;
 static uint8_t lfs_read_buffer[LFS_BLOCK_SIZE];
 static uint8_t lfs_prog_buffer[LFS_BLOCK_SIZE];
 static uint8_t lfs_lookahead_buffer[128];
+#if PICO_OS_FREERTOS
+static SemaphoreHandle_t lfs_mutex;  // Shell and fs service tasks share the FS
+#else
+static recursive_mutex_t lfs_mutex; // Shell (core 0) and fs worker (core 1) share the FS
+#endif
+
+#if !PICO_OS_FREERTOS
+// Core 1 service loop stack
+static uint32_t core1_stack[CORE1_STACK_SIZE / sizeof(uint32_t)];
+#endif
+
+// Boot results, reported once the console is up
+static int boot_fonts_loaded = 0;
+static bool boot_wifi_config = false;
+static int boot_wifi_init = -1;
+#if PICO_OS_FAST_BOOT
+static semaphore_t boot_storage_done;   // Core 1 -> core 0: filesystem and config loaded
+static semaphore_t boot_services_ready; // Core 0 -> core 1: fs worker queues exist
+#endif
 
 // Log system
 #define MAX_LOG_ENTRIES 50
 static char log_entries[MAX_LOG_ENTRIES][128];
 static int log_index = 0;
 static int log_count = 0;
+static volatile uint32_t log_sequence = 0; // Entries ever logged; log_index == log_sequence % MAX_LOG_ENTRIES
+static critical_section_t log_lock;         // Both cores log
 
-// Todo list
-static TodoItem todos[2] = {
-    {"", false, false},
-    {"", false, false}
-};
+// Todo list, opened by boot_storage()
+#define TODO_DIR "/todo"
+static struct todo_store todos;
+static bool todos_ready = false;
 
 // Forward declarations
+void boot_storage();
 void shell_loop();
-void log_message(const char* msg);
 void print_prompt();
 void execute_command(char* cmd);
-char* read_line(const char* prompt, bool echo);
-void start_http_server();
-void stop_http_server();
-void create_default_website();
 
 // Panic handler - prints panic info over USB serial
 void panic_handler(const char *fmt, ...) {
@@ -183,20 +205,9 @@ void panic_handler(const char *fmt, ...) {
     }
 }
 
-// Helper function to get current time
+// Current local time, from the per-second cache (0 if not set yet)
 time_t get_current_time() {
-    if (system_time_offset == 0) {
-        return 0; // No time set yet
-    }
-    uint64_t elapsed_ms = absolute_time_diff_us(time_sync_base, get_absolute_time()) / 1000;
-    return system_time_offset + (elapsed_ms / 1000);
-}
-
-// Helper function to set current time
-void set_current_time(time_t new_time) {
-    system_time_offset = new_time;
-    time_sync_base = get_absolute_time();
-    ntp_synced = true;
+    return timecache_local();
 }
 
 // LittleFS flash operations
@@ -207,38 +218,94 @@ int lfs_flash_read(const struct lfs_config *c, lfs_block_t block,
     return 0;
 }
 
+// Flash programming stalls XIP for both cores, so writes go through
+// flash_safe_execute() which parks the other core in RAM first
+struct flash_op_params {
+    uint32_t addr;
+    const uint8_t *data;
+    size_t size;
+};
+
+static void __not_in_flash_func(flash_prog_safe)(void *param) {
+    struct flash_op_params *op = (struct flash_op_params*)param;
+    flash_range_program(op->addr, op->data, op->size);
+}
+
+static void __not_in_flash_func(flash_erase_safe)(void *param) {
+    struct flash_op_params *op = (struct flash_op_params*)param;
+    flash_range_erase(op->addr, op->size);
+}
+
 int lfs_flash_prog(const struct lfs_config *c, lfs_block_t block,
                    lfs_off_t off, const void *buffer, lfs_size_t size) {
-    uint32_t addr = FLASH_TARGET_OFFSET + (block * c->block_size) + off;
-    uint32_t ints = save_and_disable_interrupts();
-    flash_range_program(addr, (const uint8_t*)buffer, size);
-    restore_interrupts(ints);
-    return 0;
+    struct flash_op_params op = {
+        FLASH_TARGET_OFFSET + (block * c->block_size) + off,
+        (const uint8_t*)buffer,
+        size
+    };
+    enum cpu_activity previous = cpu_enter(CPU_FLASH);
+    int rc = flash_safe_execute(flash_prog_safe, &op, UINT32_MAX);
+    cpu_enter(previous);
+    return rc == PICO_OK ? 0 : LFS_ERR_IO;
 }
 
 int lfs_flash_erase(const struct lfs_config *c, lfs_block_t block) {
-    uint32_t addr = FLASH_TARGET_OFFSET + (block * c->block_size);
-    uint32_t ints = save_and_disable_interrupts();
-    flash_range_erase(addr, c->block_size);
-    restore_interrupts(ints);
-    return 0;
+    struct flash_op_params op = {
+        FLASH_TARGET_OFFSET + (block * c->block_size),
+        NULL,
+        c->block_size
+    };
+    enum cpu_activity previous = cpu_enter(CPU_FLASH);
+    int rc = flash_safe_execute(flash_erase_safe, &op, UINT32_MAX);
+    cpu_enter(previous);
+    return rc == PICO_OK ? 0 : LFS_ERR_IO;
 }
 
 int lfs_flash_sync(const struct lfs_config *c) {
     return 0;
 }
 
+// LFS_THREADSAFE hooks
+#if PICO_OS_FREERTOS
+int lfs_flash_lock(const struct lfs_config *c) {
+    xSemaphoreTakeRecursive(lfs_mutex, portMAX_DELAY);
+    return 0;
+}
+
+int lfs_flash_unlock(const struct lfs_config *c) {
+    xSemaphoreGiveRecursive(lfs_mutex);
+    return 0;
+}
+#else
+int lfs_flash_lock(const struct lfs_config *c) {
+    recursive_mutex_enter_blocking(&lfs_mutex);
+    return 0;
+}
+
+int lfs_flash_unlock(const struct lfs_config *c) {
+    recursive_mutex_exit(&lfs_mutex);
+    return 0;
+}
+#endif
+
 // Initialize LittleFS
 void init_filesystem() {
+#if PICO_OS_FREERTOS
+    lfs_mutex = xSemaphoreCreateRecursiveMutex();
+#else
+    recursive_mutex_init(&lfs_mutex);
+#endif
     lfs_cfg.read = lfs_flash_read;
     lfs_cfg.prog = lfs_flash_prog;
     lfs_cfg.erase = lfs_flash_erase;
     lfs_cfg.sync = lfs_flash_sync;
+    lfs_cfg.lock = lfs_flash_lock;
+    lfs_cfg.unlock = lfs_flash_unlock;
     lfs_cfg.read_size = 1;
     lfs_cfg.prog_size = FLASH_PAGE_SIZE;
     lfs_cfg.block_size = LFS_BLOCK_SIZE;
     lfs_cfg.block_count = LFS_BLOCK_COUNT;
-    lfs_cfg.cache_size = 256;
+    lfs_cfg.cache_size = LFS_CACHE_SIZE;
     lfs_cfg.lookahead_size = 128;
     lfs_cfg.block_cycles = 500;
     lfs_cfg.read_buffer = lfs_read_buffer;
@@ -265,543 +332,225 @@ void init_filesystem() {
     log_message("Filesystem mounted successfully");
 }
 
-// Log message function
+void fs_stamp(const char* path) {
+    uint64_t stamp = time_us_64();
+    lfs_setattr(&lfs, path, FS_ATTR_STAMP, &stamp, sizeof(stamp));
+}
+
+// Log message function - formatted outside the lock, which only covers
+// claiming the slot and publishing it
 void log_message(const char* msg) {
-    time_t now = get_current_time();
-    if (now == 0) {
+    char hms[9];
+    char entry[sizeof(log_entries[0])];
+    if (!timecache_hms(hms)) {
         // No time set yet, use uptime
-        uint32_t uptime_sec = to_ms_since_boot(get_absolute_time()) / 1000;
-        snprintf(log_entries[log_index], sizeof(log_entries[0]), 
-                 "[+%05lus] %s", (unsigned long)uptime_sec, msg);
+        snprintf(entry, sizeof(entry), "[+%05lus] %s", (unsigned long)timecache_uptime(), msg);
     } else {
-        struct tm *t = localtime(&now);
-        snprintf(log_entries[log_index], sizeof(log_entries[0]), 
-                 "[%02d:%02d:%02d] %s", t->tm_hour, t->tm_min, t->tm_sec, msg);
+        snprintf(entry, sizeof(entry), "[%s] %s", hms, msg);
     }
+    critical_section_enter_blocking(&log_lock);
+    memcpy(log_entries[log_index], entry, sizeof(entry));
     log_index = (log_index + 1) % MAX_LOG_ENTRIES;
     if (log_count < MAX_LOG_ENTRIES) log_count++;
+    log_sequence++;
+    critical_section_exit(&log_lock);
 }
 
-// NTP time sync callback
-void ntp_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
-    if (p->tot_len >= 48) {
-        uint8_t *data = (uint8_t*)p->payload;
-        uint32_t ntp_time = (data[40] << 24) | (data[41] << 16) | (data[42] << 8) | data[43];
-        time_t unix_time = ntp_time - 2208988800UL + (timezone_offset * 3600); // NTP to Unix epoch with timezone
-        
-        set_current_time(unix_time);
-        log_message("NTP time synchronized");
-        printf(ANSI_GREEN "Time synchronized successfully!\n" ANSI_RESET);
+uint32_t log_first_sequence() {
+    return log_sequence - log_count;
+}
+
+uint32_t log_next_sequence() {
+    return log_sequence;
+}
+
+bool log_get_entry(uint32_t sequence, char* out, size_t len) {
+    if (sequence - log_first_sequence() >= (uint32_t)log_count) {
+        return false;
     }
-    pbuf_free(p);
+    // Bounded copy - the entry may be rewritten by the other core meanwhile
+    strncpy(out, log_entries[sequence % MAX_LOG_ENTRIES], len - 1);
+    out[len - 1] = '\0';
+    return true;
 }
 
+// Start the time service, or poll its servers again if it is running,
+// and wait briefly for the result
 void sync_ntp_time() {
     if (!wifi_connected) {
         printf(ANSI_YELLOW "WiFi not connected. Cannot sync time.\n" ANSI_RESET);
         return;
     }
     
-    printf("Syncing time with NTP server...\n");
+    printf("Syncing time with NTP servers...\n");
     
-    struct udp_pcb *pcb = udp_new();
-    if (!pcb) {
-        printf(ANSI_RED "Failed to create UDP socket\n" ANSI_RESET);
-        return;
-    }
-    
-    ip_addr_t ntp_server;
-    if (!ipaddr_aton("129.6.15.28", &ntp_server)) { // NIST time server
-        printf(ANSI_RED "Failed to resolve NTP server\n" ANSI_RESET);
-        udp_remove(pcb);
-        return;
-    }
-    
-    udp_recv(pcb, ntp_recv_callback, NULL);
-    
-    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 48, PBUF_RAM);
-    if (!p) {
-        printf(ANSI_RED "Failed to allocate buffer\n" ANSI_RESET);
-        udp_remove(pcb);
-        return;
+    struct timesync_status status;
+    timesync_get_status(&status);
+    uint32_t updates_before = status.updates;
+    if (!ntp_started) {
+        ntp_started = timesync_start(ntp_servers, sizeof(ntp_servers) / sizeof(ntp_servers[0]));
+        if (!ntp_started) {
+            printf(ANSI_RED "Failed to start NTP client\n" ANSI_RESET);
+            return;
+        }
+    } else {
+        timesync_poll_now();
     }
     
-    uint8_t *req = (uint8_t*)p->payload;
-    memset(req, 0, 48);
-    req[0] = 0x1B; // LI = 0, VN = 3, Mode = 3
-    
-    cyw43_arch_lwip_begin();
-    err_t err = udp_sendto(pcb, p, &ntp_server, 123);
-    cyw43_arch_lwip_end();
-    
-    pbuf_free(p);
+    // DNS plus the first round of replies
+    absolute_time_t timeout = make_timeout_time_ms(5000);
+    do {
+        sleep_ms(10);
+        timesync_get_status(&status);
+    } while (status.updates == updates_before && !time_reached(timeout));
     
-    if (err != ERR_OK) {
-        printf(ANSI_RED "Failed to send NTP request\n" ANSI_RESET);
-        udp_remove(pcb);
+    if (status.updates == updates_before) {
+        printf(ANSI_YELLOW "No NTP reply yet, will keep trying in the background\n" ANSI_RESET);
         return;
     }
-    
-    // Wait for response (simple timeout)
-    sleep_ms(2000);
-    udp_remove(pcb);
+    timecache_refresh();
+    printf(ANSI_GREEN "Time synchronized successfully! " ANSI_RESET
+           "(offset %+lld us, delay %lld us)\n",
+           (long long)status.offset_us, (long long)status.delay_us);
+    log_message("NTP time synchronized");
 }
 
-// ===== WEB SERVER - HTTP SERVER FROM LITTLEFS =====
-
-// Get MIME type from file extension
-const char* get_mime_type(const char* filename) {
-    const char* ext = strrchr(filename, '.');
-    if (!ext) return "text/plain";
-    
-    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0) return "text/html";
-    if (strcmp(ext, ".css") == 0) return "text/css";
-    if (strcmp(ext, ".js") == 0) return "application/javascript";
-    if (strcmp(ext, ".json") == 0) return "application/json";
-    if (strcmp(ext, ".png") == 0) return "image/png";
-    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "image/jpeg";
-    if (strcmp(ext, ".gif") == 0) return "image/gif";
-    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
-    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
-    if (strcmp(ext, ".txt") == 0) return "text/plain";
-    
-    return "application/octet-stream";
-}
-
-// HTTP error response
-err_t send_http_error(struct tcp_pcb *pcb, int code, const char* message) {
-    char response[256];
-    int len = snprintf(response, sizeof(response),
-        "HTTP/1.1 %d %s\r\n"
-        "Content-Type: text/html\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "<html><body><h1>%d %s</h1></body></html>\r\n",
-        code, message, code, message);
-    
-    cyw43_arch_lwip_begin();
-    err_t err = tcp_write(pcb, response, len, TCP_WRITE_FLAG_COPY);
-    tcp_output(pcb);
-    cyw43_arch_lwip_end();
-    
-    return err;
+void show_ntp_status() {
+    struct timesync_status status;
+    timesync_get_status(&status);
+    
+    printf("\n" ANSI_BOLD "Time Service:\n" ANSI_RESET);
+    printf("  Clock:      %s\n", status.synced ? "NTP" : status.valid ? "manual" : "not set");
+    printf("  Offset:     %+lld us (last update)\n", (long long)status.offset_us);
+    printf("  Delay:      %lld us\n", (long long)status.delay_us);
+    printf("  Frequency:  %+ld.%03ld ppm\n", (long)(status.freq_ppb / 1000),
+           (long)(labs(status.freq_ppb) % 1000));
+    printf("  Slewing:    %s\n", status.slew_ppb ? "yes" : "no");
+    printf("  Updates:    %lu (%lu steps)\n", (unsigned long)status.updates,
+           (unsigned long)status.steps);
+    
+    if (status.servers > 0) {
+        printf("\n  %-18s %-15s %7s %12s %10s\n", "Server", "Address", "Replies", "Offset us", "Delay us");
+        struct timesync_server_status server;
+        for (int i = 0; timesync_get_server(i, &server); i++) {
+            printf("  %-18.18s %-15s %3lu/%-3lu ", server.name,
+                   server.addr[0] ? server.addr : "-",
+                   (unsigned long)server.replies, (unsigned long)server.polls);
+            if (server.have_sample) {
+                printf("%12lld %10lld\n", (long long)server.offset_us, (long long)server.delay_us);
+            } else {
+                printf("%12s %10s\n", "-", "-");
+            }
+        }
+    }
+    printf("\n");
 }
 
-// Send file from LittleFS
-err_t send_file_response(struct tcp_pcb *pcb, const char* filepath) {
-    lfs_file_t file;
-    int result = lfs_file_open(&lfs, &file, filepath, LFS_O_RDONLY);
-    
-    if (result < 0) {
-        log_message("HTTP: File not found");
-        return send_http_error(pcb, 404, "Not Found");
-    }
-    
-    // Get file size
-    lfs_soff_t size = lfs_file_size(&lfs, &file);
-    if (size < 0 || size > 65536) { // Max 64KB per file
-        lfs_file_close(&lfs, &file);
-        return send_http_error(pcb, 500, "Internal Server Error");
-    }
-    
-    // Allocate buffer for file content
-    char *content = (char*)malloc(size + 1);
-    if (!content) {
-        lfs_file_close(&lfs, &file);
-        return send_http_error(pcb, 500, "Internal Server Error");
-    }
-    
-    // Read file
-    lfs_ssize_t read_size = lfs_file_read(&lfs, &file, content, size);
-    lfs_file_close(&lfs, &file);
-    
-    if (read_size < 0) {
-        free(content);
-        return send_http_error(pcb, 500, "Internal Server Error");
-    }
-    
-    content[read_size] = '\0';
-    
-    // Build HTTP response header
-    const char* mime = get_mime_type(filepath);
-    char header[256];
-    int header_len = snprintf(header, sizeof(header),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %d\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        mime, (int)read_size);
-    
-    // Send response
-    cyw43_arch_lwip_begin();
-    err_t err = tcp_write(pcb, header, header_len, TCP_WRITE_FLAG_COPY);
-    if (err == ERR_OK) {
-        err = tcp_write(pcb, content, read_size, TCP_WRITE_FLAG_COPY);
+// Wait for a lookup; any key aborts it, the cache's own retries bound it
+static bool shell_wait_dns(struct dns_future *future) {
+    while (future->result == DNS_RESULT_PENDING) {
+        if (getchar_timeout_us(10000) != PICO_ERROR_TIMEOUT) {
+            dns_future_cancel(future);
+            printf(ANSI_YELLOW "Lookup aborted\n" ANSI_RESET);
+            return false;
+        }
     }
-    tcp_output(pcb);
-    cyw43_arch_lwip_end();
-    
-    free(content);
-    
-    char log_msg[128];
-    snprintf(log_msg, sizeof(log_msg), "HTTP: Served %s (%d bytes)", filepath, (int)read_size);
-    log_message(log_msg);
-    
-    return err;
+    return true;
 }
 
-// HTTP request received callback
-err_t http_recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
-    if (p == NULL) {
-        // Connection closed
-        active_connections--;
-        tcp_close(pcb);
-        return ERR_OK;
+// Resolve a hostname (or parse an address) through the DNS cache
+bool shell_resolve(const char *host, ip_addr_t *addr) {
+    struct dns_future future;
+    dns_cache_resolve(host, &future);
+    if (!shell_wait_dns(&future)) {
+        return false;
     }
-    
-    if (err != ERR_OK) {
-        pbuf_free(p);
-        active_connections--;
-        tcp_close(pcb);
-        return err;
-    }
-    
-    // Parse HTTP request
-    char request[512];
-    int len = p->tot_len < sizeof(request) - 1 ? p->tot_len : sizeof(request) - 1;
-    pbuf_copy_partial(p, request, len, 0);
-    request[len] = '\0';
-    
-    tcp_recved(pcb, p->tot_len);
-    pbuf_free(p);
-    
-    // Extract request path
-    char method[16], path[128], version[16];
-    if (sscanf(request, "%15s %127s %15s", method, path, version) != 3) {
-        send_http_error(pcb, 400, "Bad Request");
-        active_connections--;
-        tcp_close(pcb);
-        return ERR_OK;
-    }
-    
-    // Log request
-    char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "HTTP: %s %s", method, path);
-    log_message(log_msg);
-    
-    // Handle request
-    if (strcmp(method, "GET") != 0) {
-        send_http_error(pcb, 405, "Method Not Allowed");
-    } else {
-        // Map URL to file
-        char filepath[144];
-        if (strcmp(path, "/") == 0) {
-            strcpy(filepath, "/web/index.html");
-        } else {
-            snprintf(filepath, sizeof(filepath), "/web%s", path);
-        }
-        
-        send_file_response(pcb, filepath);
+    if (future.result != DNS_RESULT_OK) {
+        printf(ANSI_RED "Cannot resolve %s: %s\n" ANSI_RESET, host,
+               future.result == DNS_RESULT_NXDOMAIN ? "no such host" : "lookup failed");
+        return false;
     }
-    
-    // Close connection
-    sleep_ms(10);
-    active_connections--;
-    tcp_close(pcb);
-    
-    return ERR_OK;
+    *addr = future.addr;
+    return true;
 }
 
-// HTTP connection error callback
-void http_err_callback(void *arg, err_t err) {
-    if (active_connections > 0) {
-        active_connections--;
+static const char *dns_result_name(enum dns_result result) {
+    switch (result) {
+        case DNS_RESULT_OK: return "ok";
+        case DNS_RESULT_NXDOMAIN: return "nxdomain";
+        case DNS_RESULT_FAIL: return "failed";
+        default: return "pending";
     }
 }
 
-// New connection accepted
-err_t http_accept_callback(void *arg, struct tcp_pcb *newpcb, err_t err) {
-    if (err != ERR_OK || newpcb == NULL) {
-        return ERR_VAL;
-    }
-    
-    if (active_connections >= MAX_HTTP_CONNECTIONS) {
-        tcp_abort(newpcb);
-        return ERR_ABRT;
+void show_dns_cache() {
+    struct dns_cache_stats stats;
+    dns_cache_get_stats(&stats);
+
+    printf("\n" ANSI_BOLD "DNS Cache:\n" ANSI_RESET);
+    printf("  %-28s %-9s %-15s %6s %6s %5s\n", "Name", "Result", "Address", "TTL", "Left", "Hits");
+    struct dns_cache_info info;
+    int count = 0;
+    for (int i = 0; dns_cache_get_entry(i, &info); i++, count++) {
+        printf("  %-28.28s %-9s %-15s %6lu %6lu %5lu%s%s\n", info.name, dns_result_name(info.result),
+               info.result == DNS_RESULT_OK ? ipaddr_ntoa(&info.addr) : "-",
+               (unsigned long)info.ttl, (unsigned long)info.ttl_left, (unsigned long)info.hits,
+               info.prefetch ? " prefetch" : "", info.refreshing ? " refreshing" : "");
+    }
+    if (count == 0) {
+        printf("  (empty)\n");
+    }
+
+    uint32_t answered = stats.hits + stats.negative_hits;
+    printf("\n  Lookups: %lu  Hits: %lu (+%lu negative)  Joined: %lu  Misses: %lu\n",
+           (unsigned long)stats.lookups, (unsigned long)stats.hits, (unsigned long)stats.negative_hits,
+           (unsigned long)stats.joined, (unsigned long)stats.misses);
+    printf("  Queries: %lu  Timeouts: %lu  Prefetches: %lu  Evictions: %lu\n",
+           (unsigned long)stats.queries, (unsigned long)stats.timeouts,
+           (unsigned long)stats.prefetches, (unsigned long)stats.evictions);
+    if (stats.lookups > 0) {
+        printf("  Hit rate: %lu%%\n", (unsigned long)(answered * 100 / stats.lookups));
     }
-    
-    active_connections++;
-    
-    tcp_setprio(newpcb, TCP_PRIO_MIN);
-    tcp_arg(newpcb, NULL);
-    tcp_recv(newpcb, http_recv_callback);
-    tcp_err(newpcb, http_err_callback);
-    
-    return ERR_OK;
+    printf("\n");
 }
 
-// Start HTTP server
-void start_http_server() {
+void dig_command(const char *name) {
     if (!wifi_connected) {
-        printf(ANSI_RED "Error: WiFi not connected!\n" ANSI_RESET);
-        printf("Connect to WiFi first using the 'wifi' command\n");
-        return;
-    }
-    
-    if (http_server_running) {
-        printf(ANSI_YELLOW "Web server is already running\n" ANSI_RESET);
-        return;
-    }
-    
-    // Create listening PCB
-    http_server_pcb = tcp_new();
-    if (!http_server_pcb) {
-        printf(ANSI_RED "Failed to create server PCB\n" ANSI_RESET);
-        return;
-    }
-    
-    err_t err = tcp_bind(http_server_pcb, IP_ADDR_ANY, HTTP_SERVER_PORT);
-    if (err != ERR_OK) {
-        printf(ANSI_RED "Failed to bind to port %d\n" ANSI_RESET, HTTP_SERVER_PORT);
-        tcp_close(http_server_pcb);
-        http_server_pcb = NULL;
+        printf(ANSI_RED "WiFi not connected. Connect to WiFi first.\n" ANSI_RESET);
         return;
     }
-    
-    http_server_pcb = tcp_listen(http_server_pcb);
-    tcp_accept(http_server_pcb, http_accept_callback);
-    
-    http_server_running = true;
-    active_connections = 0;
-    
-    // Get IP address
-    char ip_str[16];
-    const ip4_addr_t *addr = netif_ip4_addr(netif_list);
-    snprintf(ip_str, sizeof(ip_str), "%s", ip4addr_ntoa(addr));
-    
-    printf(ANSI_CLEAR_SCREEN);
-    printf(ANSI_BOLD ANSI_GREEN);
-    printf("╔═══════════════════════════════════════════════╗\n");
-    printf("║        WEB SERVER STARTED - VERSION 2.0       ║\n");
-    printf("╚═══════════════════════════════════════════════╝\n");
-    printf(ANSI_RESET "\n");
-    
-    printf(ANSI_BOLD "Server Status:\n" ANSI_RESET);
-    printf("  • Running on:    http://%s:%d\n", ip_str, HTTP_SERVER_PORT);
-    printf("  • Document root: /web/ (on LittleFS)\n");
-    printf("  • Max connections: %d\n\n", MAX_HTTP_CONNECTIONS);
-    
-    printf(ANSI_CYAN "How to access:\n" ANSI_RESET);
-    printf("  1. Open a web browser on your device\n");
-    printf("  2. Navigate to: " ANSI_BOLD "http://%s" ANSI_RESET "\n", ip_str);
-    printf("  3. Your HTML/CSS files from /web/ will be served\n\n");
-    
-    printf(ANSI_YELLOW "Quick Start:\n" ANSI_RESET);
-    printf("  • Create HTML files: nano /web/index.html\n");
-    printf("  • Create CSS files:  nano /web/style.css\n");
-    printf("  • List web files:    ls\n");
-    printf("  • Stop server:       Press Ctrl+C or type 'stopweb'\n\n");
-    
-    log_message("HTTP server started");
-    
-    printf(ANSI_GREEN "Server is running! Access it from your browser.\n" ANSI_RESET);
-    printf("Type 'stopweb' to stop the server, or any command to continue.\n\n");
-}
-
-// Stop HTTP server
-void stop_http_server() {
-    if (!http_server_running) {
-        printf(ANSI_YELLOW "Web server is not running\n" ANSI_RESET);
+    uint64_t start = time_us_64();
+    struct dns_future future;
+    dns_cache_resolve(name, &future);
+    if (!shell_wait_dns(&future)) {
         return;
     }
-    
-    if (http_server_pcb) {
-        tcp_close(http_server_pcb);
-        http_server_pcb = NULL;
+    uint32_t elapsed_us = (uint32_t)(time_us_64() - start);
+
+    printf("%s: %s", name, dns_result_name(future.result));
+    if (future.result == DNS_RESULT_OK) {
+        printf(" %s", ipaddr_ntoa(&future.addr));
     }
-    
-    http_server_running = false;
-    active_connections = 0;
-    
-    printf(ANSI_GREEN "Web server stopped\n" ANSI_RESET);
-    log_message("HTTP server stopped");
-}
+    printf("  (%s, %lu.%03lu ms)\n", future.cached ? "cached" : "queried",
+           (unsigned long)(elapsed_us / 1000), (unsigned long)(elapsed_us % 1000));
 
-// Create default website files
-void create_default_website() {
-    printf("Creating default website in /web/...\n");
-    
-    // Create /web directory
-    lfs_mkdir(&lfs, "/web");
-    
-    // Create index.html
-    lfs_file_t file;
-    const char* index_html = 
-        "<!DOCTYPE html>\n"
-        "<html>\n"
-        "<head>\n"
-        "    <meta charset=\"UTF-8\">\n"
-        "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
-        "    <title>Pico OS v2.0 - Web Server</title>\n"
-        "    <link rel=\"stylesheet\" href=\"style.css\">\n"
-        "</head>\n"
-        "<body>\n"
-        "    <div class=\"container\">\n"
-        "        <header>\n"
-        "            <h1>🚀 Welcome to Pico OS v2.0</h1>\n"
-        "            <p class=\"subtitle\">Raspberry Pi Pico 2 W Web Server</p>\n"
-        "        </header>\n"
-        "        \n"
-        "        <main>\n"
-        "            <div class=\"card\">\n"
-        "                <h2>✨ Features</h2>\n"
-        "                <ul>\n"
-        "                    <li>HTTP Web Server running on Pico 2 W</li>\n"
-        "                    <li>HTML & CSS support from LittleFS flash</li>\n"
-        "                    <li>Dual-core processing architecture</li>\n"
-        "                    <li>Real-time file system storage</li>\n"
-        "                </ul>\n"
-        "            </div>\n"
-        "            \n"
-        "            <div class=\"card\">\n"
-        "                <h2>📝 Getting Started</h2>\n"
-        "                <p>Edit this page using the nano editor:</p>\n"
-        "                <code>nano /web/index.html</code>\n"
-        "                <p>Customize the CSS stylesheet:</p>\n"
-        "                <code>nano /web/style.css</code>\n"
-        "            </div>\n"
-        "            \n"
-        "            <div class=\"card\">\n"
-        "                <h2>💡 System Info</h2>\n"
-        "                <p><strong>Platform:</strong> Raspberry Pi Pico 2 W</p>\n"
-        "                <p><strong>RAM:</strong> 520 KB</p>\n"
-        "                <p><strong>Flash:</strong> 512 KB (for filesystem)</p>\n"
-        "                <p><strong>WiFi:</strong> 2.4 GHz 802.11n</p>\n"
-        "            </div>\n"
-        "        </main>\n"
-        "        \n"
-        "        <footer>\n"
-        "            <p>Pico OS Version 2.0 | Powered by LittleFS & lwIP</p>\n"
-        "        </footer>\n"
-        "    </div>\n"
-        "</body>\n"
-        "</html>\n";
-    
-    if (lfs_file_open(&lfs, &file, "/web/index.html", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
-        lfs_file_write(&lfs, &file, index_html, strlen(index_html));
-        lfs_file_close(&lfs, &file);
-        printf("[OK] Created /web/index.html\n");
-    }
-    
-    // Create style.css
-    const char* style_css = 
-        "* {\n"
-        "    margin: 0;\n"
-        "    padding: 0;\n"
-        "    box-sizing: border-box;\n"
-        "}\n"
-        "\n"
-        "body {\n"
-        "    font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif;\n"
-        "    background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);\n"
-        "    min-height: 100vh;\n"
-        "    display: flex;\n"
-        "    justify-content: center;\n"
-        "    align-items: center;\n"
-        "    padding: 20px;\n"
-        "}\n"
-        "\n"
-        ".container {\n"
-        "    max-width: 800px;\n"
-        "    background: white;\n"
-        "    border-radius: 20px;\n"
-        "    box-shadow: 0 20px 60px rgba(0,0,0,0.3);\n"
-        "    overflow: hidden;\n"
-        "}\n"
-        "\n"
-        "header {\n"
-        "    background: linear-gradient(135deg, #667eea 0%, #764ba2 100%);\n"
-        "    color: white;\n"
-        "    padding: 40px;\n"
-        "    text-align: center;\n"
-        "}\n"
-        "\n"
-        "header h1 {\n"
-        "    font-size: 2.5em;\n"
-        "    margin-bottom: 10px;\n"
-        "}\n"
-        "\n"
-        ".subtitle {\n"
-        "    font-size: 1.2em;\n"
-        "    opacity: 0.9;\n"
-        "}\n"
-        "\n"
-        "main {\n"
-        "    padding: 40px;\n"
-        "}\n"
-        "\n"
-        ".card {\n"
-        "    background: #f8f9fa;\n"
-        "    border-radius: 10px;\n"
-        "    padding: 25px;\n"
-        "    margin-bottom: 20px;\n"
-        "}\n"
-        "\n"
-        ".card h2 {\n"
-        "    color: #667eea;\n"
-        "    margin-bottom: 15px;\n"
-        "    font-size: 1.5em;\n"
-        "}\n"
-        "\n"
-        ".card ul {\n"
-        "    list-style: none;\n"
-        "    padding-left: 0;\n"
-        "}\n"
-        "\n"
-        ".card li {\n"
-        "    padding: 8px 0;\n"
-        "    padding-left: 25px;\n"
-        "    position: relative;\n"
-        "}\n"
-        "\n"
-        ".card li:before {\n"
-        "    content: '✓';\n"
-        "    position: absolute;\n"
-        "    left: 0;\n"
-        "    color: #667eea;\n"
-        "    font-weight: bold;\n"
-        "}\n"
-        "\n"
-        "code {\n"
-        "    background: #2d3748;\n"
-        "    color: #68d391;\n"
-        "    padding: 8px 12px;\n"
-        "    border-radius: 5px;\n"
-        "    display: block;\n"
-        "    margin: 10px 0;\n"
-        "    font-family: 'Courier New', monospace;\n"
-        "}\n"
-        "\n"
-        "footer {\n"
-        "    background: #2d3748;\n"
-        "    color: white;\n"
-        "    text-align: center;\n"
-        "    padding: 20px;\n"
-        "    font-size: 0.9em;\n"
-        "}\n";
-    
-    if (lfs_file_open(&lfs, &file, "/web/style.css", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
-        lfs_file_write(&lfs, &file, style_css, strlen(style_css));
-        lfs_file_close(&lfs, &file);
-        printf("[OK] Created /web/style.css\n");
+    // Remaining TTL as the cache holds it now
+    struct dns_cache_info info;
+    char key[DNS_CACHE_NAME_MAX];
+    snprintf(key, sizeof(key), "%s", name);
+    for (char *c = key; *c; c++) {
+        *c = (char)tolower((unsigned char)*c);
+    }
+    for (int i = 0; dns_cache_get_entry(i, &info); i++) {
+        if (strcmp(info.name, key) == 0) {
+            printf("  TTL %lu s, %lu s left\n", (unsigned long)info.ttl, (unsigned long)info.ttl_left);
+            break;
+        }
     }
-    
-    printf(ANSI_GREEN "\nDefault website created successfully!\n" ANSI_RESET);
-    printf("Start the web server with: " ANSI_BOLD "localhost\n" ANSI_RESET);
 }
 
 // Process management
+// Processes are cooperative background tasks polled by core1_main()
 int add_process(const char* name, void (*func)(void)) {
     if (process_count >= MAX_PROCESSES) {
         return -1;
@@ -813,18 +562,32 @@ int add_process(const char* name, void (*func)(void)) {
     
     strncpy(processes[process_count].name, name, sizeof(processes[process_count].name) - 1);
     processes[process_count].name[sizeof(processes[process_count].name) - 1] = '\0';
-    processes[process_count].running = true;
     processes[process_count].start_time = to_ms_since_boot(get_absolute_time()) / 1000;
     processes[process_count].func = func;
-    
-    // Launch on core 1
-    multicore_reset_core1();
-    multicore_launch_core1(func);
+    processes[process_count].run_us = 0;
+    processes[process_count].calls = 0;
+    __dmb();
+    processes[process_count].running = true;
     
     log_message("Process started");
     return process_count++;
 }
 
+int process_get_count() {
+    return process_count;
+}
+
+bool process_get_info(int pid, char* name, size_t len, bool* running, uint32_t* start_time) {
+    if (pid < 0 || pid >= process_count) {
+        return false;
+    }
+    strncpy(name, processes[pid].name, len - 1);
+    name[len - 1] = '\0';
+    *running = processes[pid].running;
+    *start_time = processes[pid].start_time;
+    return true;
+}
+
 void list_processes() {
     printf("\n" ANSI_BOLD "Running Processes:" ANSI_RESET "\n");
     printf("%-20s %-10s %-10s\n", "Name", "PID", "Uptime");
@@ -846,7 +609,6 @@ void stop_process(const char* name) {
     for (int i = 0; i < process_count; i++) {
         if (processes[i].running && strcmp(processes[i].name, name) == 0) {
             processes[i].running = false;
-            multicore_reset_core1();
             printf(ANSI_GREEN "Process '%s' stopped\n" ANSI_RESET, name);
             log_message("Process stopped");
             return;
@@ -855,6 +617,176 @@ void stop_process(const char* name) {
     printf(ANSI_RED "Process '%s' not found\n" ANSI_RESET, name);
 }
 
+// ===== TOP =====
+#define TOP_DEFAULT_INTERVAL_MS 1000
+#define TOP_MIN_INTERVAL_MS 100
+
+// Share of total in tenths of a percent
+static uint32_t top_permille(uint64_t part, uint64_t total) {
+    return total ? (uint32_t)((part * 1000 + total / 2) / total) : 0;
+}
+
+static void top_print_percent(uint32_t permille) {
+    printf(" %4lu.%lu%%", (unsigned long)(permille / 10), (unsigned long)(permille % 10));
+}
+
+// Waits out the refresh interval as idle time; true if a key was pressed
+static bool top_wait(uint32_t interval_ms) {
+    absolute_time_t deadline = make_timeout_time_ms(interval_ms);
+    enum cpu_activity previous = cpu_enter(CPU_IDLE);
+    bool key = false;
+    while (!time_reached(deadline)) {
+        if (getchar_timeout_us(0) != PICO_ERROR_TIMEOUT) {
+            key = true;
+            break;
+        }
+        sleep_ms(10);
+    }
+    cpu_enter(previous);
+    return key;
+}
+
+#if PICO_OS_FREERTOS
+#define TOP_MAX_TASKS 16
+
+// Scheduler run-time counters (microseconds) as of the last refresh
+struct top_task_times {
+    UBaseType_t numbers[TOP_MAX_TASKS];
+    configRUN_TIME_COUNTER_TYPE run[TOP_MAX_TASKS];
+    UBaseType_t count;
+};
+
+// One line per task, CPU as a share of one core; print false only takes
+// the baseline
+static void top_tasks(struct top_task_times *times, uint64_t elapsed_us, bool print) {
+    static TaskStatus_t status[TOP_MAX_TASKS];
+    UBaseType_t count = uxTaskGetSystemState(status, TOP_MAX_TASKS, NULL);
+    if (print) {
+        printf("\033[K\n" ANSI_BOLD "%-12s %3s %5s %7s %9s" ANSI_RESET "\033[K\n",
+               "TASK", "PRI", "STATE", "cpu", "stack free");
+        for (UBaseType_t i = 0; i < count; i++) {
+            configRUN_TIME_COUNTER_TYPE previous = 0;
+            for (UBaseType_t j = 0; j < times->count; j++) {
+                if (times->numbers[j] == status[i].xTaskNumber) {
+                    previous = times->run[j];
+                    break;
+                }
+            }
+            static const char states[] = "RrBSD";   // Running, ready, blocked, suspended, deleted
+            eTaskState state = status[i].eCurrentState;
+            printf("%-12s %3lu %5c", status[i].pcTaskName, (unsigned long)status[i].uxCurrentPriority,
+                   state <= eDeleted ? states[state] : '?');
+            top_print_percent(top_permille(status[i].ulRunTimeCounter - previous, elapsed_us));
+            printf(" %9lu\033[K\n", (unsigned long)(status[i].usStackHighWaterMark * sizeof(StackType_t)));
+        }
+    }
+    times->count = count;
+    for (UBaseType_t i = 0; i < count; i++) {
+        times->numbers[i] = status[i].xTaskNumber;
+        times->run[i] = status[i].ulRunTimeCounter;
+    }
+}
+#endif
+
+// Per-core load by activity and per-process run time, refreshed in place
+void top_command(int argc, char* args[]) {
+    uint32_t interval_ms = TOP_DEFAULT_INTERVAL_MS;
+    int count = 0;              // Refreshes; 0 = until a key
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "-d") == 0 && i + 1 < argc) {
+            interval_ms = (uint32_t)(atof(args[++i]) * 1000);
+        } else if (strcmp(args[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(args[++i]);
+        } else {
+            printf("Usage: top [-d seconds] [-n count]\n");
+            return;
+        }
+    }
+    if (interval_ms < TOP_MIN_INTERVAL_MS) {
+        interval_ms = TOP_MIN_INTERVAL_MS;
+    }
+
+    uint32_t switch_ns = cpu_load_switch_ns();
+    struct cpu_load_sample before, after;
+    uint32_t run_before[MAX_PROCESSES], calls_before[MAX_PROCESSES];
+    cpu_load_sample(&before);
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        run_before[i] = processes[i].run_us;
+        calls_before[i] = processes[i].calls;
+    }
+#if PICO_OS_FREERTOS
+    static struct top_task_times task_times;
+    top_tasks(&task_times, 0, false);
+#endif
+
+    printf(ANSI_CLEAR_SCREEN);
+    for (int n = 0; count == 0 || n < count; n++) {
+        if (top_wait(interval_ms)) {
+            break;
+        }
+        cpu_load_sample(&after);
+        uint64_t elapsed_us = after.at_us - before.at_us;
+
+        uint32_t uptime = (uint32_t)(after.at_us / 1000000);
+        printf("\033[H" ANSI_BOLD "top" ANSI_RESET " - up %lu:%02lu:%02lu, every %lu.%lu s, any key quits\033[K\n\033[K\n",
+               (unsigned long)(uptime / 3600), (unsigned long)(uptime % 3600 / 60), (unsigned long)(uptime % 60),
+               (unsigned long)(interval_ms / 1000), (unsigned long)(interval_ms % 1000 / 100));
+        printf(ANSI_BOLD "%-5s %7s", "CORE", "busy");
+        for (int a = 0; a < CPU_ACTIVITIES; a++) {
+            printf(" %7s", cpu_activity_name((enum cpu_activity)a));
+        }
+        printf(ANSI_RESET);
+        printf("\033[K\n");
+
+        uint32_t switches = 0;
+        for (int core = 0; core < CPU_LOAD_CORES; core++) {
+            uint64_t delta[CPU_ACTIVITIES];
+            uint64_t total = 0;
+            for (int a = 0; a < CPU_ACTIVITIES; a++) {
+                delta[a] = after.us[core][a] - before.us[core][a];
+                total += delta[a];
+            }
+            printf("core%d", core);
+            top_print_percent(1000 - top_permille(delta[CPU_IDLE], total));
+            for (int a = 0; a < CPU_ACTIVITIES; a++) {
+                top_print_percent(top_permille(delta[a], total));
+            }
+            printf("\033[K\n");
+            switches += after.switches[core] - before.switches[core];
+        }
+        // Cost of the accounting itself, as a share of both cores
+        uint64_t switch_us = (uint64_t)switches * switch_ns / 1000;
+        printf("accounting: %lu switches/s at %lu ns,",
+               (unsigned long)((uint64_t)switches * 1000000 / elapsed_us), (unsigned long)switch_ns);
+        top_print_percent(top_permille(switch_us, elapsed_us * CPU_LOAD_CORES));
+        printf(" of the CPU\033[K\n\033[K\n");
+
+        printf(ANSI_BOLD "%-4s %-20s %7s %9s %9s" ANSI_RESET "\033[K\n", "PID", "NAME", "cpu", "calls/s", "us/call");
+        for (int i = 0; i < process_count; i++) {
+            uint32_t run = processes[i].run_us;
+            uint32_t calls = processes[i].calls;
+            uint32_t run_delta = run - run_before[i];
+            uint32_t call_delta = calls - calls_before[i];
+            run_before[i] = run;
+            calls_before[i] = calls;
+            if (!processes[i].running) {
+                continue;
+            }
+            printf("%-4d %-20s", i, processes[i].name);
+            top_print_percent(top_permille(run_delta, elapsed_us));
+            printf(" %9lu %9lu\033[K\n", (unsigned long)((uint64_t)call_delta * 1000000 / elapsed_us),
+                   (unsigned long)(call_delta ? run_delta / call_delta : 0));
+        }
+#if PICO_OS_FREERTOS
+        top_tasks(&task_times, elapsed_us, true);
+#endif
+        printf("\033[J");
+        fflush(stdout);
+        before = after;
+    }
+    printf("\n");
+}
+
 // ===== NMAP - TCP PORT SCANNER =====
 struct tcp_scan_state {
     ip_addr_t target_ip;
@@ -877,7 +809,7 @@ static void scan_error_callback(void *arg, err_t err) {
     state->finished = true;
 }
 
-bool scan_port(ip_addr_t *target, uint16_t port, uint32_t timeout_ms) {
+bool scan_port(const ip_addr_t *target, uint16_t port, uint32_t timeout_ms) {
     struct tcp_scan_state state;
     state.target_ip = *target;
     state.port = port;
@@ -915,121 +847,345 @@ bool scan_port(ip_addr_t *target, uint16_t port, uint32_t timeout_ms) {
     return state.connected;
 }
 
-void nmap_app() {
-    if (!wifi_connected) {
-        printf(ANSI_RED "\nWiFi not connected. Cannot perform port scan.\n" ANSI_RESET);
+static const uint16_t nmap_common_ports[] = {21, 22, 23, 25, 53, 80, 110, 143, 443, 445, 3306, 3389, 5432,
+                                             8080, 8443};
+static const uint16_t nmap_common_udp_ports[] = {53, 67, 68, 69, 123, 137, 161, 500, 514, 1900, 5353};
+
+// Open ports found by a SYN or UDP scan, queued in lwIP context for the shell
+#define NMAP_OPEN_RING 32
+static struct {
+    uint16_t open[NMAP_OPEN_RING];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile bool done;
+} nmap_syn;
+
+static void nmap_syn_event(struct port_scan *scan, enum port_scan_event event, uint16_t port, void *arg) {
+    if (event == PORT_SCAN_EVENT_DONE) {
+        nmap_syn.done = true;
         return;
     }
-    
-    printf(ANSI_CLEAR_SCREEN);
-    printf(ANSI_BOLD ANSI_CYAN "╔════════════════════════════════════════╗\n");
-    printf("║         NMAP - Port Scanner            ║\n");
-    printf("╚════════════════════════════════════════╝\n" ANSI_RESET);
-    
-    char *target_input = read_line("\nEnter target IP or hostname: ", true);
-    if (!target_input || strlen(target_input) == 0) {
-        printf(ANSI_RED "Invalid input\n" ANSI_RESET);
-        return;
+    uint32_t head = nmap_syn.head;
+    if (head - nmap_syn.tail < NMAP_OPEN_RING) {
+        nmap_syn.open[head % NMAP_OPEN_RING] = port;
+        __dmb();
+        nmap_syn.head = head + 1;
     }
-    
-    ip_addr_t target_ip;
-    if (!ipaddr_aton(target_input, &target_ip)) {
-        printf("Resolving hostname...\n");
-        // For simplicity, require IP address
-        printf(ANSI_RED "Please use IP address format (e.g., 192.168.1.1)\n" ANSI_RESET);
+}
+
+static void nmap_print_open(uint16_t port, enum port_scan_mode mode) {
+    const char *service = port_service_name(port, mode);
+    printf("\r\033[K" ANSI_GREEN "%-8u %-10s %s\n" ANSI_RESET, port, "open", service ? service : "unknown");
+}
+
+// Half-open SYN or UDP scan through the port scan engine; any key stops it
+static void nmap_raw_scan(const ip_addr_t *target, const struct port_scan_options *options) {
+    static struct port_scan scan;
+    uint32_t count = options->ports ? options->port_count : options->last_port - options->first_port + 1;
+    uint8_t *states = (uint8_t*)malloc(PORT_SCAN_STATE_BYTES(count));
+    if (!states) {
+        printf(ANSI_RED "Out of memory\n" ANSI_RESET);
         return;
     }
-    
-    char *range_input = read_line("Port range (e.g., 1-1024 or 'common'): ", true);
-    if (!range_input || strlen(range_input) == 0) {
-        printf(ANSI_RED "Invalid input\n" ANSI_RESET);
+    memset(&nmap_syn, 0, sizeof(nmap_syn));
+
+    cyw43_arch_lwip_begin();
+    bool started = port_scan_start(&scan, target, options, states, nmap_syn_event, NULL);
+    cyw43_arch_lwip_end();
+    if (!started) {
+        printf(ANSI_RED "Cannot start %s scan\n" ANSI_RESET, options->mode == PORT_SCAN_UDP ? "UDP" : "SYN");
+        free(states);
         return;
     }
-    
-    uint16_t start_port = 1;
-    uint16_t end_port = 1024;
-    
-    if (strcmp(range_input, "common") == 0) {
-        // Scan common ports
-        uint16_t common_ports[] = {21, 22, 23, 25, 53, 80, 110, 143, 443, 445, 3306, 3389, 5432, 8080, 8443};
-        int num_common = sizeof(common_ports) / sizeof(common_ports[0]);
-        
-        printf("\nScanning %d common ports on %s...\n\n", num_common, target_input);
-        printf(ANSI_BOLD "PORT     STATE      SERVICE\n" ANSI_RESET);
-        printf("----     -----      -------\n");
-        
-        int open_count = 0;
-        for (int i = 0; i < num_common; i++) {
-            printf("Scanning port %d...\r", common_ports[i]);
+
+    printf(ANSI_BOLD "PORT     STATE      SERVICE\n" ANSI_RESET);
+    printf("----     -----      -------\n");
+    bool aborted = false;
+    uint64_t next_progress_us = 0;
+    while (true) {
+        while (nmap_syn.tail != nmap_syn.head) {
+            __dmb();
+            nmap_print_open(nmap_syn.open[nmap_syn.tail % NMAP_OPEN_RING], options->mode);
+            nmap_syn.tail = nmap_syn.tail + 1;
+        }
+        if (nmap_syn.done) {
+            break;
+        }
+        if (getchar_timeout_us(0) != PICO_ERROR_TIMEOUT) {
+            cyw43_arch_lwip_begin();
+            port_scan_stop(&scan);
+            cyw43_arch_lwip_end();
+            aborted = true;
+            break;
+        }
+        uint64_t now = time_us_64();
+        if (now >= next_progress_us) {
+            printf("\r\033[K%lu/%lu ports, %lu probes sent, %lu/s", (unsigned long)scan.stats.resolved,
+                   (unsigned long)count, (unsigned long)scan.stats.sent, (unsigned long)scan.stats.rate_pps);
             fflush(stdout);
-            
-            bool is_open = scan_port(&target_ip, common_ports[i], 1000);
-            if (is_open) {
-                const char *service = "unknown";
-                switch (common_ports[i]) {
-                    case 21: service = "ftp"; break;
-                    case 22: service = "ssh"; break;
-                    case 23: service = "telnet"; break;
-                    case 25: service = "smtp"; break;
-                    case 53: service = "dns"; break;
-                    case 80: service = "http"; break;
-                    case 110: service = "pop3"; break;
-                    case 143: service = "imap"; break;
-                    case 443: service = "https"; break;
-                    case 445: service = "smb"; break;
-                    case 3306: service = "mysql"; break;
-                    case 3389: service = "rdp"; break;
-                    case 5432: service = "postgresql"; break;
-                    case 8080: service = "http-alt"; break;
-                    case 8443: service = "https-alt"; break;
-                }
-                printf(ANSI_GREEN "%-8d %-10s %s\n" ANSI_RESET, common_ports[i], "open", service);
-                open_count++;
+            next_progress_us = now + 250000;
+        }
+        best_effort_wfe_or_timeout(make_timeout_time_ms(10));
+    }
+
+    cyw43_arch_lwip_begin();
+    struct port_scan_stats stats = scan.stats;
+    cyw43_arch_lwip_end();
+    free(states);
+
+    uint32_t ms = (uint32_t)((stats.end_us - stats.start_us) / 1000);
+    printf("\r\033[K\n" ANSI_BOLD "%s: %lu open, %lu closed, %lu %s of %lu ports in %lu.%03lu s\n" ANSI_RESET,
+           aborted ? "Scan stopped" : "Scan complete", (unsigned long)stats.open, (unsigned long)stats.closed,
+           (unsigned long)stats.filtered, options->mode == PORT_SCAN_UDP ? "open|filtered" : "filtered",
+           (unsigned long)count, (unsigned long)(ms / 1000), (unsigned long)(ms % 1000));
+    printf("%lu probes (%lu retries, %lu send errors), %lu late answers\n", (unsigned long)stats.sent,
+           (unsigned long)stats.retries, (unsigned long)stats.send_errors, (unsigned long)stats.late);
+    if (options->mode == PORT_SCAN_UDP) {
+        printf("%lu ICMP unreachables, %lu rate halvings, ending at %lu probes/s\n",
+               (unsigned long)stats.unreachables, (unsigned long)stats.backoffs, (unsigned long)stats.rate_pps);
+    }
+}
+
+// One full connect per port, waiting for each
+static void nmap_connect_scan(const ip_addr_t *target, const struct port_scan_options *options) {
+    uint32_t count = options->ports ? options->port_count : options->last_port - options->first_port + 1;
+    printf(ANSI_BOLD "PORT     STATE      SERVICE\n" ANSI_RESET);
+    printf("----     -----      -------\n");
+
+    int open_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t port = options->ports ? options->ports[i] : (uint16_t)(options->first_port + i);
+        printf("Scanning port %d...\r", port);
+        fflush(stdout);
+
+        if (scan_port(target, port, options->ports ? 1000 : 500)) {
+            nmap_print_open(port, PORT_SCAN_SYN);
+            open_count++;
+        }
+    }
+
+    printf("\n" ANSI_BOLD "Scan complete: %d open ports found\n" ANSI_RESET, open_count);
+}
+
+static void nmap_usage() {
+    printf("Usage: nmap [-sS|-sU|-sT] [-r pps] [<host> [<from>-<to>|<port>|common]]\n");
+    printf("  -sS  half-open SYN scan, paced (default %d probes/s)\n", PORT_SCAN_DEFAULT_RATE);
+    printf("  -sU  UDP scan, slowing to the target's ICMP unreachable rate\n");
+    printf("  -sT  full connect scan, one port at a time (default)\n");
+    printf("Missing arguments are asked for.\n");
+}
+
+void nmap_command(int argc, char* args[]) {
+    bool raw = false;           // SYN or UDP through the scan engine
+    const char *host = NULL;
+    const char *range = NULL;
+    struct port_scan_options options;
+    port_scan_options_default(&options);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "-sS") == 0) {
+            raw = true;
+            options.mode = PORT_SCAN_SYN;
+        } else if (strcmp(args[i], "-sU") == 0) {
+            raw = true;
+            options.mode = PORT_SCAN_UDP;
+            options.retries = 2;        // Silence decides UDP ports, so confirm it once more
+        } else if (strcmp(args[i], "-sT") == 0) {
+            raw = false;
+        } else if (strcmp(args[i], "-r") == 0 && i + 1 < argc) {
+            int rate = atoi(args[++i]);
+            if (rate < 1 || rate > PORT_SCAN_MAX_RATE) {
+                printf(ANSI_RED "Rate must be 1..%d probes/s\n" ANSI_RESET, PORT_SCAN_MAX_RATE);
+                return;
             }
+            options.rate_pps = (uint16_t)rate;
+        } else if (args[i][0] != '-' && !host) {
+            host = args[i];
+        } else if (args[i][0] != '-' && !range) {
+            range = args[i];
+        } else {
+            nmap_usage();
+            return;
         }
-        
-        printf("\n" ANSI_BOLD "Scan complete: %d open ports found\n" ANSI_RESET, open_count);
-        
-    } else {
-        // Parse range
-        char *dash = strchr(range_input, '-');
-        if (dash) {
-            *dash = '\0';
-            start_port = atoi(range_input);
-            end_port = atoi(dash + 1);
+    }
+
+    if (!wifi_connected) {
+        printf(ANSI_RED "\nWiFi not connected. Cannot perform port scan.\n" ANSI_RESET);
+        return;
+    }
+
+    if (!host) {
+        printf(ANSI_CLEAR_SCREEN);
+        printf(ANSI_BOLD ANSI_CYAN "╔════════════════════════════════════════╗\n");
+        printf("║         NMAP - Port Scanner            ║\n");
+        printf("╚════════════════════════════════════════╝\n" ANSI_RESET);
+
+        host = read_line("\nEnter target IP or hostname: ", true);
+        if (!host || strlen(host) == 0) {
+            printf(ANSI_RED "Invalid input\n" ANSI_RESET);
+            return;
+        }
+    }
+
+    ip_addr_t target_ip;
+    if (!shell_resolve(host, &target_ip)) {
+        return;
+    }
+
+    if (!range) {
+        range = read_line("Port range (e.g., 1-1024 or 'common'): ", true);
+        if (!range || strlen(range) == 0) {
+            printf(ANSI_RED "Invalid input\n" ANSI_RESET);
+            return;
+        }
+    }
+
+    const char *verb = !raw ? "Scanning" : options.mode == PORT_SCAN_UDP ? "UDP scanning" : "SYN scanning";
+    if (strcmp(range, "common") == 0) {
+        if (raw && options.mode == PORT_SCAN_UDP) {
+            options.ports = nmap_common_udp_ports;
+            options.port_count = sizeof(nmap_common_udp_ports) / sizeof(nmap_common_udp_ports[0]);
         } else {
-            start_port = end_port = atoi(range_input);
+            options.ports = nmap_common_ports;
+            options.port_count = sizeof(nmap_common_ports) / sizeof(nmap_common_ports[0]);
         }
-        
-        if (start_port < 1 || start_port > end_port) {
+        printf("\n%s %d common ports on %s...\n\n", verb, options.port_count, host);
+    } else {
+        // Parse range
+        const char *dash = strchr(range, '-');
+        long start_port = atol(range);
+        long end_port = dash ? atol(dash + 1) : start_port;
+        if (start_port < 1 || end_port > 65535 || start_port > end_port) {
             printf(ANSI_RED "Invalid port range\n" ANSI_RESET);
             return;
         }
-        
-        printf("\nScanning ports %d-%d on %s...\n\n", start_port, end_port, target_input);
-        printf(ANSI_BOLD "PORT     STATE\n" ANSI_RESET);
-        printf("----     -----\n");
-        
-        int open_count = 0;
-        for (uint16_t port = start_port; port <= end_port; port++) {
-            printf("Scanning port %d...\r", port);
-            fflush(stdout);
-            
-            bool is_open = scan_port(&target_ip, port, 500);
-            if (is_open) {
-                printf(ANSI_GREEN "%-8d open\n" ANSI_RESET, port);
-                open_count++;
-            }
+        options.first_port = (uint16_t)start_port;
+        options.last_port = (uint16_t)end_port;
+        printf("\n%s ports %ld-%ld on %s...\n\n", verb, start_port, end_port, host);
+    }
+
+    if (raw) {
+        nmap_raw_scan(&target_ip, &options);
+    } else {
+        nmap_connect_scan(&target_ip, &options);
+    }
+
+    if (argc < 2) {
+        read_line("\nPress Enter to continue...", true);
+    }
+}
+
+// ===== FONTS =====
+// Glyph rendering lives in font.cpp; extra fonts are binary images in
+// /fonts (see font.h for the format and the mkfont host tool)
+
+// Load one font file and register it under its base name
+bool font_load_file(const char* path) {
+    lfs_file_t file;
+    if (lfs_file_open(&lfs, &file, path, LFS_O_RDONLY) < 0) {
+        return false;
+    }
+    lfs_soff_t size = lfs_file_size(&lfs, &file);
+    if (size <= 0 || size > FONT_FILE_MAX) {
+        lfs_file_close(&lfs, &file);
+        return false;
+    }
+    uint8_t *data = (uint8_t*)malloc(size);
+    if (!data) {
+        lfs_file_close(&lfs, &file);
+        return false;
+    }
+    lfs_ssize_t len = lfs_file_read(&lfs, &file, data, size);
+    lfs_file_close(&lfs, &file);
+
+    // "/fonts/big.fnt" -> "big"
+    char name[FONT_NAME_LEN];
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    strncpy(name, base, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    char *dot = strrchr(name, '.');
+    if (dot) *dot = '\0';
+
+    struct font *font = len == size ? font_parse(data, size, name) : NULL;
+    free(data);
+    if (!font) {
+        return false;
+    }
+    if (!font_register(font)) {
+        font_free(font);
+        return false;
+    }
+    return true;
+}
+
+// Register every *.fnt in /fonts, returns how many loaded
+int load_fonts() {
+    lfs_dir_t dir;
+    struct lfs_info info;
+    if (lfs_dir_open(&lfs, &dir, FONT_DIR) < 0) {
+        return 0;
+    }
+    int loaded = 0;
+    while (lfs_dir_read(&lfs, &dir, &info) > 0) {
+        size_t n = strlen(info.name);
+        if (info.type != LFS_TYPE_REG || n < 5 || strcmp(info.name + n - 4, ".fnt") != 0) {
+            continue;
+        }
+        char path[LFS_NAME_MAX + sizeof(FONT_DIR) + 1];
+        snprintf(path, sizeof(path), "%s/%s", FONT_DIR, info.name);
+        if (font_load_file(path)) {
+            loaded++;
         }
-        
-        printf("\n" ANSI_BOLD "Scan complete: %d open ports found\n" ANSI_RESET, open_count);
     }
-    
-    read_line("\nPress Enter to continue...", true);
+    lfs_dir_close(&lfs, &dir);
+    return loaded;
+}
+
+void list_fonts() {
+    printf("\n" ANSI_BOLD "Fonts:\n" ANSI_RESET);
+    for (int i = 0; i < font_count(); i++) {
+        const struct font *font = font_get(i);
+        printf("  %-16s %d rows\n", font->name, font->height);
+    }
+    printf("\n");
+}
+
+// banner [-f font] text...
+void banner_command(int argc, char* args[]) {
+    const struct font *font = &font_slash;
+    int first = 1;
+    if (argc > 2 && strcmp(args[1], "-f") == 0) {
+        font = font_find(args[2]);
+        if (!font) {
+            printf(ANSI_RED "Unknown font: %s\n" ANSI_RESET, args[2]);
+            return;
+        }
+        first = 3;
+    }
+    if (first >= argc) {
+        printf("Usage: banner [-f font] <text>\n");
+        return;
+    }
+
+    char text[64] = "";
+    for (int i = first; i < argc; i++) {
+        if (i > first) strncat(text, " ", sizeof(text) - strlen(text) - 1);
+        strncat(text, args[i], sizeof(text) - strlen(text) - 1);
+    }
+    printf("\n");
+    font_print(font, text, 0);
+    printf("\n");
 }
 
 // ===== ASCII ART CONVERTER =====
-void ascii_converter() {
+void ascii_converter(const char* font_name) {
+    const struct font *font = font_name ? font_find(font_name) : &font_slash;
+    if (!font) {
+        printf(ANSI_RED "Unknown font: %s\n" ANSI_RESET, font_name);
+        return;
+    }
+
     printf(ANSI_CLEAR_SCREEN);
     printf(ANSI_BOLD ANSI_CYAN "╔════════════════════════════════════════╗\n");
     printf("║       ASCII Art Text Converter         ║\n");
@@ -1051,314 +1207,41 @@ void ascii_converter() {
         text[20] = '\0';
     }
     
-    // Convert text to uppercase for consistency
-    for (int i = 0; text[i]; i++) {
-        text[i] = toupper(text[i]);
-    }
-    
     printf("\n");
-    
-    // Slash style ASCII art - 5 lines high, using / and \ characters
-    for (int line = 0; line < 5; line++) {
-        for (int i = 0; text[i]; i++) {
-            char c = text[i];
-            
-            if (c == ' ') {
-                printf("    ");
-            } else if (c >= 'A' && c <= 'Z') {
-                // Letter definitions using / and \ characters
-                switch (line) {
-                    case 0: // Top line
-                        if (c == 'A') printf(" /\\ ");
-                        else if (c == 'B') printf("/==\\");
-                        else if (c == 'C') printf(" /==");
-                        else if (c == 'D') printf("/==\\");
-                        else if (c == 'E') printf("/===");
-                        else if (c == 'F') printf("/===");
-                        else if (c == 'G') printf(" /==");
-                        else if (c == 'H') printf("/  \\");
-                        else if (c == 'I') printf("===");
-                        else if (c == 'J') printf("  /");
-                        else if (c == 'K') printf("/  \\");
-                        else if (c == 'L') printf("/   ");
-                        else if (c == 'M') printf("/\\  /\\");
-                        else if (c == 'N') printf("/\\  \\");
-                        else if (c == 'O') printf(" /\\ ");
-                        else if (c == 'P') printf("/==\\");
-                        else if (c == 'Q') printf(" /\\ ");
-                        else if (c == 'R') printf("/==\\");
-                        else if (c == 'S') printf(" /==");
-                        else if (c == 'T') printf("===");
-                        else if (c == 'U') printf("\\  /");
-                        else if (c == 'V') printf("\\  /");
-                        else if (c == 'W') printf("\\    /");
-                        else if (c == 'X') printf("\\  /");
-                        else if (c == 'Y') printf("\\ /");
-                        else if (c == 'Z') printf("===");
-                        else printf("    ");
-                        break;
-                        
-                    case 1: // Second line
-                        if (c == 'A') printf("/  \\");
-                        else if (c == 'B') printf("|-- ");
-                        else if (c == 'C') printf("|   ");
-                        else if (c == 'D') printf("|  \\");
-                        else if (c == 'E') printf("|-- ");
-                        else if (c == 'F') printf("|-- ");
-                        else if (c == 'G') printf("|   ");
-                        else if (c == 'H') printf("|--|");
-                        else if (c == 'I') printf(" | ");
-                        else if (c == 'J') printf("  |");
-                        else if (c == 'K') printf("|-/ ");
-                        else if (c == 'L') printf("|   ");
-                        else if (c == 'M') printf("| \\/ |");
-                        else if (c == 'N') printf("| \\ |");
-                        else if (c == 'O') printf("|  |");
-                        else if (c == 'P') printf("|--/");
-                        else if (c == 'Q') printf("|  |");
-                        else if (c == 'R') printf("|--/");
-                        else if (c == 'S') printf("\\__ ");
-                        else if (c == 'T') printf(" | ");
-                        else if (c == 'U') printf("|  |");
-                        else if (c == 'V') printf(" \\/");
-                        else if (c == 'W') printf(" \\  / ");
-                        else if (c == 'X') printf(" \\/ ");
-                        else if (c == 'Y') printf(" | ");
-                        else if (c == 'Z') printf(" / ");
-                        else printf("    ");
-                        break;
-                        
-                    case 2: // Middle line
-                        if (c == 'A') printf("/==\\");
-                        else if (c == 'B') printf("|==\\");
-                        else if (c == 'C') printf("|   ");
-                        else if (c == 'D') printf("|  |");
-                        else if (c == 'E') printf("|-- ");
-                        else if (c == 'F') printf("|   ");
-                        else if (c == 'G') printf("| -+");
-                        else if (c == 'H') printf("|  |");
-                        else if (c == 'I') printf(" | ");
-                        else if (c == 'J') printf("  |");
-                        else if (c == 'K') printf("|-\\ ");
-                        else if (c == 'L') printf("|   ");
-                        else if (c == 'M') printf("|    |");
-                        else if (c == 'N') printf("|  \\|");
-                        else if (c == 'O') printf("|  |");
-                        else if (c == 'P') printf("|   ");
-                        else if (c == 'Q') printf("| \\|");
-                        else if (c == 'R') printf("|-\\ ");
-                        else if (c == 'S') printf(" __/");
-                        else if (c == 'T') printf(" | ");
-                        else if (c == 'U') printf("|  |");
-                        else if (c == 'V') printf(" /\\");
-                        else if (c == 'W') printf("  \\/  ");
-                        else if (c == 'X') printf(" /\\ ");
-                        else if (c == 'Y') printf(" | ");
-                        else if (c == 'Z') printf("/  ");
-                        else printf("    ");
-                        break;
-                        
-                    case 3: // Fourth line
-                        if (c == 'A') printf("|  |");
-                        else if (c == 'B') printf("|  |");
-                        else if (c == 'C') printf("|   ");
-                        else if (c == 'D') printf("|  /");
-                        else if (c == 'E') printf("|   ");
-                        else if (c == 'F') printf("|   ");
-                        else if (c == 'G') printf("|  |");
-                        else if (c == 'H') printf("|  |");
-                        else if (c == 'I') printf(" | ");
-                        else if (c == 'J') printf("\\ |");
-                        else if (c == 'K') printf("| \\");
-                        else if (c == 'L') printf("|   ");
-                        else if (c == 'M') printf("|    |");
-                        else if (c == 'N') printf("|   |");
-                        else if (c == 'O') printf("|  |");
-                        else if (c == 'P') printf("|   ");
-                        else if (c == 'Q') printf(" \\|\\");
-                        else if (c == 'R') printf("| \\");
-                        else if (c == 'S') printf("\\  \\");
-                        else if (c == 'T') printf(" | ");
-                        else if (c == 'U') printf("|  |");
-                        else if (c == 'V') printf("/  \\");
-                        else if (c == 'W') printf(" /  \\ ");
-                        else if (c == 'X') printf("/  \\");
-                        else if (c == 'Y') printf(" | ");
-                        else if (c == 'Z') printf("/   ");
-                        else printf("    ");
-                        break;
-                        
-                    case 4: // Bottom line
-                        if (c == 'A') printf("|  |");
-                        else if (c == 'B') printf("\\==/");
-                        else if (c == 'C') printf(" \\==");
-                        else if (c == 'D') printf("\\==/");
-                        else if (c == 'E') printf("\\===");
-                        else if (c == 'F') printf("|   ");
-                        else if (c == 'G') printf(" \\==");
-                        else if (c == 'H') printf("|  |");
-                        else if (c == 'I') printf("===");
-                        else if (c == 'J') printf(" \\/ ");
-                        else if (c == 'K') printf("|  \\");
-                        else if (c == 'L') printf("\\___");
-                        else if (c == 'M') printf("|    |");
-                        else if (c == 'N') printf("|   |");
-                        else if (c == 'O') printf(" \\/ ");
-                        else if (c == 'P') printf("|   ");
-                        else if (c == 'Q') printf("  \\_\\");
-                        else if (c == 'R') printf("|  \\");
-                        else if (c == 'S') printf("\\==/");
-                        else if (c == 'T') printf(" | ");
-                        else if (c == 'U') printf(" \\/ ");
-                        else if (c == 'V') printf("|  |");
-                        else if (c == 'W') printf("/    \\");
-                        else if (c == 'X') printf("|  |");
-                        else if (c == 'Y') printf(" | ");
-                        else if (c == 'Z') printf("===");
-                        else printf("    ");
-                        break;
-                }
-                printf(" ");
-            } else if (c >= '0' && c <= '9') {
-                // Number support
-                switch (line) {
-                    case 0: printf(" /==\\"); break;
-                    case 1: printf("|  %c|", c); break;
-                    case 2: printf("|  %c|", c); break;
-                    case 3: printf("|  %c|", c); break;
-                    case 4: printf(" \\==/"); break;
-                }
-                printf(" ");
-            }
-        }
-        printf("\n");
-    }
+    font_print(font, text, 0);
     
     read_line("\nPress Enter to continue...", true);
 }
 
 // ===== TETRIS GAME =====
-static const int tetris_shapes[7][4][4] = {
-    // I piece
-    {{0,0,0,0}, {1,1,1,1}, {0,0,0,0}, {0,0,0,0}},
-    // O piece
-    {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
-    // T piece
-    {{0,0,0,0}, {1,1,1,0}, {0,1,0,0}, {0,0,0,0}},
-    // S piece
-    {{0,0,0,0}, {0,1,1,0}, {1,1,0,0}, {0,0,0,0}},
-    // Z piece
-    {{0,0,0,0}, {1,1,0,0}, {0,1,1,0}, {0,0,0,0}},
-    // J piece
-    {{0,0,0,0}, {1,1,1,0}, {0,0,1,0}, {0,0,0,0}},
-    // L piece
-    {{0,0,0,0}, {1,1,1,0}, {1,0,0,0}, {0,0,0,0}}
-};
-
-void rotate_piece(TetrisPiece *piece) {
-    int temp[4][4];
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            temp[i][j] = piece->shape[3-j][i];
-        }
-    }
-    memcpy(piece->shape, temp, sizeof(temp));
-}
-
-bool check_collision(int board[TETRIS_HEIGHT][TETRIS_WIDTH], TetrisPiece *piece, int dx, int dy) {
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            if (piece->shape[i][j]) {
-                int new_x = piece->x + j + dx;
-                int new_y = piece->y + i + dy;
-                
-                if (new_x < 0 || new_x >= TETRIS_WIDTH || new_y >= TETRIS_HEIGHT) {
-                    return true;
-                }
-                if (new_y >= 0 && board[new_y][new_x]) {
-                    return true;
-                }
-            }
-        }
-    }
-    return false;
-}
-
-void merge_piece(int board[TETRIS_HEIGHT][TETRIS_WIDTH], TetrisPiece *piece) {
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            if (piece->shape[i][j]) {
-                int x = piece->x + j;
-                int y = piece->y + i;
-                if (y >= 0 && y < TETRIS_HEIGHT && x >= 0 && x < TETRIS_WIDTH) {
-                    board[y][x] = piece->type + 1;
-                }
-            }
-        }
-    }
-}
+// Rules live in tetris.cpp (bitboard engine); this is the terminal front-end
 
-int clear_lines(int board[TETRIS_HEIGHT][TETRIS_WIDTH]) {
-    int lines_cleared = 0;
-    for (int i = TETRIS_HEIGHT - 1; i >= 0; i--) {
-        bool full = true;
-        for (int j = 0; j < TETRIS_WIDTH; j++) {
-            if (board[i][j] == 0) {
-                full = false;
-                break;
-            }
-        }
-        if (full) {
-            lines_cleared++;
-            for (int k = i; k > 0; k--) {
-                memcpy(board[k], board[k-1], sizeof(board[0]));
-            }
-            memset(board[0], 0, sizeof(board[0]));
-            i++; // Check this line again
-        }
-    }
-    return lines_cleared;
-}
-
-void draw_tetris_board(int board[TETRIS_HEIGHT][TETRIS_WIDTH], TetrisPiece *piece, int score, int level) {
+void draw_tetris_board(const struct tetris_board *board, const struct tetris_piece *piece, int score, int level) {
     printf(ANSI_CLEAR_SCREEN);
     printf(ANSI_BOLD ANSI_CYAN "╔════════════════════════╗\n");
     printf("║        TETRIS          ║\n");
     printf("╚════════════════════════╝\n" ANSI_RESET);
     printf("Score: %d  Level: %d\n\n", score, level);
     
-    // Create temporary board with current piece
-    int display[TETRIS_HEIGHT][TETRIS_WIDTH];
-    memcpy(display, board, sizeof(display));
-    
-    // Add current piece to display
-    if (piece) {
-        for (int i = 0; i < 4; i++) {
-            for (int j = 0; j < 4; j++) {
-                if (piece->shape[i][j]) {
-                    int x = piece->x + j;
-                    int y = piece->y + i;
-                    if (y >= 0 && y < TETRIS_HEIGHT && x >= 0 && x < TETRIS_WIDTH) {
-                        display[y][x] = piece->type + 1;
-                    }
-                }
-            }
-        }
-    }
-    
     // Draw board
     printf("┌");
     for (int i = 0; i < TETRIS_WIDTH; i++) printf("──");
     printf("┐\n");
     
     for (int i = 0; i < TETRIS_HEIGHT; i++) {
+        // Falling piece cells in this row, as column bits
+        uint16_t piece_bits = 0;
+        if (piece && i >= piece->y && i < piece->y + 4) {
+            piece_bits = tetris_piece_row(piece, i - piece->y);
+        }
         printf("│");
         for (int j = 0; j < TETRIS_WIDTH; j++) {
-            if (display[i][j] == 0) {
+            int cell = (piece_bits & (1 << j)) ? piece->type + 1 : board->cells[i][j];
+            if (cell == 0) {
                 printf("  ");
             } else {
                 const char *colors[] = {ANSI_CYAN, ANSI_YELLOW, ANSI_MAGENTA, ANSI_GREEN, ANSI_RED, ANSI_BLUE, ANSI_RESET};
-                printf("%s▓▓" ANSI_RESET, colors[display[i][j] - 1]);
+                printf("%s▓▓" ANSI_RESET, colors[cell - 1]);
             }
         }
         printf("│\n");
@@ -1368,63 +1251,87 @@ void draw_tetris_board(int board[TETRIS_HEIGHT][TETRIS_WIDTH], TetrisPiece *piec
     for (int i = 0; i < TETRIS_WIDTH; i++) printf("──");
     printf("┘\n");
     
-    printf("\nControls: A/D=Move  W=Rotate  S=Drop  Q=Quit\n");
+    printf("\nControls: ←/→ A/D=Move  ↑ W=Rotate  ↓=Down  S/Space=Drop  Q=Quit\n");
 }
 
 void tetris_game() {
-    int board[TETRIS_HEIGHT][TETRIS_WIDTH] = {0};
+    struct tetris_board board;
+    tetris_board_reset(&board);
     int score = 0;
     int level = 1;
     int lines = 0;
     bool game_over = false;
     
-    TetrisPiece current_piece;
-    current_piece.type = rand() % 7;
-    memcpy(current_piece.shape, tetris_shapes[current_piece.type], sizeof(current_piece.shape));
-    current_piece.x = TETRIS_WIDTH / 2 - 2;
-    current_piece.y = 0;
+    struct tetris_piece current_piece = tetris_spawn(rand() % TETRIS_PIECES);
     
-    uint32_t last_drop = to_ms_since_boot(get_absolute_time());
     uint32_t drop_interval = 1000 - (level - 1) * 100;
     if (drop_interval < 100) drop_interval = 100;
+    uint32_t gravity_ms = 0;
+
+    struct game_loop loop;
+    if (!game_loop_start(&loop, GAME_TICK_MS * 1000)) {
+        printf(ANSI_RED "No timer available\n" ANSI_RESET);
+        return;
+    }
     
+    bool dirty = true;
     while (!game_over) {
-        draw_tetris_board(board, &current_piece, score, level);
+        if (dirty) {
+            draw_tetris_board(&board, &current_piece, score, level);
+            dirty = false;
+        }
         
-        // Check for input
-        int c = getchar_timeout_us(50000);
+        uint32_t ticks = game_loop_wait(&loop);
         
-        if (c == 'q' || c == 'Q') {
-            break;
-        } else if (c == 'a' || c == 'A') {
-            if (!check_collision(board, &current_piece, -1, 0)) {
-                current_piece.x--;
-            }
-        } else if (c == 'd' || c == 'D') {
-            if (!check_collision(board, &current_piece, 1, 0)) {
-                current_piece.x++;
-            }
-        } else if (c == 'w' || c == 'W') {
-            TetrisPiece test_piece = current_piece;
-            rotate_piece(&test_piece);
-            if (!check_collision(board, &test_piece, 0, 0)) {
-                current_piece = test_piece;
-            }
-        } else if (c == 's' || c == 'S') {
-            while (!check_collision(board, &current_piece, 0, 1)) {
-                current_piece.y++;
+        // Keys take effect as they arrive, not on the next gravity step
+        struct key_event event;
+        bool quit = false;
+        while (input_poll(&event)) {
+            int key = event.key < 0x100 ? tolower(event.key) : event.key;
+            if (key == 'q' || key == KEY_ESC) {
+                quit = true;
+            } else if (key == 'a' || key == KEY_LEFT) {
+                if (!tetris_collides(&board, &current_piece, -1, 0, 0)) {
+                    current_piece.x--;
+                    dirty = true;
+                }
+            } else if (key == 'd' || key == KEY_RIGHT) {
+                if (!tetris_collides(&board, &current_piece, 1, 0, 0)) {
+                    current_piece.x++;
+                    dirty = true;
+                }
+            } else if (key == 'w' || key == KEY_UP) {
+                if (!tetris_collides(&board, &current_piece, 0, 0, 1)) {
+                    current_piece.rotation = (current_piece.rotation + 1) & 3;
+                    dirty = true;
+                }
+            } else if (key == KEY_DOWN) {
+                if (!tetris_collides(&board, &current_piece, 0, 1, 0)) {
+                    current_piece.y++;
+                    gravity_ms = 0;
+                    dirty = true;
+                }
+            } else if (key == 's' || key == ' ') {
+                tetris_hard_drop(&board, &current_piece);
+                gravity_ms = drop_interval;  // Lock on this tick
+                dirty = true;
             }
         }
+        if (quit) {
+            break;
+        }
         
-        // Auto drop
-        uint32_t now = to_ms_since_boot(get_absolute_time());
-        if (now - last_drop >= drop_interval) {
-            if (!check_collision(board, &current_piece, 0, 1)) {
+        // Gravity, in fixed ticks
+        gravity_ms += ticks * GAME_TICK_MS;
+        while (gravity_ms >= drop_interval && !game_over) {
+            gravity_ms -= drop_interval;
+            dirty = true;
+            if (!tetris_collides(&board, &current_piece, 0, 1, 0)) {
                 current_piece.y++;
             } else {
                 // Piece landed
-                merge_piece(board, &current_piece);
-                int cleared = clear_lines(board);
+                tetris_merge(&board, &current_piece);
+                int cleared = tetris_clear_lines(&board);
                 if (cleared > 0) {
                     lines += cleared;
                     score += cleared * cleared * 100;
@@ -1434,21 +1341,17 @@ void tetris_game() {
                 }
                 
                 // New piece
-                current_piece.type = rand() % 7;
-                memcpy(current_piece.shape, tetris_shapes[current_piece.type], sizeof(current_piece.shape));
-                current_piece.x = TETRIS_WIDTH / 2 - 2;
-                current_piece.y = 0;
+                current_piece = tetris_spawn(rand() % TETRIS_PIECES);
                 
-                if (check_collision(board, &current_piece, 0, 0)) {
+                if (tetris_collides(&board, &current_piece, 0, 0, 0)) {
                     game_over = true;
                 }
             }
-            last_drop = now;
         }
-        
-        sleep_ms(50);
     }
     
+    game_loop_stop(&loop);
+    
     printf(ANSI_CLEAR_SCREEN);
     printf(ANSI_BOLD ANSI_RED "\n╔════════════════════════╗\n");
     printf("║      GAME OVER!        ║\n");
@@ -1460,6 +1363,25 @@ void tetris_game() {
     read_line("Press Enter to continue...", true);
 }
 
+// Headless engine benchmark: the bot plays seeded games flat out
+void tetris_benchmark(uint32_t games, uint32_t seed) {
+    printf("Running %lu bot games (seed %lu)...\n", (unsigned long)games, (unsigned long)seed);
+    struct tetris_bench_result result;
+    uint64_t start = time_us_64();
+    tetris_bench(games, seed, 1000, &result);
+    uint64_t elapsed = time_us_64() - start;
+    if (elapsed == 0) elapsed = 1;
+
+    printf("  Games:   %lu\n", (unsigned long)result.games);
+    printf("  Pieces:  %lu\n", (unsigned long)result.pieces);
+    printf("  Lines:   %lu (best game %lu)\n", (unsigned long)result.lines, (unsigned long)result.best_lines);
+    printf("  Moves:   %lu evaluated\n", (unsigned long)result.moves);
+    printf("  Time:    %lu ms\n", (unsigned long)(elapsed / 1000));
+    printf(ANSI_GREEN "  %lu moves/s, %lu pieces/s\n" ANSI_RESET,
+           (unsigned long)((uint64_t)result.moves * 1000000 / elapsed),
+           (unsigned long)((uint64_t)result.pieces * 1000000 / elapsed));
+}
+
 // ===== SNAKE GAME =====
 void draw_snake_board(int board[SNAKE_HEIGHT][SNAKE_WIDTH], int score) {
     printf(ANSI_CLEAR_SCREEN);
@@ -1490,7 +1412,7 @@ void draw_snake_board(int board[SNAKE_HEIGHT][SNAKE_WIDTH], int score) {
     for (int i = 0; i < SNAKE_WIDTH; i++) printf("─");
     printf("┘\n");
     
-    printf("\nControls: W/A/S/D=Move  Q=Quit\n");
+    printf("\nControls: Arrows or W/A/S/D=Move  Q=Quit\n");
 }
 
 void snake_game() {
@@ -1513,49 +1435,83 @@ void snake_game() {
     int food_x = rand() % SNAKE_WIDTH;
     int food_y = rand() % SNAKE_HEIGHT;
     
-    uint32_t last_move = to_ms_since_boot(get_absolute_time());
     uint32_t move_interval = 200;
+    uint32_t move_ms = 0;
     
-    char pending_direction = 'd';
+    // Turns typed between two steps are applied one per step, so a quick
+    // up-then-left is not collapsed into just "left"
+    int turns[2][2];
+    int turn_count = 0;
     
+    struct game_loop loop;
+    if (!game_loop_start(&loop, GAME_TICK_MS * 1000)) {
+        printf(ANSI_RED "No timer available\n" ANSI_RESET);
+        return;
+    }
+    
+    bool dirty = true;
     while (!game_over) {
-        // Update board
-        memset(board, 0, sizeof(board));
-        for (int i = 0; i < snake_length; i++) {
-            board[snake[i].y][snake[i].x] = 1;
+        if (dirty) {
+            // Update board
+            memset(board, 0, sizeof(board));
+            for (int i = 0; i < snake_length; i++) {
+                board[snake[i].y][snake[i].x] = 1;
+            }
+            board[food_y][food_x] = 2;
+            
+            draw_snake_board(board, score);
+            dirty = false;
         }
-        board[food_y][food_x] = 2;
         
-        draw_snake_board(board, score);
+        uint32_t ticks = game_loop_wait(&loop);
         
         // Check for input
-        int c = getchar_timeout_us(50000);
-        if (c != PICO_ERROR_TIMEOUT) {
-            if ((c == 'w' || c == 'W') && dy != 1) {
-                pending_direction = 'w';
-            } else if ((c == 's' || c == 'S') && dy != -1) {
-                pending_direction = 's';
-            } else if ((c == 'a' || c == 'A') && dx != 1) {
-                pending_direction = 'a';
-            } else if ((c == 'd' || c == 'D') && dx != -1) {
-                pending_direction = 'd';
-            } else if (c == 'q' || c == 'Q') {
-                break;
+        struct key_event event;
+        bool quit = false;
+        while (input_poll(&event)) {
+            int key = event.key < 0x100 ? tolower(event.key) : event.key;
+            int tx = 0, ty = 0;
+            if (key == 'w' || key == KEY_UP) {
+                ty = -1;
+            } else if (key == 's' || key == KEY_DOWN) {
+                ty = 1;
+            } else if (key == 'a' || key == KEY_LEFT) {
+                tx = -1;
+            } else if (key == 'd' || key == KEY_RIGHT) {
+                tx = 1;
+            } else if (key == 'q' || key == KEY_ESC) {
+                quit = true;
+                continue;
+            } else {
+                continue;
             }
+            // Ignore reversals and repeats of the last queued heading
+            int last_x = turn_count ? turns[turn_count - 1][0] : dx;
+            int last_y = turn_count ? turns[turn_count - 1][1] : dy;
+            if ((tx == -last_x && ty == -last_y) || (tx == last_x && ty == last_y) || turn_count == 2) {
+                continue;
+            }
+            turns[turn_count][0] = tx;
+            turns[turn_count][1] = ty;
+            turn_count++;
+        }
+        if (quit) {
+            break;
         }
         
-        // Move snake
-        uint32_t now = to_ms_since_boot(get_absolute_time());
-        if (now - last_move >= move_interval) {
+        // Move snake, in fixed ticks
+        move_ms += ticks * GAME_TICK_MS;
+        while (move_ms >= move_interval && !game_over) {
+            move_ms -= move_interval;
+            dirty = true;
+            
             // Update direction
-            if (pending_direction == 'w') {
-                dx = 0; dy = -1;
-            } else if (pending_direction == 's') {
-                dx = 0; dy = 1;
-            } else if (pending_direction == 'a') {
-                dx = -1; dy = 0;
-            } else if (pending_direction == 'd') {
-                dx = 1; dy = 0;
+            if (turn_count > 0) {
+                dx = turns[0][0];
+                dy = turns[0][1];
+                turns[0][0] = turns[1][0];
+                turns[0][1] = turns[1][1];
+                turn_count--;
             }
             
             // Calculate new head position
@@ -1617,13 +1573,11 @@ void snake_game() {
             
             snake[0].x = new_x;
             snake[0].y = new_y;
-            
-            last_move = now;
         }
-        
-        sleep_ms(50);
     }
     
+    game_loop_stop(&loop);
+    
     printf(ANSI_CLEAR_SCREEN);
     printf(ANSI_BOLD ANSI_RED "\n╔════════════════════════╗\n");
     printf("║      GAME OVER!        ║\n");
@@ -1643,8 +1597,8 @@ void show_help() {
     
     // Compact single-column format that works on all screen sizes
     printf(ANSI_BOLD "SYSTEM:\n" ANSI_RESET);
-    printf("  help, neofetch, sysinfo, clear, reboot\n");
-    printf("  time, viewlog, showram, setting\n");
+    printf("  help, neofetch, sysinfo, clear, reboot, bootprof\n");
+    printf("  time, ntp [sync], viewlog, showram, setting\n");
     printf("\n");
     
     printf(ANSI_BOLD "FILES:\n" ANSI_RESET);
@@ -1653,7 +1607,10 @@ void show_help() {
     printf("\n");
     
     printf(ANSI_BOLD "NETWORK:\n" ANSI_RESET);
-    printf("  wifi, ipa, ping <host>, nmap\n");
+    printf("  wifi [status|reconnect|off], ipa, nmap [-sS|-sU] [<host> [ports]]\n");
+    printf("  ping [-c n] [-i ms] [-s bytes] [-S max[:step]] [-f] [-q] <host>\n");
+    printf("  dig [<host>|flush], netperf -s|-c <host> [-u]\n");
+    printf("  chksum [verify [n]|bench]\n");
     printf("\n");
     
     printf(ANSI_BOLD ANSI_GREEN "WEB SERVER:\n" ANSI_RESET);
@@ -1661,11 +1618,13 @@ void show_help() {
     printf("\n");
     
     printf(ANSI_BOLD "APPS:\n" ANSI_RESET);
-    printf("  timer, todo, ascii, tetris, snake\n");
+    printf("  timer, todo, ascii [font], tetris, snake\n");
+    printf("  banner [-f font] <text>, font [load <file>]\n");
+    printf("  tetris bench [games] [seed], todo bench [items]\n");
     printf("\n");
     
     printf(ANSI_BOLD "PROCESS:\n" ANSI_RESET);
-    printf("  ps, stop <name>\n");
+    printf("  ps, top [-d seconds] [-n count], stop <name>\n");
     printf("\n");
     
     printf(ANSI_CYAN "╚════════════════════════════════════════════╝\n" ANSI_RESET);
@@ -1687,8 +1646,9 @@ void neofetch() {
     printf("       '~'\n" ANSI_RESET);
     printf("\n");
     
-    time_t now = get_current_time();
-    uint32_t uptime_sec = to_ms_since_boot(get_absolute_time()) / 1000;
+    struct time_snapshot now;
+    timecache_read(&now);
+    uint32_t uptime_sec = now.uptime_sec;
     
     printf(ANSI_BOLD ANSI_BLUE "pico@os\n" ANSI_RESET);
     printf("-------\n");
@@ -1706,11 +1666,8 @@ void neofetch() {
         printf(ANSI_BOLD "WiFi:" ANSI_RESET " " ANSI_RED "Disconnected" ANSI_RESET "\n");
     }
     
-    if (now != 0) {
-        struct tm *t = localtime(&now);
-        printf(ANSI_BOLD "Time:" ANSI_RESET " %04d-%02d-%02d %02d:%02d:%02d %s\n",
-               t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-               t->tm_hour, t->tm_min, t->tm_sec, timezone_str);
+    if (now.valid) {
+        printf(ANSI_BOLD "Time:" ANSI_RESET " %.10s %s %s\n", now.iso, now.hms, timezone_str);
     }
     
     printf("\n");
@@ -1753,6 +1710,19 @@ void show_system_info() {
         printf("  WiFi: " ANSI_RED "Disconnected" ANSI_RESET "\n");
     }
     
+    // Since boot; 'top' shows it live and by activity
+    struct cpu_load_sample load;
+    cpu_load_sample(&load);
+    printf("\n" ANSI_BOLD "CPU Load (since boot):\n" ANSI_RESET);
+    for (int core = 0; core < CPU_LOAD_CORES; core++) {
+        uint64_t total = 0;
+        for (int a = 0; a < CPU_ACTIVITIES; a++) {
+            total += load.us[core][a];
+        }
+        uint32_t busy = 1000 - top_permille(load.us[core][CPU_IDLE], total);
+        printf("  Core %d: %lu.%lu%% busy\n", core, (unsigned long)(busy / 10), (unsigned long)(busy % 10));
+    }
+    
     printf("\n");
 }
 
@@ -1800,24 +1770,48 @@ void timer_app() {
     read_line("\nPress Enter to continue...", true);
 }
 
-void todo_app() {
+static void todo_header() {
     printf(ANSI_CLEAR_SCREEN);
     printf(ANSI_BOLD ANSI_CYAN "╔════════════════════════════════════════╗\n");
     printf("║          Todo List Manager             ║\n");
     printf("╚════════════════════════════════════════╝\n" ANSI_RESET);
+}
+
+// Parse a todo ID typed at a prompt; 0 if none
+static uint32_t todo_read_id(const char *prompt) {
+    char *num = read_line(prompt, true);
+    return num ? strtoul(num, NULL, 10) : 0;
+}
+
+static void todo_commit() {
+    if (!todo_store_commit(&todos)) {
+        printf(ANSI_RED "Could not save the todo list (filesystem full?)\n" ANSI_RESET);
+    }
+}
+
+void todo_app() {
+    if (!todos_ready) {
+        printf(ANSI_RED "Todo list unavailable: could not open " TODO_DIR "\n" ANSI_RESET);
+        return;
+    }
+
+    // One extra item tells whether there is a next page
+    static struct todo_item page[TODO_PAGE_SIZE + 1];
+    uint32_t from = 1;
     
+    todo_header();
     while (true) {
-        printf("\n" ANSI_BOLD "Current Todos:\n" ANSI_RESET);
-        bool has_todos = false;
-        for (int i = 0; i < 2; i++) {
-            if (todos[i].active) {
-                has_todos = true;
-                printf("%d. [%c] %s\n", i + 1,
-                       todos[i].completed ? 'X' : ' ',
-                       todos[i].text);
-            }
+        int count = todo_store_list(&todos, from, page, TODO_PAGE_SIZE + 1);
+        bool more = count > TODO_PAGE_SIZE;
+        if (more) count = TODO_PAGE_SIZE;
+        
+        printf("\n" ANSI_BOLD "Current Todos" ANSI_RESET " (%lu, %lu done):\n",
+               (unsigned long)todos.count, (unsigned long)todos.done);
+        for (int i = 0; i < count; i++) {
+            printf("%4lu. [%c] %s\n", (unsigned long)page[i].id,
+                   page[i].done ? 'X' : ' ', page[i].text);
         }
-        if (!has_todos) {
+        if (todos.count == 0) {
             printf("  (No todos yet)\n");
         }
         
@@ -1825,58 +1819,75 @@ void todo_app() {
         printf("1. Add todo\n");
         printf("2. Complete todo\n");
         printf("3. Delete todo\n");
-        printf("4. Exit\n");
+        printf("4. %s\n", more ? "Next page" : "First page");
+        printf("5. Exit\n");
         
         char *choice = read_line("\nChoice: ", true);
         
         if (strcmp(choice, "1") == 0) {
-            for (int i = 0; i < 2; i++) {
-                if (!todos[i].active) {
-                    char *text = read_line("Enter todo: ", true);
-                    if (!text || strlen(text) == 0) {
-                        printf(ANSI_YELLOW "Todo text cannot be empty\n" ANSI_RESET);
-                        break;
-                    }
-                    strncpy(todos[i].text, text, sizeof(todos[i].text) - 1);
-                    todos[i].text[sizeof(todos[i].text) - 1] = '\0';
-                    todos[i].active = true;
-                    todos[i].completed = false;
-                    printf(ANSI_GREEN "Todo added!\n" ANSI_RESET);
-                    break;
-                }
+            char *text = read_line("Enter todo: ", true);
+            if (!text || strlen(text) == 0) {
+                printf(ANSI_YELLOW "Todo text cannot be empty\n" ANSI_RESET);
+            } else if (todo_store_add(&todos, text)) {
+                todo_commit();
+                printf(ANSI_GREEN "Todo added!\n" ANSI_RESET);
+            } else {
+                printf(ANSI_RED "Could not add todo\n" ANSI_RESET);
             }
         } else if (strcmp(choice, "2") == 0) {
-            char *num = read_line("Todo number to complete: ", true);
-            if (!num) continue;
-            int idx = atoi(num) - 1;
-            if (idx >= 0 && idx < 2 && todos[idx].active) {
-                todos[idx].completed = !todos[idx].completed;
+            uint32_t id = todo_read_id("Todo number to complete: ");
+            struct todo_item item;
+            if (todo_store_get(&todos, id, &item) && todo_store_set_done(&todos, id, !item.done)) {
+                todo_commit();
                 printf(ANSI_GREEN "Todo toggled!\n" ANSI_RESET);
             } else {
                 printf(ANSI_YELLOW "Invalid todo number\n" ANSI_RESET);
             }
         } else if (strcmp(choice, "3") == 0) {
-            char *num = read_line("Todo number to delete: ", true);
-            if (!num) continue;
-            int idx = atoi(num) - 1;
-            if (idx >= 0 && idx < 2 && todos[idx].active) {
-                todos[idx].active = false;
-                todos[idx].text[0] = '\0';
+            uint32_t id = todo_read_id("Todo number to delete: ");
+            if (todo_store_delete(&todos, id)) {
+                todo_commit();
                 printf(ANSI_GREEN "Todo deleted!\n" ANSI_RESET);
             } else {
                 printf(ANSI_YELLOW "Invalid todo number\n" ANSI_RESET);
             }
         } else if (strcmp(choice, "4") == 0) {
+            from = more ? page[count - 1].id + 1 : 1;
+        } else if (strcmp(choice, "5") == 0) {
             break;
         }
         
-        printf(ANSI_CLEAR_SCREEN);
-        printf(ANSI_BOLD ANSI_CYAN "╔════════════════════════════════════════╗\n");
-        printf("║          Todo List Manager             ║\n");
-        printf("╚════════════════════════════════════════╝\n" ANSI_RESET);
+        todo_header();
     }
 }
 
+// Fill a scratch list on the real filesystem and time the store
+void todo_benchmark(uint32_t items) {
+    printf("Filling a scratch todo list with %lu items...\n", (unsigned long)items);
+    struct todo_bench_result r;
+    todo_store_bench(&lfs, "/todo-bench", items, &r);
+    if (!r.ok) {
+        printf(ANSI_RED "  Stopped: out of flash or memory at %lu items\n" ANSI_RESET, (unsigned long)r.items);
+    }
+
+    const struct { const char *name; const struct todo_bench_stat *stat; } rows[] = {
+        { "Add:       ", &r.add },
+        { "Commit:    ", &r.commit },
+        { "Add+commit:", &r.add_commit },
+        { "List page: ", &r.list },
+        { "Done:      ", &r.done },
+    };
+    printf("  Items:      %lu (%lu compactions)\n", (unsigned long)r.items, (unsigned long)r.compactions);
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        printf("  %s %5lu x  avg %6lu us  max %7lu us\n", rows[i].name, (unsigned long)rows[i].stat->count,
+               (unsigned long)rows[i].stat->avg_us, (unsigned long)rows[i].stat->max_us);
+    }
+    printf("  Open:       %lu ms\n", (unsigned long)(r.open_us / 1000));
+    printf("  Compact:    %lu ms\n", (unsigned long)(r.compact_us / 1000));
+    printf(ANSI_GREEN "  %lu KB flash, %lu KB RAM index\n" ANSI_RESET,
+           (unsigned long)(r.flash_bytes / 1024), (unsigned long)(r.ram_bytes / 1024));
+}
+
 void list_files() {
     printf("\n" ANSI_BOLD "Files:\n" ANSI_RESET);
     lfs_dir_t dir;
@@ -1966,6 +1977,7 @@ void nano_editor(const char* filename) {
     
     lfs_file_write(&lfs, &file, buffer, idx);
     lfs_file_close(&lfs, &file);
+    fs_stamp(filename);
     
     printf("\n\n" ANSI_GREEN "File saved successfully!\n" ANSI_RESET);
 }
@@ -2008,195 +2020,267 @@ void show_ip() {
     }
 }
 
-// Ping state structure
-struct ping_state {
-    struct raw_pcb *pcb;
-    ip_addr_t target_ip;
-    uint16_t seq_num;
-    bool received;
-    uint32_t sent_time;
-    uint32_t rtt_ms;
-};
-
-static struct ping_state ping_data;
+static void ping_usage() {
+    printf("Usage: ping [-c count] [-i ms] [-s bytes] [-S max[:step]] [-W ms] [-w window] [-f] [-q] <host>\n");
+    printf("  -c  probes to send (0 = until a key is pressed)\n");
+    printf("  -i  interval between probes, fractions allowed (default 1000)\n");
+    printf("  -s  payload bytes (default %d, max %d)\n", PING_DEFAULT_PAYLOAD, PING_MAX_PAYLOAD);
+    printf("  -S  sweep the payload from -s up to max, one step per probe\n");
+    printf("  -W  per-probe timeout (default 1000)\n");
+    printf("  -w  probes in flight (default %d, 1 when flooding)\n", PING_WINDOW);
+    printf("  -f  flood: next probe as soon as a reply arrives, report the rate\n");
+    printf("  -q  summary only\n");
+}
 
-// ICMP echo receive callback
-static u8_t ping_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_addr_t *addr) {
-    struct ping_state *state = (struct ping_state *)arg;
-    
-    if (p->tot_len >= (PBUF_IP_HLEN + sizeof(struct icmp_echo_hdr))) {
-        struct icmp_echo_hdr *iecho = (struct icmp_echo_hdr *)((u8_t *)p->payload + PBUF_IP_HLEN);
-        
-        if ((iecho->type == ICMP_ER) && 
-            (iecho->id == 0xABCD) && 
-            (ntohs(iecho->seqno) == state->seq_num)) {
-            
-            state->received = true;
-            state->rtt_ms = to_ms_since_boot(get_absolute_time()) - state->sent_time;
-            pbuf_free(p);
-            return 1; // Packet consumed
+void ping_command(int argc, char* args[]) {
+    struct ping_options options;
+    ping_options_default(&options);
+    bool count_set = false;
+    bool window_set = false;
+    const char *host = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = args[i];
+        const char *value = i + 1 < argc ? args[i + 1] : NULL;
+        bool takes_value = strcmp(arg, "-c") == 0 || strcmp(arg, "-i") == 0 || strcmp(arg, "-s") == 0 ||
+                           strcmp(arg, "-S") == 0 || strcmp(arg, "-W") == 0 || strcmp(arg, "-w") == 0;
+        if (takes_value && !value) {
+            ping_usage();
+            return;
+        }
+        if (strcmp(arg, "-c") == 0) {
+            options.count = (uint32_t)strtoul(value, NULL, 10);
+            count_set = true;
+        } else if (strcmp(arg, "-i") == 0) {
+            options.interval_us = (uint32_t)(strtof(value, NULL) * 1000.0f);
+        } else if (strcmp(arg, "-s") == 0) {
+            options.size = (uint16_t)atoi(value);
+        } else if (strcmp(arg, "-S") == 0) {
+            options.sweep_max = (uint16_t)atoi(value);
+            const char *colon = strchr(value, ':');
+            options.sweep_step = colon ? (uint16_t)atoi(colon + 1) : 0;
+        } else if (strcmp(arg, "-W") == 0) {
+            options.timeout_us = (uint32_t)(strtof(value, NULL) * 1000.0f);
+        } else if (strcmp(arg, "-w") == 0) {
+            options.window = (uint8_t)atoi(value);
+            window_set = true;
+        } else if (strcmp(arg, "-f") == 0) {
+            options.flood = true;
+            continue;
+        } else if (strcmp(arg, "-q") == 0) {
+            options.quiet = true;
+            continue;
+        } else if (arg[0] != '-' && !host) {
+            host = arg;
+            continue;
+        } else {
+            ping_usage();
+            return;
         }
+        i++;
     }
-    
-    return 0; // Packet not consumed
-}
 
-// Send ICMP echo request
-static void ping_send(struct ping_state *state) {
-    struct pbuf *p;
-    struct icmp_echo_hdr *iecho;
-    size_t ping_size = sizeof(struct icmp_echo_hdr) + 32; // 32 bytes of data
-    
-    p = pbuf_alloc(PBUF_IP, (u16_t)ping_size, PBUF_RAM);
-    if (!p) {
+    if (!host || options.size > PING_MAX_PAYLOAD || options.sweep_max > PING_MAX_PAYLOAD ||
+        options.window < 1 || options.window > PING_WINDOW ||
+        options.interval_us < 100 || options.timeout_us < 1000) {
+        ping_usage();
         return;
     }
-    
-    if ((p->len == p->tot_len) && (p->next == NULL)) {
-        iecho = (struct icmp_echo_hdr *)p->payload;
-        
-        ICMPH_TYPE_SET(iecho, ICMP_ECHO);
-        ICMPH_CODE_SET(iecho, 0);
-        iecho->chksum = 0;
-        iecho->id = 0xABCD;
-        iecho->seqno = htons(state->seq_num);
-        
-        // Fill data with pattern
-        u8_t *data = (u8_t *)iecho + sizeof(struct icmp_echo_hdr);
-        for (int i = 0; i < 32; i++) {
-            data[i] = 0x20 + i;
+    if (options.sweep_max) {
+        if (options.sweep_max <= options.size) {
+            printf(ANSI_RED "Sweep end must be above the start size (-s %u)\n" ANSI_RESET, options.size);
+            return;
+        }
+        uint16_t span = options.sweep_max - options.size;
+        uint16_t min_step = (span + PING_SWEEP_MAX_STEPS - 2) / (PING_SWEEP_MAX_STEPS - 1);
+        if (options.sweep_step == 0) {
+            options.sweep_step = min_step > 0 ? min_step : 1;
+        } else if (options.sweep_step < min_step) {
+            printf(ANSI_RED "Sweep step too small: at most %d sizes (step >= %u)\n" ANSI_RESET,
+                   PING_SWEEP_MAX_STEPS, min_step);
+            return;
+        }
+        if (!count_set) {
+            // Four probes per size, like a plain ping
+            options.count = 4 * ((span / options.sweep_step) + 1);
+        }
+    }
+    if (options.flood) {
+        if (!count_set) {
+            options.count = 0;
+        }
+        if (!window_set) {
+            options.window = 1;
         }
-        
-        iecho->chksum = inet_chksum(iecho, ping_size);
-        
-        state->sent_time = to_ms_since_boot(get_absolute_time());
-        state->received = false;
-        
-        cyw43_arch_lwip_begin();
-        raw_sendto(state->pcb, p, &state->target_ip);
-        cyw43_arch_lwip_end();
     }
-    
-    pbuf_free(p);
-}
 
-void ping_test(const char* host) {
     if (!wifi_connected) {
         printf(ANSI_RED "WiFi not connected. Connect to WiFi first.\n" ANSI_RESET);
         return;
     }
     
-    printf("\n" ANSI_BOLD "PING %s" ANSI_RESET "\n", host);
-    
     // Resolve hostname or parse IP
     ip_addr_t target_ip;
-    if (!ipaddr_aton(host, &target_ip)) {
-        printf("Resolving hostname %s...\n", host);
-        
-        // Simple DNS resolution with timeout
-        struct {
-            bool resolved;
-            ip_addr_t addr;
-        } dns_data = {false, {0}};
-        
-        auto dns_callback = [](const char *name, const ip_addr_t *ipaddr, void *arg) {
-            auto *data = (decltype(dns_data)*)arg;
-            if (ipaddr) {
-                data->addr = *ipaddr;
-                data->resolved = true;
-            }
-        };
-        
-        cyw43_arch_lwip_begin();
-        err_t err = dns_gethostbyname(host, &target_ip, dns_callback, &dns_data);
-        cyw43_arch_lwip_end();
-        
-        if (err == ERR_INPROGRESS) {
-            // Wait for DNS resolution
-            uint32_t start = to_ms_since_boot(get_absolute_time());
-            while (!dns_data.resolved && (to_ms_since_boot(get_absolute_time()) - start < 5000)) {
-                sleep_ms(100);
-            }
-            
-            if (dns_data.resolved) {
-                target_ip = dns_data.addr;
-            } else {
-                printf(ANSI_RED "DNS resolution timeout\n" ANSI_RESET);
-                return;
-            }
-        } else if (err != ERR_OK) {
-            printf(ANSI_RED "DNS resolution failed\n" ANSI_RESET);
+    if (!shell_resolve(host, &target_ip)) {
+        return;
+    }
+    
+    printf("\n");
+    struct ping_stats stats;
+    ping_run(host, &target_ip, &options, &stats);
+}
+
+static void netperf_usage() {
+    printf("Usage: netperf -s [-u] [-p port]\n");
+    printf("       netperf -c <host> [-u] [-R] [-t seconds] [-l bytes] [-b kbit/s] [-p port]\n");
+    printf("  -s  server, until a key is pressed   -c  client to <host>\n");
+    printf("  -u  UDP (default TCP)                -R  TCP: server sends\n");
+    printf("  -t  duration (default %d s)          -l  write/datagram size\n", NETPERF_DEFAULT_SECONDS);
+    printf("  -b  UDP rate (default %d, 0 = max)   -p  port (default %d)\n", NETPERF_DEFAULT_UDP_KBPS, NETPERF_PORT);
+    printf("Peer for a PC: c++ -O2 -DNETPERF_HOST_PEER netperf.cpp -o netperf\n");
+}
+
+void netperf_command(int argc, char* args[]) {
+    struct netperf_options options;
+    netperf_options_default(&options);
+    const char *host = NULL;
+    uint32_t len = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = args[i];
+        const char *value = i + 1 < argc ? args[i + 1] : NULL;
+        if (strcmp(arg, "-s") == 0) {
+            options.server = true;
+        } else if (strcmp(arg, "-u") == 0) {
+            options.udp = true;
+        } else if (strcmp(arg, "-R") == 0) {
+            options.reverse = true;
+        } else if (value && strcmp(arg, "-c") == 0) {
+            host = args[++i];
+        } else if (value && strcmp(arg, "-t") == 0) {
+            options.seconds = (uint32_t)strtoul(args[++i], NULL, 10);
+        } else if (value && strcmp(arg, "-l") == 0) {
+            len = (uint32_t)strtoul(args[++i], NULL, 10);
+        } else if (value && strcmp(arg, "-b") == 0) {
+            options.rate_kbps = (uint32_t)strtoul(args[++i], NULL, 10);
+        } else if (value && strcmp(arg, "-p") == 0) {
+            options.port = (uint16_t)atoi(args[++i]);
+        } else {
+            netperf_usage();
             return;
         }
     }
-    
-    printf("Target: %s\n", ipaddr_ntoa(&target_ip));
-    printf("Sending 4 ICMP echo requests...\n\n");
-    
-    // Setup ping
-    ping_data.target_ip = target_ip;
-    ping_data.seq_num = 0;
-    
-    cyw43_arch_lwip_begin();
-    ping_data.pcb = raw_new(IP_PROTO_ICMP);
-    cyw43_arch_lwip_end();
-    
-    if (!ping_data.pcb) {
-        printf(ANSI_RED "Failed to create ICMP socket\n" ANSI_RESET);
+    if (options.server == (host != NULL) || options.seconds == 0 || options.seconds > NETPERF_MAX_SECONDS ||
+        options.port == 0) {
+        netperf_usage();
         return;
     }
-    
-    cyw43_arch_lwip_begin();
-    raw_recv(ping_data.pcb, ping_recv, &ping_data);
-    raw_bind(ping_data.pcb, IP_ADDR_ANY);
-    cyw43_arch_lwip_end();
-    
-    int received_count = 0;
-    uint32_t total_rtt = 0;
-    uint32_t min_rtt = UINT32_MAX;
-    uint32_t max_rtt = 0;
-    
-    // Send 4 pings
-    for (int i = 0; i < 4; i++) {
-        ping_data.seq_num = i + 1;
-        ping_send(&ping_data);
-        
-        // Wait for response (1 second timeout)
-        uint32_t start = to_ms_since_boot(get_absolute_time());
-        while (!ping_data.received && (to_ms_since_boot(get_absolute_time()) - start < 1000)) {
-            sleep_ms(10);
-        }
-        
-        if (ping_data.received) {
-            printf("%s: icmp_seq=%d time=%lu ms\n", 
-                   ipaddr_ntoa(&target_ip), ping_data.seq_num, (unsigned long)ping_data.rtt_ms);
-            received_count++;
-            total_rtt += ping_data.rtt_ms;
-            if (ping_data.rtt_ms < min_rtt) min_rtt = ping_data.rtt_ms;
-            if (ping_data.rtt_ms > max_rtt) max_rtt = ping_data.rtt_ms;
+    uint32_t max_len = options.udp ? NETPERF_MAX_UDP_LEN : NETPERF_MAX_TCP_LEN;
+    options.len = len ? len : options.udp ? NETPERF_DEFAULT_UDP_LEN : NETPERF_DEFAULT_TCP_LEN;
+    if (options.len > max_len || (options.udp && options.len < NETPERF_UDP_HEADER)) {
+        printf(ANSI_RED "Size must be %d..%lu bytes\n" ANSI_RESET, options.udp ? NETPERF_UDP_HEADER : 1,
+               (unsigned long)max_len);
+        return;
+    }
+
+    if (!wifi_connected) {
+        printf(ANSI_RED "WiFi not connected. Connect to WiFi first.\n" ANSI_RESET);
+        return;
+    }
+    ip_addr_t peer;
+    if (host && !shell_resolve(host, &peer)) {
+        return;
+    }
+    netperf_run(host ? &peer : NULL, &options);
+}
+
+// Check the lwIP checksum override against the reference and time it
+void chksum_command(int argc, char* args[]) {
+    bool verify = argc < 2 || strcmp(args[1], "verify") == 0;
+    bool bench = argc < 2 || strcmp(args[1], "bench") == 0;
+    if (!verify && !bench) {
+        printf("Usage: chksum [verify [n]|bench]\n");
+        return;
+    }
+    if (verify) {
+        uint32_t iterations = argc > 2 ? (uint32_t)strtoul(args[2], NULL, 10) : 2000;
+        uint32_t seed = time_us_32();
+        printf("Verifying %s checksum on %lu random buffers (seed 0x%08lx)...\n",
+               CHKSUM_ARM_ASM ? "M33" : "portable", (unsigned long)iterations, (unsigned long)seed);
+        uint32_t failures = chksum_verify(iterations, seed);
+        if (failures) {
+            printf(ANSI_RED "%lu mismatches\n" ANSI_RESET, (unsigned long)failures);
         } else {
-            printf("%s: icmp_seq=%d " ANSI_RED "Request timeout" ANSI_RESET "\n", 
-                   ipaddr_ntoa(&target_ip), ping_data.seq_num);
+            printf(ANSI_GREEN "All match lwIP's reference\n" ANSI_RESET);
         }
-        
-        sleep_ms(1000);
     }
-    
-    // Cleanup
-    cyw43_arch_lwip_begin();
-    raw_remove(ping_data.pcb);
-    cyw43_arch_lwip_end();
-    
-    // Print statistics
-    printf("\n--- %s ping statistics ---\n", host);
-    printf("4 packets transmitted, %d received, %d%% packet loss\n", 
-           received_count, ((4 - received_count) * 100) / 4);
-    
-    if (received_count > 0) {
-        printf("rtt min/avg/max = %lu/%lu/%lu ms\n", 
-               (unsigned long)min_rtt, 
-               (unsigned long)(total_rtt / received_count), 
-               (unsigned long)max_rtt);
+    if (bench) {
+        printf("Checksum throughput:\n");
+        chksum_bench();
+    }
+}
+
+// WiFi manager events - lwIP context, so no blocking and no printf
+static void wifi_event(enum wifi_event event, void *arg) {
+    struct wifi_status status;
+    char msg[96];
+    switch (event) {
+        case WIFI_EVENT_UP:
+            wifi_connected = true;
+            wifi_manager_get_status(&status);
+            snprintf(msg, sizeof(msg), "WiFi up in %lu ms%s", (unsigned long)status.connect_ms,
+                     status.fast ? " (cached AP)" : "");
+            log_message(msg);
+            // Keep the clock disciplined across reconnects
+            if (!ntp_started) {
+                ntp_started = timesync_start(ntp_servers, sizeof(ntp_servers) / sizeof(ntp_servers[0]));
+            } else {
+                timesync_poll_now();
+            }
+            break;
+        case WIFI_EVENT_DOWN:
+            wifi_connected = false;
+            log_message("WiFi link down");
+            break;
+        case WIFI_EVENT_RETRY:
+            wifi_manager_get_status(&status);
+            snprintf(msg, sizeof(msg), "WiFi connection failed, retrying in %lu s",
+                     (unsigned long)(status.retry_in_ms / 1000));
+            log_message(msg);
+            break;
+    }
+}
+
+void show_wifi_status() {
+    struct wifi_status status;
+    wifi_manager_get_status(&status);
+
+    printf("\n" ANSI_BOLD "WiFi:" ANSI_RESET " %s%s" ANSI_RESET "\n",
+           status.state == WIFI_UP ? ANSI_GREEN : ANSI_YELLOW, wifi_state_name(status.state));
+    if (status.ssid[0]) {
+        printf("  SSID:       %s\n", status.ssid);
+    }
+    if (status.state == WIFI_UP) {
+        printf("  AP:         %02x:%02x:%02x:%02x:%02x:%02x, channel %u, %s%s\n",
+               status.bssid[0], status.bssid[1], status.bssid[2],
+               status.bssid[3], status.bssid[4], status.bssid[5],
+               status.channel, wifi_auth_name(status.auth), status.fast ? " (cached)" : "");
+        cyw43_arch_lwip_begin();
+        const ip4_addr_t *ip = netif_ip4_addr(netif_default);
+        char addr[16];
+        ip4addr_ntoa_r(ip, addr, sizeof(addr));
+        cyw43_arch_lwip_end();
+        printf("  IP:         %s%s\n", addr, status.provisional ? " (cached lease, DHCP pending)" : "");
+        printf("  Connected:  in %lu ms, at +%lu.%03lus\n", (unsigned long)status.connect_ms,
+               (unsigned long)(status.up_at_ms / 1000), (unsigned long)(status.up_at_ms % 1000));
+    } else if (status.state == WIFI_BACKOFF) {
+        printf("  Retry in:   %lu ms (%lu failed round(s))\n",
+               (unsigned long)status.retry_in_ms, (unsigned long)status.failures);
+    }
+    if (status.state != WIFI_OFF && status.state != WIFI_IDLE) {
+        printf("  Joins:      %lu started, %lu link drop(s)\n",
+               (unsigned long)status.attempts, (unsigned long)status.drops);
+        printf("  Cache:      %s\n", status.cached ? "AP and lease saved" : "none for this SSID");
     }
     printf("\n");
 }
@@ -2207,6 +2291,11 @@ void connect_wifi() {
     printf("║          WiFi Configuration            ║\n");
     printf("╚════════════════════════════════════════╝\n" ANSI_RESET);
     
+    if (wifi_manager_state() == WIFI_OFF) {
+        printf(ANSI_RED "\nWiFi driver is not available\n" ANSI_RESET);
+        return;
+    }
+    
     char *ssid = read_line("\nEnter WiFi SSID: ", true);
     if (!ssid || strlen(ssid) == 0) {
         printf(ANSI_RED "Error: SSID cannot be empty\n" ANSI_RESET);
@@ -2226,80 +2315,64 @@ void connect_wifi() {
     strncpy(wifi_password, password, sizeof(wifi_password) - 1);
     wifi_password[sizeof(wifi_password) - 1] = '\0';
     
-    printf("Connecting to WiFi...\n");
-    printf("SSID: %s\n", wifi_ssid);
-    
-    cyw43_arch_enable_sta_mode();
-    
-    // Try multiple authentication methods
-    int result = -1;
-    
-    // Try WPA2 first (most common)
-    printf("Trying WPA2...\n");
-    result = cyw43_arch_wifi_connect_timeout_ms(wifi_ssid, wifi_password, 
-                                                  CYW43_AUTH_WPA2_AES_PSK, 15000);
-    
-    if (result != 0) {
-        printf("WPA2 failed, trying WPA2 Mixed...\n");
-        result = cyw43_arch_wifi_connect_timeout_ms(wifi_ssid, wifi_password, 
-                                                      CYW43_AUTH_WPA2_MIXED_PSK, 15000);
-    }
-    
-    if (result != 0) {
-        printf("Trying WPA...\n");
-        result = cyw43_arch_wifi_connect_timeout_ms(wifi_ssid, wifi_password, 
-                                                      CYW43_AUTH_WPA_TKIP_PSK, 15000);
+    // Saved up front: the manager keeps trying after this command returns,
+    // and resumes from here after a reboot
+    lfs_file_t file;
+    if (lfs_file_open(&lfs, &file, "wifi.cfg", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%s\n%s", wifi_ssid, wifi_password);
+        lfs_file_write(&lfs, &file, buf, strlen(buf));
+        lfs_file_close(&lfs, &file);
     }
     
-    if (result == 0) {
-        wifi_connected = true;
-        printf(ANSI_GREEN "\n✓ Connected successfully!\n" ANSI_RESET);
-        
-        // Show IP address
-        sleep_ms(1000);
-        const ip4_addr_t *addr_ptr = netif_ip4_addr(netif_list);
-        if (addr_ptr) {
-            printf("IP Address: %s\n", ip4addr_ntoa(addr_ptr));
-        }
-        
-        // Save config
-        lfs_file_t file;
-        if (lfs_file_open(&lfs, &file, "wifi.cfg", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
-            char buf[128];
-            snprintf(buf, sizeof(buf), "%s\n%s", wifi_ssid, wifi_password);
-            lfs_file_write(&lfs, &file, buf, strlen(buf));
-            lfs_file_close(&lfs, &file);
+    printf("Connecting to WiFi...\n");
+    printf("SSID: %s\n", wifi_ssid);
+    wifi_manager_connect(wifi_ssid, wifi_password);
+    
+    // Follow the first round of attempts; the manager carries on after
+    struct wifi_status status;
+    enum wifi_state shown = WIFI_IDLE;
+    uint32_t auth_shown = 0;
+    absolute_time_t timeout = make_timeout_time_ms(WIFI_CONNECT_WAIT_MS);
+    do {
+        sleep_ms(50);
+        wifi_manager_get_status(&status);
+        if (status.state == WIFI_JOINING && (shown != WIFI_JOINING || status.auth != auth_shown)) {
+            printf("Trying %s%s...\n", wifi_auth_name(status.auth), status.fast ? " (cached AP)" : "");
+            auth_shown = status.auth;
+        } else if (status.state == WIFI_ADDRESSING && shown != WIFI_ADDRESSING) {
+            printf("Associated, waiting for DHCP...\n");
         }
-        
-        log_message("WiFi connected");
-        
-        // Sync time
-        printf("Syncing time...\n");
-        sync_ntp_time();
+        shown = status.state;
+    } while (status.state != WIFI_UP && status.failures == 0 && !time_reached(timeout));
+    
+    if (status.state == WIFI_UP) {
+        printf(ANSI_GREEN "\n✓ Connected in %lu ms!\n" ANSI_RESET, (unsigned long)status.connect_ms);
+        show_ip();
+        printf("Time sync started in the background ('ntp' to check)\n");
     } else {
-        wifi_connected = false;
-        printf(ANSI_RED "\n✗ Connection failed!\n" ANSI_RESET);
+        printf(ANSI_RED "\n✗ Not connected yet\n" ANSI_RESET);
         printf("\nTroubleshooting:\n");
         printf("  • Check SSID is correct (case-sensitive)\n");
         printf("  • Check password is correct\n");
         printf("  • Make sure network is 2.4GHz (not 5GHz)\n");
         printf("  • Try moving closer to the router\n");
         printf("  • Check if MAC filtering is enabled\n");
-        log_message("WiFi connection failed");
+        printf("\nStill retrying in the background ('wifi status', 'wifi off')\n");
     }
 }
 
 void show_time() {
-    time_t now = get_current_time();
-    if (now == 0) {
+    struct time_snapshot now;
+    timecache_read(&now);
+    if (!now.valid) {
         printf(ANSI_YELLOW "Time not synchronized yet\n" ANSI_RESET);
         printf("Use 'wifi' to connect and sync time\n");
     } else {
-        struct tm *t = localtime(&now);
         printf("\n" ANSI_BOLD "Current Time:\n" ANSI_RESET);
-        printf("  %04d-%02d-%02d %02d:%02d:%02d %s\n\n",
-               t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-               t->tm_hour, t->tm_min, t->tm_sec, timezone_str);
+        printf("\n");
+        font_print(&font_block, now.hms, 2);
+        printf("\n  %.10s %s %s\n\n", now.iso, now.hms, timezone_str);
     }
 }
 
@@ -2350,8 +2423,11 @@ void settings_menu() {
     } else if (strcmp(choice, "2") == 0) {
         char *tz = read_line("Enter timezone offset (e.g., 0 for GMT, 1 for BST): ", true);
         timezone_offset = atoi(tz);
+        timecache_set_utc_offset(timezone_offset * 3600);
         printf(ANSI_GREEN "Timezone set to GMT%+d\n" ANSI_RESET, timezone_offset);
     } else if (strcmp(choice, "3") == 0) {
+        wifi_manager_disconnect();
+        wifi_manager_forget();
         wifi_ssid[0] = '\0';
         wifi_password[0] = '\0';
         lfs_remove(&lfs, "wifi.cfg");
@@ -2360,14 +2436,32 @@ void settings_menu() {
         printf(ANSI_RED "WARNING: This will erase all files!\n" ANSI_RESET);
         char *confirm = read_line("Type 'yes' to confirm: ", true);
         if (strcmp(confirm, "yes") == 0) {
+            // The todo store holds files open: close it around the format
+            // and start an empty list on the new filesystem
+            todo_store_close(&todos);
             lfs_unmount(&lfs);
             lfs_format(&lfs, &lfs_cfg);
             lfs_mount(&lfs, &lfs_cfg);
+            todos_ready = todo_store_open(&todos, &lfs, TODO_DIR);
             printf(ANSI_GREEN "Filesystem formatted\n" ANSI_RESET);
         }
     }
 }
 
+// Next key, counting the wait as idle time
+static int shell_getchar() {
+    int c = getchar_timeout_us(0);
+    if (c != PICO_ERROR_TIMEOUT) {
+        return c;
+    }
+    enum cpu_activity previous = cpu_enter(CPU_IDLE);
+    while ((c = getchar_timeout_us(0)) == PICO_ERROR_TIMEOUT) {
+        sleep_ms(1);
+    }
+    cpu_enter(previous);
+    return c;
+}
+
 char* read_line(const char* prompt, bool echo) {
     static char input_buffer1[256];
     static char input_buffer2[256];
@@ -2383,7 +2477,7 @@ char* read_line(const char* prompt, bool echo) {
     fflush(stdout);
     
     while (idx < sizeof(input_buffer1) - 1) {
-        int c = getchar();
+        int c = shell_getchar();
         
         if (c == '\r' || c == '\n') {
             current_buffer[idx] = '\0';
@@ -2433,13 +2527,34 @@ void execute_command(char* cmd) {
     } else if (strcmp(args[0], "timer") == 0) {
         timer_app();
     } else if (strcmp(args[0], "todo") == 0) {
-        todo_app();
+        if (argc > 1 && strcmp(args[1], "bench") == 0) {
+            todo_benchmark(argc > 2 ? strtoul(args[2], NULL, 10) : 10000);
+        } else {
+            todo_app();
+        }
     } else if (strcmp(args[0], "nmap") == 0) {
-        nmap_app();
+        nmap_command(argc, args);
     } else if (strcmp(args[0], "ascii") == 0) {
-        ascii_converter();
+        ascii_converter(argc > 1 ? args[1] : NULL);
+    } else if (strcmp(args[0], "banner") == 0) {
+        banner_command(argc, args);
+    } else if (strcmp(args[0], "font") == 0) {
+        if (argc > 2 && strcmp(args[1], "load") == 0) {
+            if (font_load_file(args[2])) {
+                printf(ANSI_GREEN "Font loaded\n" ANSI_RESET);
+            } else {
+                printf(ANSI_RED "Error: Could not load font %s\n" ANSI_RESET, args[2]);
+            }
+        } else {
+            list_fonts();
+        }
     } else if (strcmp(args[0], "tetris") == 0) {
-        tetris_game();
+        if (argc > 1 && strcmp(args[1], "bench") == 0) {
+            tetris_benchmark(argc > 2 ? strtoul(args[2], NULL, 10) : 10,
+                             argc > 3 ? strtoul(args[3], NULL, 10) : 1);
+        } else {
+            tetris_game();
+        }
     } else if (strcmp(args[0], "snake") == 0) {
         snake_game();
     } else if (strcmp(args[0], "sysinfo") == 0) {
@@ -2453,6 +2568,8 @@ void execute_command(char* cmd) {
         while (1);
     } else if (strcmp(args[0], "ps") == 0) {
         list_processes();
+    } else if (strcmp(args[0], "top") == 0) {
+        top_command(argc, args);
     } else if (strcmp(args[0], "stop") == 0) {
         if (argc < 2) {
             printf("Usage: stop <process_name>\n");
@@ -2490,15 +2607,47 @@ void execute_command(char* cmd) {
     } else if (strcmp(args[0], "ipa") == 0) {
         show_ip();
     } else if (strcmp(args[0], "ping") == 0) {
+        ping_command(argc, args);
+    } else if (strcmp(args[0], "netperf") == 0) {
+        netperf_command(argc, args);
+    } else if (strcmp(args[0], "chksum") == 0) {
+        chksum_command(argc, args);
+    } else if (strcmp(args[0], "dig") == 0) {
         if (argc < 2) {
-            printf("Usage: ping <host>\n");
+            show_dns_cache();
+        } else if (strcmp(args[1], "flush") == 0) {
+            dns_cache_flush();
+            printf("DNS cache flushed\n");
         } else {
-            ping_test(args[1]);
+            dig_command(args[1]);
         }
     } else if (strcmp(args[0], "wifi") == 0) {
-        connect_wifi();
+        if (argc < 2) {
+            connect_wifi();
+        } else if (strcmp(args[1], "status") == 0) {
+            show_wifi_status();
+        } else if (strcmp(args[1], "reconnect") == 0) {
+            if (wifi_ssid[0] && wifi_manager_connect(wifi_ssid, wifi_password)) {
+                printf("Reconnecting to %s in the background\n", wifi_ssid);
+            } else {
+                printf(ANSI_YELLOW "No WiFi network configured\n" ANSI_RESET);
+            }
+        } else if (strcmp(args[1], "off") == 0) {
+            wifi_manager_disconnect();
+            printf("WiFi disconnected\n");
+        } else {
+            printf("Usage: wifi [status|reconnect|off]\n");
+        }
     } else if (strcmp(args[0], "time") == 0) {
         show_time();
+    } else if (strcmp(args[0], "bootprof") == 0) {
+        boot_profile_print();
+    } else if (strcmp(args[0], "ntp") == 0) {
+        if (argc > 1 && strcmp(args[1], "sync") == 0) {
+            sync_ntp_time();
+        } else {
+            show_ntp_status();
+        }
     } else if (strcmp(args[0], "viewlog") == 0) {
         view_log();
     } else if (strcmp(args[0], "showram") == 0) {
@@ -2519,19 +2668,16 @@ void execute_command(char* cmd) {
 
 // Print shell prompt
 void print_prompt() {
-    time_t now = get_current_time();
-    if (now == 0) {
+    char hms[9];
+    if (!timecache_hms(hms)) {
         // No time set, show uptime
-        uint32_t uptime_sec = to_ms_since_boot(get_absolute_time()) / 1000;
         printf(ANSI_GREEN "+%05lus" ANSI_RESET " " 
                ANSI_BOLD ANSI_BLUE "pico@os" ANSI_RESET 
-               ":" ANSI_CYAN "~" ANSI_RESET "$ ", (unsigned long)uptime_sec);
+               ":" ANSI_CYAN "~" ANSI_RESET "$ ", (unsigned long)timecache_uptime());
     } else {
-        struct tm *t = localtime(&now);
-        printf(ANSI_GREEN "%02d:%02d:%02d" ANSI_RESET " " 
+        printf(ANSI_GREEN "%s" ANSI_RESET " " 
                ANSI_BOLD ANSI_BLUE "pico@os" ANSI_RESET 
-               ":" ANSI_CYAN "~" ANSI_RESET "$ ", 
-               t->tm_hour, t->tm_min, t->tm_sec);
+               ":" ANSI_CYAN "~" ANSI_RESET "$ ", hms);
     }
     fflush(stdout);
 }
@@ -2539,12 +2685,15 @@ void print_prompt() {
 // Main shell loop
 void shell_loop() {
     print_prompt();
+    cpu_enter(CPU_SHELL);
     
     while (true) {
         int c = getchar_timeout_us(0);
         
         if (c == PICO_ERROR_TIMEOUT) {
+            cpu_enter(CPU_IDLE);
             sleep_ms(10);
+            cpu_enter(CPU_SHELL);
             continue;
         }
         
@@ -2575,19 +2724,148 @@ void shell_loop() {
     }
 }
 
-// Background NTP sync task
-void ntp_sync_task() {
+// One poll of every running background process, timed for 'top'
+static void run_processes() {
+    for (int i = 0; i < process_count; i++) {
+        if (processes[i].running) {
+            uint32_t start = time_us_32();
+            processes[i].func();
+            processes[i].run_us += time_us_32() - start;
+            processes[i].calls++;
+        }
+    }
+}
+
+#if !PICO_OS_FREERTOS
+// Core 1 service loop: filesystem worker first, then background processes.
+// Sleeps in WFE when idle; queue pushes from core 0 send an event.
+void core1_main() {
+    flash_safe_execute_core_init();
+    
+#if PICO_OS_FAST_BOOT
+    boot_storage();
+    sem_release(&boot_storage_done);
+    sem_acquire_blocking(&boot_services_ready);
+#endif
+    
     while (true) {
-        if (wifi_connected && ntp_synced) {
-            sleep_ms(3600000); // Sync every hour
-            sync_ntp_time();
-        } else {
-            sleep_ms(5000);
+        cpu_enter(CPU_FS);
+        bool busy = fs_worker_service();
+        
+        cpu_enter(CPU_TASKS);
+        run_processes();
+        
+        if (!busy) {
+            cpu_enter(CPU_IDLE);
+            best_effort_wfe_or_timeout(make_timeout_time_ms(10));
+        }
+    }
+}
+#endif
+
+// Saved WiFi credentials into wifi_ssid/wifi_password
+static bool load_wifi_config() {
+    bool loaded = false;
+    lfs_file_t file;
+    if (lfs_file_open(&lfs, &file, "wifi.cfg", LFS_O_RDONLY) >= 0) {
+        char buf[128];
+        int len = lfs_file_read(&lfs, &file, buf, sizeof(buf) - 1);
+        if (len > 0) {
+            buf[len] = '\0';
+            char* newline = strchr(buf, '\n');
+            if (newline) {
+                *newline = '\0';
+                size_t ssid_len = strlen(buf);
+                if (ssid_len < sizeof(wifi_ssid)) {
+                    memcpy(wifi_ssid, buf, ssid_len);
+                    wifi_ssid[ssid_len] = '\0';
+                }
+                size_t pass_len = strlen(newline + 1);
+                if (pass_len < sizeof(wifi_password)) {
+                    memcpy(wifi_password, newline + 1, pass_len);
+                    wifi_password[pass_len] = '\0';
+                }
+                loaded = true;
+            }
+        }
+        lfs_file_close(&lfs, &file);
+    }
+    return loaded;
+}
+
+// Filesystem, fonts and saved config. Runs on core 1 in fast boot, before
+// the console is up, so results are kept for boot_sequence() to report.
+void boot_storage() {
+    int stage = boot_stage_begin("filesystem");
+    init_filesystem();
+    boot_stage_end(stage);
+    
+    stage = boot_stage_begin("fonts");
+    boot_fonts_loaded = load_fonts();
+    boot_stage_end(stage);
+    
+    stage = boot_stage_begin("config");
+    boot_wifi_config = load_wifi_config();
+    boot_stage_end(stage);
+    
+    stage = boot_stage_begin("todo");
+    todos_ready = todo_store_open(&todos, &lfs, TODO_DIR);
+    boot_stage_end(stage);
+}
+
+// Always on core 0: the driver's async context, and with it every lwIP
+// callback, runs on the core that initialises it (FreeRTOS: in the shell
+// task, since the driver's task can only be created once the scheduler runs)
+static void boot_wifi_driver() {
+    int stage = boot_stage_begin("wifi driver");
+    boot_wifi_init = cyw43_arch_init();
+    if (boot_wifi_init == 0) {
+        cyw43_arch_enable_sta_mode();
+        cpu_load_hook_net();
+    }
+    boot_stage_end(stage);
+}
+
+// Needs storage and the driver: fs worker queues, WiFi manager, first join
+static void boot_network() {
+    int stage = boot_stage_begin("network start");
+    fs_worker_init();
+    if (boot_wifi_init == 0) {
+        wifi_manager_init(wifi_event, NULL);
+        // Joins in the background; the shell is up long before the address
+        if (wifi_ssid[0]) {
+            wifi_manager_connect(wifi_ssid, wifi_password);
+        }
+    }
+    boot_stage_end(stage);
+}
+
+// Until a terminal opens the USB serial port, woken by the USB interrupt;
+// false if none did within timeout_ms
+static bool boot_wait_usb(uint32_t timeout_ms) {
+    int stage = boot_stage_begin("usb host");
+    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+    bool connected = true;
+    while (!stdio_usb_connected()) {
+#if PICO_OS_FREERTOS
+        // A task must not hold its core in WFE; poll instead
+        if (time_reached(deadline)) {
+            connected = false;
+            break;
+        }
+        sleep_ms(10);
+#else
+        if (best_effort_wfe_or_timeout(deadline)) {
+            connected = false;
+            break;
         }
+#endif
     }
+    boot_stage_end(stage);
+    return connected;
 }
 
-// Boot sequence
+// Boot sequence - banner and the report of what the stages did
 void boot_sequence() {
     printf("\r\n\r\n");
     printf("╔═══════════════════════════════════════════════╗\r\n");
@@ -2597,56 +2875,40 @@ void boot_sequence() {
     printf("╚═══════════════════════════════════════════════╝\r\n");
     printf("\r\n");
     
-    printf("Booting...\r\n\r\n");
+    printf("Booting%s...\r\n\r\n", PICO_OS_FAST_BOOT ? " (fast)" : "");
     
     log_message("System booting");
     
     printf("[OK] Initializing hardware\r\n");
     
+#if !PICO_OS_FAST_BOOT
     printf("[..] Mounting filesystem\r\n");
-    init_filesystem();
+    boot_storage();
+    printf("[..] Starting WiFi driver\r\n");
+    boot_wifi_driver();
+    boot_network();
+#endif
+    
     printf("[OK] Filesystem ready\r\n");
+    if (boot_fonts_loaded > 0) {
+        printf("[OK] Loaded %d font(s) from " FONT_DIR "\r\n", boot_fonts_loaded);
+    }
     
-    printf("[..] Starting WiFi driver\r\n");
-    int wifi_init = cyw43_arch_init();
-    if (wifi_init != 0) {
-        printf("[WARN] WiFi driver init failed (code %d)\r\n", wifi_init);
+    if (boot_wifi_init != 0) {
+        printf("[WARN] WiFi driver init failed (code %d)\r\n", boot_wifi_init);
         printf("[WARN] WiFi features will be unavailable\r\n");
         log_message("WARNING: WiFi init failed");
     } else {
-        cyw43_arch_enable_sta_mode();
         printf("[OK] WiFi driver ready\r\n");
     }
     
     printf("[OK] Initializing system clock\r\n");
-    // Initialize time tracking
-    time_sync_base = get_absolute_time();
-    system_time_offset = 0; // Will be set by NTP
     
-    // Load WiFi config
-    lfs_file_t file;
-    if (lfs_file_open(&lfs, &file, "wifi.cfg", LFS_O_RDONLY) >= 0) {
-        char buf[128];
-        int len = lfs_file_read(&lfs, &file, buf, sizeof(buf) - 1);
-        if (len > 0) {
-            buf[len] = '\0';
-            char* newline = strchr(buf, '\n');
-            if (newline) {
-                *newline = '\0';
-                size_t ssid_len = strlen(buf);
-                if (ssid_len < sizeof(wifi_ssid)) {
-                    memcpy(wifi_ssid, buf, ssid_len);
-                    wifi_ssid[ssid_len] = '\0';
-                }
-                size_t pass_len = strlen(newline + 1);
-                if (pass_len < sizeof(wifi_password)) {
-                    memcpy(wifi_password, newline + 1, pass_len);
-                    wifi_password[pass_len] = '\0';
-                }
-                printf("[OK] WiFi credentials loaded\r\n");
-            }
+    if (boot_wifi_config) {
+        printf("[OK] WiFi credentials loaded\r\n");
+        if (boot_wifi_init == 0) {
+            printf("[OK] WiFi connecting to %s in the background\r\n", wifi_ssid);
         }
-        lfs_file_close(&lfs, &file);
     }
     
     printf("\r\nBoot complete!\r\n");
@@ -2659,13 +2921,114 @@ void boot_sequence() {
     boot_time = get_absolute_time();
 }
 
+// Boot profile report, then the shell for good
+static void boot_enter_shell() {
+    boot_profile_ready();
+    boot_profile_print();
+    boot_profile_log();
+    
+    // Enter shell loop
+    shell_loop();
+    
+    // Should never reach here
+    panic_handler("Shell loop exited unexpectedly");
+}
+
+#if PICO_OS_FREERTOS
+// ===== FREERTOS TASKS =====
+// Storage comes up here while the shell task starts the WiFi driver, as
+// core 1 does in the fast boot; then this task is the filesystem service
+static void fs_task(void *param) {
+    cpu_load_tag_task(NULL, CPU_OTHER);
+    boot_storage();
+    sem_release(&boot_storage_done);
+    sem_acquire_blocking(&boot_services_ready);
+    
+    cpu_load_tag_task(NULL, CPU_FS);
+    fs_worker_run();
+}
+
+// Background processes, polled like core 1 does but sleeping in between
+static void processes_task(void *param) {
+    cpu_load_tag_task(NULL, CPU_TASKS);
+    while (true) {
+        run_processes();
+        vTaskDelay(pdMS_TO_TICKS(PROCESSES_POLL_MS));
+    }
+}
+
+// WiFi driver, the rest of the boot, then the shell
+static void shell_task(void *param) {
+    cpu_load_tag_task(NULL, CPU_OTHER);
+    boot_wifi_driver();
+    int stage = boot_stage_begin("wait for storage");
+    sem_acquire_blocking(&boot_storage_done);
+    boot_stage_end(stage);
+    boot_network();
+    sem_release(&boot_services_ready);
+    
+    boot_wait_usb(BOOT_USB_WAIT_MS);
+    boot_sequence();
+    
+    cpu_load_tag_task(NULL, CPU_SHELL);
+    boot_enter_shell();
+}
+#endif
+
 // Main function
 int main() {
+    boot_profile_init();
+    cpu_load_init();
+    critical_section_init(&log_lock);
+    
+    int stage = boot_stage_begin("runtime init");
     // Initialize all stdio types
     stdio_init_all();
     
+    // Initialize random seed
+    srand(to_ms_since_boot(get_absolute_time()));
+    tetris_init();
+    
+    // Clock is read from log_message(), so it comes first
+    timesync_init();
+    timecache_init(timezone_offset * 3600);
+    
+#if !PICO_OS_FREERTOS
+    // Either core may program flash from here on, parking the other (the
+    // FreeRTOS build parks it with a high priority task instead)
+    flash_safe_execute_core_init();
+#endif
+    boot_stage_end(stage);
+    
+#if PICO_OS_FREERTOS
+    sem_init(&boot_storage_done, 0, 1);
+    sem_init(&boot_services_ready, 0, 1);
+    xTaskCreate(shell_task, "shell", SHELL_TASK_STACK, NULL, TASK_PRIORITY_SHELL, NULL);
+    xTaskCreate(fs_task, "fs", FS_TASK_STACK, NULL, TASK_PRIORITY_FS, NULL);
+    xTaskCreate(processes_task, "procs", PROCESSES_TASK_STACK, NULL, TASK_PRIORITY_PROCESSES, NULL);
+    // Only returns if the idle or timer tasks could not be created
+    vTaskStartScheduler();
+    panic_handler("Scheduler exited unexpectedly");
+#elif PICO_OS_FAST_BOOT
+    // Storage on core 1 while the WiFi driver loads its firmware here; the
+    // console is only needed once there is something to print
+    sem_init(&boot_storage_done, 0, 1);
+    sem_init(&boot_services_ready, 0, 1);
+    multicore_launch_core1_with_stack(core1_main, core1_stack, sizeof(core1_stack));
+    
+    boot_wifi_driver();
+    stage = boot_stage_begin("wait for core 1");
+    sem_acquire_blocking(&boot_storage_done);
+    boot_stage_end(stage);
+    boot_network();
+    sem_release(&boot_services_ready);
+    
+    boot_wait_usb(BOOT_USB_WAIT_MS);
+    boot_sequence();
+#else
     // Critical: Wait for USB to enumerate
     // The Pico needs time to set up USB CDC
+    stage = boot_stage_begin("usb settle");
     busy_wait_ms(2000);
     
     // Send test pattern to verify USB is working
@@ -2683,29 +3046,22 @@ int main() {
     printf("Pico OS initializing...\r\n");
     printf("If you see this, USB serial is working!\r\n\r\n");
     busy_wait_ms(500);
-    
-    // Initialize random seed
-    srand(to_ms_since_boot(get_absolute_time()));
+    boot_stage_end(stage);
     
     // Boot sequence with error checking
     boot_sequence();
     
     printf("Starting background tasks...\r\n");
     
-    // Start background tasks
-    int ntp_pid = add_process("ntp_sync", ntp_sync_task);
-    if (ntp_pid < 0) {
-        printf("WARNING: Failed to start NTP sync task\r\n");
-    }
+    // Core 1 hosts the filesystem worker and background processes
+    multicore_launch_core1_with_stack(core1_main, core1_stack, sizeof(core1_stack));
     
     printf("Entering shell...\r\n\r\n");
     busy_wait_ms(300);
+#endif
     
-    // Enter shell loop
-    shell_loop();
-    
-    // Should never reach here
-    panic_handler("Shell loop exited unexpectedly");
-    
+#if !PICO_OS_FREERTOS
+    boot_enter_shell();
+#endif
     return 0;
 }
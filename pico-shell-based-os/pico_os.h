@@ -0,0 +1,74 @@
+/**
+ * Raspberry Pi Pico 2 W Operating System - shared kernel declarations
+ *
+ * Everything that more than one source file needs lives here: system
+ * configuration, terminal colours and the handful of globals owned by
+ * pico_os.cpp (filesystem, WiFi state, log).
+ */
+
+#ifndef PICO_OS_H
+#define PICO_OS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "pico/stdlib.h"
+
+// LittleFS includes
+extern "C" {
+#include "lfs.h"
+}
+
+// System configuration
+#define MAX_COMMAND_LEN 256
+#define MAX_ARGS 16
+#define MAX_PROCESSES 8
+#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES - (512 * 1024)) // Last 512KB for filesystem
+#define LFS_BLOCK_SIZE 4096
+#define LFS_BLOCK_COUNT 128
+#define LFS_CACHE_SIZE 256
+
+// Web server configuration
+#define HTTP_SERVER_PORT 80
+#define MAX_HTTP_CONNECTIONS 4
+#define HTTP_BUFFER_SIZE 1536
+
+// ANSI color codes for terminal
+#define ANSI_RESET "\033[0m"
+#define ANSI_BOLD "\033[1m"
+#define ANSI_RED "\033[31m"
+#define ANSI_GREEN "\033[32m"
+#define ANSI_YELLOW "\033[33m"
+#define ANSI_BLUE "\033[34m"
+#define ANSI_MAGENTA "\033[35m"
+#define ANSI_CYAN "\033[36m"
+#define ANSI_CLEAR_SCREEN "\033[2J\033[H"
+
+// Globals owned by pico_os.cpp
+extern lfs_t lfs;
+extern struct lfs_config lfs_cfg;
+extern volatile bool wifi_connected;
+extern char wifi_ssid[64];
+
+// LittleFS custom attribute on files the OS writes: when the file was
+// last written, in microseconds since boot. Every rewrite changes it, so a
+// cache can be keyed on the file itself. Files without one read as 0.
+#define FS_ATTR_STAMP 0x73
+
+// Kernel services implemented in pico_os.cpp
+void log_message(const char* msg);
+time_t get_current_time();
+char* read_line(const char* prompt, bool echo);
+void fs_stamp(const char* path);    // Set path's write stamp after writing it
+
+// Read-only views for the web API (http_api.cpp). Log entries are
+// addressed by a running sequence number so a reader can walk the ring
+// while it is being appended to; overwritten entries return false.
+uint32_t log_first_sequence();
+uint32_t log_next_sequence();
+bool log_get_entry(uint32_t sequence, char* out, size_t len);
+int process_get_count();
+bool process_get_info(int pid, char* name, size_t len, bool* running, uint32_t* start_time);
+
+#endif // PICO_OS_H
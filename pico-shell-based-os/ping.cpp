@@ -0,0 +1,425 @@
+/**
+ * ICMP echo engine - see ping.h
+ *
+ * The probe table is shared between the shell (send, expire) and the raw
+ * PCB callback (match), so the shell touches it only inside the lwIP lock.
+ * Replies update the statistics in the callback and are also queued to a
+ * small ring that the shell drains to print them.
+ */
+
+#include <string.h>
+#include "pico_os.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "lwip/pbuf.h"
+#include "lwip/raw.h"
+#include "lwip/icmp.h"
+#include "lwip/inet_chksum.h"
+#include "ping.h"
+
+#define PING_EVENTS 64
+#define PING_WAIT_US 10000              // Key poll interval between sends
+#define PING_BAR_WIDTH 40
+
+enum probe_state {
+    PROBE_FREE,
+    PROBE_PENDING,
+    PROBE_ANSWERED,
+    PROBE_EXPIRED
+};
+
+enum event_kind {
+    EVENT_REPLY,
+    EVENT_DUPLICATE,
+    EVENT_LATE
+};
+
+struct ping_probe {
+    uint16_t seq;
+    uint16_t size;
+    uint8_t state;
+    uint8_t step;               // Sweep step index
+    uint64_t sent_us;
+};
+
+// A reply as the callback saw it, for the shell to print
+struct ping_event {
+    uint16_t seq;
+    uint16_t size;
+    uint8_t ttl;
+    uint8_t kind;
+    uint32_t rtt_us;
+};
+
+static struct {
+    struct raw_pcb *pcb;
+    ip_addr_t target;
+    uint16_t id;
+    struct ping_stats *stats;
+    struct ping_probe probes[PING_WINDOW];
+    int outstanding;
+    struct ping_event events[PING_EVENTS];
+    volatile uint32_t event_head;       // Advanced by the receive callback
+    volatile uint32_t event_tail;       // Advanced by the shell
+} session;
+
+void ping_options_default(struct ping_options *options) {
+    memset(options, 0, sizeof(*options));
+    options->count = 4;
+    options->interval_us = 1000000;
+    options->timeout_us = 1000000;
+    options->size = PING_DEFAULT_PAYLOAD;
+    options->window = PING_WINDOW;
+}
+
+static void ping_record(struct ping_stats *stats, const struct ping_probe *probe, uint32_t rtt_us) {
+    stats->received++;
+    if (rtt_us < stats->min_us) stats->min_us = rtt_us;
+    if (rtt_us > stats->max_us) stats->max_us = rtt_us;
+    stats->sum_us += rtt_us;
+    stats->sum_sq_us += (uint64_t)rtt_us * rtt_us;
+
+    int bucket = 0;
+    for (uint32_t v = rtt_us >> PING_HIST_BASE_SHIFT; v && bucket < PING_HIST_BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+    stats->hist[bucket]++;
+
+    if (stats->sweep_steps > 0) {
+        struct ping_sweep_step *step = &stats->sweep[probe->step];
+        step->received++;
+        if (rtt_us < step->min_us) step->min_us = rtt_us;
+        if (rtt_us > step->max_us) step->max_us = rtt_us;
+        step->sum_us += rtt_us;
+    }
+}
+
+// lwIP context
+static u8_t ping_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_addr_t *addr) {
+    uint64_t now = time_us_64();
+    u16_t ihl = (u16_t)((pbuf_get_at(p, 0) & 0x0F) * 4);
+    struct icmp_echo_hdr echo;
+    if (!session.stats || !ip_addr_cmp(addr, &session.target) ||
+        pbuf_copy_partial(p, &echo, sizeof(echo), ihl) != sizeof(echo) ||
+        echo.type != ICMP_ER || echo.id != session.id) {
+        return 0;       // Not ours
+    }
+
+    uint16_t seq = lwip_ntohs(echo.seqno);
+    struct ping_probe *probe = &session.probes[seq % PING_WINDOW];
+    if (probe->state == PROBE_FREE || probe->seq != seq) {
+        pbuf_free(p);   // From a slot that has been reused since
+        return 1;
+    }
+
+    struct ping_event event;
+    event.seq = seq;
+    event.size = (uint16_t)(p->tot_len - ihl - sizeof(echo));
+    event.ttl = pbuf_get_at(p, 8);
+    event.rtt_us = (uint32_t)(now - probe->sent_us);
+    if (probe->state == PROBE_PENDING) {
+        event.kind = EVENT_REPLY;
+        probe->state = PROBE_ANSWERED;
+        session.outstanding--;
+        ping_record(session.stats, probe, event.rtt_us);
+    } else if (probe->state == PROBE_ANSWERED) {
+        event.kind = EVENT_DUPLICATE;
+        session.stats->duplicates++;
+    } else {
+        event.kind = EVENT_LATE;
+        session.stats->late++;
+    }
+    pbuf_free(p);
+
+    uint32_t head = session.event_head;
+    if (head - session.event_tail < PING_EVENTS) {
+        session.events[head % PING_EVENTS] = event;
+        __dmb();
+        session.event_head = head + 1;
+    }
+    return 1;
+}
+
+static bool ping_send_probe(uint16_t seq, uint16_t size, uint8_t step) {
+    u16_t len = (u16_t)(sizeof(struct icmp_echo_hdr) + size);
+    cyw43_arch_lwip_begin();
+    struct pbuf *p = pbuf_alloc(PBUF_IP, len, PBUF_RAM);
+    if (!p) {
+        cyw43_arch_lwip_end();
+        return false;
+    }
+
+    struct icmp_echo_hdr *echo = (struct icmp_echo_hdr*)p->payload;
+    ICMPH_TYPE_SET(echo, ICMP_ECHO);
+    ICMPH_CODE_SET(echo, 0);
+    echo->chksum = 0;
+    echo->id = session.id;
+    echo->seqno = lwip_htons(seq);
+    u8_t *data = (u8_t*)echo + sizeof(struct icmp_echo_hdr);
+    for (int i = 0; i < size; i++) {
+        data[i] = (u8_t)(0x20 + i);
+    }
+    echo->chksum = inet_chksum(echo, len);
+
+    struct ping_probe *probe = &session.probes[seq % PING_WINDOW];
+    probe->seq = seq;
+    probe->size = size;
+    probe->step = step;
+    probe->state = PROBE_PENDING;
+    probe->sent_us = time_us_64();
+    err_t err = raw_sendto(session.pcb, p, &session.target);
+    if (err == ERR_OK) {
+        session.outstanding++;
+    } else {
+        probe->state = PROBE_FREE;
+    }
+    pbuf_free(p);
+    cyw43_arch_lwip_end();
+    return err == ERR_OK;
+}
+
+static void format_ms(char *out, size_t len, uint32_t us) {
+    snprintf(out, len, "%lu.%03lu", (unsigned long)(us / 1000), (unsigned long)(us % 1000));
+}
+
+static void ping_print_event(const struct ping_event *event) {
+    char rtt[16];
+    format_ms(rtt, sizeof(rtt), event->rtt_us);
+    printf("%u bytes from %s: icmp_seq=%u ttl=%u time=%s ms%s\n", event->size,
+           ipaddr_ntoa(&session.target), event->seq, event->ttl, rtt,
+           event->kind == EVENT_DUPLICATE ? " (DUP!)" : event->kind == EVENT_LATE ? " (late)" : "");
+}
+
+bool ping_run(const char *label, const ip_addr_t *target, const struct ping_options *options,
+              struct ping_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->min_us = UINT32_MAX;
+    if (options->sweep_max > options->size && options->sweep_step > 0) {
+        stats->sweep_steps = (options->sweep_max - options->size) / options->sweep_step + 1;
+        if (stats->sweep_steps > PING_SWEEP_MAX_STEPS) {
+            stats->sweep_steps = PING_SWEEP_MAX_STEPS;
+        }
+        for (int i = 0; i < stats->sweep_steps; i++) {
+            stats->sweep[i].size = (uint16_t)(options->size + i * options->sweep_step);
+            stats->sweep[i].min_us = UINT32_MAX;
+        }
+    }
+
+    memset(&session, 0, sizeof(session));
+    ip_addr_copy(session.target, *target);
+    session.id = (uint16_t)LWIP_RAND();
+    cyw43_arch_lwip_begin();
+    session.pcb = raw_new(IP_PROTO_ICMP);
+    if (session.pcb) {
+        raw_recv(session.pcb, ping_recv, NULL);
+        raw_bind(session.pcb, IP_ADDR_ANY);
+        session.stats = stats;
+    }
+    cyw43_arch_lwip_end();
+    if (!session.pcb) {
+        printf(ANSI_RED "Failed to create ICMP socket\n" ANSI_RESET);
+        return false;
+    }
+
+    if (stats->sweep_steps > 0) {
+        printf("PING %s (%s): %u-%u data bytes in %d steps\n", label, ipaddr_ntoa(target),
+               options->size, stats->sweep[stats->sweep_steps - 1].size, stats->sweep_steps);
+    } else {
+        printf("PING %s (%s): %u data bytes\n", label, ipaddr_ntoa(target), options->size);
+    }
+    printf("(press any key to stop)\n");
+
+    int window = options->window < 1 ? 1 : options->window > PING_WINDOW ? PING_WINDOW : options->window;
+    uint16_t seq = 0;
+    uint64_t next_send_us = time_us_64();
+    uint64_t last_send_us = 0;
+    uint16_t expired[PING_WINDOW];
+    stats->start_us = next_send_us;
+
+    while (true) {
+        uint64_t now = time_us_64();
+        bool stop = getchar_timeout_us(0) != PICO_ERROR_TIMEOUT;
+        bool more = !stop && (options->count == 0 || stats->sent + stats->send_errors < options->count);
+
+        // Expire probes past their timeout
+        int expired_count = 0;
+        cyw43_arch_lwip_begin();
+        for (int i = 0; i < PING_WINDOW; i++) {
+            struct ping_probe *probe = &session.probes[i];
+            if (probe->state == PROBE_PENDING && now - probe->sent_us >= options->timeout_us) {
+                probe->state = PROBE_EXPIRED;
+                session.outstanding--;
+                stats->lost++;
+                expired[expired_count++] = probe->seq;
+            }
+        }
+        int outstanding = session.outstanding;
+        bool slot_free = session.probes[seq % PING_WINDOW].state != PROBE_PENDING;
+        cyw43_arch_lwip_end();
+
+        if (more && slot_free) {
+            bool due = options->flood ? outstanding < window || now - last_send_us >= PING_FLOOD_REARM_US
+                                      : outstanding < window && now >= next_send_us;
+            if (due) {
+                uint8_t step = stats->sweep_steps > 0 ? (uint8_t)((seq) % stats->sweep_steps) : 0;
+                uint16_t size = stats->sweep_steps > 0 ? stats->sweep[step].size : options->size;
+                if (ping_send_probe(seq, size, step)) {
+                    stats->sent++;
+                    if (options->flood && !options->quiet) {
+                        putchar('.');
+                    }
+                } else {
+                    stats->send_errors++;
+                }
+                seq++;
+                last_send_us = now;
+                // Keep the schedule, but do not burst to catch up after a stall
+                next_send_us += options->interval_us;
+                if (next_send_us < now) {
+                    next_send_us = now;
+                }
+            }
+        }
+
+        // Report what happened since the last pass
+        if (!options->quiet) {
+            for (int i = 0; i < expired_count; i++) {
+                if (options->flood) {
+                    continue;           // Its dot stays on the line
+                }
+                printf("Request timeout for icmp_seq %u\n", expired[i]);
+            }
+        }
+        while (session.event_tail != session.event_head) {
+            __dmb();
+            struct ping_event event = session.events[session.event_tail % PING_EVENTS];
+            session.event_tail = session.event_tail + 1;
+            if (options->quiet) {
+                continue;
+            }
+            if (options->flood) {
+                if (event.kind == EVENT_REPLY) {
+                    printf("\b \b");
+                }
+            } else {
+                ping_print_event(&event);
+            }
+        }
+
+        if (stop || (!more && outstanding == 0)) {
+            break;
+        }
+        if (!options->flood) {
+            // Sleep until the next send or reply, polling keys meanwhile
+            uint64_t wake_us = now + PING_WAIT_US;
+            if (more && next_send_us < wake_us) {
+                wake_us = next_send_us;
+            }
+            best_effort_wfe_or_timeout(from_us_since_boot(wake_us));
+        }
+    }
+    stats->end_us = time_us_64();
+
+    cyw43_arch_lwip_begin();
+    raw_remove(session.pcb);
+    session.pcb = NULL;
+    session.stats = NULL;
+    cyw43_arch_lwip_end();
+
+    if (options->flood && !options->quiet) {
+        printf("\n");
+    }
+    ping_print_stats(label, options, stats);
+    return true;
+}
+
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t root = 0;
+    for (uint64_t bit = 1ULL << 62; bit; bit >>= 2) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return (uint32_t)root;
+}
+
+static void format_bound(char *out, size_t len, uint32_t us) {
+    if (us < 1000) {
+        snprintf(out, len, "%lu us", (unsigned long)us);
+    } else {
+        snprintf(out, len, "%lu ms", (unsigned long)((us + 500) / 1000));
+    }
+}
+
+void ping_print_stats(const char *label, const struct ping_options *options, const struct ping_stats *stats) {
+    uint32_t elapsed_us = (uint32_t)(stats->end_us - stats->start_us);
+    printf("\n--- %s ping statistics ---\n", label);
+    printf("%lu packets transmitted, %lu received, %lu%% packet loss, time %lu ms\n",
+           (unsigned long)stats->sent, (unsigned long)stats->received,
+           (unsigned long)(stats->sent ? (stats->sent - stats->received) * 100 / stats->sent : 0),
+           (unsigned long)(elapsed_us / 1000));
+    if (stats->duplicates || stats->late || stats->send_errors) {
+        printf("%lu duplicates, %lu late, %lu send errors\n", (unsigned long)stats->duplicates,
+               (unsigned long)stats->late, (unsigned long)stats->send_errors);
+    }
+    if (stats->received == 0) {
+        printf("\n");
+        return;
+    }
+
+    uint32_t avg_us = (uint32_t)(stats->sum_us / stats->received);
+    uint64_t mean_sq = stats->sum_sq_us / stats->received;
+    uint64_t avg_sq = (uint64_t)avg_us * avg_us;
+    uint32_t mdev_us = mean_sq > avg_sq ? isqrt64(mean_sq - avg_sq) : 0;
+    char min[16], avg[16], max[16], mdev[16];
+    format_ms(min, sizeof(min), stats->min_us);
+    format_ms(avg, sizeof(avg), avg_us);
+    format_ms(max, sizeof(max), stats->max_us);
+    format_ms(mdev, sizeof(mdev), mdev_us);
+    printf("rtt min/avg/max/mdev = %s/%s/%s/%s ms\n", min, avg, max, mdev);
+    if (options->flood && elapsed_us > 0) {
+        uint64_t rate_x10 = (uint64_t)stats->received * 10000000ULL / elapsed_us;
+        printf("echo rate %lu.%lu replies/s (window %u)\n",
+               (unsigned long)(rate_x10 / 10), (unsigned long)(rate_x10 % 10), options->window);
+    }
+
+    // Histogram over the occupied range of buckets
+    int first = 0, last = PING_HIST_BUCKETS - 1;
+    uint32_t peak = 0;
+    while (stats->hist[first] == 0) first++;
+    while (stats->hist[last] == 0) last--;
+    for (int i = first; i <= last; i++) {
+        if (stats->hist[i] > peak) peak = stats->hist[i];
+    }
+    printf("\nLatency histogram:\n");
+    for (int i = first; i <= last; i++) {
+        char bound[16];
+        // Bucket i ends at 2^(BASE + i); the last one starts where the one before ends
+        format_bound(bound, sizeof(bound), 1u << (PING_HIST_BASE_SHIFT + (i < PING_HIST_BUCKETS - 1 ? i : i - 1)));
+        int bar = (int)((uint64_t)stats->hist[i] * PING_BAR_WIDTH / peak);
+        printf("  %s %7s |", i < PING_HIST_BUCKETS - 1 ? "< " : ">=", bound);
+        for (int j = 0; j < bar; j++) {
+            putchar('#');
+        }
+        printf(" %lu\n", (unsigned long)stats->hist[i]);
+    }
+
+    if (stats->sweep_steps > 0) {
+        printf("\n  %5s %6s %10s %10s %10s\n", "Bytes", "Recv", "Min ms", "Avg ms", "Max ms");
+        for (int i = 0; i < stats->sweep_steps; i++) {
+            const struct ping_sweep_step *step = &stats->sweep[i];
+            if (step->received == 0) {
+                printf("  %5u %6lu %10s %10s %10s\n", step->size, 0UL, "-", "-", "-");
+                continue;
+            }
+            format_ms(min, sizeof(min), step->min_us);
+            format_ms(avg, sizeof(avg), (uint32_t)(step->sum_us / step->received));
+            format_ms(max, sizeof(max), step->max_us);
+            printf("  %5u %6lu %10s %10s %10s\n", step->size, (unsigned long)step->received, min, avg, max);
+        }
+    }
+    printf("\n");
+}
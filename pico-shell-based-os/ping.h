@@ -0,0 +1,80 @@
+/**
+ * ICMP echo engine - microsecond ping with statistics
+ *
+ * Probes carry a per-session ICMP identifier and are matched back by
+ * sequence number, so up to PING_WINDOW of them can be in flight at once.
+ * Send and receive times come from the 1 MHz hardware timer; the receive
+ * stamp is taken in the raw PCB callback, before the shell gets to run.
+ *
+ * Each reply lands in min/avg/max/mdev and a log2 latency histogram. A
+ * payload-size sweep steps the size per probe and keeps per-size figures.
+ * Flood mode sends the next probe as soon as a reply frees the window (or
+ * every 10 ms regardless) and reports the echo rate the link sustains.
+ */
+
+#ifndef PING_H
+#define PING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/ip_addr.h"
+
+#define PING_WINDOW 32                  // Probes in flight
+#define PING_MAX_PAYLOAD 1472           // Fits a 1500 byte MTU unfragmented
+#define PING_DEFAULT_PAYLOAD 32
+#define PING_HIST_BUCKETS 16            // <128us, <256us, ... >=2s
+#define PING_HIST_BASE_SHIFT 7
+#define PING_SWEEP_MAX_STEPS 24
+#define PING_FLOOD_REARM_US 10000       // Flood sends at least this often
+
+struct ping_options {
+    uint32_t count;             // 0 = until a key is pressed
+    uint32_t interval_us;       // Between sends (ignored when flooding)
+    uint32_t timeout_us;        // Per probe
+    uint16_t size;              // Payload bytes (sweep start)
+    uint16_t sweep_max;         // Sweep end; 0 = no sweep
+    uint16_t sweep_step;
+    uint8_t window;             // Outstanding probe limit, 1..PING_WINDOW
+    bool flood;
+    bool quiet;                 // Summary only
+};
+
+struct ping_sweep_step {
+    uint16_t size;
+    uint32_t received;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+};
+
+struct ping_stats {
+    uint32_t sent;
+    uint32_t received;
+    uint32_t lost;              // Timed out
+    uint32_t late;              // Replies after their timeout
+    uint32_t duplicates;
+    uint32_t send_errors;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint64_t sum_sq_us;
+    uint32_t hist[PING_HIST_BUCKETS];
+    uint64_t start_us;
+    uint64_t end_us;
+    int sweep_steps;
+    struct ping_sweep_step sweep[PING_SWEEP_MAX_STEPS];
+};
+
+// Fill in the defaults: 4 probes, 1 s apart, 1 s timeout, 32 bytes
+void ping_options_default(struct ping_options *options);
+
+// Run a ping session from the shell until the count is reached or a key
+// is pressed, printing each reply and the summary. label is the name to
+// show for target. False if the session could not start.
+bool ping_run(const char *label, const ip_addr_t *target, const struct ping_options *options,
+              struct ping_stats *stats);
+
+// Summary lines, histogram and sweep table for a finished session
+void ping_print_stats(const char *label, const struct ping_options *options, const struct ping_stats *stats);
+
+#endif // PING_H
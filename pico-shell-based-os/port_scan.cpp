@@ -0,0 +1,933 @@
+/**
+ * Port scan engine - see port_scan.h
+ *
+ * The pacing and classification core at the top knows nothing of lwIP; it
+ * sends through scan_transmit() and learns answers through scan_answer().
+ * On the device one raw TCP PCB, one UDP PCB, one raw ICMP PCB and one
+ * sys_timeout tick serve every running scan. The raw PCBs see every TCP
+ * segment and ICMP message the device receives before lwIP does; anything
+ * that does not answer one of our probes is passed on untouched. The host
+ * test (PORT_SCAN_HOST_TEST) drives the same core against a simulated
+ * target on a virtual clock.
+ */
+
+#include <string.h>
+#include "port_scan.h"
+
+#define ICMP_UNREACH_NET 0
+#define ICMP_UNREACH_HOST 1
+#define ICMP_UNREACH_PROTOCOL 2
+#define ICMP_UNREACH_PORT 3
+#define ICMP_UNREACH_NET_PROHIBITED 9
+#define ICMP_UNREACH_HOST_PROHIBITED 10
+#define ICMP_UNREACH_ADMIN_PROHIBITED 13
+
+static void scan_transmit(struct port_scan *scan, struct port_scan_probe *probe);
+static void scan_detach(struct port_scan *scan);
+static uint64_t scan_clock_us();
+
+// ===== PORTS AND STATE =====
+
+static uint16_t scan_port_at(const struct port_scan *scan, uint32_t index) {
+    return scan->options.ports ? scan->options.ports[index] : (uint16_t)(scan->options.first_port + index);
+}
+
+// Index of port in the scan, or -1
+static int32_t scan_index_of(const struct port_scan *scan, uint16_t port) {
+    const struct port_scan_options *options = &scan->options;
+    if (!options->ports) {
+        return port >= options->first_port && port <= options->last_port ? port - options->first_port : -1;
+    }
+    int32_t low = 0;
+    int32_t high = (int32_t)options->port_count - 1;
+    while (low <= high) {
+        int32_t mid = (low + high) / 2;
+        if (options->ports[mid] == port) {
+            return mid;
+        }
+        if (options->ports[mid] < port) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+static enum port_state scan_state(const struct port_scan *scan, uint32_t index) {
+    return (enum port_state)((scan->states[index / 4] >> (index % 4 * 2)) & 3);
+}
+
+static void scan_set_state(struct port_scan *scan, uint32_t index, enum port_state state) {
+    uint8_t *byte = &scan->states[index / 4];
+    *byte = (uint8_t)((*byte & ~(3 << (index % 4 * 2))) | (state << (index % 4 * 2)));
+}
+
+// Record a port's answer. A port already called filtered can still be
+// corrected by a late answer; anything else is a duplicate.
+static void scan_resolve(struct port_scan *scan, uint32_t index, enum port_state state) {
+    enum port_state old = scan_state(scan, index);
+    if (old == state || (old != PORT_PENDING && old != PORT_FILTERED)) {
+        return;
+    }
+    if (old == PORT_FILTERED) {
+        scan->stats.filtered--;
+        scan->stats.late++;
+    } else {
+        scan->stats.resolved++;
+    }
+    scan_set_state(scan, index, state);
+    switch (state) {
+        case PORT_OPEN: scan->stats.open++; break;
+        case PORT_CLOSED: scan->stats.closed++; break;
+        case PORT_FILTERED: scan->stats.filtered++; break;
+        default: break;
+    }
+    if (state == PORT_OPEN && scan->fn) {
+        scan->fn(scan, PORT_SCAN_EVENT_OPEN, scan_port_at(scan, index), scan->arg);
+    }
+}
+
+static bool scan_adaptive(const struct port_scan *scan) {
+    return scan->options.mode == PORT_SCAN_UDP && scan->options.adaptive;
+}
+
+static void scan_set_interval(struct port_scan *scan, uint32_t interval_us) {
+    uint32_t fastest = 1000000u / scan->options.rate_pps;
+    scan->interval_us = interval_us < fastest ? fastest
+                      : interval_us > PORT_SCAN_MIN_INTERVAL_US ? PORT_SCAN_MIN_INTERVAL_US : interval_us;
+    scan->stats.rate_pps = (1000000u + scan->interval_us / 2) / scan->interval_us;
+}
+
+// ===== ANSWERS =====
+
+// A probe for index was answered with state. Answers speed an adaptive
+// scan back up by 1/16 each.
+static void scan_answer(struct port_scan *scan, uint32_t index, enum port_state state) {
+    for (int i = 0; i < PORT_SCAN_MAX_WINDOW; i++) {
+        struct port_scan_probe *probe = &scan->probes[i];
+        if (probe->busy && probe->index == index) {
+            probe->busy = false;
+            scan->in_flight--;
+            break;
+        }
+    }
+    if (scan_adaptive(scan) && scan_state(scan, index) == PORT_PENDING) {
+        scan_set_interval(scan, scan->interval_us - scan->interval_us / 16);
+    }
+    scan_resolve(scan, index, state);
+}
+
+// UDP data from port of the target
+static bool scan_udp_reply(struct port_scan *scan, uint16_t port) {
+    int32_t index = scan_index_of(scan, port);
+    if (index < 0) {
+        return false;
+    }
+    scan_answer(scan, (uint32_t)index, PORT_OPEN);
+    return true;
+}
+
+// ICMP destination unreachable about a probe to index
+static void scan_unreachable(struct port_scan *scan, uint32_t index, uint8_t code) {
+    scan->stats.unreachables++;
+    switch (code) {
+        case ICMP_UNREACH_PORT:
+            if (scan->options.mode == PORT_SCAN_UDP) {
+                scan_answer(scan, index, PORT_CLOSED);
+            }
+            break;
+        case ICMP_UNREACH_HOST:
+        case ICMP_UNREACH_PROTOCOL:
+        case ICMP_UNREACH_NET_PROHIBITED:
+        case ICMP_UNREACH_HOST_PROHIBITED:
+        case ICMP_UNREACH_ADMIN_PROHIBITED:
+            scan_answer(scan, index, PORT_FILTERED);
+            break;
+        default:
+            break;
+    }
+}
+
+// ===== PACING =====
+
+// New try for a probe slot; a failed send still uses up the try, so an
+// unreachable target runs out of retries instead of stalling the scan
+static void scan_send_probe(struct port_scan *scan, struct port_scan_probe *probe, uint32_t now) {
+    probe->sent_us = now;
+    probe->tries++;
+    scan->stats.sent++;
+    scan->credit_us -= scan->interval_us;
+    scan_transmit(scan, probe);
+}
+
+// Expire, retry and send what the rate and window allow
+static void scan_service(struct port_scan *scan, uint32_t now) {
+    if (!scan->running) {
+        return;         // Stopped by an earlier scan's callback this tick
+    }
+    const struct port_scan_options *options = &scan->options;
+    uint32_t credit_max = scan->interval_us > PORT_SCAN_BURST_US ? scan->interval_us : PORT_SCAN_BURST_US;
+    scan->credit_us += now - scan->last_us;
+    scan->last_us = now;
+    if (scan->credit_us > credit_max) {
+        scan->credit_us = credit_max;
+    }
+
+    uint32_t timeout_us = options->timeout_ms * 1000u;
+    for (int i = 0; i < PORT_SCAN_MAX_WINDOW; i++) {
+        struct port_scan_probe *probe = &scan->probes[i];
+        if (!probe->busy || now - probe->sent_us < timeout_us) {
+            continue;
+        }
+        // Silence from a target known to send unreachables means it is
+        // rate-limiting them. Halve once per round: only for a probe sent
+        // at the current rate, i.e. after the last halving. A probe sent
+        // before it went out too fast to be judged, so its try is free.
+        bool judged = true;
+        if (scan_adaptive(scan) && scan->stats.unreachables > 0) {
+            if ((int32_t)(probe->sent_us - scan->backoff_us) > 0) {
+                // The window may have held the real rate below interval_us
+                uint32_t actual = timeout_us / options->window;
+                scan_set_interval(scan, 2 * (actual > scan->interval_us ? actual : scan->interval_us));
+                scan->backoff_us = now;
+                scan->stats.backoffs++;
+            } else {
+                judged = false;
+            }
+        }
+        if (judged && probe->tries > options->retries) {
+            probe->busy = false;
+            scan->in_flight--;
+            scan_resolve(scan, probe->index, PORT_FILTERED);
+        } else if (scan->credit_us >= scan->interval_us) {
+            probe->tries -= !judged;
+            scan->stats.retries++;
+            scan_send_probe(scan, probe, now);
+        }
+    }
+
+    int slot = 0;
+    while (scan->credit_us >= scan->interval_us && scan->in_flight < options->window &&
+           scan->next_index < scan->stats.ports) {
+        while (scan->probes[slot].busy) {
+            slot++;
+        }
+        struct port_scan_probe *probe = &scan->probes[slot];
+        probe->busy = true;
+        probe->index = scan->next_index++;
+        probe->tries = 0;
+        scan->in_flight++;
+        scan_send_probe(scan, probe, now);
+    }
+
+    if (scan->next_index >= scan->stats.ports && scan->in_flight == 0) {
+        scan->stats.end_us = scan_clock_us();
+        scan_detach(scan);
+        if (scan->fn) {
+            scan->fn(scan, PORT_SCAN_EVENT_DONE, 0, scan->arg);
+        }
+    }
+}
+
+// Validate options and reset scan; false if the options are invalid
+static bool scan_init(struct port_scan *scan, uint32_t target, const struct port_scan_options *options,
+                      uint8_t *states, port_scan_fn fn, void *arg, uint32_t secret) {
+    uint32_t count = options->ports ? options->port_count
+                   : options->first_port && options->first_port <= options->last_port
+                   ? (uint32_t)options->last_port - options->first_port + 1 : 0;
+    if (count == 0 || options->rate_pps == 0 || options->rate_pps > PORT_SCAN_MAX_RATE ||
+        options->window == 0 || options->window > PORT_SCAN_MAX_WINDOW || options->timeout_ms == 0) {
+        return false;
+    }
+    memset(scan, 0, sizeof(*scan));
+    scan->target = target;
+    scan->options = *options;
+    scan->states = states;
+    memset(states, 0, PORT_SCAN_STATE_BYTES(count));
+    scan->fn = fn;
+    scan->arg = arg;
+    scan->secret = secret;
+    scan->stats.ports = count;
+    scan->stats.start_us = scan_clock_us();
+    scan->last_us = (uint32_t)scan->stats.start_us;
+    scan->backoff_us = scan->last_us;
+    scan_set_interval(scan, 0);
+    scan->credit_us = scan->interval_us;        // First probe goes now
+    scan->running = true;
+    return true;
+}
+
+// ===== PUBLIC API =====
+
+void port_scan_options_default(struct port_scan_options *options) {
+    memset(options, 0, sizeof(*options));
+    options->mode = PORT_SCAN_SYN;
+    options->rate_pps = PORT_SCAN_DEFAULT_RATE;
+    options->timeout_ms = PORT_SCAN_DEFAULT_TIMEOUT_MS;
+    options->window = PORT_SCAN_DEFAULT_WINDOW;
+    options->retries = PORT_SCAN_DEFAULT_RETRIES;
+    options->adaptive = true;
+}
+
+enum port_state port_scan_get(const struct port_scan *scan, uint16_t port) {
+    int32_t index = scan_index_of(scan, port);
+    return index < 0 ? PORT_PENDING : scan_state(scan, (uint32_t)index);
+}
+
+const char *port_service_name(uint16_t port, enum port_scan_mode mode) {
+    if (mode == PORT_SCAN_UDP) {
+        switch (port) {
+            case 53: return "dns";
+            case 67: return "dhcps";
+            case 68: return "dhcpc";
+            case 69: return "tftp";
+            case 123: return "ntp";
+            case 137: return "netbios-ns";
+            case 161: return "snmp";
+            case 500: return "isakmp";
+            case 514: return "syslog";
+            case 1900: return "ssdp";
+            case 5353: return "mdns";
+            default: return NULL;
+        }
+    }
+    switch (port) {
+        case 21: return "ftp";
+        case 22: return "ssh";
+        case 23: return "telnet";
+        case 25: return "smtp";
+        case 53: return "dns";
+        case 80: return "http";
+        case 110: return "pop3";
+        case 143: return "imap";
+        case 443: return "https";
+        case 445: return "smb";
+        case 3306: return "mysql";
+        case 3389: return "rdp";
+        case 5432: return "postgresql";
+        case 8080: return "http-alt";
+        case 8443: return "https-alt";
+        default: return NULL;
+    }
+}
+
+// ===== UDP PROBES =====
+
+// DNS: "." NS, recursion desired
+static const uint8_t probe_dns[] = {
+    0x50, 0x53, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x02, 0x00, 0x01
+};
+
+// NTP: version 4 client request
+static const uint8_t probe_ntp[48] = { 0x23 };
+
+// NetBIOS: node status request for "*"
+static const uint8_t probe_netbios[] = {
+    0x50, 0x53, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x20, 'C', 'K', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A',
+    'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A',
+    0x00, 0x00, 0x21, 0x00, 0x01
+};
+
+// SNMP: v1 get-request, community "public", sysDescr.0
+static const uint8_t probe_snmp[] = {
+    0x30, 0x26, 0x02, 0x01, 0x00, 0x04, 0x06, 'p', 'u', 'b', 'l', 'i', 'c',
+    0xA0, 0x19, 0x02, 0x01, 0x01, 0x02, 0x01, 0x00, 0x02, 0x01, 0x00,
+    0x30, 0x0E, 0x30, 0x0C, 0x06, 0x08, 0x2B, 0x06, 0x01, 0x02, 0x01, 0x01, 0x01, 0x00, 0x05, 0x00
+};
+
+// SSDP: discover everything
+static const char probe_ssdp[] =
+    "M-SEARCH * HTTP/1.1\r\n"
+    "HOST: 239.255.255.250:1900\r\n"
+    "MAN: \"ssdp:discover\"\r\n"
+    "MX: 1\r\n"
+    "ST: ssdp:all\r\n"
+    "\r\n";
+
+// mDNS: _services._dns-sd._udp.local PTR, as a legacy unicast query
+static const uint8_t probe_mdns[] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    9, '_', 's', 'e', 'r', 'v', 'i', 'c', 'e', 's',
+    7, '_', 'd', 'n', 's', '-', 's', 'd',
+    4, '_', 'u', 'd', 'p',
+    5, 'l', 'o', 'c', 'a', 'l', 0x00,
+    0x00, 0x0C, 0x00, 0x01
+};
+
+const uint8_t *port_scan_udp_payload(uint16_t port, uint16_t *len) {
+    switch (port) {
+        case 53: *len = sizeof(probe_dns); return probe_dns;
+        case 123: *len = sizeof(probe_ntp); return probe_ntp;
+        case 137: *len = sizeof(probe_netbios); return probe_netbios;
+        case 161: *len = sizeof(probe_snmp); return probe_snmp;
+        case 1900: *len = sizeof(probe_ssdp) - 1; return (const uint8_t *)probe_ssdp;
+        case 5353: *len = sizeof(probe_mdns); return probe_mdns;
+        default: *len = 0; return NULL;
+    }
+}
+
+#ifndef PORT_SCAN_HOST_TEST
+// ===========================================================================
+// Device: lwIP raw, UDP and ICMP PCBs
+// ===========================================================================
+
+#include "pico/time.h"
+#include "lwip/pbuf.h"
+#include "lwip/raw.h"
+#include "lwip/udp.h"
+#include "lwip/ip4.h"
+#include "lwip/netif.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/prot/icmp.h"
+#include "lwip/timeouts.h"
+
+#define SYN_WINDOW 1024                 // Advertised in probes
+#define SYN_MSS 1460
+#define SOURCE_PORT_BASE 49152          // Random source ports from here up
+#define SOURCE_PORT_MASK 0x3FFF
+
+static struct raw_pcb *tcp_raw_pcb;
+static struct udp_pcb *udp_probe_pcb;
+static struct raw_pcb *icmp_raw_pcb;
+static struct port_scan *scans;         // Running scans
+
+static void scan_tick(void *arg);
+
+// murmur3 finaliser
+static uint32_t mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Initial sequence number of a SYN: replies acknowledge it plus one
+static uint32_t scan_cookie(const struct port_scan *scan, uint16_t port, uint16_t source_port) {
+    uint32_t h = mix32(scan->secret ^ scan->target);
+    return mix32(h ^ ((uint32_t)port << 16 | source_port));
+}
+
+static uint64_t scan_clock_us() {
+    return time_us_64();
+}
+
+static err_t scan_send_tcp(uint32_t target, uint16_t source_port, uint16_t port, uint32_t seq, uint8_t flags) {
+    ip_addr_t dest;
+    ip_addr_set_ip4_u32(&dest, target);
+    struct netif *netif = ip4_route(ip_2_ip4(&dest));
+    if (!netif) {
+        return ERR_RTE;
+    }
+    u16_t len = (u16_t)(TCP_HLEN + ((flags & TCP_SYN) ? 4 : 0));
+    struct pbuf *p = pbuf_alloc(PBUF_IP, len, PBUF_RAM);
+    if (!p) {
+        return ERR_MEM;
+    }
+    struct tcp_hdr *tcp = (struct tcp_hdr *)p->payload;
+    tcp->src = lwip_htons(source_port);
+    tcp->dest = lwip_htons(port);
+    tcp->seqno = lwip_htonl(seq);
+    tcp->ackno = 0;
+    TCPH_HDRLEN_FLAGS_SET(tcp, len / 4, flags);
+    tcp->wnd = lwip_htons((flags & TCP_SYN) ? SYN_WINDOW : 0);
+    tcp->chksum = 0;
+    tcp->urgp = 0;
+    if (flags & TCP_SYN) {
+        // MSS option, as any real SYN carries one
+        u8_t *option = (u8_t *)p->payload + TCP_HLEN;
+        option[0] = 2;
+        option[1] = 4;
+        option[2] = SYN_MSS >> 8;
+        option[3] = SYN_MSS & 0xFF;
+    }
+    const ip_addr_t *source = netif_ip_addr4(netif);
+    tcp->chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, len, source, &dest);
+    err_t err = raw_sendto_if_src(tcp_raw_pcb, p, &dest, netif, source);
+    pbuf_free(p);
+    return err;
+}
+
+static err_t scan_send_udp(uint32_t target, uint16_t port) {
+    ip_addr_t dest;
+    ip_addr_set_ip4_u32(&dest, target);
+    uint16_t len;
+    const uint8_t *payload = port_scan_udp_payload(port, &len);
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if (!p) {
+        return ERR_MEM;
+    }
+    if (len) {
+        memcpy(p->payload, payload, len);
+    }
+    err_t err = udp_sendto(udp_probe_pcb, p, &dest, port);
+    pbuf_free(p);
+    return err;
+}
+
+static void scan_transmit(struct port_scan *scan, struct port_scan_probe *probe) {
+    uint16_t port = scan_port_at(scan, probe->index);
+    err_t err;
+    if (scan->options.mode == PORT_SCAN_UDP) {
+        err = scan_send_udp(scan->target, port);
+    } else {
+        uint16_t source_port = (uint16_t)(SOURCE_PORT_BASE + (LWIP_RAND() & SOURCE_PORT_MASK));
+        err = scan_send_tcp(scan->target, source_port, port, scan_cookie(scan, port, source_port), TCP_SYN);
+    }
+    if (err != ERR_OK) {
+        scan->stats.send_errors++;
+    }
+}
+
+// Running scan of the given mode against target, from which an answer
+// about port with cookie ack (SYN only) would come; index set when found
+static struct port_scan *scan_find(enum port_scan_mode mode, uint32_t target, uint16_t port,
+                                   uint16_t source_port, uint32_t cookie, int32_t *index) {
+    for (struct port_scan *scan = scans; scan; scan = scan->next) {
+        if (scan->options.mode != mode || scan->target != target ||
+            (mode == PORT_SCAN_SYN && cookie != scan_cookie(scan, port, source_port))) {
+            continue;
+        }
+        *index = scan_index_of(scan, port);
+        if (*index >= 0) {
+            return scan;
+        }
+    }
+    return NULL;
+}
+
+// lwIP context, for every TCP segment received
+static u8_t scan_tcp_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_addr_t *addr) {
+    u16_t ihl = (u16_t)((pbuf_get_at(p, 0) & 0x0F) * 4);
+    struct tcp_hdr tcp;
+    if (pbuf_copy_partial(p, &tcp, sizeof(tcp), ihl) != sizeof(tcp)) {
+        return 0;
+    }
+    u16_t flags = TCPH_FLAGS(&tcp);
+    bool syn_ack = (flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK);
+    bool rst = (flags & TCP_RST) != 0;
+    if (!syn_ack && !rst) {
+        return 0;
+    }
+
+    uint16_t port = lwip_ntohs(tcp.src);
+    uint16_t source_port = lwip_ntohs(tcp.dest);
+    uint32_t ack = lwip_ntohl(tcp.ackno);
+    int32_t index;
+    struct port_scan *scan = scan_find(PORT_SCAN_SYN, ip4_addr_get_u32(ip_2_ip4(addr)), port, source_port,
+                                       ack - 1, &index);
+    if (!scan) {
+        return 0;       // Not ours; lwIP's TCP takes it
+    }
+    if (syn_ack) {
+        // Tear the half-open connection down on the target
+        scan_send_tcp(scan->target, source_port, port, ack, TCP_RST);
+    }
+    scan_answer(scan, (uint32_t)index, syn_ack ? PORT_OPEN : PORT_CLOSED);
+    pbuf_free(p);
+    return 1;
+}
+
+// lwIP context, for datagrams answering UDP probes
+static void scan_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    uint32_t target = ip4_addr_get_u32(ip_2_ip4(addr));
+    for (struct port_scan *scan = scans; scan; scan = scan->next) {
+        if (scan->options.mode == PORT_SCAN_UDP && scan->target == target && scan_udp_reply(scan, port)) {
+            break;
+        }
+    }
+    pbuf_free(p);
+}
+
+// lwIP context, for every ICMP message received: destination unreachables
+// quote the IP header and first 8 bytes of the probe they refuse
+static u8_t scan_icmp_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_addr_t *addr) {
+    u16_t ihl = (u16_t)((pbuf_get_at(p, 0) & 0x0F) * 4);
+    u8_t quote[60 + 8];
+    u16_t len = pbuf_copy_partial(p, quote, sizeof(quote), (u16_t)(ihl + 8));
+    if (pbuf_get_at(p, ihl) != ICMP_DUR || len < 20) {
+        return 0;
+    }
+    u8_t code = pbuf_get_at(p, (u16_t)(ihl + 1));
+    u16_t quoted_ihl = (u16_t)((quote[0] & 0x0F) * 4);
+    if (quoted_ihl < 20 || len < quoted_ihl + 8) {
+        return 0;
+    }
+    u8_t proto = quote[9];
+    uint32_t target;
+    memcpy(&target, quote + 16, 4);
+    const u8_t *transport = quote + quoted_ihl;
+    uint16_t source_port = (uint16_t)(transport[0] << 8 | transport[1]);
+    uint16_t port = (uint16_t)(transport[2] << 8 | transport[3]);
+
+    int32_t index;
+    struct port_scan *scan = NULL;
+    if (proto == IP_PROTO_UDP && udp_probe_pcb && source_port == udp_probe_pcb->local_port) {
+        scan = scan_find(PORT_SCAN_UDP, target, port, source_port, 0, &index);
+    } else if (proto == IP_PROTO_TCP) {
+        uint32_t seq = (uint32_t)transport[4] << 24 | (uint32_t)transport[5] << 16 |
+                       (uint32_t)transport[6] << 8 | transport[7];
+        scan = scan_find(PORT_SCAN_SYN, target, port, source_port, seq, &index);
+    }
+    if (!scan) {
+        return 0;       // Ping and lwIP's own ICMP handling see it
+    }
+    scan_unreachable(scan, (uint32_t)index, code);
+    pbuf_free(p);
+    return 1;
+}
+
+static void scan_release_pcbs() {
+    bool syn = false;
+    bool udp = false;
+    for (struct port_scan *scan = scans; scan; scan = scan->next) {
+        syn |= scan->options.mode == PORT_SCAN_SYN;
+        udp |= scan->options.mode == PORT_SCAN_UDP;
+    }
+    if (!syn && tcp_raw_pcb) {
+        raw_remove(tcp_raw_pcb);
+        tcp_raw_pcb = NULL;
+    }
+    if (!udp && udp_probe_pcb) {
+        udp_remove(udp_probe_pcb);
+        udp_probe_pcb = NULL;
+    }
+    if (!scans && icmp_raw_pcb) {
+        raw_remove(icmp_raw_pcb);
+        icmp_raw_pcb = NULL;
+    }
+}
+
+static bool scan_make_pcbs(enum port_scan_mode mode) {
+    if (!icmp_raw_pcb) {
+        icmp_raw_pcb = raw_new(IP_PROTO_ICMP);
+        if (icmp_raw_pcb) {
+            raw_recv(icmp_raw_pcb, scan_icmp_recv, NULL);
+            raw_bind(icmp_raw_pcb, IP_ADDR_ANY);
+        }
+    }
+    if (mode == PORT_SCAN_SYN && !tcp_raw_pcb) {
+        tcp_raw_pcb = raw_new(IP_PROTO_TCP);
+        if (tcp_raw_pcb) {
+            raw_recv(tcp_raw_pcb, scan_tcp_recv, NULL);
+            raw_bind(tcp_raw_pcb, IP_ADDR_ANY);
+        }
+    }
+    if (mode == PORT_SCAN_UDP && !udp_probe_pcb) {
+        udp_probe_pcb = udp_new();
+        if (udp_probe_pcb && udp_bind(udp_probe_pcb, IP_ADDR_ANY, 0) == ERR_OK) {
+            udp_recv(udp_probe_pcb, scan_udp_recv, NULL);
+        } else if (udp_probe_pcb) {
+            udp_remove(udp_probe_pcb);
+            udp_probe_pcb = NULL;
+        }
+    }
+    return icmp_raw_pcb && (mode == PORT_SCAN_SYN ? tcp_raw_pcb != NULL : udp_probe_pcb != NULL);
+}
+
+static void scan_detach(struct port_scan *scan) {
+    for (struct port_scan **link = &scans; *link; link = &(*link)->next) {
+        if (*link == scan) {
+            *link = scan->next;
+            break;
+        }
+    }
+    scan->running = false;
+    if (!scans) {
+        sys_untimeout(scan_tick, NULL);
+    }
+    scan_release_pcbs();
+}
+
+static void scan_tick(void *arg) {
+    uint32_t now = time_us_32();
+    // Round-robin: whoever went first last tick goes last this one, so no
+    // scan always gets the first of the sends a busy link will take
+    if (scans && scans->next) {
+        struct port_scan *first = scans;
+        struct port_scan **tail = &scans;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+        scans = first->next;
+        first->next = NULL;
+        *tail = first;
+    }
+    struct port_scan *next;
+    for (struct port_scan *scan = scans; scan; scan = next) {
+        next = scan->next;
+        scan_service(scan, now);
+    }
+    // A DONE callback may have started a scan, and with it a tick
+    sys_untimeout(scan_tick, NULL);
+    if (scans) {
+        sys_timeout(PORT_SCAN_TICK_MS, scan_tick, NULL);
+    }
+}
+
+bool port_scan_start(struct port_scan *scan, const ip_addr_t *target, const struct port_scan_options *options,
+                     uint8_t *states, port_scan_fn fn, void *arg) {
+    if (!IP_IS_V4(target) ||
+        !scan_init(scan, ip4_addr_get_u32(ip_2_ip4(target)), options, states, fn, arg, LWIP_RAND())) {
+        return false;
+    }
+    if (!scan_make_pcbs(options->mode)) {
+        scan->running = false;
+        scan_release_pcbs();
+        return false;
+    }
+
+    bool idle = scans == NULL;
+    scan->next = scans;
+    scans = scan;
+    if (idle) {
+        sys_timeout(PORT_SCAN_TICK_MS, scan_tick, NULL);
+    }
+    scan_service(scan, scan->last_us);
+    return true;
+}
+
+void port_scan_stop(struct port_scan *scan) {
+    if (scan->running) {
+        scan->stats.end_us = time_us_64();
+        scan_detach(scan);
+    }
+}
+
+bool port_scan_set_limits(struct port_scan *scan, uint16_t rate_pps, uint8_t window) {
+    if (rate_pps == 0 || rate_pps > PORT_SCAN_MAX_RATE || window == 0 || window > PORT_SCAN_MAX_WINDOW) {
+        return false;
+    }
+    scan->options.rate_pps = rate_pps;
+    scan->options.window = window;
+    // Fixed pacing follows the new rate; adaptive keeps its own unless it
+    // is now faster than the new ceiling
+    scan_set_interval(scan, scan_adaptive(scan) ? scan->interval_us : 0);
+    return true;
+}
+
+#else // PORT_SCAN_HOST_TEST
+// ===========================================================================
+// Host test: UDP scans of a simulated target on a virtual clock
+// ===========================================================================
+//
+// The target answers service probes on its open ports, ignores datagrams
+// to silent services and firewalled ports, and refuses the rest with ICMP
+// port unreachable through a token bucket, the way hosts rate-limit them.
+// Each direction has 1-3 ms of latency and 1% loss. Every profile is
+// scanned with fixed pacing and with adaptive pacing; accuracy is the share
+// of ports classified as a scanner can know them (a closed port behind
+// blocked ICMP is open|filtered), duration is virtual time.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_FIRST_PORT 1
+#define HOST_LAST_PORT 300
+#define HOST_EVENTS 512
+#define HOST_LOSS_PERMILLE 10
+#define HOST_TIME_LIMIT_US (3600ULL * 1000000)
+
+struct host_profile {
+    const char *name;
+    uint32_t icmp_per_s;        // 0 = unlimited
+    uint32_t icmp_burst;
+    bool icmp_blocked;
+};
+
+static const struct host_profile host_profiles[] = {
+    {"no ICMP limit", 0, 0, false},
+    {"ICMP 1/s, burst 6 (Linux)", 1, 6, false},
+    {"ICMP 10/s, burst 10", 10, 10, false},
+    {"ICMP blocked", 0, 0, true},
+};
+
+struct host_event {
+    uint64_t due_us;
+    uint16_t port;
+    bool unreachable;
+    bool used;
+};
+
+static uint64_t host_now_us;
+static uint32_t host_rng = 12345;
+static const struct host_profile *host_profile;
+static double host_icmp_tokens;
+static uint64_t host_icmp_refill_us;
+static struct host_event host_events[HOST_EVENTS];
+static uint32_t host_dropped_events;
+
+static uint64_t scan_clock_us() {
+    return host_now_us;
+}
+
+static uint32_t host_rand() {
+    host_rng ^= host_rng << 13;
+    host_rng ^= host_rng >> 17;
+    host_rng ^= host_rng << 5;
+    return host_rng;
+}
+
+static bool host_service(uint16_t port) {
+    uint16_t len;
+    return port_scan_udp_payload(port, &len) != NULL;
+}
+
+static bool host_silent(uint16_t port) {
+    return port == 67 || port == 69 || port == 500;     // Open, but ignore junk
+}
+
+static bool host_firewalled(uint16_t port) {
+    return port >= 135 && port <= 139 && port != 137;
+}
+
+static enum port_state host_expected(uint16_t port) {
+    if (host_service(port)) {
+        return PORT_OPEN;
+    }
+    if (host_silent(port) || host_firewalled(port) || host_profile->icmp_blocked) {
+        return PORT_FILTERED;
+    }
+    return PORT_CLOSED;
+}
+
+static void host_schedule(uint16_t port, bool unreachable) {
+    if (host_rand() % 1000 < HOST_LOSS_PERMILLE) {
+        return;
+    }
+    for (int i = 0; i < HOST_EVENTS; i++) {
+        struct host_event *event = &host_events[i];
+        if (!event->used) {
+            event->used = true;
+            event->port = port;
+            event->unreachable = unreachable;
+            event->due_us = host_now_us + 2000 + host_rand() % 4000;    // Both ways
+            return;
+        }
+    }
+    host_dropped_events++;
+}
+
+static bool host_icmp_allowed() {
+    const struct host_profile *profile = host_profile;
+    if (profile->icmp_blocked) {
+        return false;
+    }
+    if (profile->icmp_per_s == 0) {
+        return true;
+    }
+    host_icmp_tokens += (double)(host_now_us - host_icmp_refill_us) * profile->icmp_per_s / 1e6;
+    host_icmp_refill_us = host_now_us;
+    if (host_icmp_tokens > profile->icmp_burst) {
+        host_icmp_tokens = profile->icmp_burst;
+    }
+    if (host_icmp_tokens < 1) {
+        return false;
+    }
+    host_icmp_tokens -= 1;
+    return true;
+}
+
+// The target's side of a probe
+static void scan_transmit(struct port_scan *scan, struct port_scan_probe *probe) {
+    uint16_t port = scan_port_at(scan, probe->index);
+    if (host_rand() % 1000 < HOST_LOSS_PERMILLE) {
+        return;         // Lost on the way there
+    }
+    if (host_service(port)) {
+        host_schedule(port, false);
+    } else if (!host_silent(port) && !host_firewalled(port) && host_icmp_allowed()) {
+        host_schedule(port, true);
+    }
+}
+
+static void scan_detach(struct port_scan *scan) {
+    scan->running = false;
+}
+
+static void host_deliver(struct port_scan *scan) {
+    for (int i = 0; i < HOST_EVENTS; i++) {
+        struct host_event *event = &host_events[i];
+        if (!event->used || event->due_us > host_now_us) {
+            continue;
+        }
+        event->used = false;
+        if (!scan->running) {
+            continue;
+        }
+        if (event->unreachable) {
+            int32_t index = scan_index_of(scan, event->port);
+            if (index >= 0) {
+                scan_unreachable(scan, (uint32_t)index, ICMP_UNREACH_PORT);
+            }
+        } else {
+            scan_udp_reply(scan, event->port);
+        }
+    }
+}
+
+static void host_run(const struct host_profile *profile, bool adaptive, uint8_t retries) {
+    static uint8_t states[PORT_SCAN_STATE_BYTES(HOST_LAST_PORT - HOST_FIRST_PORT + 1)];
+    struct port_scan scan;
+    struct port_scan_options options;
+    port_scan_options_default(&options);
+    options.mode = PORT_SCAN_UDP;
+    options.first_port = HOST_FIRST_PORT;
+    options.last_port = HOST_LAST_PORT;
+    options.adaptive = adaptive;
+    options.retries = retries;
+
+    host_profile = profile;
+    host_now_us = 1000000;
+    host_icmp_tokens = profile->icmp_burst;
+    host_icmp_refill_us = host_now_us;
+    memset(host_events, 0, sizeof(host_events));
+    scan_init(&scan, 0x0100007F, &options, states, NULL, NULL, host_rand());
+    scan_service(&scan, (uint32_t)host_now_us);
+    while (scan.running && host_now_us < HOST_TIME_LIMIT_US) {
+        host_now_us += PORT_SCAN_TICK_MS * 1000;
+        host_deliver(&scan);
+        scan_service(&scan, (uint32_t)host_now_us);
+    }
+
+    uint32_t wrong = 0;
+    uint32_t closed_as_filtered = 0;
+    for (uint32_t port = HOST_FIRST_PORT; port <= HOST_LAST_PORT; port++) {
+        enum port_state got = port_scan_get(&scan, (uint16_t)port);
+        enum port_state want = host_expected((uint16_t)port);
+        if (got != want) {
+            wrong++;
+            closed_as_filtered += want == PORT_CLOSED && got == PORT_FILTERED;
+        }
+    }
+    uint32_t ports = scan.stats.ports;
+    uint64_t us = scan.stats.end_us - scan.stats.start_us;
+    printf("  %-26s %-8s %u  %5.1f%%  %5lu  %5lu  %8.1f  %6lu  %5lu\n", profile->name,
+           adaptive ? "adaptive" : "fixed", retries, 100.0 * (ports - wrong) / ports, (unsigned long)wrong,
+           (unsigned long)closed_as_filtered, us / 1e6, (unsigned long)scan.stats.sent,
+           (unsigned long)scan.stats.backoffs);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        host_rng = (uint32_t)strtoul(argv[1], NULL, 0);
+    }
+    printf("UDP scan of ports %d-%d, %d probes/s start, window %d, %d ms timeout\n", HOST_FIRST_PORT,
+           HOST_LAST_PORT, PORT_SCAN_DEFAULT_RATE, PORT_SCAN_DEFAULT_WINDOW, PORT_SCAN_DEFAULT_TIMEOUT_MS);
+    printf("  %-26s %-8s %s  %6s  %5s  %5s  %8s  %6s  %5s\n", "target", "pacing", "r", "right", "wrong",
+           "c->f", "seconds", "probes", "halve");
+    for (unsigned i = 0; i < sizeof(host_profiles) / sizeof(host_profiles[0]); i++) {
+        host_run(&host_profiles[i], false, PORT_SCAN_DEFAULT_RETRIES);
+        host_run(&host_profiles[i], true, PORT_SCAN_DEFAULT_RETRIES);
+    }
+    if (host_dropped_events) {
+        printf("(%lu simulated packets dropped: event table full)\n", (unsigned long)host_dropped_events);
+    }
+    return 0;
+}
+#endif // PORT_SCAN_HOST_TEST
@@ -0,0 +1,168 @@
+/**
+ * Port scan engine - half-open TCP SYN and UDP scans on raw PCBs
+ *
+ * SYN: probes are hand-built SYNs sent through a raw IP_PROTO_TCP PCB, so a
+ * scan holds no TCP PCBs and leaves no connections behind: a SYN-ACK marks
+ * the port open and is answered with a RST, a RST marks it closed, and
+ * silence through every retry marks it filtered. Each SYN gets a random
+ * source port and a sequence number that is a keyed hash of the target and
+ * both ports, so replies are recognised from their acknowledgement number
+ * alone (no per-probe lookup, and stray or spoofed segments do not match).
+ *
+ * UDP: well-known services get a probe they answer (DNS, NTP, NetBIOS,
+ * SNMP, SSDP, mDNS), other ports an empty datagram. Any UDP reply marks the
+ * port open; ICMP port unreachable, read from a raw ICMP PCB, marks it
+ * closed; silence leaves it open|filtered (reported as filtered). Hosts
+ * rate-limit their unreachables (Linux sends about one a second), so a
+ * scan faster than that turns closed ports into silent ones. Once the
+ * target has been seen sending unreachables, the UDP scan halves its rate
+ * whenever probes go unanswered and speeds up again with every answer.
+ *
+ * ICMP unreachables marked administratively prohibited (or host and net
+ * unreachable) mark a port filtered in either mode.
+ *
+ * Sends are paced by a token bucket at the requested packets per second,
+ * with at most a window of probes awaiting an answer, so how many ports are
+ * in flight is set by the rate, not by MEMP_NUM_TCP_PCB. Several scans can
+ * run at once; each keeps two bits of state per port in a buffer its owner
+ * provides. The tick serves running scans round-robin, a different one
+ * first each time, and port_scan_set_limits() lets an owner running several
+ * scans split one rate and window between them.
+ *
+ * Everything runs in lwIP context: start and stop scans inside the lwIP
+ * lock, and expect the callback from lwIP callbacks. With
+ * PORT_SCAN_HOST_TEST defined, port_scan.cpp builds the pacing and
+ * classification core against a simulated target instead, and reports how
+ * accurate and how long UDP scans are with fixed and adaptive pacing:
+ *
+ *     c++ -O2 -DPORT_SCAN_HOST_TEST port_scan.cpp -o port_scan_test && ./port_scan_test
+ */
+
+#ifndef PORT_SCAN_H
+#define PORT_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PORT_SCAN_MAX_WINDOW 64
+#define PORT_SCAN_DEFAULT_WINDOW 32
+#define PORT_SCAN_DEFAULT_RATE 200      // Probes per second
+#define PORT_SCAN_MAX_RATE 5000
+#define PORT_SCAN_MIN_INTERVAL_US 1000000   // Adaptive UDP slows to 1 probe/s at most
+#define PORT_SCAN_DEFAULT_TIMEOUT_MS 1000
+#define PORT_SCAN_DEFAULT_RETRIES 1
+#define PORT_SCAN_BURST_US 16000        // Sending a stalled tick may catch up
+#define PORT_SCAN_TICK_MS 2
+
+// Bytes of state buffer for count ports
+#define PORT_SCAN_STATE_BYTES(count) (((count) + 3) / 4)
+
+enum port_scan_mode {
+    PORT_SCAN_SYN,
+    PORT_SCAN_UDP
+};
+
+enum port_state {
+    PORT_PENDING,               // Not answered yet
+    PORT_OPEN,
+    PORT_CLOSED,
+    PORT_FILTERED               // No answer after every retry (UDP: open|filtered)
+};
+
+enum port_scan_event {
+    PORT_SCAN_EVENT_OPEN,       // port answered SYN-ACK, or UDP data
+    PORT_SCAN_EVENT_DONE        // Every port resolved; port is 0
+};
+
+struct port_scan;
+typedef void (*port_scan_fn)(struct port_scan *scan, enum port_scan_event event, uint16_t port, void *arg);
+
+struct port_scan_options {
+    enum port_scan_mode mode;
+    uint16_t first_port;        // Range, used when ports is NULL
+    uint16_t last_port;
+    const uint16_t *ports;      // Or an ascending list, kept by the caller
+    uint16_t port_count;
+    uint16_t rate_pps;          // Starting (and, adaptive, highest) rate
+    uint16_t timeout_ms;        // Per try
+    uint8_t window;             // Probes awaiting an answer, 1..PORT_SCAN_MAX_WINDOW
+    uint8_t retries;            // Extra tries before a port is filtered
+    bool adaptive;              // UDP: follow the target's ICMP rate limit
+};
+
+struct port_scan_stats {
+    uint32_t ports;
+    uint32_t resolved;
+    uint32_t open;
+    uint32_t closed;
+    uint32_t filtered;
+    uint32_t sent;              // Probes, retries included
+    uint32_t retries;
+    uint32_t send_errors;
+    uint32_t late;              // Answers after the port was called filtered
+    uint32_t unreachables;      // ICMP destination unreachable received
+    uint32_t backoffs;          // Adaptive rate halvings
+    uint32_t rate_pps;          // Current send rate
+    uint64_t start_us;
+    uint64_t end_us;
+};
+
+// In-flight probe; private to the engine
+struct port_scan_probe {
+    uint32_t index;             // Into the port list or range
+    uint32_t sent_us;
+    uint8_t tries;
+    bool busy;
+};
+
+// Owned by the caller, which must keep it (and states) in place until the
+// scan is done or stopped. Read stats freely; the rest is the engine's.
+struct port_scan {
+    struct port_scan_stats stats;
+    bool running;
+
+    struct port_scan *next;
+    uint32_t target;            // IPv4, network order
+    struct port_scan_options options;
+    uint8_t *states;
+    port_scan_fn fn;
+    void *arg;
+    uint32_t secret;            // SYN sequence number key
+    uint32_t next_index;        // First port not yet probed
+    uint32_t interval_us;       // Between sends at the current rate
+    uint32_t credit_us;         // Token bucket, in microseconds of sending
+    uint32_t last_us;
+    uint32_t backoff_us;        // Time of the last halving
+    uint16_t in_flight;
+    struct port_scan_probe probes[PORT_SCAN_MAX_WINDOW];
+};
+
+// 200 probes/s, window 32, 1 s timeout, one retry, adaptive; SYN, no ports
+void port_scan_options_default(struct port_scan_options *options);
+
+#ifndef PORT_SCAN_HOST_TEST
+#include "lwip/ip_addr.h"
+
+// lwIP context. states must hold PORT_SCAN_STATE_BYTES(number of ports)
+// bytes. False if the options are invalid or the PCBs cannot be made.
+bool port_scan_start(struct port_scan *scan, const ip_addr_t *target, const struct port_scan_options *options,
+                     uint8_t *states, port_scan_fn fn, void *arg);
+
+// lwIP context. Abandon a running scan; no DONE event follows
+void port_scan_stop(struct port_scan *scan);
+
+// lwIP context. Change a running scan's rate and window; probes already in
+// flight beyond a smaller window finish normally. False if out of range.
+bool port_scan_set_limits(struct port_scan *scan, uint16_t rate_pps, uint8_t window);
+#endif
+
+// Result so far for one port of the scan
+enum port_state port_scan_get(const struct port_scan *scan, uint16_t port);
+
+// Common service name for a well-known port, or NULL
+const char *port_service_name(uint16_t port, enum port_scan_mode mode);
+
+// UDP probe payload for a well-known port, or NULL (send it empty)
+const uint8_t *port_scan_udp_payload(uint16_t port, uint16_t *len);
+
+#endif // PORT_SCAN_H
@@ -0,0 +1,287 @@
+/**
+ * Tetris engine - see tetris.h
+ */
+
+#include <string.h>
+#include "tetris.h"
+
+// Spawn shapes; rotation r is r clockwise quarter turns of these
+static const uint8_t tetris_shapes[TETRIS_PIECES][4][4] = {
+    // I piece
+    {{0,0,0,0}, {1,1,1,1}, {0,0,0,0}, {0,0,0,0}},
+    // O piece
+    {{0,0,0,0}, {0,1,1,0}, {0,1,1,0}, {0,0,0,0}},
+    // T piece
+    {{0,0,0,0}, {1,1,1,0}, {0,1,0,0}, {0,0,0,0}},
+    // S piece
+    {{0,0,0,0}, {0,1,1,0}, {1,1,0,0}, {0,0,0,0}},
+    // Z piece
+    {{0,0,0,0}, {1,1,0,0}, {0,1,1,0}, {0,0,0,0}},
+    // J piece
+    {{0,0,0,0}, {1,1,1,0}, {0,0,1,0}, {0,0,0,0}},
+    // L piece
+    {{0,0,0,0}, {1,1,1,0}, {1,0,0,0}, {0,0,0,0}}
+};
+
+// [type][rotation][box row]: box column j in bit j
+static uint8_t tetris_masks[TETRIS_PIECES][4][4];
+
+void tetris_init() {
+    for (int t = 0; t < TETRIS_PIECES; t++) {
+        uint8_t shape[4][4];
+        memcpy(shape, tetris_shapes[t], sizeof(shape));
+        for (int r = 0; r < 4; r++) {
+            for (int i = 0; i < 4; i++) {
+                uint8_t bits = 0;
+                for (int j = 0; j < 4; j++) {
+                    if (shape[i][j]) bits |= 1 << j;
+                }
+                tetris_masks[t][r][i] = bits;
+            }
+            // Clockwise quarter turn for the next rotation
+            uint8_t turned[4][4];
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) {
+                    turned[i][j] = shape[3 - j][i];
+                }
+            }
+            memcpy(shape, turned, sizeof(shape));
+        }
+    }
+}
+
+void tetris_board_reset(struct tetris_board *board) {
+    for (int y = 0; y < TETRIS_HEIGHT; y++) {
+        board->rows[y] = TETRIS_ROW_EMPTY;
+    }
+    board->rows[TETRIS_HEIGHT] = TETRIS_ROW_FULL;
+    memset(board->cells, 0, sizeof(board->cells));
+}
+
+struct tetris_piece tetris_spawn(int type) {
+    struct tetris_piece piece = { (int8_t)type, 0, TETRIS_WIDTH / 2 - 2, 0 };
+    return piece;
+}
+
+// Mask row i in board bit positions; x + TETRIS_WALL_BITS >= 0 always holds
+// because no shape reaches further than two empty box columns past a wall
+static inline uint16_t tetris_mask_row(int type, int rotation, int i, int x) {
+    return (uint16_t)(tetris_masks[type][rotation & 3][i] << (x + TETRIS_WALL_BITS));
+}
+
+uint16_t tetris_piece_row(const struct tetris_piece *piece, int i) {
+    return tetris_mask_row(piece->type, piece->rotation, i, piece->x) >> TETRIS_WALL_BITS;
+}
+
+static inline bool tetris_fits(const uint16_t *rows, int type, int rotation, int x, int y) {
+    for (int i = 0; i < 4; i++) {
+        uint16_t mask = tetris_mask_row(type, rotation, i, x);
+        if (!mask) continue;
+        if (y + i > TETRIS_HEIGHT || (rows[y + i] & mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool tetris_collides(const struct tetris_board *board, const struct tetris_piece *piece,
+                     int dx, int dy, int drot) {
+    int x = piece->x + dx;
+    if (x + TETRIS_WALL_BITS < 0) {
+        return true;
+    }
+    return !tetris_fits(board->rows, piece->type, piece->rotation + drot, x, piece->y + dy);
+}
+
+int tetris_hard_drop(const struct tetris_board *board, struct tetris_piece *piece) {
+    int fallen = 0;
+    while (tetris_fits(board->rows, piece->type, piece->rotation, piece->x, piece->y + 1)) {
+        piece->y++;
+        fallen++;
+    }
+    return fallen;
+}
+
+void tetris_merge(struct tetris_board *board, const struct tetris_piece *piece) {
+    for (int i = 0; i < 4; i++) {
+        int y = piece->y + i;
+        uint16_t mask = tetris_mask_row(piece->type, piece->rotation, i, piece->x);
+        if (!mask || y >= TETRIS_HEIGHT) continue;
+        board->rows[y] |= mask;
+        uint16_t cols = mask >> TETRIS_WALL_BITS;
+        while (cols) {
+            int x = __builtin_ctz(cols);
+            board->cells[y][x] = piece->type + 1;
+            cols &= cols - 1;
+        }
+    }
+}
+
+int tetris_clear_lines(struct tetris_board *board) {
+    int cleared = 0;
+    // Compact surviving rows downwards
+    int dst = TETRIS_HEIGHT - 1;
+    for (int y = TETRIS_HEIGHT - 1; y >= 0; y--) {
+        if (board->rows[y] == TETRIS_ROW_FULL) {
+            cleared++;
+            continue;
+        }
+        if (dst != y) {
+            board->rows[dst] = board->rows[y];
+            memcpy(board->cells[dst], board->cells[y], sizeof(board->cells[0]));
+        }
+        dst--;
+    }
+    for (; dst >= 0; dst--) {
+        board->rows[dst] = TETRIS_ROW_EMPTY;
+        memset(board->cells[dst], 0, sizeof(board->cells[0]));
+    }
+    return cleared;
+}
+
+// ===== HEADLESS BOT / BENCHMARK =====
+
+uint32_t tetris_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Score a board (rows only) with the usual four features, weights x100:
+// aggregate height, completed lines, holes, bumpiness
+static int tetris_evaluate(const uint16_t *rows, int lines) {
+    const uint16_t field = (uint16_t)~TETRIS_ROW_EMPTY;
+    uint16_t seen = 0;
+    int heights[TETRIS_WIDTH] = {0};
+    int aggregate = 0;
+    int holes = 0;
+
+    for (int y = 0; y < TETRIS_HEIGHT; y++) {
+        uint16_t row = rows[y] & field;
+        // Empty cells under a block seen higher up are holes
+        holes += __builtin_popcount(seen & ~row);
+        uint16_t tops = row & ~seen;
+        while (tops) {
+            int bit = __builtin_ctz(tops);
+            heights[bit - TETRIS_WALL_BITS] = TETRIS_HEIGHT - y;
+            aggregate += TETRIS_HEIGHT - y;
+            tops &= tops - 1;
+        }
+        seen |= row;
+    }
+
+    int bumpiness = 0;
+    for (int x = 0; x < TETRIS_WIDTH - 1; x++) {
+        int d = heights[x] - heights[x + 1];
+        bumpiness += d < 0 ? -d : d;
+    }
+    return -51 * aggregate + 76 * lines - 36 * holes - 18 * bumpiness;
+}
+
+uint32_t tetris_bot_choose(const struct tetris_board *board, struct tetris_piece *piece) {
+    uint32_t evaluated = 0;
+    int best_score = -0x7FFFFFFF;
+    int best_rotation = piece->rotation;
+    int best_x = piece->x;
+
+    for (int rotation = 0; rotation < 4; rotation++) {
+        for (int x = -TETRIS_WALL_BITS; x < TETRIS_WIDTH; x++) {
+            if (!tetris_fits(board->rows, piece->type, rotation, x, piece->y)) {
+                continue;
+            }
+            int y = piece->y;
+            while (tetris_fits(board->rows, piece->type, rotation, x, y + 1)) {
+                y++;
+            }
+
+            // Place on a copy of the bit rows and clear with word compares
+            uint16_t rows[TETRIS_HEIGHT + 1];
+            memcpy(rows, board->rows, sizeof(rows));
+            for (int i = 0; i < 4; i++) {
+                if (y + i < TETRIS_HEIGHT) {
+                    rows[y + i] |= tetris_mask_row(piece->type, rotation, i, x);
+                }
+            }
+            int lines = 0;
+            int dst = TETRIS_HEIGHT - 1;
+            for (int r = TETRIS_HEIGHT - 1; r >= 0; r--) {
+                if (rows[r] == TETRIS_ROW_FULL) {
+                    lines++;
+                } else {
+                    rows[dst--] = rows[r];
+                }
+            }
+            while (dst >= 0) {
+                rows[dst--] = TETRIS_ROW_EMPTY;
+            }
+
+            int score = tetris_evaluate(rows, lines);
+            evaluated++;
+            if (score > best_score) {
+                best_score = score;
+                best_rotation = rotation;
+                best_x = x;
+            }
+        }
+    }
+
+    piece->rotation = best_rotation;
+    piece->x = best_x;
+    return evaluated;
+}
+
+void tetris_bench(uint32_t games, uint32_t seed, uint32_t max_pieces,
+                  struct tetris_bench_result *result) {
+    memset(result, 0, sizeof(*result));
+    uint32_t rng = seed ? seed : 1;
+    struct tetris_board board;
+
+    for (uint32_t g = 0; g < games; g++) {
+        tetris_board_reset(&board);
+        uint32_t game_lines = 0;
+        for (uint32_t n = 0; n < max_pieces; n++) {
+            struct tetris_piece piece = tetris_spawn(tetris_random(&rng) % TETRIS_PIECES);
+            if (tetris_collides(&board, &piece, 0, 0, 0)) {
+                break;  // Topped out
+            }
+            result->moves += tetris_bot_choose(&board, &piece);
+            tetris_hard_drop(&board, &piece);
+            tetris_merge(&board, &piece);
+            game_lines += tetris_clear_lines(&board);
+            result->pieces++;
+        }
+        result->lines += game_lines;
+        if (game_lines > result->best_lines) {
+            result->best_lines = game_lines;
+        }
+        result->games++;
+    }
+}
+
+#ifdef TETRIS_HOST_BENCH
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char **argv) {
+    uint32_t games = argc > 1 ? strtoul(argv[1], NULL, 10) : 10;
+    uint32_t seed = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+
+    tetris_init();
+    struct tetris_bench_result r;
+    clock_t start = clock();
+    tetris_bench(games, seed, 1000, &r);
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("games=%lu pieces=%lu lines=%lu best=%lu moves=%lu\n",
+           (unsigned long)r.games, (unsigned long)r.pieces, (unsigned long)r.lines,
+           (unsigned long)r.best_lines, (unsigned long)r.moves);
+    printf("%.3f s, %.0f moves/s, %.0f pieces/s\n",
+           secs, secs > 0 ? r.moves / secs : 0.0, secs > 0 ? r.pieces / secs : 0.0);
+    return 0;
+}
+#endif
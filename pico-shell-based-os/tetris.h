@@ -0,0 +1,89 @@
+/**
+ * Tetris engine - bitboard core shared by the game and the bot benchmark
+ *
+ * Every board row is one uint16_t: the 10 playfield columns sit in bits
+ * 3..12 with the bits either side permanently set as walls, and one extra
+ * all-ones row below the field acts as the floor. Each piece rotation is
+ * a precomputed 4-row mask, so a collision test is four shifts and ANDs
+ * and a full line is a single compare against TETRIS_ROW_FULL.
+ *
+ * No Pico SDK dependencies: the same file builds for the board and, with
+ * TETRIS_HOST_BENCH defined, as a host benchmark:
+ *
+ *     c++ -O2 -DTETRIS_HOST_BENCH tetris.cpp -o tetris_bench
+ *     ./tetris_bench [games] [seed]
+ */
+
+#ifndef TETRIS_H
+#define TETRIS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TETRIS_WIDTH 10
+#define TETRIS_HEIGHT 20
+#define TETRIS_PIECES 7
+
+// Three wall columns each side: a rotation moves a cell at most three
+// columns, so it can never jump over the wall bits
+#define TETRIS_WALL_BITS 3
+#define TETRIS_ROW_EMPTY ((uint16_t)~(((1u << TETRIS_WIDTH) - 1) << TETRIS_WALL_BITS))
+#define TETRIS_ROW_FULL ((uint16_t)0xFFFF)
+
+struct tetris_board {
+    uint16_t rows[TETRIS_HEIGHT + 1];               // rows[TETRIS_HEIGHT] is the floor
+    uint8_t cells[TETRIS_HEIGHT][TETRIS_WIDTH];     // Piece type + 1 per cell, for drawing only
+};
+
+struct tetris_piece {
+    int8_t type;
+    int8_t rotation;
+    int8_t x;       // Column of the 4x4 box's left edge (may be negative)
+    int8_t y;       // Row of the box's top edge
+};
+
+// Build the rotation masks; call once before anything else
+void tetris_init();
+
+void tetris_board_reset(struct tetris_board *board);
+
+// Piece of the given type at the spawn position
+struct tetris_piece tetris_spawn(int type);
+
+// Box row i (0..3) of the piece as playfield column bits (bit 0 = column 0)
+uint16_t tetris_piece_row(const struct tetris_piece *piece, int i);
+
+// Would the piece overlap walls, floor or blocks after moving by
+// dx/dy and turning clockwise drot quarter turns?
+bool tetris_collides(const struct tetris_board *board, const struct tetris_piece *piece,
+                     int dx, int dy, int drot);
+
+// Drop as far as possible, returns rows fallen
+int tetris_hard_drop(const struct tetris_board *board, struct tetris_piece *piece);
+
+void tetris_merge(struct tetris_board *board, const struct tetris_piece *piece);
+
+// Remove full rows, returns how many
+int tetris_clear_lines(struct tetris_board *board);
+
+// ===== HEADLESS BOT / BENCHMARK =====
+
+// Deterministic generator so host and device play identical games
+uint32_t tetris_random(uint32_t *state);
+
+struct tetris_bench_result {
+    uint32_t games;
+    uint32_t pieces;            // Pieces placed
+    uint32_t lines;
+    uint32_t moves;             // Candidate placements evaluated by the bot
+    uint32_t best_lines;        // Most lines in a single game
+};
+
+// Let the bot choose a rotation and column for piece and set it (not dropped)
+uint32_t tetris_bot_choose(const struct tetris_board *board, struct tetris_piece *piece);
+
+// Play games seeded games of at most max_pieces pieces each
+void tetris_bench(uint32_t games, uint32_t seed, uint32_t max_pieces,
+                  struct tetris_bench_result *result);
+
+#endif // TETRIS_H
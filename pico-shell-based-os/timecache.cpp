@@ -0,0 +1,178 @@
+/**
+ * Time-of-day cache - see timecache.h
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "hardware/sync.h"
+#include "timecache.h"
+#include "timesync.h"
+
+// Fire this long after the boundary so the new second has begun
+#define TIMECACHE_MARGIN_US 200
+
+static struct time_snapshot cache;
+static volatile uint32_t cache_sequence = 0;    // Odd while a write is in progress
+static volatile int utc_offset = 0;
+static critical_section_t writer_lock;
+
+static inline void put2(char *p, int v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+// gmtime() without the C library: civil date from a day count
+// (days_from_civil inverse, valid for the whole proleptic Gregorian range)
+static void timecache_breakdown(int64_t t, struct tm *tm) {
+    int64_t days = t / 86400;
+    int64_t rem = t % 86400;
+    if (rem < 0) {
+        rem += 86400;
+        days--;
+    }
+    tm->tm_hour = (int)(rem / 3600);
+    tm->tm_min = (int)(rem % 3600 / 60);
+    tm->tm_sec = (int)(rem % 60);
+    tm->tm_wday = (int)((days % 7 + 11) % 7);     // 1970-01-01 was a Thursday
+
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);   // From March 1st
+    int64_t mp = (5 * doy + 2) / 153;
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int64_t year = yoe + era * 400 + (month <= 2);
+
+    tm->tm_year = (int)(year - 1900);
+    tm->tm_mon = month - 1;
+    tm->tm_mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    tm->tm_yday = (int)(mp < 10 ? doy + 59 + leap : doy - 306);
+    tm->tm_isdst = 0;
+}
+
+static void timecache_build(struct time_snapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    snap->uptime_sec = to_ms_since_boot(get_absolute_time()) / 1000;
+    snap->valid = timesync_valid();
+    if (!snap->valid) {
+        strcpy(snap->hms, "--:--:--");
+        strcpy(snap->iso, "----------T--:--:--");
+        return;
+    }
+
+    snap->local = timesync_unix() + utc_offset;
+    timecache_breakdown(snap->local, &snap->tm);
+
+    const struct tm *tm = &snap->tm;
+    put2(snap->hms, tm->tm_hour);
+    snap->hms[2] = ':';
+    put2(snap->hms + 3, tm->tm_min);
+    snap->hms[5] = ':';
+    put2(snap->hms + 6, tm->tm_sec);
+
+    int year = tm->tm_year + 1900;
+    put2(snap->iso, year / 100 % 100);
+    put2(snap->iso + 2, year % 100);
+    snap->iso[4] = '-';
+    put2(snap->iso + 5, tm->tm_mon + 1);
+    snap->iso[7] = '-';
+    put2(snap->iso + 8, tm->tm_mday);
+    snap->iso[10] = 'T';
+    memcpy(snap->iso + 11, snap->hms, 8);
+}
+
+void timecache_refresh() {
+    // Build outside the write window so readers retry as little as possible
+    struct time_snapshot snap;
+    timecache_build(&snap);
+
+    critical_section_enter_blocking(&writer_lock);
+    cache_sequence++;
+    __dmb();
+    cache = snap;
+    __dmb();
+    cache_sequence++;
+    critical_section_exit(&writer_lock);
+}
+
+// Microseconds until just after the clock's next second boundary
+static int64_t timecache_next_us() {
+    int64_t into_second = timesync_time_us() % 1000000;
+    if (into_second < 0) {
+        into_second += 1000000;
+    }
+    return 1000000 - into_second + TIMECACHE_MARGIN_US;
+}
+
+static int64_t timecache_alarm(alarm_id_t id, void *user_data) {
+    timecache_refresh();
+    // Negative: reschedule relative to now rather than the last firing, so
+    // the alarm follows the clock through slews and steps
+    return -timecache_next_us();
+}
+
+void timecache_init(int utc_offset_sec) {
+    critical_section_init(&writer_lock);
+    utc_offset = utc_offset_sec;
+    timecache_refresh();
+    add_alarm_in_us(timecache_next_us(), timecache_alarm, NULL, true);
+}
+
+void timecache_set_utc_offset(int utc_offset_sec) {
+    utc_offset = utc_offset_sec;
+    timecache_refresh();
+}
+
+// ===== READERS =====
+
+// Run the copy until it saw no write in progress or completed meanwhile
+#define TIMECACHE_READ(copy) do {                       \
+        uint32_t seq;                                   \
+        do {                                            \
+            while ((seq = cache_sequence) & 1) {        \
+                tight_loop_contents();                  \
+            }                                           \
+            __dmb();                                    \
+            copy;                                       \
+            __dmb();                                    \
+        } while (seq != cache_sequence);                \
+    } while (0)
+
+void timecache_read(struct time_snapshot *out) {
+    TIMECACHE_READ(*out = cache);
+}
+
+bool timecache_hms(char out[9]) {
+    char hms[9];
+    bool valid;
+    TIMECACHE_READ((valid = cache.valid, memcpy(hms, cache.hms, sizeof(hms))));
+    if (valid) {
+        memcpy(out, hms, sizeof(hms));
+    }
+    return valid;
+}
+
+bool timecache_iso(char out[20]) {
+    char iso[20];
+    bool valid;
+    TIMECACHE_READ((valid = cache.valid, memcpy(iso, cache.iso, sizeof(iso))));
+    if (valid) {
+        memcpy(out, iso, sizeof(iso));
+    }
+    return valid;
+}
+
+time_t timecache_local() {
+    time_t local;
+    TIMECACHE_READ(local = cache.local);
+    return local;
+}
+
+uint32_t timecache_uptime() {
+    uint32_t uptime;
+    TIMECACHE_READ(uptime = cache.uptime_sec);
+    return uptime;
+}
@@ -0,0 +1,51 @@
+/**
+ * Time-of-day cache - broken-down local time refreshed once a second
+ *
+ * An alarm fires just after every second boundary of the disciplined
+ * clock (timesync.h) and rebuilds a snapshot: Unix local time, struct tm,
+ * and ready-made "HH:MM:SS" and ISO-8601 strings. Hot paths (log lines,
+ * the prompt, templates) copy from the snapshot instead of calling
+ * localtime() and printf'ing the digits every time.
+ *
+ * The snapshot is published under a sequence lock: writers (the alarm, or
+ * timecache_refresh() after a clock change) serialise on a spin lock and
+ * bump the sequence around the update; readers on either core just retry
+ * if it changed under them, so they never block or disable interrupts.
+ */
+
+#ifndef TIMECACHE_H
+#define TIMECACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct time_snapshot {
+    bool valid;             // Clock has been set (NTP or manual)
+    time_t local;           // Unix time plus the UTC offset, 0 if !valid
+    uint32_t uptime_sec;
+    struct tm tm;           // Broken-down local time
+    char hms[9];            // "HH:MM:SS"
+    char iso[20];           // "YYYY-MM-DDTHH:MM:SS"
+};
+
+// Start the per-second refresh (core 0, after timesync_init())
+void timecache_init(int utc_offset_sec);
+
+// Change the UTC offset; takes effect immediately
+void timecache_set_utc_offset(int utc_offset_sec);
+
+// Rebuild now, e.g. after the clock was stepped
+void timecache_refresh();
+
+// Consistent copy of the whole snapshot
+void timecache_read(struct time_snapshot *out);
+
+// Just the pieces hot paths need; false (and out untouched) if the clock
+// is not set yet
+bool timecache_hms(char out[9]);
+bool timecache_iso(char out[20]);
+time_t timecache_local();           // 0 if not set
+uint32_t timecache_uptime();
+
+#endif // TIMECACHE_H
@@ -0,0 +1,433 @@
+/**
+ * Time service core - see timesync.h
+ */
+
+#ifdef TIMESYNC_HOST_TEST
+// Poll twice a second so a harness run takes a minute rather than hours
+#define TIMESYNC_POLL_MS 500
+#define TIMESYNC_MIN_FREQ_SPAN_US 2000000ULL
+#endif
+
+#include <string.h>
+#include "timesync.h"
+
+// Jitter allowance over the best sample's delay for the frequency fit
+#define TIMESYNC_FREQ_DELAY_SLACK_US 500
+
+int64_t timesync_ntp_to_us(uint64_t ntp) {
+    uint32_t seconds = (uint32_t)(ntp >> 32);
+    uint32_t fraction = (uint32_t)ntp;
+    // NTP seconds wrap in 2036; small values belong to the next era
+    int64_t unix_seconds = seconds >= 0x80000000u
+        ? (int64_t)seconds - (int64_t)TIMESYNC_NTP_DELTA
+        : (int64_t)seconds + 0x100000000LL - (int64_t)TIMESYNC_NTP_DELTA;
+    return unix_seconds * 1000000 + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+}
+
+uint64_t timesync_us_to_ntp(int64_t unix_us) {
+    int64_t seconds = unix_us / 1000000;
+    int64_t micros = unix_us % 1000000;
+    if (micros < 0) {
+        micros += 1000000;
+        seconds--;
+    }
+    uint32_t ntp_seconds = (uint32_t)(seconds + (int64_t)TIMESYNC_NTP_DELTA);
+    uint32_t fraction = (uint32_t)(((uint64_t)micros << 32) / 1000000);
+    return ((uint64_t)ntp_seconds << 32) | fraction;
+}
+
+// ===== CLOCK =====
+
+static inline int64_t timesync_scale(int64_t us, int32_t ppb) {
+    return us * ppb / 1000000000;
+}
+
+void timesync_clock_init(struct timesync_clock *clock) {
+    memset(clock, 0, sizeof(*clock));
+}
+
+int64_t timesync_clock_read(const struct timesync_clock *clock, uint64_t mono_us) {
+    int64_t dt = (int64_t)(mono_us - clock->ref_mono_us);
+    int64_t time = clock->ref_time_us + dt + timesync_scale(dt, clock->freq_ppb);
+    if (clock->slew_ppb && dt > 0 && clock->slew_end_us > clock->ref_mono_us) {
+        uint64_t end = mono_us < clock->slew_end_us ? mono_us : clock->slew_end_us;
+        time += timesync_scale((int64_t)(end - clock->ref_mono_us), clock->slew_ppb);
+    }
+    return time;
+}
+
+uint64_t timesync_clock_uptime(const struct timesync_clock *clock, uint64_t mono_us) {
+    int64_t dt = (int64_t)(mono_us - clock->uptime_ref_mono_us);
+    return clock->uptime_ref_us + dt + timesync_scale(dt, clock->freq_ppb);
+}
+
+// Move the reference points to mono_us so rates can change without a jump;
+// a slew in progress carries on (slew_end_us is absolute)
+static void timesync_clock_fold(struct timesync_clock *clock, uint64_t mono_us) {
+    clock->ref_time_us = timesync_clock_read(clock, mono_us);
+    clock->uptime_ref_us = timesync_clock_uptime(clock, mono_us);
+    clock->ref_mono_us = mono_us;
+    clock->uptime_ref_mono_us = mono_us;
+    if (clock->slew_end_us <= mono_us) {
+        clock->slew_ppb = 0;
+    }
+}
+
+void timesync_clock_step(struct timesync_clock *clock, uint64_t mono_us, int64_t time_us) {
+    timesync_clock_fold(clock, mono_us);
+    clock->ref_time_us = time_us;
+    clock->slew_ppb = 0;
+    clock->set = true;
+    clock->steps++;
+}
+
+void timesync_clock_correct(struct timesync_clock *clock, uint64_t mono_us, int64_t offset_us) {
+    int64_t magnitude = offset_us < 0 ? -offset_us : offset_us;
+    if (!clock->set || magnitude > TIMESYNC_STEP_US) {
+        timesync_clock_step(clock, mono_us, timesync_clock_read(clock, mono_us) + offset_us);
+        return;
+    }
+
+    // Replace any slew in progress: offset_us was measured against the
+    // clock as already partly slewed
+    timesync_clock_fold(clock, mono_us);
+    int64_t window = magnitude * 1000000 / TIMESYNC_MAX_SLEW_PPM;
+    if (window < TIMESYNC_MIN_SLEW_US) {
+        window = TIMESYNC_MIN_SLEW_US;
+    }
+    clock->slew_ppb = (int32_t)(offset_us * 1000000000 / window);
+    clock->slew_end_us = mono_us + window;
+}
+
+// ===== SAMPLES =====
+
+void timesync_sample_make(const struct timesync_clock *clock, uint64_t mono_t1, uint64_t mono_t4,
+                          int64_t t2, int64_t t3, struct timesync_sample *sample) {
+    int64_t elapsed = (int64_t)(mono_t4 - mono_t1);
+    int64_t delay = elapsed + timesync_scale(elapsed, clock->freq_ppb) - (t3 - t2);
+    sample->mono_us = mono_t1 + elapsed / 2;
+    sample->server_us = t2 + (t3 - t2) / 2;
+    sample->delay_us = delay > 0 ? delay : 0;
+}
+
+int64_t timesync_sample_offset(const struct timesync_clock *clock,
+                               const struct timesync_sample *sample, uint64_t mono_now) {
+    // Carry the server's time forward at the corrected rate
+    int64_t age = (int64_t)(mono_now - sample->mono_us);
+    int64_t server_now = sample->server_us + age + timesync_scale(age, clock->freq_ppb);
+    return server_now - timesync_clock_read(clock, mono_now);
+}
+
+void timesync_filter_reset(struct timesync_filter *filter) {
+    memset(filter, 0, sizeof(*filter));
+}
+
+void timesync_filter_add(struct timesync_filter *filter, const struct timesync_sample *sample) {
+    filter->samples[filter->next] = *sample;
+    filter->next = (filter->next + 1) % TIMESYNC_FILTER_SIZE;
+    if (filter->count < TIMESYNC_FILTER_SIZE) {
+        filter->count++;
+    }
+}
+
+static inline bool timesync_sample_fresh(const struct timesync_sample *sample, uint64_t mono_now) {
+    return mono_now - sample->mono_us <= TIMESYNC_MAX_AGE_US;
+}
+
+// Lowest-delay fresh sample: the one least disturbed by queueing
+static bool timesync_filter_best(const struct timesync_filter *filter, uint64_t mono_now,
+                                 struct timesync_sample *best) {
+    bool found = false;
+    for (int i = 0; i < filter->count; i++) {
+        const struct timesync_sample *sample = &filter->samples[i];
+        if (timesync_sample_fresh(sample, mono_now) && (!found || sample->delay_us < best->delay_us)) {
+            *best = *sample;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Oscillator frequency error from a least-squares fit of (server - local)
+// against local time over the low-delay samples
+static bool timesync_filter_freq(const struct timesync_filter *filter, uint64_t mono_now,
+                                 int64_t max_delay_us, int32_t *freq_ppb) {
+    const struct timesync_sample *base = NULL;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    uint64_t first = 0, last = 0;
+    int n = 0;
+
+    for (int i = 0; i < filter->count; i++) {
+        const struct timesync_sample *sample = &filter->samples[i];
+        if (!timesync_sample_fresh(sample, mono_now) || sample->delay_us > max_delay_us) {
+            continue;
+        }
+        if (!base) {
+            base = sample;
+            first = last = sample->mono_us;
+        }
+        // Relative to the first sample to keep the sums small
+        double x = (double)(int64_t)(sample->mono_us - base->mono_us);
+        double y = (double)((sample->server_us - base->server_us) -
+                            (int64_t)(sample->mono_us - base->mono_us));
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        if (sample->mono_us < first) first = sample->mono_us;
+        if (sample->mono_us > last) last = sample->mono_us;
+        n++;
+    }
+
+    if (n < 3 || last - first < TIMESYNC_MIN_FREQ_SPAN_US) {
+        return false;
+    }
+    double denominator = n * sxx - sx * sx;
+    if (denominator <= 0) {
+        return false;
+    }
+    double ppb = (n * sxy - sx * sy) / denominator * 1e9;
+    if (ppb > TIMESYNC_MAX_FREQ_PPB) ppb = TIMESYNC_MAX_FREQ_PPB;
+    if (ppb < -TIMESYNC_MAX_FREQ_PPB) ppb = -TIMESYNC_MAX_FREQ_PPB;
+    *freq_ppb = (int32_t)ppb;
+    return true;
+}
+
+static int64_t timesync_median(int64_t *values, int count) {
+    for (int i = 1; i < count; i++) {
+        int64_t v = values[i];
+        int j = i - 1;
+        while (j >= 0 && values[j] > v) {
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = v;
+    }
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+bool timesync_update(struct timesync_clock *clock, const struct timesync_filter *filters,
+                     int count, uint64_t mono_now) {
+    struct timesync_sample best[TIMESYNC_MAX_SERVERS];
+    bool have[TIMESYNC_MAX_SERVERS];
+    int64_t freqs[TIMESYNC_MAX_SERVERS];
+    int64_t offsets[TIMESYNC_MAX_SERVERS];
+    int64_t delays[TIMESYNC_MAX_SERVERS];
+    int servers = 0;
+    int nfreq = 0;
+
+    if (count > TIMESYNC_MAX_SERVERS) {
+        count = TIMESYNC_MAX_SERVERS;
+    }
+    for (int i = 0; i < count; i++) {
+        have[i] = timesync_filter_best(&filters[i], mono_now, &best[i]);
+        if (!have[i]) continue;
+        servers++;
+        int32_t freq;
+        if (timesync_filter_freq(&filters[i], mono_now,
+                                 best[i].delay_us * 2 + TIMESYNC_FREQ_DELAY_SLACK_US, &freq)) {
+            freqs[nfreq++] = freq;
+        }
+    }
+    if (servers == 0) {
+        return false;
+    }
+
+    // Frequency first: offsets of older samples are projected with it
+    if (nfreq > 0) {
+        timesync_clock_fold(clock, mono_now);
+        clock->freq_ppb = (int32_t)timesync_median(freqs, nfreq);
+    }
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (!have[i]) continue;
+        offsets[n] = timesync_sample_offset(clock, &best[i], mono_now);
+        delays[n] = best[i].delay_us;
+        n++;
+    }
+    int64_t offset = timesync_median(offsets, n);
+    timesync_clock_correct(clock, mono_now, offset);
+
+    clock->last_offset_us = offset;
+    clock->last_delay_us = timesync_median(delays, n);
+    clock->updates++;
+    return true;
+}
+
+#ifdef TIMESYNC_HOST_TEST
+// Fake NTP servers on 127.0.0.1 serve "true" time (host monotonic clock
+// plus a fixed date); the client's local timer runs fast or slow by the
+// given drift. Inbound packets are randomly held back to simulate
+// asymmetric queueing, and the third server is a falseticker 20 ms off.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define HOST_SERVERS 3
+#define HOST_TRUE_BASE_US (1767225600LL * 1000000)     // 2026-01-01
+
+static double host_drift_ppm = 150;
+static double host_jitter_ms = 5;
+
+static uint64_t host_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t host_true_us() {
+    return HOST_TRUE_BASE_US + (int64_t)host_us();
+}
+
+// The client's free-running timer
+static uint64_t host_local_us() {
+    return (uint64_t)(host_us() * (1.0 + host_drift_ppm * 1e-6)) + 5000000;
+}
+
+static void put_be64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--, v >>= 8) p[i] = (uint8_t)v;
+}
+
+static uint64_t get_be64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+struct fake_server {
+    int fd;
+    uint16_t port;
+    int64_t bias_us;
+    unsigned seed;
+};
+
+static void *fake_server_main(void *arg) {
+    struct fake_server *server = (struct fake_server*)arg;
+    uint8_t packet[48];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+
+    while (recvfrom(server->fd, packet, sizeof(packet), 0, (struct sockaddr*)&from, &from_len) == 48) {
+        // Mostly a short hold, sometimes a long one
+        if (rand_r(&server->seed) % 5 == 0) {
+            usleep(1000 + rand_r(&server->seed) % (unsigned)(host_jitter_ms * 1000 + 1));
+        } else {
+            usleep(rand_r(&server->seed) % 200);
+        }
+        int64_t t2 = host_true_us() + server->bias_us;
+
+        uint8_t reply[48] = {0};
+        reply[0] = 0x24;        // LI 0, VN 4, mode 4 (server)
+        reply[1] = 2;           // Stratum
+        memcpy(reply + 24, packet + 40, 8);     // Originate = client's transmit
+        put_be64(reply + 32, timesync_us_to_ntp(t2));
+        put_be64(reply + 40, timesync_us_to_ntp(host_true_us() + server->bias_us));
+        sendto(server->fd, reply, sizeof(reply), 0, (struct sockaddr*)&from, from_len);
+        from_len = sizeof(from);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 60;
+    if (argc > 2) host_drift_ppm = atof(argv[2]);
+    if (argc > 3) host_jitter_ms = atof(argv[3]);
+
+    static struct fake_server servers[HOST_SERVERS];
+    for (int i = 0; i < HOST_SERVERS; i++) {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        servers[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+        socklen_t len = sizeof(addr);
+        if (bind(servers[i].fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            getsockname(servers[i].fd, (struct sockaddr*)&addr, &len) < 0) {
+            perror("fake server");
+            return 1;
+        }
+        servers[i].port = ntohs(addr.sin_port);
+        servers[i].bias_us = i == HOST_SERVERS - 1 ? 20000 : 0;
+        servers[i].seed = 1234 + i;
+        pthread_t thread;
+        pthread_create(&thread, NULL, fake_server_main, &servers[i]);
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = { 0, 200000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct timesync_clock clock;
+    struct timesync_filter filters[HOST_SERVERS];
+    timesync_clock_init(&clock);
+    for (int i = 0; i < HOST_SERVERS; i++) {
+        timesync_filter_reset(&filters[i]);
+    }
+
+    printf("drift %+.1f ppm, jitter up to %.1f ms, %d servers (one 20 ms off)\n\n",
+           host_drift_ppm, host_jitter_ms, HOST_SERVERS);
+    printf("  time   error us   offset us  delay us   freq ppm\n");
+
+    uint64_t start = host_us();
+    uint64_t end = start + (uint64_t)(seconds * 1e6);
+    uint64_t half = start + (end - start) / 2;
+    double sum_sq = 0;
+    int64_t worst = 0;
+    int measured = 0;
+    uint32_t rounds = 0;
+
+    while (host_us() < end) {
+        for (int i = 0; i < HOST_SERVERS; i++) {
+            struct sockaddr_in to = {};
+            to.sin_family = AF_INET;
+            to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            to.sin_port = htons(servers[i].port);
+
+            uint8_t request[48] = {0};
+            request[0] = 0x23;      // LI 0, VN 4, mode 3 (client)
+            uint64_t t1 = host_local_us();
+            uint64_t cookie = timesync_us_to_ntp(timesync_clock_read(&clock, t1));
+            put_be64(request + 40, cookie);
+            sendto(fd, request, sizeof(request), 0, (struct sockaddr*)&to, sizeof(to));
+
+            uint8_t reply[48];
+            if (recv(fd, reply, sizeof(reply), 0) != 48 || get_be64(reply + 24) != cookie) {
+                continue;
+            }
+            uint64_t t4 = host_local_us();
+            struct timesync_sample sample;
+            timesync_sample_make(&clock, t1, t4, timesync_ntp_to_us(get_be64(reply + 32)),
+                                 timesync_ntp_to_us(get_be64(reply + 40)), &sample);
+            timesync_filter_add(&filters[i], &sample);
+            timesync_update(&clock, filters, HOST_SERVERS, t4);
+        }
+
+        int64_t error = timesync_clock_read(&clock, host_local_us()) - host_true_us();
+        if (host_us() >= half) {
+            sum_sq += (double)error * error;
+            if (llabs(error) > worst) worst = llabs(error);
+            measured++;
+        }
+        if (rounds++ % 4 == 0) {
+            printf("%6.1f %10lld %11lld %9lld %10.2f\n", (host_us() - start) / 1e6,
+                   (long long)error, (long long)clock.last_offset_us,
+                   (long long)clock.last_delay_us, clock.freq_ppb / 1000.0);
+        }
+        usleep(TIMESYNC_POLL_MS * 1000);
+    }
+
+    double expected = -host_drift_ppm / (1.0 + host_drift_ppm * 1e-6);
+    printf("\nsecond half: rms error %.0f us, worst %lld us over %d rounds\n",
+           measured ? sqrt(sum_sq / measured) : 0.0, (long long)worst, measured);
+    printf("frequency correction %.2f ppm (ideal %.2f), %lu steps, %lu updates\n",
+           clock.freq_ppb / 1000.0, expected, (unsigned long)clock.steps,
+           (unsigned long)clock.updates);
+    return 0;
+}
+#endif
@@ -0,0 +1,171 @@
+/**
+ * Time service - disciplined wall clock fed by SNTP
+ *
+ * The wall clock is a piecewise-linear function of the local monotonic
+ * timer: time = ref_time + elapsed * (1 + freq) (+ slew). Each NTP exchange
+ * records the local timer at the midpoint of the request/reply and the
+ * server's time at that moment (full four-timestamp SNTP), so a sample
+ * stays valid however the clock is adjusted afterwards. Per server the
+ * lowest-delay recent sample gives the offset and a fit over the clean
+ * samples gives the oscillator's frequency error; across servers the
+ * median is used, so one bad server cannot drag the clock.
+ *
+ * Large offsets (and the first sync) step the clock; small ones are
+ * slewed out at a bounded rate so time never jumps. A separate uptime
+ * counter is frequency corrected but never stepped or slewed.
+ *
+ * The core below has no Pico SDK dependencies; the device service at the
+ * bottom (timesync_ntp.cpp) runs the SNTP client on lwIP. With
+ * TIMESYNC_HOST_TEST defined, timesync.cpp builds a host harness that
+ * syncs against local fake NTP servers and reports the offset error:
+ *
+ *     c++ -O2 -DTIMESYNC_HOST_TEST timesync.cpp -o timesync_test -lpthread
+ *     ./timesync_test [seconds] [drift ppm] [jitter ms]
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define TIMESYNC_MAX_SERVERS 4
+#define TIMESYNC_FILTER_SIZE 8              // Samples kept per server
+#define TIMESYNC_STEP_US 128000             // Larger offsets are stepped
+#define TIMESYNC_MAX_SLEW_PPM 500           // Slew rate limit
+#define TIMESYNC_MIN_SLEW_US 1000000        // Shortest slew
+#define TIMESYNC_MAX_FREQ_PPB 500000        // Frequency correction limit
+
+#ifndef TIMESYNC_POLL_MS
+#define TIMESYNC_POLL_MS 64000              // Steady-state poll interval
+#endif
+#define TIMESYNC_BURST 4                    // Quick polls after start / poll_now
+#define TIMESYNC_BURST_MS 2000
+
+#ifndef TIMESYNC_MAX_AGE_US
+#define TIMESYNC_MAX_AGE_US (8ULL * TIMESYNC_POLL_MS * 1000)  // Older samples are ignored
+#endif
+#ifndef TIMESYNC_MIN_FREQ_SPAN_US
+#define TIMESYNC_MIN_FREQ_SPAN_US 30000000ULL   // Shortest baseline for a frequency fit
+#endif
+
+// Seconds between the NTP (1900) and Unix (1970) epochs
+#define TIMESYNC_NTP_DELTA 2208988800ULL
+
+// ===== CORE =====
+
+struct timesync_sample {
+    uint64_t mono_us;       // Local monotonic time at the exchange midpoint
+    int64_t server_us;      // Server time (Unix us) at that moment
+    int64_t delay_us;       // Round trip minus server processing
+};
+
+struct timesync_filter {
+    struct timesync_sample samples[TIMESYNC_FILTER_SIZE];
+    uint8_t count;
+    uint8_t next;
+};
+
+struct timesync_clock {
+    bool set;                   // Holds a real time (NTP or manual)
+    uint64_t ref_mono_us;       // Local monotonic time of the last adjustment
+    int64_t ref_time_us;        // Wall time (Unix us) at ref_mono_us
+    int32_t freq_ppb;           // Oscillator correction
+    int32_t slew_ppb;           // Extra rate until slew_end_us
+    uint64_t slew_end_us;
+    uint64_t uptime_ref_mono_us;    // Frequency-corrected uptime, see
+    uint64_t uptime_ref_us;         // timesync_clock_uptime()
+
+    int64_t last_offset_us;     // Combined offset of the last update
+    int64_t last_delay_us;
+    uint32_t updates;
+    uint32_t steps;
+};
+
+// Convert a 64-bit NTP timestamp to Unix microseconds (era 1 after 2036)
+int64_t timesync_ntp_to_us(uint64_t ntp);
+uint64_t timesync_us_to_ntp(int64_t unix_us);
+
+void timesync_clock_init(struct timesync_clock *clock);
+
+// Wall time (Unix us) at local monotonic time mono_us
+int64_t timesync_clock_read(const struct timesync_clock *clock, uint64_t mono_us);
+
+// Monotonic, frequency-corrected microseconds since boot
+uint64_t timesync_clock_uptime(const struct timesync_clock *clock, uint64_t mono_us);
+
+// Jump to time_us (first sync, manual set, huge offsets)
+void timesync_clock_step(struct timesync_clock *clock, uint64_t mono_us, int64_t time_us);
+
+// Remove offset_us: stepped if large or the clock is unset, else slewed
+void timesync_clock_correct(struct timesync_clock *clock, uint64_t mono_us, int64_t offset_us);
+
+// Build a sample from one exchange: local monotonic send/receive times and
+// the server's receive (t2) and transmit (t3) timestamps in Unix us
+void timesync_sample_make(const struct timesync_clock *clock, uint64_t mono_t1, uint64_t mono_t4,
+                          int64_t t2, int64_t t3, struct timesync_sample *sample);
+
+// Offset of the sample against the clock at mono_now (server - local)
+int64_t timesync_sample_offset(const struct timesync_clock *clock,
+                               const struct timesync_sample *sample, uint64_t mono_now);
+
+void timesync_filter_reset(struct timesync_filter *filter);
+void timesync_filter_add(struct timesync_filter *filter, const struct timesync_sample *sample);
+
+// Combine the servers' filters and discipline the clock; false if no
+// server has a usable sample
+bool timesync_update(struct timesync_clock *clock, const struct timesync_filter *filters,
+                     int count, uint64_t mono_now);
+
+// ===== DEVICE SERVICE (timesync_ntp.cpp) =====
+
+struct timesync_status {
+    bool valid;             // Clock holds a real time
+    bool synced;            // ... and it came from NTP
+    int64_t offset_us;
+    int64_t delay_us;
+    int32_t freq_ppb;
+    int32_t slew_ppb;
+    uint32_t updates;
+    uint32_t steps;
+    int servers;
+};
+
+struct timesync_server_status {
+    char name[48];
+    char addr[16];          // Empty until resolved
+    uint32_t polls;
+    uint32_t replies;
+    bool have_sample;
+    int64_t offset_us;      // Lowest-delay recent sample against the clock
+    int64_t delay_us;
+};
+
+// Call once at boot, before anything else
+void timesync_init();
+
+// Start polling the given servers (host names or dotted IPs); a running
+// service is restarted with the new list. Safe to call from any core.
+bool timesync_start(const char *const *servers, int count);
+void timesync_stop();
+
+// Poll every server now (a short burst)
+void timesync_poll_now();
+
+bool timesync_valid();
+bool timesync_synced();
+
+// Wall clock
+int64_t timesync_time_us();
+time_t timesync_unix();
+void timesync_set_unix(time_t t);       // Manual time, overridden by NTP
+
+// Monotonic clock: never steps or slews, only frequency corrected
+uint64_t timesync_uptime_us();
+uint32_t timesync_uptime_ms();
+
+void timesync_get_status(struct timesync_status *status);
+bool timesync_get_server(int index, struct timesync_server_status *status);
+
+#endif // TIMESYNC_H
@@ -0,0 +1,354 @@
+/**
+ * Time service - SNTP client and system clock (see timesync.h)
+ *
+ * All network work runs in the lwIP context: polls are scheduled with
+ * sys_timeout() and replies arrive in the UDP receive callback. The clock
+ * itself is read from both cores, so it sits behind a critical section.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/timeouts.h"
+#include "timesync.h"
+#include "dns_cache.h"
+
+#define NTP_PORT 123
+#define NTP_PACKET_SIZE 48
+#define NTP_STAGGER_MS 250      // Between servers within one poll round
+#define NTP_RERESOLVE_POLLS 4   // Unanswered polls before looking the name up again
+
+struct ntp_server {
+    char name[48];
+    ip_addr_t addr;
+    bool literal;               // Configured as an address, never resolved
+    bool resolved;
+    bool dns_pending;
+    uint32_t unanswered;        // Consecutive polls without a reply
+    uint64_t sent_mono_us;      // 0 = no request outstanding
+    uint64_t cookie;            // Our transmit timestamp, echoed as originate
+    uint32_t polls;
+    uint32_t replies;
+};
+
+static struct ntp_server servers[TIMESYNC_MAX_SERVERS];
+static struct timesync_filter filters[TIMESYNC_MAX_SERVERS];
+static int server_count = 0;
+static int poll_index = 0;          // Next server in the current round
+static int burst_remaining = 0;
+static bool running = false;
+static bool synced = false;
+static struct udp_pcb *ntp_pcb = NULL;
+
+static struct timesync_clock sys_clock;
+static critical_section_t clock_lock;
+
+static inline uint64_t ntp_be64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+// ===== CLOCK ACCESS =====
+
+void timesync_init() {
+    critical_section_init(&clock_lock);
+    timesync_clock_init(&sys_clock);
+}
+
+bool timesync_valid() {
+    critical_section_enter_blocking(&clock_lock);
+    bool valid = sys_clock.set;
+    critical_section_exit(&clock_lock);
+    return valid;
+}
+
+bool timesync_synced() {
+    return synced;
+}
+
+int64_t timesync_time_us() {
+    critical_section_enter_blocking(&clock_lock);
+    int64_t now = timesync_clock_read(&sys_clock, time_us_64());
+    critical_section_exit(&clock_lock);
+    return now;
+}
+
+time_t timesync_unix() {
+    int64_t now = timesync_time_us();
+    return (time_t)(now >= 0 ? now / 1000000 : (now - 999999) / 1000000);
+}
+
+void timesync_set_unix(time_t t) {
+    critical_section_enter_blocking(&clock_lock);
+    timesync_clock_step(&sys_clock, time_us_64(), (int64_t)t * 1000000);
+    critical_section_exit(&clock_lock);
+}
+
+uint64_t timesync_uptime_us() {
+    critical_section_enter_blocking(&clock_lock);
+    uint64_t uptime = timesync_clock_uptime(&sys_clock, time_us_64());
+    critical_section_exit(&clock_lock);
+    return uptime;
+}
+
+uint32_t timesync_uptime_ms() {
+    return (uint32_t)(timesync_uptime_us() / 1000);
+}
+
+void timesync_get_status(struct timesync_status *status) {
+    critical_section_enter_blocking(&clock_lock);
+    status->valid = sys_clock.set;
+    status->offset_us = sys_clock.last_offset_us;
+    status->delay_us = sys_clock.last_delay_us;
+    status->freq_ppb = sys_clock.freq_ppb;
+    status->slew_ppb = sys_clock.slew_end_us > time_us_64() ? sys_clock.slew_ppb : 0;
+    status->updates = sys_clock.updates;
+    status->steps = sys_clock.steps;
+    critical_section_exit(&clock_lock);
+    status->synced = synced;
+    status->servers = server_count;
+}
+
+bool timesync_get_server(int index, struct timesync_server_status *status) {
+    if (index < 0 || index >= server_count) {
+        return false;
+    }
+    const struct ntp_server *server = &servers[index];
+    memset(status, 0, sizeof(*status));
+    strncpy(status->name, server->name, sizeof(status->name) - 1);
+    if (server->resolved) {
+        ipaddr_ntoa_r(&server->addr, status->addr, sizeof(status->addr));
+    }
+    status->polls = server->polls;
+    status->replies = server->replies;
+
+    // Lowest-delay sample, as the filter would pick it
+    uint64_t now = time_us_64();
+    critical_section_enter_blocking(&clock_lock);
+    const struct timesync_filter *filter = &filters[index];
+    for (int i = 0; i < filter->count; i++) {
+        const struct timesync_sample *sample = &filter->samples[i];
+        if (!status->have_sample || sample->delay_us < status->delay_us) {
+            status->have_sample = true;
+            status->delay_us = sample->delay_us;
+            status->offset_us = timesync_sample_offset(&sys_clock, sample, now);
+        }
+    }
+    critical_section_exit(&clock_lock);
+    return true;
+}
+
+// ===== SNTP CLIENT (lwIP context) =====
+
+static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    uint64_t mono_t4 = time_us_64();
+    uint8_t packet[NTP_PACKET_SIZE];
+
+    if (port != NTP_PORT || p->tot_len < NTP_PACKET_SIZE ||
+        pbuf_copy_partial(p, packet, NTP_PACKET_SIZE, 0) != NTP_PACKET_SIZE) {
+        pbuf_free(p);
+        return;
+    }
+    pbuf_free(p);
+
+    struct ntp_server *server = NULL;
+    int index;
+    for (index = 0; index < server_count; index++) {
+        if (servers[index].resolved && ip_addr_cmp(&servers[index].addr, addr)) {
+            server = &servers[index];
+            break;
+        }
+    }
+
+    // Must answer our outstanding request: server mode, synchronised,
+    // sane stratum, originate matching what we sent
+    uint8_t leap = packet[0] >> 6;
+    uint8_t mode = packet[0] & 0x07;
+    uint8_t stratum = packet[1];
+    if (!server || !server->sent_mono_us || mode != 4 || leap == 3 ||
+        stratum == 0 || stratum > 15 || ntp_be64(packet + 24) != server->cookie) {
+        return;
+    }
+    uint64_t t2 = ntp_be64(packet + 32);
+    uint64_t t3 = ntp_be64(packet + 40);
+    if (t2 == 0 || t3 == 0) {
+        return;
+    }
+
+    uint64_t mono_t1 = server->sent_mono_us;
+    server->sent_mono_us = 0;
+    server->unanswered = 0;
+    server->replies++;
+
+    struct timesync_sample sample;
+    critical_section_enter_blocking(&clock_lock);
+    timesync_sample_make(&sys_clock, mono_t1, mono_t4,
+                         timesync_ntp_to_us(t2), timesync_ntp_to_us(t3), &sample);
+    timesync_filter_add(&filters[index], &sample);
+    timesync_update(&sys_clock, filters, server_count, mono_t4);
+    critical_section_exit(&clock_lock);
+    synced = true;
+}
+
+static void ntp_dns_found(const char *name, enum dns_result result, const ip_addr_t *ip, void *arg) {
+    struct ntp_server *server = (struct ntp_server*)arg;
+    server->dns_pending = false;
+    if (result == DNS_RESULT_OK) {
+        server->addr = *ip;
+        server->resolved = true;
+    }
+}
+
+static void ntp_send(struct ntp_server *server) {
+    // The address sticks while the server answers. A pool name whose host
+    // has gone quiet is looked up again (the cache keeps it fresh, so this
+    // rarely queries) and the old host's samples are dropped.
+    if (server->sent_mono_us && ++server->unanswered >= NTP_RERESOLVE_POLLS && !server->literal) {
+        server->resolved = false;
+        server->unanswered = 0;
+        server->sent_mono_us = 0;
+        critical_section_enter_blocking(&clock_lock);
+        timesync_filter_reset(&filters[server - servers]);
+        critical_section_exit(&clock_lock);
+    }
+
+    if (!server->resolved) {
+        if (!server->dns_pending) {
+            ip_addr_t addr;
+            enum dns_result result = dns_cache_lookup(server->name, &addr, ntp_dns_found, server);
+            if (result == DNS_RESULT_OK) {
+                server->addr = addr;
+                server->resolved = true;
+            } else if (result == DNS_RESULT_PENDING) {
+                server->dns_pending = true;
+            }
+        }
+        if (!server->resolved) {
+            return;     // Polled again next round
+        }
+    }
+
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, NTP_PACKET_SIZE, PBUF_RAM);
+    if (!p) {
+        return;
+    }
+    uint8_t *packet = (uint8_t*)p->payload;
+    memset(packet, 0, NTP_PACKET_SIZE);
+    packet[0] = 0x23;       // LI 0, VN 4, mode 3 (client)
+
+    // Transmit timestamp doubles as the request cookie
+    uint64_t mono_t1 = time_us_64();
+    critical_section_enter_blocking(&clock_lock);
+    uint64_t cookie = timesync_us_to_ntp(timesync_clock_read(&sys_clock, mono_t1));
+    critical_section_exit(&clock_lock);
+    for (int i = 0; i < 8; i++) {
+        packet[40 + i] = (uint8_t)(cookie >> (56 - 8 * i));
+    }
+
+    server->cookie = cookie;
+    server->sent_mono_us = mono_t1;
+    server->polls++;
+    udp_sendto(ntp_pcb, p, &server->addr, NTP_PORT);
+    pbuf_free(p);
+}
+
+// One step of the poll schedule: a server per call, a round per interval
+static void ntp_poll_timer(void *arg) {
+    if (!running) {
+        return;
+    }
+    ntp_send(&servers[poll_index]);
+
+    uint32_t delay;
+    if (++poll_index < server_count) {
+        delay = NTP_STAGGER_MS;
+    } else {
+        poll_index = 0;
+        if (burst_remaining > 0) {
+            burst_remaining--;
+        }
+        delay = burst_remaining > 0 ? TIMESYNC_BURST_MS : TIMESYNC_POLL_MS;
+    }
+    sys_timeout(delay, ntp_poll_timer, NULL);
+}
+
+bool timesync_start(const char *const *names, int count) {
+    if (count <= 0) {
+        return false;
+    }
+    if (count > TIMESYNC_MAX_SERVERS) {
+        count = TIMESYNC_MAX_SERVERS;
+    }
+
+    cyw43_arch_lwip_begin();
+    sys_untimeout(ntp_poll_timer, NULL);
+    for (int i = 0; i < server_count; i++) {
+        dns_cache_cancel(ntp_dns_found, &servers[i]);
+    }
+    if (!ntp_pcb) {
+        ntp_pcb = udp_new();
+        if (ntp_pcb) {
+            udp_recv(ntp_pcb, ntp_recv, NULL);
+        }
+    }
+    if (!ntp_pcb) {
+        cyw43_arch_lwip_end();
+        return false;
+    }
+
+    critical_section_enter_blocking(&clock_lock);
+    for (int i = 0; i < count; i++) {
+        memset(&servers[i], 0, sizeof(servers[i]));
+        strncpy(servers[i].name, names[i], sizeof(servers[i].name) - 1);
+        servers[i].literal = ipaddr_aton(names[i], &servers[i].addr);
+        servers[i].resolved = servers[i].literal;
+        timesync_filter_reset(&filters[i]);
+    }
+    server_count = count;
+    critical_section_exit(&clock_lock);
+
+    // Polled every few minutes for good: keep the names resolved
+    for (int i = 0; i < count; i++) {
+        if (!servers[i].literal) {
+            dns_cache_prefetch(servers[i].name);
+        }
+    }
+
+    poll_index = 0;
+    burst_remaining = TIMESYNC_BURST;
+    running = true;
+    sys_timeout(0, ntp_poll_timer, NULL);
+    cyw43_arch_lwip_end();
+    return true;
+}
+
+void timesync_stop() {
+    cyw43_arch_lwip_begin();
+    running = false;
+    sys_untimeout(ntp_poll_timer, NULL);
+    for (int i = 0; i < server_count; i++) {
+        dns_cache_cancel(ntp_dns_found, &servers[i]);
+        servers[i].dns_pending = false;
+    }
+    if (ntp_pcb) {
+        udp_remove(ntp_pcb);
+        ntp_pcb = NULL;
+    }
+    cyw43_arch_lwip_end();
+}
+
+void timesync_poll_now() {
+    cyw43_arch_lwip_begin();
+    if (running) {
+        sys_untimeout(ntp_poll_timer, NULL);
+        poll_index = 0;
+        burst_remaining = TIMESYNC_BURST;
+        sys_timeout(0, ntp_poll_timer, NULL);
+    }
+    cyw43_arch_lwip_end();
+}
@@ -0,0 +1,831 @@
+/**
+ * To-do store - see todo_store.h
+ */
+
+#include "todo_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Index entries: live and done bits, whether the record is in the journal
+// (otherwise in the ID's segment) and its offset there. Changed marks an
+// entry the segment file no longer matches: done toggled, or deleted (a
+// dead entry that is not 0), so compaction knows which segments to rewrite.
+#define ENTRY_LIVE 0x80000000u
+#define ENTRY_DONE 0x40000000u
+#define ENTRY_JOURNAL 0x20000000u
+#define ENTRY_CHANGED 0x10000000u
+#define ENTRY_OFFSET 0x0FFFFFFFu
+
+// Journal records: op, text length, check (16 bits), ID (32 bits), then
+// the text. Segment records: text length with the done flag in bit 7, the
+// ID's offset in the segment (16 bits), then the text.
+#define RECORD_HEADER 8
+#define RECORD_MAX (RECORD_HEADER + TODO_TEXT_MAX - 1)
+#define SEGMENT_HEADER 3
+#define SEGMENT_DONE 0x80
+#define SEGMENTS_MAX (TODO_STORE_MAX_IDS / TODO_SEGMENT_IDS + 2)
+#define INDEX_STEP 256                      // Table growth, in IDs
+#define PATH_MAX_LEN (TODO_DIR_MAX + 16)
+
+enum todo_op {
+    OP_ADD = 1,
+    OP_DONE,
+    OP_UNDONE,
+    OP_DELETE,
+    OP_NEXT_ID,                     // First record after compaction: IDs in use so far
+};
+
+// ===== RECORDS =====
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// FNV-1a over the record, the check field itself left out
+static uint16_t record_check(const uint8_t *record, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        if (i != 2 && i != 3) {
+            hash = (hash ^ record[i]) * 16777619u;
+        }
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+static size_t record_build(uint8_t *record, uint8_t op, uint32_t id, const char *text, size_t len) {
+    record[0] = op;
+    record[1] = (uint8_t)len;
+    put32(record + 4, id);
+    memcpy(record + RECORD_HEADER, text, len);
+    uint16_t check = record_check(record, RECORD_HEADER + len);
+    record[2] = (uint8_t)check;
+    record[3] = (uint8_t)(check >> 8);
+    return RECORD_HEADER + len;
+}
+
+static void store_path(const char *dir, const char *name, char *path) {
+    snprintf(path, PATH_MAX_LEN, "%s/%s", dir, name);
+}
+
+static void segment_path(const char *dir, uint32_t segment, char *path) {
+    snprintf(path, PATH_MAX_LEN, "%s/seg%lu", dir, (unsigned long)segment);
+}
+
+// ===== INDEX =====
+
+// One past the last ID the table holds. next_id can run ahead of the
+// table when the journal says the IDs below it were used up and deleted.
+static uint32_t index_end(const struct todo_store *store) {
+    uint32_t used = store->next_id - store->first_id;
+    return store->first_id + (used < store->capacity ? used : store->capacity);
+}
+
+// Room for id in the table: drop the unused IDs at its start, then grow
+// by whole steps, so the table stays close to the ID range it covers.
+// Changed entries stay until compaction has written their segment.
+static bool index_reserve(struct todo_store *store, uint32_t id) {
+    if (id - store->first_id < store->capacity) {
+        return true;
+    }
+    uint32_t held = index_end(store) - store->first_id;
+    uint32_t unused = 0;
+    while (unused < held && store->index[unused] == 0) {
+        unused++;
+    }
+    if (unused == held) {
+        // Everything up to next_id is gone (already 0)
+        store->first_id = id < store->next_id ? id : store->next_id;
+    } else if (unused > 0) {
+        memmove(store->index, store->index + unused, (held - unused) * sizeof(uint32_t));
+        memset(store->index + held - unused, 0, unused * sizeof(uint32_t));
+        store->first_id += unused;
+    }
+    if (id - store->first_id < store->capacity) {
+        return true;
+    }
+
+    uint32_t need = id - store->first_id + 1;
+    if (need > TODO_STORE_MAX_IDS) {
+        return false;
+    }
+    uint32_t capacity = (need + INDEX_STEP - 1) / INDEX_STEP * INDEX_STEP;
+    uint32_t *index = (uint32_t*)realloc(store->index, capacity * sizeof(uint32_t));
+    if (!index) {
+        return false;
+    }
+    memset(index + store->capacity, 0, (capacity - store->capacity) * sizeof(uint32_t));
+    store->index = index;
+    store->capacity = capacity;
+    return true;
+}
+
+static uint32_t *index_entry(struct todo_store *store, uint32_t id) {
+    if (id < store->first_id || id >= index_end(store)) {
+        return NULL;
+    }
+    uint32_t *entry = &store->index[id - store->first_id];
+    return *entry & ENTRY_LIVE ? entry : NULL;
+}
+
+// Applies a change to the index; location is where an added item's
+// record is. Replay can meet IDs below the table, deleted before their
+// segment was last written, and skips them.
+static bool index_apply(struct todo_store *store, uint8_t op, uint32_t id, uint32_t location) {
+    if (op == OP_NEXT_ID) {
+        if (id > store->next_id) {
+            store->next_id = id;
+        }
+        return true;
+    }
+    if (op == OP_ADD) {
+        if (id < store->first_id || !index_reserve(store, id)) {
+            return false;
+        }
+        uint32_t *entry = &store->index[id - store->first_id];
+        if (*entry & ENTRY_LIVE) {
+            store->count--;
+            store->done -= *entry & ENTRY_DONE ? 1 : 0;
+        }
+        *entry = ENTRY_LIVE | location;
+        store->count++;
+        store->done += location & ENTRY_DONE ? 1 : 0;
+        if (id >= store->next_id) {
+            store->next_id = id + 1;
+        }
+        return true;
+    }
+
+    uint32_t *entry = index_entry(store, id);
+    if (!entry) {
+        return false;
+    }
+    switch (op) {
+        case OP_DONE:
+            if (!(*entry & ENTRY_DONE)) {
+                *entry |= ENTRY_DONE | ENTRY_CHANGED;
+                store->done++;
+            }
+            break;
+        case OP_UNDONE:
+            if (*entry & ENTRY_DONE) {
+                *entry = (*entry & ~ENTRY_DONE) | ENTRY_CHANGED;
+                store->done--;
+            }
+            break;
+        case OP_DELETE:
+            store->count--;
+            store->done -= *entry & ENTRY_DONE ? 1 : 0;
+            *entry = ENTRY_CHANGED;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// ===== FILES =====
+
+static void segment_close(struct todo_store *store) {
+    if (store->segment_open) {
+        lfs_file_close(store->lfs, &store->segment);
+        store->segment_open = false;
+    }
+}
+
+// The segment file, kept open since pages read from one segment at a time
+static lfs_file_t *segment_file(struct todo_store *store, uint32_t segment) {
+    if (store->segment_open && store->segment_number == segment) {
+        return &store->segment;
+    }
+    segment_close(store);
+    char path[PATH_MAX_LEN];
+    segment_path(store->dir, segment, path);
+    if (lfs_file_open(store->lfs, &store->segment, path, LFS_O_RDONLY) < 0) {
+        return NULL;
+    }
+    store->segment_open = true;
+    store->segment_number = segment;
+    return &store->segment;
+}
+
+static bool read_record(struct todo_store *store, uint32_t entry, uint32_t id, struct todo_item *item) {
+    bool journal = (entry & ENTRY_JOURNAL) != 0;
+    lfs_file_t *file = journal ? &store->journal : segment_file(store, id / TODO_SEGMENT_IDS);
+    uint8_t record[RECORD_MAX];
+    if (!file || lfs_file_seek(store->lfs, file, entry & ENTRY_OFFSET, LFS_SEEK_SET) < 0) {
+        return false;
+    }
+    size_t header = journal ? RECORD_HEADER : SEGMENT_HEADER;
+    lfs_ssize_t n = lfs_file_read(store->lfs, file, record, header + TODO_TEXT_MAX - 1);
+    size_t len = journal ? record[1] : record[0] & ~SEGMENT_DONE;
+    if (n < (lfs_ssize_t)(header + len) || len >= TODO_TEXT_MAX) {
+        return false;
+    }
+    item->id = id;
+    item->done = (entry & ENTRY_DONE) != 0;
+    memcpy(item->text, record + header, len);
+    item->text[len] = '\0';
+    return true;
+}
+
+static bool load_segment(struct todo_store *store, uint32_t segment) {
+    lfs_t *lfs = store->lfs;
+    lfs_file_t *file = segment_file(store, segment);
+    if (!file) {
+        return false;
+    }
+    lfs_soff_t size = lfs_file_size(lfs, file);
+    uint32_t offset = 0;
+    uint8_t record[SEGMENT_HEADER];
+    while (offset + SEGMENT_HEADER <= (uint32_t)size) {
+        if (lfs_file_read(lfs, file, record, SEGMENT_HEADER) != SEGMENT_HEADER) {
+            return false;
+        }
+        uint32_t id = segment * TODO_SEGMENT_IDS + (record[1] | record[2] << 8);
+        uint32_t done = record[0] & SEGMENT_DONE ? ENTRY_DONE : 0;
+        if (!index_apply(store, OP_ADD, id, done | offset)) {
+            return false;
+        }
+        offset += SEGMENT_HEADER + (record[0] & ~SEGMENT_DONE);
+        lfs_file_seek(lfs, file, offset, LFS_SEEK_SET);
+    }
+    store->snapshot_size += (uint32_t)size;
+    return true;
+}
+
+// Segment numbers in the store's directory, sorted; -1 if there are more
+// than a full table's worth
+static int list_segments(struct todo_store *store, uint32_t *segments) {
+    lfs_dir_t dir;
+    struct lfs_info info;
+    int count = 0;
+    if (lfs_dir_open(store->lfs, &dir, store->dir) < 0) {
+        return -1;
+    }
+    while (lfs_dir_read(store->lfs, &dir, &info) > 0) {
+        char *end;
+        if (info.type != LFS_TYPE_REG || strncmp(info.name, "seg", 3) != 0 || !isdigit((unsigned char)info.name[3])) {
+            continue;
+        }
+        uint32_t segment = strtoul(info.name + 3, &end, 10);
+        if (*end != '\0') {
+            continue;
+        }
+        if (count == SEGMENTS_MAX) {
+            count = -1;
+            break;
+        }
+        int i = count++;
+        for (; i > 0 && segments[i - 1] > segment; i--) {
+            segments[i] = segments[i - 1];
+        }
+        segments[i] = segment;
+    }
+    lfs_dir_close(store->lfs, &dir);
+    return count;
+}
+
+// Truncating leaves the position where it was, and a write past the end
+// would pad the gap with zeros
+static int journal_truncate(struct todo_store *store, uint32_t size) {
+    int err = lfs_file_truncate(store->lfs, &store->journal, size);
+    if (err == 0) {
+        err = (int)lfs_file_seek(store->lfs, &store->journal, size, LFS_SEEK_SET);
+    }
+    return err < 0 ? err : 0;
+}
+
+// Replays records up to the first one that is torn or corrupt and cuts
+// the journal there
+static bool replay_journal(struct todo_store *store) {
+    lfs_t *lfs = store->lfs;
+    lfs_soff_t size = lfs_file_size(lfs, &store->journal);
+    if (size < 0) {
+        return false;
+    }
+    uint32_t offset = 0;
+    uint8_t record[RECORD_MAX];
+    lfs_file_seek(lfs, &store->journal, 0, LFS_SEEK_SET);
+    while (offset + RECORD_HEADER <= (uint32_t)size) {
+        if (lfs_file_read(lfs, &store->journal, record, RECORD_HEADER) != RECORD_HEADER) {
+            break;
+        }
+        uint8_t len = record[1];
+        if (record[0] < OP_ADD || record[0] > OP_NEXT_ID || len >= TODO_TEXT_MAX ||
+            offset + RECORD_HEADER + len > (uint32_t)size ||
+            lfs_file_read(lfs, &store->journal, record + RECORD_HEADER, len) != len ||
+            record_check(record, RECORD_HEADER + len) != (record[2] | record[3] << 8)) {
+            break;
+        }
+        index_apply(store, record[0], get32(record + 4), ENTRY_JOURNAL | offset);
+        offset += RECORD_HEADER + len;
+    }
+
+    store->journal_size = offset;
+    if (offset < (uint32_t)size) {
+        store->dropped = (uint32_t)size - offset;
+        if (journal_truncate(store, offset) < 0 || lfs_file_sync(lfs, &store->journal) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool journal_append(struct todo_store *store, uint8_t op, uint32_t id,
+                           const char *text, size_t len, uint32_t *location) {
+    uint8_t record[RECORD_MAX];
+    size_t size = record_build(record, op, id, text, len);
+    if (lfs_file_write(store->lfs, &store->journal, record, size) != (lfs_ssize_t)size) {
+        // Whatever part did land is cut off again, or at the next open
+        journal_truncate(store, store->journal_size);
+        return false;
+    }
+    *location = ENTRY_JOURNAL | store->journal_size;
+    store->journal_size += size;
+    store->dirty = true;
+    return true;
+}
+
+static void close_files(struct todo_store *store) {
+    segment_close(store);
+    if (store->open) {
+        lfs_file_close(store->lfs, &store->journal);
+        store->open = false;
+    }
+    free(store->index);
+    store->index = NULL;
+    store->capacity = 0;
+}
+
+// After a failed compaction the table may point into a discarded file
+static bool reload(struct todo_store *store) {
+    lfs_t *lfs = store->lfs;
+    char dir[TODO_DIR_MAX];
+    strcpy(dir, store->dir);
+    uint32_t compactions = store->compactions;
+    close_files(store);
+    bool ok = todo_store_open(store, lfs, dir);
+    store->compactions = compactions;
+    return ok;
+}
+
+// Writes the segment's live items to a new file and renames it over the
+// old one (or removes the old one if none are left). Entries point at
+// the new file as their text is copied; if anything fails, the caller
+// reloads the table from the files.
+static bool compact_segment(struct todo_store *store, uint32_t segment) {
+    lfs_t *lfs = store->lfs;
+    char tmp_path[PATH_MAX_LEN];
+    char path[PATH_MAX_LEN];
+    store_path(store->dir, "seg.tmp", tmp_path);
+    segment_path(store->dir, segment, path);
+
+    uint32_t start = segment * TODO_SEGMENT_IDS;
+    uint32_t end = start + TODO_SEGMENT_IDS;
+    if (start < store->first_id) {
+        start = store->first_id;
+    }
+    if (end > index_end(store)) {
+        end = index_end(store);
+    }
+
+    lfs_file_t out;
+    if (lfs_file_open(lfs, &out, tmp_path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) < 0) {
+        return false;
+    }
+    bool ok = true;
+    uint32_t offset = 0;
+    uint8_t record[SEGMENT_HEADER + TODO_TEXT_MAX - 1];
+    struct todo_item item;
+    for (uint32_t id = start; ok && id < end; id++) {
+        uint32_t *entry = &store->index[id - store->first_id];
+        if (!(*entry & ENTRY_LIVE)) {
+            *entry = 0;
+            continue;
+        }
+        ok = read_record(store, *entry, id, &item);
+        if (ok) {
+            size_t len = strlen(item.text);
+            uint32_t slot = id - segment * TODO_SEGMENT_IDS;
+            record[0] = (uint8_t)len | (item.done ? SEGMENT_DONE : 0);
+            record[1] = (uint8_t)slot;
+            record[2] = (uint8_t)(slot >> 8);
+            memcpy(record + SEGMENT_HEADER, item.text, len);
+            ok = lfs_file_write(lfs, &out, record, SEGMENT_HEADER + len) == (lfs_ssize_t)(SEGMENT_HEADER + len);
+            *entry = ENTRY_LIVE | (*entry & ENTRY_DONE) | offset;
+            offset += SEGMENT_HEADER + len;
+        }
+    }
+    ok = lfs_file_close(lfs, &out) == 0 && ok;
+    if (!ok) {
+        return false;
+    }
+
+    if (store->segment_open && store->segment_number == segment) {
+        segment_close(store);
+    }
+    struct lfs_info info;
+    if (lfs_stat(lfs, path, &info) == 0) {
+        store->snapshot_size -= info.size;
+    }
+    if (offset == 0) {
+        lfs_remove(lfs, tmp_path);
+        int err = lfs_remove(lfs, path);
+        return err == 0 || err == LFS_ERR_NOENT;
+    }
+    store->snapshot_size += offset;
+    return lfs_rename(lfs, tmp_path, path) == 0;
+}
+
+// ===== API =====
+
+bool todo_store_open(struct todo_store *store, lfs_t *lfs, const char *dir) {
+    char path[PATH_MAX_LEN];
+    memset(store, 0, sizeof(*store));
+    store->lfs = lfs;
+    strncpy(store->dir, dir, TODO_DIR_MAX - 1);
+    store->first_id = 1;
+    store->next_id = 1;
+
+    int err = lfs_mkdir(lfs, dir);
+    if (err < 0 && err != LFS_ERR_EXIST) {
+        return false;
+    }
+    store_path(dir, "seg.tmp", path);
+    lfs_remove(lfs, path);          // Left by a compaction that did not finish
+
+    uint32_t segments[SEGMENTS_MAX];
+    int count = list_segments(store, segments);
+    if (count < 0) {
+        return false;
+    }
+    if (count > 0 && segments[0] > 0) {
+        store->first_id = segments[0] * TODO_SEGMENT_IDS;
+        store->next_id = store->first_id;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!load_segment(store, segments[i])) {
+            close_files(store);
+            return false;
+        }
+    }
+
+    store_path(dir, "journal", path);
+    if (lfs_file_open(lfs, &store->journal, path, LFS_O_RDWR | LFS_O_CREAT | LFS_O_APPEND) < 0) {
+        close_files(store);
+        return false;
+    }
+    store->open = true;
+    if (!replay_journal(store)) {
+        close_files(store);
+        return false;
+    }
+    return true;
+}
+
+void todo_store_close(struct todo_store *store) {
+    if (!store->open) {
+        return;
+    }
+    todo_store_commit(store);
+    close_files(store);
+}
+
+uint32_t todo_store_add(struct todo_store *store, const char *text) {
+    size_t len = strlen(text);
+    if (!store->open || len == 0) {
+        return 0;
+    }
+    if (len > TODO_TEXT_MAX - 1) {
+        len = TODO_TEXT_MAX - 1;
+    }
+    uint32_t id = store->next_id;
+    uint32_t location;
+    if (!index_reserve(store, id) || !journal_append(store, OP_ADD, id, text, len, &location)) {
+        return 0;
+    }
+    index_apply(store, OP_ADD, id, location);
+    return id;
+}
+
+bool todo_store_set_done(struct todo_store *store, uint32_t id, bool done) {
+    uint32_t location;
+    uint8_t op = done ? OP_DONE : OP_UNDONE;
+    if (!store->open || !index_entry(store, id) || !journal_append(store, op, id, "", 0, &location)) {
+        return false;
+    }
+    return index_apply(store, op, id, 0);
+}
+
+bool todo_store_delete(struct todo_store *store, uint32_t id) {
+    uint32_t location;
+    if (!store->open || !index_entry(store, id) || !journal_append(store, OP_DELETE, id, "", 0, &location)) {
+        return false;
+    }
+    return index_apply(store, OP_DELETE, id, 0);
+}
+
+bool todo_store_get(struct todo_store *store, uint32_t id, struct todo_item *item) {
+    uint32_t *entry = store->open ? index_entry(store, id) : NULL;
+    return entry && read_record(store, *entry, id, item);
+}
+
+int todo_store_list(struct todo_store *store, uint32_t from_id, struct todo_item *items, int max) {
+    int n = 0;
+    if (!store->open) {
+        return 0;
+    }
+    uint32_t end = index_end(store);
+    for (uint32_t id = from_id > store->first_id ? from_id : store->first_id; id < end && n < max; id++) {
+        uint32_t entry = store->index[id - store->first_id];
+        if ((entry & ENTRY_LIVE) && read_record(store, entry, id, &items[n])) {
+            n++;
+        }
+    }
+    return n;
+}
+
+bool todo_store_commit(struct todo_store *store) {
+    if (!store->open) {
+        return false;
+    }
+    if (store->dirty) {
+        if (lfs_file_sync(store->lfs, &store->journal) < 0) {
+            return false;
+        }
+        store->dirty = false;
+    }
+    uint32_t threshold = store->snapshot_size / 2;
+    if (threshold < TODO_COMPACT_MIN_BYTES) {
+        threshold = TODO_COMPACT_MIN_BYTES;
+    }
+    return store->journal_size <= threshold || todo_store_compact(store);
+}
+
+bool todo_store_compact(struct todo_store *store) {
+    if (!store->open) {
+        return false;
+    }
+    // A segment needs writing if it has items still in the journal or
+    // entries changed since it was written
+    bool ok = true;
+    uint32_t end = index_end(store);
+    for (uint32_t segment = store->first_id / TODO_SEGMENT_IDS;
+         ok && segment * TODO_SEGMENT_IDS < end; segment++) {
+        uint32_t start = segment * TODO_SEGMENT_IDS;
+        uint32_t id = start > store->first_id ? start : store->first_id;
+        uint32_t stop = start + TODO_SEGMENT_IDS < end ? start + TODO_SEGMENT_IDS : end;
+        while (id < stop && !(store->index[id - store->first_id] & (ENTRY_JOURNAL | ENTRY_CHANGED))) {
+            id++;
+        }
+        if (id < stop) {
+            ok = compact_segment(store, segment);
+        }
+    }
+
+    // Every change is in a segment now. The journal starts over with the
+    // next ID, so IDs of items deleted since stay used.
+    uint32_t location;
+    ok = ok && journal_truncate(store, 0) == 0;
+    if (ok) {
+        store->journal_size = 0;
+        ok = journal_append(store, OP_NEXT_ID, store->next_id, "", 0, &location) &&
+             lfs_file_sync(store->lfs, &store->journal) == 0;
+        store->dirty = false;
+    }
+    if (!ok) {
+        char tmp_path[PATH_MAX_LEN];
+        store_path(store->dir, "seg.tmp", tmp_path);
+        lfs_remove(store->lfs, tmp_path);
+        reload(store);
+        return false;
+    }
+    store->compactions++;
+    return true;
+}
+
+void todo_store_remove(lfs_t *lfs, const char *dir) {
+    // Removing entries while reading the directory is not supported, so
+    // look again after each one
+    char path[TODO_DIR_MAX + LFS_NAME_MAX + 2];
+    lfs_dir_t d;
+    struct lfs_info info;
+    bool found = true;
+    while (found && lfs_dir_open(lfs, &d, dir) == 0) {
+        found = false;
+        while (lfs_dir_read(lfs, &d, &info) > 0) {
+            if (info.type == LFS_TYPE_REG) {
+                snprintf(path, sizeof(path), "%s/%s", dir, info.name);
+                found = true;
+                break;
+            }
+        }
+        lfs_dir_close(lfs, &d);
+        if (found) {
+            lfs_remove(lfs, path);
+        }
+    }
+    lfs_remove(lfs, dir);
+}
+
+// ===== BENCHMARK =====
+
+#ifdef TODO_STORE_HOST_BENCH
+#include <time.h>
+
+static uint64_t bench_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#else
+#include "pico/time.h"
+
+static uint64_t bench_now_us() {
+    return time_us_64();
+}
+#endif
+
+struct bench_acc {
+    uint64_t total_us;
+    uint32_t count;
+    uint32_t max_us;
+};
+
+static void bench_time(struct bench_acc *acc, uint64_t start) {
+    uint32_t us = (uint32_t)(bench_now_us() - start);
+    acc->total_us += us;
+    acc->count++;
+    if (us > acc->max_us) {
+        acc->max_us = us;
+    }
+}
+
+static void bench_stat(const struct bench_acc *acc, struct todo_bench_stat *stat) {
+    stat->count = acc->count;
+    stat->avg_us = acc->count ? (uint32_t)(acc->total_us / acc->count) : 0;
+    stat->max_us = acc->max_us;
+}
+
+static uint32_t bench_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+void todo_store_bench(lfs_t *lfs, const char *dir, uint32_t items, struct todo_bench_result *result) {
+    memset(result, 0, sizeof(*result));
+    struct todo_store *store = (struct todo_store*)malloc(sizeof(struct todo_store));
+    struct todo_item *page = (struct todo_item*)malloc(TODO_PAGE_SIZE * sizeof(struct todo_item));
+    if (!store || !page) {
+        free(store);
+        free(page);
+        return;
+    }
+    todo_store_remove(lfs, dir);
+    if (!todo_store_open(store, lfs, dir)) {
+        free(store);
+        free(page);
+        return;
+    }
+
+    struct bench_acc add = {}, commit = {}, add_commit = {}, list = {}, done = {};
+    char text[TODO_TEXT_MAX];
+    uint32_t seed = 0x2545F491;
+    uint64_t start;
+    bool ok = true;
+
+    for (uint32_t i = 1; ok && i <= items; i++) {
+        snprintf(text, sizeof(text), "Benchmark task %lu", (unsigned long)i);
+        start = bench_now_us();
+        ok = todo_store_add(store, text) != 0;
+        bench_time(&add, start);
+        if (ok && i % TODO_BENCH_BATCH == 0) {
+            start = bench_now_us();
+            ok = todo_store_commit(store);
+            bench_time(&commit, start);
+        }
+    }
+    ok = ok && todo_store_commit(store);
+    result->items = store->count;
+
+    // On the full store, one change at a time as the front-ends make them
+    for (int i = 0; ok && i < TODO_BENCH_SAMPLES; i++) {
+        snprintf(text, sizeof(text), "Sample task %d", i);
+        start = bench_now_us();
+        ok = todo_store_add(store, text) != 0 && todo_store_commit(store);
+        bench_time(&add_commit, start);
+    }
+    for (int i = 0; ok && i < TODO_BENCH_SAMPLES; i++) {
+        uint32_t from = store->first_id + bench_random(&seed) % (store->next_id - store->first_id);
+        start = bench_now_us();
+        todo_store_list(store, from, page, TODO_PAGE_SIZE);
+        bench_time(&list, start);
+    }
+    for (int i = 0; ok && i < TODO_BENCH_SAMPLES; i++) {
+        uint32_t id = store->first_id + bench_random(&seed) % (store->next_id - store->first_id);
+        struct todo_item *item = &page[0];
+        start = bench_now_us();
+        ok = todo_store_get(store, id, item) &&
+             todo_store_set_done(store, id, !item->done) && todo_store_commit(store);
+        bench_time(&done, start);
+    }
+
+    result->compactions = store->compactions;
+    todo_store_close(store);
+    if (ok) {
+        start = bench_now_us();
+        ok = todo_store_open(store, lfs, dir);
+        result->open_us = (uint32_t)(bench_now_us() - start);
+    }
+    if (ok) {
+        start = bench_now_us();
+        ok = todo_store_compact(store);
+        result->compact_us = (uint32_t)(bench_now_us() - start);
+        result->compactions++;
+        result->flash_bytes = store->snapshot_size + store->journal_size;
+        result->ram_bytes = store->capacity * sizeof(uint32_t);
+        todo_store_close(store);
+    }
+
+    bench_stat(&add, &result->add);
+    bench_stat(&commit, &result->commit);
+    bench_stat(&add_commit, &result->add_commit);
+    bench_stat(&list, &result->list);
+    bench_stat(&done, &result->done);
+    result->ok = ok;
+    todo_store_remove(lfs, dir);
+    free(store);
+    free(page);
+}
+
+#ifdef TODO_STORE_HOST_BENCH
+#include "bd/lfs_rambd.h"
+
+// Same geometry as the device filesystem (pico_os.h, flash_fs.h)
+#define HOST_BLOCK_SIZE 4096
+#define HOST_BLOCK_COUNT 128
+
+static void print_stat(const char *name, const struct todo_bench_stat *stat) {
+    printf("%-11s %6lu x  avg %7lu us  max %7lu us\n", name, (unsigned long)stat->count,
+           (unsigned long)stat->avg_us, (unsigned long)stat->max_us);
+}
+
+int main(int argc, char **argv) {
+    uint32_t items = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+
+    static lfs_rambd_t bd;
+    struct lfs_rambd_config bd_cfg = {};
+    bd_cfg.read_size = 1;
+    bd_cfg.prog_size = 256;
+    bd_cfg.erase_size = HOST_BLOCK_SIZE;
+    bd_cfg.erase_count = HOST_BLOCK_COUNT;
+
+    struct lfs_config cfg = {};
+    cfg.context = &bd;
+    cfg.read = lfs_rambd_read;
+    cfg.prog = lfs_rambd_prog;
+    cfg.erase = lfs_rambd_erase;
+    cfg.sync = lfs_rambd_sync;
+    cfg.read_size = 1;
+    cfg.prog_size = 256;
+    cfg.block_size = HOST_BLOCK_SIZE;
+    cfg.block_count = HOST_BLOCK_COUNT;
+    cfg.cache_size = 256;
+    cfg.lookahead_size = 128;
+    cfg.block_cycles = 500;
+
+    lfs_t lfs;
+    if (lfs_rambd_create(&cfg, &bd_cfg) || lfs_format(&lfs, &cfg) || lfs_mount(&lfs, &cfg)) {
+        printf("RAM filesystem failed\n");
+        return 1;
+    }
+
+    struct todo_bench_result r;
+    todo_store_bench(&lfs, "/todo-bench", items, &r);
+    printf("items=%lu compactions=%lu flash=%lu bytes ram=%lu bytes%s\n",
+           (unsigned long)r.items, (unsigned long)r.compactions, (unsigned long)r.flash_bytes,
+           (unsigned long)r.ram_bytes, r.ok ? "" : " (FAILED)");
+    print_stat("add", &r.add);
+    print_stat("commit", &r.commit);
+    print_stat("add+commit", &r.add_commit);
+    print_stat("list page", &r.list);
+    print_stat("done", &r.done);
+    printf("open %lu us, compact %lu us\n", (unsigned long)r.open_us, (unsigned long)r.compact_us);
+
+    lfs_unmount(&lfs);
+    lfs_rambd_destroy(&cfg);
+    return r.ok ? 0 : 1;
+}
+#endif
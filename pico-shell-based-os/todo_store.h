@@ -0,0 +1,145 @@
+/**
+ * To-do store - persistent to-do items on LittleFS, thousands of them
+ *
+ * A store is a directory. The snapshot is split into segment files,
+ * "seg<N>" holding the items with IDs from N * TODO_SEGMENT_IDS up to the
+ * next segment as of the last compaction. "journal" is an append-only log
+ * of the changes since then (add, done, undone, delete), so a change costs
+ * one record of a few bytes instead of rewriting the list. Changes are
+ * buffered by LittleFS until todo_store_commit() syncs the journal, which
+ * front-ends do after each command. Journal records carry a checksum:
+ * opening a store replays the journal up to the first torn or corrupt
+ * record and cuts it off there, so a reset loses at most the uncommitted
+ * changes.
+ *
+ * Once the journal grows past both TODO_COMPACT_MIN_BYTES and half the
+ * snapshot, commit rewrites the segments the journal touched. Each one is
+ * written to a temporary file and renamed over the old one (atomic in
+ * LittleFS), and then the journal is emptied. Replaying a record a segment
+ * already has changes nothing, so a reset part way through is harmless.
+ * Adding items only ever rewrites the newest segment, compaction needs
+ * free space for one segment rather than a second copy of the list, and
+ * waiting for the journal to reach half the snapshot keeps the cost per
+ * change constant however many items there are.
+ *
+ * Item text stays in flash. RAM holds one 32-bit word per ID, from the
+ * oldest live ID up: live and done bits and where the item's record is.
+ * Done and delete by ID are a table lookup plus one journal record, and
+ * listing walks the table from a cursor ID, reading only the text of the
+ * items on the page. IDs count up from 1 and are never reused.
+ *
+ * One caller at a time per store. The filesystem itself may be shared if
+ * LittleFS is built thread-safe.
+ *
+ * todo_store_bench() fills a scratch store and times add, commit, paged
+ * listing, done, reopen and compaction. With TODO_STORE_HOST_BENCH defined,
+ * todo_store.cpp builds it for the host on LittleFS's RAM block device
+ * (LittleFS and CPU cost only, no flash timing):
+ *
+ *     cc -O2 -c -Ilittlefs littlefs/lfs.c littlefs/lfs_util.c littlefs/bd/lfs_rambd.c
+ *     c++ -O2 -DTODO_STORE_HOST_BENCH -Ilittlefs todo_store.cpp lfs.o lfs_util.o lfs_rambd.o -o todo_bench
+ *     ./todo_bench [items]
+ */
+
+#ifndef TODO_STORE_H
+#define TODO_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lfs.h"
+
+#define TODO_TEXT_MAX 100                   // Including the terminator
+#define TODO_STORE_MAX_IDS 16384            // ID range held in RAM, 4 bytes each
+#define TODO_COMPACT_MIN_BYTES (16 * 1024)  // Journal size before compaction is considered
+#define TODO_SEGMENT_IDS 1024               // IDs per snapshot segment file
+#define TODO_PAGE_SIZE 20                   // Items per page for the front-ends
+#define TODO_DIR_MAX 32
+
+struct todo_item {
+    uint32_t id;
+    bool done;
+    char text[TODO_TEXT_MAX];
+};
+
+struct todo_store {
+    lfs_t *lfs;
+    char dir[TODO_DIR_MAX];
+    lfs_file_t journal;
+    lfs_file_t segment;             // Last segment read from, kept open
+    uint32_t segment_number;
+    bool segment_open;
+    bool open;
+    bool dirty;                     // Journal written since the last commit
+
+    uint32_t *index;                // index[id - first_id]
+    uint32_t capacity;
+    uint32_t first_id;
+    uint32_t next_id;
+
+    uint32_t count;                 // Live items
+    uint32_t done;
+    uint32_t snapshot_size;         // All segments
+    uint32_t journal_size;
+    uint32_t compactions;
+    uint32_t dropped;               // Bad journal bytes cut off when opened
+};
+
+// Load the store in dir, creating it if needed. False if the directory
+// cannot be created or read, or there is no memory for the index.
+bool todo_store_open(struct todo_store *store, lfs_t *lfs, const char *dir);
+
+// Commits, then frees the index
+void todo_store_close(struct todo_store *store);
+
+// Returns the new item's ID, 0 if the text is empty, the ID range is full
+// or the journal write failed. Text is cut at TODO_TEXT_MAX - 1 bytes.
+uint32_t todo_store_add(struct todo_store *store, const char *text);
+
+// False if there is no such item or the journal write failed
+bool todo_store_set_done(struct todo_store *store, uint32_t id, bool done);
+bool todo_store_delete(struct todo_store *store, uint32_t id);
+bool todo_store_get(struct todo_store *store, uint32_t id, struct todo_item *item);
+
+// Up to max items with ID >= from_id, in ID order; returns how many. The
+// next page starts at the last item's ID + 1.
+int todo_store_list(struct todo_store *store, uint32_t from_id, struct todo_item *items, int max);
+
+// Make the changes so far durable, compacting if the journal is due
+bool todo_store_commit(struct todo_store *store);
+
+// Rewrite the segments the journal touched now and empty it
+bool todo_store_compact(struct todo_store *store);
+
+// Delete a closed store's files and directory
+void todo_store_remove(lfs_t *lfs, const char *dir);
+
+// ===== BENCHMARK =====
+
+struct todo_bench_stat {
+    uint32_t count;
+    uint32_t avg_us;
+    uint32_t max_us;
+};
+
+struct todo_bench_result {
+    uint32_t items;                 // Items in the store when measured
+    struct todo_bench_stat add;     // Journal append, not yet synced
+    struct todo_bench_stat commit;  // While filling: one per TODO_BENCH_BATCH adds, compactions included
+    struct todo_bench_stat add_commit;  // Add plus its commit on the full store, as a front-end does it
+    struct todo_bench_stat list;    // One page of TODO_PAGE_SIZE from a random cursor
+    struct todo_bench_stat done;    // Toggle plus commit
+    uint32_t open_us;               // Reopen the full store: snapshot and journal replay
+    uint32_t compact_us;
+    uint32_t compactions;
+    uint32_t flash_bytes;           // Segments and journal after the final compaction
+    uint32_t ram_bytes;             // ID index
+    bool ok;                        // False if the store ran out of space or memory
+};
+
+#define TODO_BENCH_BATCH 16
+#define TODO_BENCH_SAMPLES 100
+
+// Fill a scratch store in dir with items items, measure, then remove it
+void todo_store_bench(lfs_t *lfs, const char *dir, uint32_t items, struct todo_bench_result *result);
+
+#endif // TODO_STORE_H
@@ -0,0 +1,487 @@
+/**
+ * WiFi connection manager - see wifi_manager.h
+ *
+ * Everything here runs in lwIP context: the public calls take the lwIP
+ * lock, and the netif callbacks and the tick are already inside it. The
+ * callbacks fire from within the driver's event processing, so they only
+ * record what happened and schedule the tick; driver calls (join, leave,
+ * ioctls) are made from the tick.
+ */
+
+#include "wifi_manager.h"
+#include "fs_worker.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/netif.h"
+#include "lwip/dhcp.h"
+#include "lwip/timeouts.h"
+
+#define WIFI_CACHE_MAGIC 0x31434657     // "WFC1"
+#define WIFI_CACHE_TMP WIFI_CACHE_FILE ".tmp"
+
+// Last good join, as saved in WIFI_CACHE_FILE (raw, read back by the same
+// firmware; the magic changes with the layout)
+struct wifi_cache {
+    uint32_t magic;
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t auth;
+    uint32_t ip;                // DHCP lease, network byte order
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t lease_s;
+};
+
+struct join_attempt {
+    uint32_t auth;
+    bool fast;                  // Cached BSSID and channel, no scan
+};
+
+// Probed in this order when nothing is cached
+static const uint32_t auth_modes[] = {
+    CYW43_AUTH_WPA2_AES_PSK, CYW43_AUTH_WPA2_MIXED_PSK, CYW43_AUTH_WPA_TKIP_PSK
+};
+#define WIFI_AUTH_MODES (sizeof(auth_modes) / sizeof(auth_modes[0]))
+
+static struct wifi_status status;        // Zeroed: WIFI_OFF until init
+static wifi_event_fn event_fn = NULL;
+static void *event_arg = NULL;
+static struct netif *sta_netif = NULL;
+static char password[64];
+
+static struct join_attempt plan[1 + WIFI_AUTH_MODES];
+static int plan_len = 0;
+static int plan_index = 0;
+static uint64_t deadline_us = 0;        // Current attempt, DHCP wait or backoff
+static uint64_t connect_start_us = 0;
+
+static struct wifi_cache cache;
+static struct fs_job save_job;
+static struct wifi_cache save_record;   // Owned by save_job while it is queued
+static bool save_busy = false;
+static bool save_again = false;
+
+static void wifi_tick(void *arg);
+
+static void wifi_schedule(uint32_t ms) {
+    sys_untimeout(wifi_tick, NULL);
+    sys_timeout(ms, wifi_tick, NULL);
+}
+
+static void wifi_notify(enum wifi_event event) {
+    if (event_fn) {
+        event_fn(event, event_arg);
+    }
+}
+
+static bool wifi_has_address() {
+    return !ip4_addr_isany_val(*netif_ip4_addr(sta_netif));
+}
+
+static bool wifi_cache_matches() {
+    return cache.magic == WIFI_CACHE_MAGIC && strcmp(cache.ssid, status.ssid) == 0;
+}
+
+// ===== CACHE =====
+
+// Runs on core 1 (FS_OP_CALL): write the record and rename it into place
+static void wifi_cache_write(struct fs_job *job) {
+    memset(&job->file_cfg, 0, sizeof(job->file_cfg));
+    job->file_cfg.buffer = job->file_cache;
+    job->result = lfs_file_opencfg(&lfs, &job->file, job->path,
+                                   LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC, &job->file_cfg);
+    if (job->result < 0) {
+        return;
+    }
+    lfs_ssize_t written = lfs_file_write(&lfs, &job->file, job->buf, job->len);
+    job->result = lfs_file_close(&lfs, &job->file);
+    if (written != (lfs_ssize_t)job->len) {
+        job->result = written < 0 ? (int)written : LFS_ERR_NOSPC;
+    }
+    if (job->result >= 0) {
+        job->result = lfs_rename(&lfs, job->path, job->dest_path);
+    }
+    if (job->result < 0) {
+        lfs_remove(&lfs, job->path);
+    }
+}
+
+static void wifi_cache_save();
+
+static void wifi_cache_saved(struct fs_job *job) {
+    save_busy = false;
+    if (job->op == FS_OP_CALL && job->result < 0) {
+        log_message("WiFi: failed to save AP cache");
+    }
+    if (cache.magic != WIFI_CACHE_MAGIC && job->op == FS_OP_CALL) {
+        // Forgotten while the write was queued; remove what it wrote
+        save_job.op = FS_OP_ABORT;
+        strcpy(save_job.path, WIFI_CACHE_FILE);
+        save_busy = fs_worker_submit(&save_job);
+        return;
+    }
+    if (save_again) {
+        save_again = false;
+        wifi_cache_save();
+    }
+}
+
+static void wifi_cache_save() {
+    if (save_busy) {
+        save_again = true;
+        return;
+    }
+    save_record = cache;
+    save_job.op = FS_OP_CALL;
+    strcpy(save_job.path, WIFI_CACHE_TMP);
+    strcpy(save_job.dest_path, WIFI_CACHE_FILE);
+    save_job.buf = (uint8_t*)&save_record;
+    save_job.len = sizeof(save_record);
+    save_job.call = wifi_cache_write;
+    save_job.done = wifi_cache_saved;
+    save_busy = fs_worker_submit(&save_job);
+}
+
+// Record the current join and lease; written only if something changed
+static void wifi_cache_update() {
+    struct wifi_cache fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = WIFI_CACHE_MAGIC;
+    strcpy(fresh.ssid, status.ssid);
+    memcpy(fresh.bssid, status.bssid, sizeof(fresh.bssid));
+    fresh.channel = status.channel;
+    fresh.auth = status.auth;
+    fresh.ip = ip4_addr_get_u32(netif_ip4_addr(sta_netif));
+    fresh.netmask = ip4_addr_get_u32(netif_ip4_netmask(sta_netif));
+    fresh.gw = ip4_addr_get_u32(netif_ip4_gw(sta_netif));
+    struct dhcp *dhcp = netif_dhcp_data(sta_netif);
+    fresh.lease_s = dhcp ? dhcp->offered_t0_lease : 0;
+    if (memcmp(&fresh, &cache, sizeof(fresh)) != 0) {
+        cache = fresh;
+        wifi_cache_save();
+    }
+}
+
+// ===== STATE MACHINE =====
+
+static uint8_t wifi_read_channel() {
+    uint8_t info[12] = {0};     // hw, target and scan channel, little endian
+    if (cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL, sizeof(info), info, CYW43_ITF_STA) != 0) {
+        return 0;
+    }
+    return info[0];
+}
+
+// Retry from the tick after ms (0 = as soon as possible)
+static void wifi_retry_in(uint32_t ms) {
+    status.state = WIFI_BACKOFF;
+    deadline_us = time_us_64() + (uint64_t)ms * 1000;
+    wifi_schedule(ms);
+}
+
+static void wifi_round_failed() {
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    status.failures++;
+    uint32_t backoff = WIFI_BACKOFF_MIN_MS;
+    for (uint32_t i = 1; i < status.failures && backoff < WIFI_BACKOFF_MAX_MS; i++) {
+        backoff *= 2;
+    }
+    if (backoff > WIFI_BACKOFF_MAX_MS) {
+        backoff = WIFI_BACKOFF_MAX_MS;
+    }
+    wifi_retry_in(backoff);
+    wifi_notify(WIFI_EVENT_RETRY);
+}
+
+static void wifi_start_attempt() {
+    if (plan_index >= plan_len) {
+        wifi_round_failed();
+        return;
+    }
+    const struct join_attempt *attempt = &plan[plan_index];
+    status.auth = attempt->auth;
+    status.fast = attempt->fast;
+    status.attempts++;
+
+    // Stop whatever the firmware is still trying (a timed-out attempt or
+    // its own reassociation after a drop)
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    size_t key_len = attempt->auth == CYW43_AUTH_OPEN ? 0 : strlen(password);
+    int err = cyw43_wifi_join(&cyw43_state, strlen(status.ssid), (const uint8_t*)status.ssid,
+                              key_len, (const uint8_t*)password, attempt->auth,
+                              attempt->fast ? cache.bssid : NULL,
+                              attempt->fast && cache.channel ? cache.channel : CYW43_CHANNEL_NONE);
+
+    status.state = WIFI_JOINING;
+    deadline_us = time_us_64() + (attempt->fast ? WIFI_FAST_JOIN_MS : WIFI_JOIN_MS) * 1000ULL;
+    if (err != 0) {
+        deadline_us = 0;        // Move on at the next tick
+    }
+    wifi_schedule(WIFI_TICK_MS);
+}
+
+static void wifi_start_round() {
+    plan_len = 0;
+    if (password[0] == '\0') {
+        plan[plan_len++] = { CYW43_AUTH_OPEN, false };
+    } else {
+        bool cached = wifi_cache_matches();
+        if (cached && cache.channel) {
+            plan[plan_len++] = { cache.auth, true };
+        }
+        // Scanned joins, the last good auth mode first
+        if (cached) {
+            plan[plan_len++] = { cache.auth, false };
+        }
+        for (size_t i = 0; i < WIFI_AUTH_MODES; i++) {
+            if (!cached || auth_modes[i] != cache.auth) {
+                plan[plan_len++] = { auth_modes[i], false };
+            }
+        }
+    }
+    plan_index = 0;
+    wifi_start_attempt();
+}
+
+static void wifi_up() {
+    uint64_t now = time_us_64();
+    status.state = WIFI_UP;
+    status.failures = 0;
+    status.connect_ms = (uint32_t)((now - connect_start_us) / 1000);
+    status.up_at_ms = (uint32_t)(now / 1000);
+    if (!status.provisional) {
+        wifi_cache_update();
+    }
+    wifi_schedule(WIFI_SUPERVISE_MS);
+    wifi_notify(WIFI_EVENT_UP);
+}
+
+// Associated: note where, and use the cached lease if DHCP has not
+// produced an address yet
+static void wifi_link_up() {
+    status.state = WIFI_ADDRESSING;
+    deadline_us = time_us_64() + WIFI_DHCP_MS * 1000ULL;
+    cyw43_wifi_get_bssid(&cyw43_state, status.bssid);
+    status.channel = wifi_read_channel();
+
+    status.provisional = false;
+    if (!wifi_has_address() && wifi_cache_matches() && cache.ip != 0) {
+        ip4_addr_t ip, netmask, gw;
+        ip4_addr_set_u32(&ip, cache.ip);
+        ip4_addr_set_u32(&netmask, cache.netmask);
+        ip4_addr_set_u32(&gw, cache.gw);
+        status.provisional = true;
+        netif_set_addr(sta_netif, &ip, &netmask, &gw);
+    }
+
+    if (wifi_has_address()) {
+        wifi_up();
+    } else {
+        wifi_schedule(WIFI_TICK_MS);
+    }
+}
+
+static void wifi_link_lost() {
+    bool was_up = status.state == WIFI_UP;
+    if (was_up) {
+        status.drops++;
+    }
+    status.provisional = false;
+    connect_start_us = time_us_64();
+    wifi_retry_in(0);       // Straight back in; backoff only after a failed round
+    if (was_up) {
+        wifi_notify(WIFI_EVENT_DOWN);
+    }
+}
+
+static void wifi_tick(void *arg) {
+    uint64_t now = time_us_64();
+    status.link_status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+
+    switch (status.state) {
+        case WIFI_JOINING:
+            if (status.link_status == CYW43_LINK_NOIP || status.link_status == CYW43_LINK_UP) {
+                wifi_link_up();
+            } else if (status.link_status < 0 || now >= deadline_us) {
+                plan_index++;
+                wifi_start_attempt();
+            } else {
+                wifi_schedule(WIFI_TICK_MS);
+            }
+            break;
+
+        case WIFI_ADDRESSING:
+            if (status.link_status != CYW43_LINK_NOIP && status.link_status != CYW43_LINK_UP) {
+                wifi_link_lost();
+            } else if (wifi_has_address()) {
+                wifi_up();
+            } else if (now >= deadline_us) {
+                wifi_round_failed();        // Associated but no DHCP server
+            } else {
+                wifi_schedule(WIFI_TICK_MS);
+            }
+            break;
+
+        case WIFI_UP:
+            if (status.link_status != CYW43_LINK_UP) {
+                wifi_link_lost();
+                break;
+            }
+            // DHCP confirming a provisional address does not change the
+            // netif, so it is only seen here; renewals may move the lease
+            if (dhcp_supplied_address(sta_netif)) {
+                status.provisional = false;
+                wifi_cache_update();
+            }
+            wifi_schedule(WIFI_SUPERVISE_MS);
+            break;
+
+        case WIFI_BACKOFF:
+            if (now >= deadline_us) {
+                wifi_start_round();
+            } else {
+                wifi_schedule((uint32_t)((deadline_us - now) / 1000) + 1);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Link and address changes, from inside the driver: hand over to the tick
+static void wifi_netif_link(struct netif *netif) {
+    if (netif_is_link_up(netif)) {
+        if (status.state == WIFI_JOINING) {
+            wifi_schedule(0);
+        }
+    } else if (status.state == WIFI_UP || status.state == WIFI_ADDRESSING) {
+        wifi_link_lost();
+    }
+}
+
+static void wifi_netif_status(struct netif *netif) {
+    if (status.state == WIFI_ADDRESSING || (status.state == WIFI_UP && dhcp_supplied_address(netif))) {
+        wifi_schedule(0);
+    }
+}
+
+// ===== PUBLIC API =====
+
+void wifi_manager_init(wifi_event_fn fn, void *arg) {
+    event_fn = fn;
+    event_arg = arg;
+
+    lfs_file_t file;
+    if (lfs_file_open(&lfs, &file, WIFI_CACHE_FILE, LFS_O_RDONLY) >= 0) {
+        struct wifi_cache loaded;
+        if (lfs_file_read(&lfs, &file, &loaded, sizeof(loaded)) == (lfs_ssize_t)sizeof(loaded) &&
+            loaded.magic == WIFI_CACHE_MAGIC) {
+            cache = loaded;
+        }
+        lfs_file_close(&lfs, &file);
+    }
+
+    cyw43_arch_lwip_begin();
+    sta_netif = &cyw43_state.netif[CYW43_ITF_STA];
+    netif_set_link_callback(sta_netif, wifi_netif_link);
+    netif_set_status_callback(sta_netif, wifi_netif_status);
+    status.state = WIFI_IDLE;
+    cyw43_arch_lwip_end();
+}
+
+bool wifi_manager_connect(const char *ssid, const char *pass) {
+    if (status.state == WIFI_OFF || !ssid || !ssid[0]) {
+        return false;
+    }
+    cyw43_arch_lwip_begin();
+    bool was_up = status.state == WIFI_UP;
+    strncpy(status.ssid, ssid, sizeof(status.ssid) - 1);
+    status.ssid[sizeof(status.ssid) - 1] = '\0';
+    strncpy(password, pass ? pass : "", sizeof(password) - 1);
+    password[sizeof(password) - 1] = '\0';
+    memset(status.bssid, 0, sizeof(status.bssid));
+    status.channel = 0;
+    status.provisional = false;
+    status.failures = 0;
+    connect_start_us = time_us_64();
+    wifi_retry_in(0);
+    if (was_up) {
+        wifi_notify(WIFI_EVENT_DOWN);
+    }
+    cyw43_arch_lwip_end();
+    return true;
+}
+
+void wifi_manager_disconnect() {
+    cyw43_arch_lwip_begin();
+    if (status.state != WIFI_OFF) {
+        bool was_up = status.state == WIFI_UP;
+        sys_untimeout(wifi_tick, NULL);
+        status.state = WIFI_IDLE;
+        cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+        if (was_up) {
+            wifi_notify(WIFI_EVENT_DOWN);
+        }
+    }
+    cyw43_arch_lwip_end();
+}
+
+void wifi_manager_reconnect() {
+    cyw43_arch_lwip_begin();
+    if (status.state != WIFI_OFF && status.ssid[0]) {
+        bool was_up = status.state == WIFI_UP;
+        status.failures = 0;
+        connect_start_us = time_us_64();
+        wifi_retry_in(0);
+        if (was_up) {
+            wifi_notify(WIFI_EVENT_DOWN);
+        }
+    }
+    cyw43_arch_lwip_end();
+}
+
+void wifi_manager_forget() {
+    cyw43_arch_lwip_begin();
+    memset(&cache, 0, sizeof(cache));
+    save_again = false;
+    cyw43_arch_lwip_end();
+    lfs_remove(&lfs, WIFI_CACHE_FILE);
+}
+
+enum wifi_state wifi_manager_state() {
+    return status.state;
+}
+
+void wifi_manager_get_status(struct wifi_status *out) {
+    cyw43_arch_lwip_begin();
+    *out = status;
+    out->cached = wifi_cache_matches();
+    uint64_t now = time_us_64();
+    out->retry_in_ms = status.state == WIFI_BACKOFF && deadline_us > now
+                       ? (uint32_t)((deadline_us - now) / 1000) : 0;
+    cyw43_arch_lwip_end();
+}
+
+const char *wifi_state_name(enum wifi_state state) {
+    switch (state) {
+        case WIFI_OFF: return "off";
+        case WIFI_IDLE: return "idle";
+        case WIFI_JOINING: return "joining";
+        case WIFI_ADDRESSING: return "waiting for DHCP";
+        case WIFI_UP: return "up";
+        case WIFI_BACKOFF: return "retrying";
+    }
+    return "?";
+}
+
+const char *wifi_auth_name(uint32_t auth) {
+    switch (auth) {
+        case CYW43_AUTH_OPEN: return "open";
+        case CYW43_AUTH_WPA_TKIP_PSK: return "WPA";
+        case CYW43_AUTH_WPA2_AES_PSK: return "WPA2";
+        case CYW43_AUTH_WPA2_MIXED_PSK: return "WPA2 mixed";
+        case CYW43_AUTH_WPA3_WPA2_AES_PSK: return "WPA3/WPA2";
+    }
+    return "?";
+}
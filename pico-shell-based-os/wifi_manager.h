@@ -0,0 +1,93 @@
+/**
+ * WiFi connection manager - non-blocking join, reconnect and fast rejoin
+ *
+ * A state machine in lwIP context replaces the blocking
+ * cyw43_arch_wifi_connect_timeout_ms() loop. Joins are started with
+ * cyw43_wifi_join() and followed from the netif link and status callbacks;
+ * a short tick only watches for join failures and timeouts, which the
+ * driver reports through its link status alone. When the link drops the
+ * manager rejoins straight away and then backs off exponentially.
+ *
+ * After a successful join the auth mode, BSSID, channel and DHCP lease are
+ * saved to LittleFS (via the core 1 filesystem worker). The next join to
+ * the same SSID goes to that BSSID on that channel, skipping the scan and
+ * the auth mode probing, and the cached lease is applied as soon as the
+ * link is up so the network is usable before DHCP has answered; DHCP keeps
+ * running and replaces it if the server hands out something else.
+ */
+
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WIFI_CACHE_FILE "wifi.net"
+
+#define WIFI_TICK_MS 100                // Join/DHCP supervision while connecting
+#define WIFI_SUPERVISE_MS 1000          // Link and lease check while up
+#define WIFI_FAST_JOIN_MS 5000          // Cached BSSID/channel attempt
+#define WIFI_JOIN_MS 10000              // Each scanned attempt
+#define WIFI_DHCP_MS 10000              // Link up but no address
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+
+enum wifi_state {
+    WIFI_OFF,               // Driver not available
+    WIFI_IDLE,              // Not configured or disconnected on request
+    WIFI_JOINING,           // Association and key handshake
+    WIFI_ADDRESSING,        // Link up, waiting for an address
+    WIFI_UP,
+    WIFI_BACKOFF            // Every attempt failed, waiting to retry
+};
+
+enum wifi_event {
+    WIFI_EVENT_UP,          // Link up with an address
+    WIFI_EVENT_DOWN,        // Link lost; reconnecting
+    WIFI_EVENT_RETRY        // A round of attempts failed; backing off
+};
+
+// Called in lwIP context; keep it short
+typedef void (*wifi_event_fn)(enum wifi_event event, void *arg);
+
+struct wifi_status {
+    enum wifi_state state;
+    char ssid[33];
+    uint32_t auth;                  // CYW43_AUTH_* of the current/last join
+    uint8_t bssid[6];
+    uint8_t channel;                // 0 if unknown
+    bool fast;                      // Joined from the cache
+    bool provisional;               // Address from the cache, DHCP not yet confirmed
+    bool cached;                    // Cache entry exists for this SSID
+    int link_status;                // Last CYW43_LINK_* seen
+    uint32_t connect_ms;            // Request or link loss to address, last time
+    uint32_t up_at_ms;              // Time since boot when it last came up
+    uint32_t retry_in_ms;           // WIFI_BACKOFF only
+    uint32_t attempts;              // Joins started
+    uint32_t failures;              // Consecutive failed rounds
+    uint32_t drops;                 // Link losses while up
+};
+
+// Call once after cyw43_arch_init() and the filesystem mount; loads the
+// cache. Callback may be NULL.
+void wifi_manager_init(wifi_event_fn fn, void *arg);
+
+// Start connecting to (or switch to) a network and keep it up. Returns
+// immediately; false if the driver is not available.
+bool wifi_manager_connect(const char *ssid, const char *password);
+
+// Drop the link and stop reconnecting
+void wifi_manager_disconnect();
+
+// Retry now, skipping any backoff
+void wifi_manager_reconnect();
+
+// Delete the cached AP and lease (e.g. when credentials are cleared)
+void wifi_manager_forget();
+
+enum wifi_state wifi_manager_state();
+void wifi_manager_get_status(struct wifi_status *status);
+const char *wifi_state_name(enum wifi_state state);
+const char *wifi_auth_name(uint32_t auth);
+
+#endif // WIFI_MANAGER_H
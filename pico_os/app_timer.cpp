@@ -0,0 +1,215 @@
+/**
+ * App timers - see app_timer.h
+ */
+
+#include "app_timer.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+
+static struct app_timer *heap[APP_TIMER_MAX];   // heap[0] is due first
+static int heap_count = 0;
+static alarm_id_t alarm = 0;
+static uint64_t alarm_at = 0;       // Deadline the alarm is set for
+static volatile bool timers_due = false;
+
+static struct {
+    uint32_t fired;
+    uint32_t skipped;
+    uint32_t late_max_us;
+    uint64_t late_total_us;
+} stats;
+
+// ===== HEAP =====
+
+static bool queued(const struct app_timer *timer) {
+    return timer->slot >= 0 && timer->slot < heap_count && heap[timer->slot] == timer;
+}
+
+static void heap_set(int i, struct app_timer *timer) {
+    heap[i] = timer;
+    timer->slot = (int16_t)i;
+}
+
+static void heap_up(int i) {
+    struct app_timer *timer = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent]->deadline_us <= timer->deadline_us) {
+            break;
+        }
+        heap_set(i, heap[parent]);
+        i = parent;
+    }
+    heap_set(i, timer);
+}
+
+static void heap_down(int i) {
+    struct app_timer *timer = heap[i];
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= heap_count) {
+            break;
+        }
+        if (child + 1 < heap_count && heap[child + 1]->deadline_us < heap[child]->deadline_us) {
+            child++;
+        }
+        if (timer->deadline_us <= heap[child]->deadline_us) {
+            break;
+        }
+        heap_set(i, heap[child]);
+        i = child;
+    }
+    heap_set(i, timer);
+}
+
+static void heap_remove(int i) {
+    struct app_timer *timer = heap[i];
+    heap_count--;
+    if (i != heap_count) {
+        heap_set(i, heap[heap_count]);
+        if (i > 0 && heap[i]->deadline_us < heap[(i - 1) / 2]->deadline_us) {
+            heap_up(i);
+        } else {
+            heap_down(i);
+        }
+    }
+    timer->slot = -1;
+}
+
+// ===== ALARM =====
+
+// IRQ context: only wakes the main loop
+static int64_t alarm_fired(alarm_id_t id, void *user_data) {
+    timers_due = true;
+    __sev();
+    return 0;
+}
+
+// Keeps the one alarm on the earliest deadline
+static void alarm_update() {
+    if (heap_count == 0) {
+        if (alarm > 0) {
+            cancel_alarm(alarm);
+        }
+        alarm = 0;
+        return;
+    }
+    uint64_t at = heap[0]->deadline_us;
+    if (alarm > 0 && alarm_at == at) {
+        return;
+    }
+    if (alarm > 0) {
+        cancel_alarm(alarm);
+    }
+    alarm_at = at;
+    // No alarm slot free (< 0): timers still run on the next interrupt
+    alarm = add_alarm_at(from_us_since_boot(at), alarm_fired, NULL, true);
+}
+
+// ===== API =====
+
+void app_timer_init() {
+    heap_count = 0;
+    alarm = 0;
+    timers_due = false;
+}
+
+bool app_timer_start(struct app_timer *timer, uint32_t delay_ms, uint32_t period_ms,
+                     app_timer_fn fn, void *arg, const void *owner) {
+    bool restart = queued(timer);
+    if (!restart && heap_count == APP_TIMER_MAX) {
+        return false;
+    }
+    timer->deadline_us = time_us_64() + (uint64_t)delay_ms * 1000;
+    timer->period_us = period_ms * 1000;
+    timer->fn = fn;
+    timer->arg = arg;
+    timer->owner = owner;
+    if (restart) {
+        heap_down(timer->slot);
+        heap_up(timer->slot);
+    } else {
+        heap_set(heap_count, timer);
+        heap_count++;
+        heap_up(timer->slot);
+    }
+    alarm_update();
+    return true;
+}
+
+void app_timer_stop(struct app_timer *timer) {
+    if (queued(timer)) {
+        heap_remove(timer->slot);
+        alarm_update();
+    }
+}
+
+void app_timer_stop_owner(const void *owner) {
+    // Removal reorders the heap, so rescan after each one (16 at most)
+    int i = 0;
+    while (i < heap_count) {
+        if (heap[i]->owner == owner) {
+            heap_remove(i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    alarm_update();
+}
+
+bool app_timer_active(const struct app_timer *timer) {
+    return queued(timer);
+}
+
+void app_timer_run() {
+    timers_due = false;
+    cyw43_arch_lwip_begin();
+    uint64_t now = time_us_64();
+    while (heap_count > 0 && heap[0]->deadline_us <= now) {
+        struct app_timer *timer = heap[0];
+        uint32_t late = (uint32_t)(now - timer->deadline_us);
+        stats.fired++;
+        stats.late_total_us += late;
+        if (late > stats.late_max_us) {
+            stats.late_max_us = late;
+        }
+
+        // Reschedule (or drop) before the call, which may restart or stop it
+        if (timer->period_us) {
+            timer->deadline_us += timer->period_us;
+            if (timer->deadline_us <= now) {
+                uint64_t missed = (now - timer->deadline_us) / timer->period_us + 1;
+                stats.skipped += (uint32_t)missed;
+                timer->deadline_us += missed * timer->period_us;
+            }
+            heap_down(0);
+        } else {
+            heap_remove(0);
+        }
+        timer->fn(timer->arg);
+        now = time_us_64();
+    }
+    alarm_update();
+    cyw43_arch_lwip_end();
+}
+
+void app_timer_wait() {
+    // The alarm also sets the event register, so a deadline passing
+    // between the check and the WFE still ends the sleep at once
+    if (!timers_due) {
+        __wfe();
+    }
+}
+
+absolute_time_t app_timer_next() {
+    return heap_count > 0 ? from_us_since_boot(heap[0]->deadline_us) : at_the_end_of_time;
+}
+
+void app_timer_get_stats(struct app_timer_stats *out) {
+    out->active = (uint32_t)heap_count;
+    out->fired = stats.fired;
+    out->skipped = stats.skipped;
+    out->late_max_us = stats.late_max_us;
+    out->late_avg_us = stats.fired ? (uint32_t)(stats.late_total_us / stats.fired) : 0;
+}
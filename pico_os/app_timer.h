@@ -0,0 +1,77 @@
+/**
+ * App timers - periodic and one-shot deadlines on the SDK alarm pool
+ *
+ * Apps start timers instead of being polled: the timers sit in a binary
+ * min-heap by deadline, and a single alarm on the default alarm pool is
+ * armed for the earliest one. The alarm callback only flags the main loop
+ * and wakes it with an event; app_timer_run() then calls whatever is due
+ * in thread context, holding the lwIP lock, so timer callbacks may touch
+ * the LED, the output buffer or lwIP like a network callback would. In
+ * between, app_timer_wait() sleeps the core until the alarm or any other
+ * interrupt (WiFi, USB) fires.
+ *
+ * Periodic timers are scheduled from their previous deadline, not from
+ * when they ran, so lateness in one period does not shift the next. A
+ * timer that fell more than a whole period behind skips the missed runs.
+ *
+ * Timers are owned by the caller. Start and stop them in lwIP context
+ * (network callbacks, timer callbacks) or inside cyw43_arch_lwip_begin().
+ * Each carries an owner tag so an app's timers can all be stopped at once
+ * when the app exits.
+ */
+
+#ifndef APP_TIMER_H
+#define APP_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/time.h"
+
+#define APP_TIMER_MAX 16            // Timers running at once
+
+typedef void (*app_timer_fn)(void *arg);
+
+struct app_timer {
+    uint64_t deadline_us;
+    uint32_t period_us;             // 0 for one-shot
+    app_timer_fn fn;
+    void *arg;
+    const void *owner;
+    int16_t slot;                   // Heap index, -1 when stopped
+};
+
+struct app_timer_stats {
+    uint32_t active;
+    uint32_t fired;
+    uint32_t skipped;               // Periods dropped after falling behind
+    uint32_t late_max_us;           // Worst deadline-to-callback delay
+    uint32_t late_avg_us;
+};
+
+void app_timer_init();
+
+// Run fn(arg) after delay_ms, then every period_ms (0: once). Restarts the
+// timer if it is running. False if APP_TIMER_MAX timers are running.
+bool app_timer_start(struct app_timer *timer, uint32_t delay_ms, uint32_t period_ms,
+                     app_timer_fn fn, void *arg, const void *owner);
+
+// No effect on a stopped timer; a one-shot timer stops itself once run
+void app_timer_stop(struct app_timer *timer);
+
+// Stop every timer started with owner
+void app_timer_stop_owner(const void *owner);
+
+bool app_timer_active(const struct app_timer *timer);
+
+// Main loop: call the due timers (takes the lwIP lock)
+void app_timer_run();
+
+// Main loop: sleep until a timer is due or an interrupt arrives
+void app_timer_wait();
+
+// Earliest deadline, at_the_end_of_time if none
+absolute_time_t app_timer_next();
+
+void app_timer_get_stats(struct app_timer_stats *stats);
+
+#endif // APP_TIMER_H
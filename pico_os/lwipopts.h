@@ -42,7 +42,12 @@
 #define MEMP_STATS                  0
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
-#define LWIP_CHKSUM_ALGORITHM       3
+// Internet checksum from chksum.cpp (ADCS loop on the M33); TCP data is
+// checksummed while tcp_write() copies it
+#define LWIP_CHKSUM                 pico_chksum
+#define LWIP_CHKSUM_COPY(dst, src, len) pico_chksum_copy(dst, src, len)
+#define LWIP_CHECKSUM_ON_COPY       1
+#include "chksum.h"
 #define LWIP_DHCP                   1
 #define LWIP_IPV4                   1
 #define LWIP_TCP                    1
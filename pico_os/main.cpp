@@ -18,6 +18,12 @@
 #include "lwip/udp.h"
 #include "hardware/adc.h"
 #include "hardware/watchdog.h"
+#include "hardware/sync.h"
+#include "timesync.h"
+#include "app_timer.h"
+#include "led_pattern.h"
+#include "flash_fs.h"
+#include "todo_store.h"
 
 // ============== CONFIGURATION ==============
 const char WIFI_SSID[] = "YOUR_SSID";
@@ -25,11 +31,18 @@ const char WIFI_PASSWORD[] = "YOUR_PASS";
 #define TCP_PORT 80
 #define OUTPUT_BUFFER_SIZE 16384
 #define CMD_BUFFER_SIZE 512
+#define CMD_JOB_MAX 8               // Commands queued or running at once
+#define OUTPUT_CHUNK_SIZE 2048      // Most output sent per GET /output
 
 // ============== FORWARD DECLARATIONS ==============
 void process_command(const char* cmd);
 void output_write(const char* str);
 void output_printf(const char* fmt, ...);
+struct cmd_job;
+typedef void (*cmd_step_fn)(struct cmd_job* job);
+bool cmd_continue(cmd_step_fn step, uint32_t delay_ms);
+struct app;
+extern const struct app clock_app;
 
 // ============== SYSTEM STATE ==============
 static struct {
@@ -37,31 +50,56 @@ static struct {
     absolute_time_t boot_time;
 } sys_state;
 
-// ============== OUTPUT BUFFER (Ring Buffer) ==============
+// ============== OUTPUT LOG (Ring Buffer) ==============
+// Output is a log of records (job ID, length, text) in a ring addressed by
+// sequence numbers that only grow. Reading consumes nothing: each web
+// client keeps its own cursor (GET /output?since=N), so any number of them
+// can stream the same output. When the ring is full the oldest records are
+// dropped, and a cursor left behind resumes at the oldest one still held.
+// Only used in lwIP context: network callbacks, app timers and command jobs.
+#define OUTPUT_RECORD_HEADER 4      // Job ID, text length (16 bits each)
+
 static struct {
     char buffer[OUTPUT_BUFFER_SIZE];
-    uint16_t write_pos;
-    uint16_t read_pos;
-    bool overflow;
+    uint32_t head;                  // Sequence number of the next byte
+    uint32_t tail;                  // Oldest record still held
 } output_buf;
 
+static uint16_t output_job = 0;     // Tags new records, 0 for system output
+
+static uint16_t output_get16(uint32_t seq) {
+    return (uint8_t)output_buf.buffer[seq % OUTPUT_BUFFER_SIZE] |
+           (uint8_t)output_buf.buffer[(seq + 1) % OUTPUT_BUFFER_SIZE] << 8;
+}
+
+static void output_put16(uint32_t seq, uint16_t value) {
+    output_buf.buffer[seq % OUTPUT_BUFFER_SIZE] = (char)(value & 0xFF);
+    output_buf.buffer[(seq + 1) % OUTPUT_BUFFER_SIZE] = (char)(value >> 8);
+}
+
 void output_clear() {
-    output_buf.write_pos = 0;
-    output_buf.read_pos = 0;
-    output_buf.overflow = false;
+    output_buf.tail = output_buf.head;
 }
 
 void output_write(const char* str) {
     size_t len = strlen(str);
+    if (len == 0) {
+        return;
+    }
+    if (len > OUTPUT_BUFFER_SIZE - OUTPUT_RECORD_HEADER) {
+        str += len - (OUTPUT_BUFFER_SIZE - OUTPUT_RECORD_HEADER);
+        len = OUTPUT_BUFFER_SIZE - OUTPUT_RECORD_HEADER;
+    }
+    uint32_t size = OUTPUT_RECORD_HEADER + len;
+    while (OUTPUT_BUFFER_SIZE - (output_buf.head - output_buf.tail) < size) {
+        output_buf.tail += OUTPUT_RECORD_HEADER + output_get16(output_buf.tail + 2);
+    }
+    output_put16(output_buf.head, output_job);
+    output_put16(output_buf.head + 2, (uint16_t)len);
     for (size_t i = 0; i < len; i++) {
-        output_buf.buffer[output_buf.write_pos] = str[i];
-        output_buf.write_pos = (output_buf.write_pos + 1) % OUTPUT_BUFFER_SIZE;
-        
-        if (output_buf.write_pos == output_buf.read_pos) {
-            output_buf.overflow = true;
-            output_buf.read_pos = (output_buf.read_pos + 1) % OUTPUT_BUFFER_SIZE;
-        }
+        output_buf.buffer[(output_buf.head + OUTPUT_RECORD_HEADER + i) % OUTPUT_BUFFER_SIZE] = str[i];
     }
+    output_buf.head += size;
 }
 
 void output_printf(const char* fmt, ...) {
@@ -73,95 +111,299 @@ void output_printf(const char* fmt, ...) {
     output_write(temp);
 }
 
-size_t output_read_all(char* dest, size_t max_len) {
+// First record at or after since; a cursor outside the ring starts over
+// at the oldest record
+static uint32_t output_seek(uint32_t since) {
+    uint32_t seq = output_buf.tail;
+    if (since - output_buf.tail > output_buf.head - output_buf.tail) {
+        return seq;
+    }
+    while ((int32_t)(since - seq) > 0) {
+        seq += OUTPUT_RECORD_HEADER + output_get16(seq + 2);
+    }
+    return seq;
+}
+
+// Copies the text of whole records from *seq on into dest, only job's
+// records unless job is 0, and moves *seq past them. A record longer than
+// dest is cut short. Returns the length; *more if records are left over.
+size_t output_read(uint32_t* seq, uint16_t job, char* dest, size_t max_len, bool* more) {
     size_t count = 0;
-    while (output_buf.read_pos != output_buf.write_pos && count < max_len - 1) {
-        dest[count++] = output_buf.buffer[output_buf.read_pos];
-        output_buf.read_pos = (output_buf.read_pos + 1) % OUTPUT_BUFFER_SIZE;
+    uint32_t pos = output_seek(*seq);
+    *more = false;
+    while (pos != output_buf.head) {
+        uint16_t tag = output_get16(pos);
+        size_t len = output_get16(pos + 2);
+        if (job == 0 || tag == job) {
+            if (count + len > max_len - 1) {
+                if (count > 0) {
+                    *more = true;
+                    break;
+                }
+                len = max_len - 1;
+            }
+            for (size_t i = 0; i < len; i++) {
+                dest[count++] = output_buf.buffer[(pos + OUTPUT_RECORD_HEADER + i) % OUTPUT_BUFFER_SIZE];
+            }
+        }
+        pos += OUTPUT_RECORD_HEADER + output_get16(pos + 2);
     }
     dest[count] = '\0';
+    *seq = pos;
     return count;
 }
 
-// ============== TO-DO APP ==============
+// ============== COMMAND JOBS ==============
+// POST /cmd only queues the command and answers with its job ID; the main
+// loop runs the jobs one step per pass, under the lwIP lock like app
+// timers. A job's first step is process_command(). A command with more
+// to do (waiting on the network, say) calls cmd_continue() to be called
+// again, after a delay or on the next pass, instead of holding the loop;
+// the job finishes after a step that does not continue. Each pass runs the
+// runnable job that has waited longest: a job parked until later never
+// holds up the ones queued behind it, and one that continues goes to the
+// back of the line. Everything a job writes is tagged with its ID in the
+// output log.
+enum cmd_job_state { JOB_FREE, JOB_QUEUED, JOB_RUNNING };
+
+struct cmd_job {
+    uint16_t id;
+    enum cmd_job_state state;
+    uint32_t turn;                  // Lowest runnable turn goes next
+    char command[CMD_BUFFER_SIZE];
+    cmd_step_fn step;               // Next step, NULL when done
+    uint64_t resume_us;             // Not before
+    uint64_t started_us;
+};
+
 static struct {
-    char task1[15];
-    char task2[15];
-    bool done1;
-    bool done2;
-    int count;
-    bool running;
-} todo_state = {"", "", false, false, 0, false};
+    struct cmd_job slots[CMD_JOB_MAX];
+    uint8_t count;
+    uint16_t next_id;
+    uint32_t next_turn;
+    struct cmd_job* current;        // Job whose step is running
+    struct app_timer wake;          // Ends the loop's sleep for a delayed step
+    uint32_t run;
+    uint32_t rejected;
+    uint32_t step_max_us;
+} cmd_jobs = {};
+
+// lwIP context. Returns the job ID, 0 if the queue is full.
+uint16_t cmd_submit(const char* command) {
+    struct cmd_job* job = NULL;
+    for (int i = 0; i < CMD_JOB_MAX && !job; i++) {
+        if (cmd_jobs.slots[i].state == JOB_FREE) {
+            job = &cmd_jobs.slots[i];
+        }
+    }
+    if (!job) {
+        cmd_jobs.rejected++;
+        return 0;
+    }
+    if (++cmd_jobs.next_id == 0) {
+        cmd_jobs.next_id = 1;
+    }
+    job->id = cmd_jobs.next_id;
+    job->turn = cmd_jobs.next_turn++;
+    strncpy(job->command, command, CMD_BUFFER_SIZE - 1);
+    job->command[CMD_BUFFER_SIZE - 1] = '\0';
+    job->step = NULL;
+    job->resume_us = 0;
+    job->state = JOB_QUEUED;
+    cmd_jobs.count++;
+    __sev();                        // The main loop may be about to sleep
+    return job->id;
+}
+
+uint32_t cmd_pending() {
+    return cmd_jobs.count;
+}
+
+static void cmd_job_wake(void* arg) {
+}
+
+// From a job's step: run step next, delay_ms from now (0: next pass).
+// False outside a job.
+bool cmd_continue(cmd_step_fn step, uint32_t delay_ms) {
+    struct cmd_job* job = cmd_jobs.current;
+    if (!job) {
+        return false;
+    }
+    job->step = step;
+    job->resume_us = time_us_64() + (uint64_t)delay_ms * 1000;
+    return true;
+}
+
+// The runnable job that has waited longest, NULL if none
+static struct cmd_job* cmd_jobs_next(uint64_t now) {
+    struct cmd_job* next = NULL;
+    for (int i = 0; i < CMD_JOB_MAX; i++) {
+        struct cmd_job* job = &cmd_jobs.slots[i];
+        if (job->state == JOB_FREE || (job->state == JOB_RUNNING && now < job->resume_us)) {
+            continue;
+        }
+        if (!next || (int32_t)(job->turn - next->turn) < 0) {
+            next = job;
+        }
+    }
+    return next;
+}
+
+// Arm the wake timer for the earliest parked job
+static void cmd_jobs_rearm(uint64_t now) {
+    uint64_t earliest = UINT64_MAX;
+    for (int i = 0; i < CMD_JOB_MAX; i++) {
+        struct cmd_job* job = &cmd_jobs.slots[i];
+        if (job->state == JOB_RUNNING && job->resume_us > now && job->resume_us < earliest) {
+            earliest = job->resume_us;
+        }
+    }
+    if (earliest == UINT64_MAX) {
+        app_timer_stop(&cmd_jobs.wake);
+    } else {
+        app_timer_start(&cmd_jobs.wake, (uint32_t)((earliest - now + 999) / 1000), 0,
+                        cmd_job_wake, NULL, NULL);
+    }
+}
+
+// Main loop: true if some job can run now
+bool cmd_jobs_ready() {
+    return cmd_jobs.count > 0 && cmd_jobs_next(time_us_64()) != NULL;
+}
+
+// Main loop: one step of the next runnable job (takes the lwIP lock)
+void cmd_jobs_run() {
+    if (cmd_jobs.count == 0) {
+        return;
+    }
+    cyw43_arch_lwip_begin();
+    struct cmd_job* job = cmd_jobs_next(time_us_64());
+    if (!job) {
+        cyw43_arch_lwip_end();
+        return;
+    }
+    cmd_step_fn step = job->step;
+    job->step = NULL;
+    cmd_jobs.current = job;
+    output_job = job->id;
+
+    uint64_t start = time_us_64();
+    if (job->state == JOB_QUEUED) {
+        job->state = JOB_RUNNING;
+        job->started_us = start;
+        output_printf("> %s\n", job->command);
+        process_command(job->command);
+    } else {
+        step(job);
+    }
+    uint64_t end = time_us_64();
+    uint32_t took = (uint32_t)(end - start);
+    if (took > cmd_jobs.step_max_us) {
+        cmd_jobs.step_max_us = took;
+    }
+
+    output_job = 0;
+    cmd_jobs.current = NULL;
+    if (job->step) {
+        job->turn = cmd_jobs.next_turn++;
+    } else {
+        job->state = JOB_FREE;
+        cmd_jobs.count--;
+        cmd_jobs.run++;
+    }
+    cmd_jobs_rearm(end);
+    cyw43_arch_lwip_end();
+}
+
+// ============== APP FRAMEWORK ==============
+// One app runs at a time. Apps do their background work on app timers
+// (app_timer.h) owned by their descriptor, which are stopped with the app.
+struct app {
+    const char* name;
+    const char* summary;                // For 'apps'
+    void (*start)();
+    void (*stop)();
+    // App's own commands, true if handled
+    bool (*command)(const char* command, const char* arg);
+};
+
+// ============== TO-DO APP ==============
+// Items live in a to-do store (todo_store.h) on the flash filesystem, the
+// same list the shell OS and to-do-pico keep; each command commits
+#define TODO_DIR "/todo"
+
+static lfs_t todo_fs;
+static struct todo_store todo_store;
+static bool todo_ready = false;
 
 void todo_show_commands() {
     output_write("\nAvailable commands:\n");
-    output_write("  list       - Show all tasks\n");
+    output_write("  list [id]  - Show tasks, a page at a time from id\n");
     output_write("  add <task> - Add a new task\n");
-    output_write("  done <n>   - Mark task as complete\n");
-    output_write("  del <n>    - Delete a task\n");
+    output_write("  done <id>  - Toggle a task complete\n");
+    output_write("  del <id>   - Delete a task\n");
     output_write("  stop       - Exit TODO app\n\n");
 }
 
 void todo_init() {
-    todo_state.running = true;
     output_write("\n=== TO-DO APP STARTED ===\n");
+    if (!todo_ready) {
+        output_write("Task storage unavailable: changes cannot be saved.\n");
+    }
     todo_show_commands();
 }
 
-void todo_list() {
-    output_write("\n=== TO-DO LIST ===\n");
-    if (todo_state.count >= 1) 
-        output_printf("1. [%c] %s\n", todo_state.done1 ? 'X' : ' ', todo_state.task1);
-    if (todo_state.count >= 2) 
-        output_printf("2. [%c] %s\n", todo_state.done2 ? 'X' : ' ', todo_state.task2);
-    if (todo_state.count == 0) 
+void todo_commit() {
+    if (!todo_store_commit(&todo_store)) {
+        output_write("Could not save tasks (flash full?)\n");
+    }
+}
+
+void todo_list(uint32_t from) {
+    // One extra item tells whether there is a next page
+    static struct todo_item page[TODO_PAGE_SIZE + 1];
+    int count = todo_store_list(&todo_store, from, page, TODO_PAGE_SIZE + 1);
+    bool more = count > TODO_PAGE_SIZE;
+    if (more) count = TODO_PAGE_SIZE;
+
+    output_printf("\n=== TO-DO LIST (%lu tasks, %lu done) ===\n",
+                  (unsigned long)todo_store.count, (unsigned long)todo_store.done);
+    for (int i = 0; i < count; i++) {
+        output_printf("%lu. [%c] %s\n", (unsigned long)page[i].id, page[i].done ? 'X' : ' ', page[i].text);
+    }
+    if (count == 0)
         output_write("No tasks.\n");
+    if (more)
+        output_printf("'list %lu' for more\n", (unsigned long)(page[count - 1].id + 1));
     todo_show_commands();
 }
 
 void todo_add(const char* task) {
-    if (todo_state.count == 0) {
-        strncpy(todo_state.task1, task, 14);
-        todo_state.task1[14] = '\0';
-        todo_state.done1 = false;
-        todo_state.count = 1;
-        output_write("Task 1 added.\n");
-    } else if (todo_state.count == 1) {
-        strncpy(todo_state.task2, task, 14);
-        todo_state.task2[14] = '\0';
-        todo_state.done2 = false;
-        todo_state.count = 2;
-        output_write("Task 2 added.\n");
+    uint32_t id = todo_store_add(&todo_store, task);
+    if (id) {
+        todo_commit();
+        output_printf("Task %lu added.\n", (unsigned long)id);
     } else {
-        output_write("List full (max 2 tasks).\n");
+        output_write("Could not add task.\n");
     }
     todo_show_commands();
 }
 
-void todo_done(int n) {
-    if (n == 1 && todo_state.count >= 1) {
-        todo_state.done1 = true;
-        output_write("Task 1 marked done.\n");
-    } else if (n == 2 && todo_state.count >= 2) {
-        todo_state.done2 = true;
-        output_write("Task 2 marked done.\n");
+void todo_done(uint32_t id) {
+    struct todo_item item;
+    if (todo_store_get(&todo_store, id, &item) && todo_store_set_done(&todo_store, id, !item.done)) {
+        todo_commit();
+        output_printf("Task %lu marked %s.\n", (unsigned long)id, item.done ? "not done" : "done");
     } else {
         output_write("Invalid task number.\n");
     }
     todo_show_commands();
 }
 
-void todo_del(int n) {
-    if (n == 1 && todo_state.count >= 1) {
-        if (todo_state.count == 2) {
-            strcpy(todo_state.task1, todo_state.task2);
-            todo_state.done1 = todo_state.done2;
-        }
-        todo_state.count--;
-        output_write("Task 1 deleted.\n");
-    } else if (n == 2 && todo_state.count == 2) {
-        todo_state.count--;
-        output_write("Task 2 deleted.\n");
+void todo_del(uint32_t id) {
+    if (todo_store_delete(&todo_store, id)) {
+        todo_commit();
+        output_printf("Task %lu deleted.\n", (unsigned long)id);
     } else {
         output_write("Invalid task number.\n");
     }
@@ -169,17 +411,55 @@ void todo_del(int n) {
 }
 
 void todo_stop() {
-    todo_state.running = false;
     output_write("TO-DO app stopped.\n");
 }
 
+bool todo_command(const char* command, const char* arg) {
+    if (strcmp(command, "list") == 0) {
+        todo_list(strtoul(arg, NULL, 10));
+        return true;
+    }
+    
+    if (strcmp(command, "add") == 0) {
+        if (strlen(arg) == 0) {
+            output_write("Usage: add <task_name>\n");
+            todo_show_commands();
+            return true;
+        }
+        todo_add(arg);
+        return true;
+    }
+    
+    if (strcmp(command, "done") == 0) {
+        todo_done(strtoul(arg, NULL, 10));
+        return true;
+    }
+    
+    if (strcmp(command, "del") == 0) {
+        todo_del(strtoul(arg, NULL, 10));
+        return true;
+    }
+    return false;
+}
+
+// Before the network starts: mounting may format the flash region
+void todo_storage_init() {
+    todo_ready = flash_fs_mount(&todo_fs) && todo_store_open(&todo_store, &todo_fs, TODO_DIR);
+    if (!todo_ready) {
+        printf("Failed to open task storage\n");
+    }
+}
+
+const struct app todo_app = {
+    "todo", "Task manager (saved to flash)", todo_init, todo_stop, todo_command
+};
+
 // ============== BLINK APP ==============
+// Played by the LED pattern engine (led_pattern.h), which writes the
+// CYW43-attached LED only when its level changes
 static struct {
-    bool running;
-    absolute_time_t last_toggle;
-    bool led_state;
     uint32_t interval_ms;
-} blink_state = {false, 0, false, 500};
+} blink_state = {500};
 
 void blink_show_commands() {
     output_write("\nAvailable commands:\n");
@@ -188,10 +468,8 @@ void blink_show_commands() {
 }
 
 void blink_init() {
-    blink_state.running = true;
-    blink_state.last_toggle = get_absolute_time();
-    blink_state.led_state = false;
     blink_state.interval_ms = 500;
+    led_pattern_blink(0, blink_state.interval_ms, blink_state.interval_ms);
     output_write("\n=== LED BLINK APP STARTED ===\n");
     output_printf("LED blinking at %dms interval.\n", blink_state.interval_ms);
     blink_show_commands();
@@ -204,121 +482,65 @@ void blink_set_speed(uint32_t ms) {
         return;
     }
     blink_state.interval_ms = ms;
+    led_pattern_blink(0, ms, ms);
     output_printf("Blink interval set to %dms.\n", ms);
     blink_show_commands();
 }
 
 void blink_stop() {
-    blink_state.running = false;
-    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
+    led_pattern_set(false);
     output_write("LED blink stopped.\n");
 }
 
-void blink_tick() {
-    if (!blink_state.running) return;
-    
-    int64_t elapsed = absolute_time_diff_us(blink_state.last_toggle, get_absolute_time());
-    if (elapsed > (blink_state.interval_ms * 1000)) {
-        blink_state.led_state = !blink_state.led_state;
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, blink_state.led_state);
-        blink_state.last_toggle = get_absolute_time();
+bool blink_command(const char* command, const char* arg) {
+    if (strcmp(command, "speed") == 0) {
+        blink_set_speed(atoi(arg));
+        return true;
     }
+    return false;
 }
 
+const struct app blink_app = {
+    "blink", "Control LED blinking", blink_init, blink_stop, blink_command
+};
+
 // ============== NTP TIME & CLOCK APP ==============
 
-// NTP packet structure (same as ascii_clock)
-typedef struct {
-    uint8_t li_vn_mode;
-    uint8_t stratum, poll, precision;
-    uint32_t root_delay, root_dispersion, ref_id;
-    uint32_t ref_ts[2], org_ts[2], rx_ts[2], tx_ts[2];
-} ntp_packet_t;
+// Time comes from the shared time service (pico-shell-based-os/timesync.h):
+// SNTP against several servers, filtered and slewed
+static const char *const NTP_SERVERS[] = { "0.pool.ntp.org", "1.pool.ntp.org", "2.pool.ntp.org" };
+static bool ntp_started = false;
 
-static struct {
-    bool synced;
-    bool initialized;
-    bool request_sent;
-    ip_addr_t server_addr;
-    struct udp_pcb *pcb;
-    time_t base_time;           // Unix timestamp from NTP
-    absolute_time_t base_tick;  // Pico monotonic clock at the moment NTP arrived
-} ntp_state = {false, false, false, {0}, NULL, 0, 0};
-
-// Returns current Unix time using the NTP baseline + elapsed monotonic time
+// Returns current Unix time, 0 until the first NTP sync
 static time_t get_current_time(void) {
-    if (!ntp_state.synced) return 0;
-    int64_t elapsed = absolute_time_diff_us(ntp_state.base_tick, get_absolute_time()) / 1000000;
-    return ntp_state.base_time + (time_t)elapsed;
-}
-
-// UDP receive callback — fires when the NTP reply comes back
-static void ntp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
-    (void)arg; (void)pcb; (void)addr; (void)port;
-    if (p->tot_len == sizeof(ntp_packet_t)) {
-        ntp_packet_t *pkt = (ntp_packet_t*)p->payload;
-        uint32_t sec1900 = ntohl(pkt->tx_ts[0]);
-        ntp_state.base_time = (time_t)(sec1900 - 2208988800U);
-        ntp_state.base_tick = get_absolute_time();
-        ntp_state.synced = true;
-    }
-    pbuf_free(p);
-}
-
-// DNS callback — stores the resolved IP once it comes back
-static void ntp_dns_found(const char *name, const ip_addr_t *ip, void *arg) {
-    (void)name; (void)arg;
-    if (ip) ntp_state.server_addr = *ip;
-}
-
-// Send the actual NTP request packet
-static void ntp_send_request(void) {
-    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(ntp_packet_t), PBUF_RAM);
-    if (!p) return;
-    ntp_packet_t *pkt = (ntp_packet_t*)p->payload;
-    memset(pkt, 0, sizeof(*pkt));
-    pkt->li_vn_mode = 0x1b;  // LI=0, VN=3, Mode=3 (client)
-    udp_sendto(ntp_state.pcb, p, &ntp_state.server_addr, 123);
-    pbuf_free(p);
-    ntp_state.request_sent = true;
+    if (!timesync_synced()) return 0;
+    return timesync_unix();
 }
 
 void ntp_init() {
-    if (ntp_state.initialized) return;
-
-    ntp_state.pcb = udp_new();
-    if (!ntp_state.pcb) return;
-    udp_recv(ntp_state.pcb, ntp_recv, NULL);
-
-    // Kick off DNS resolution for pool.ntp.org; once it resolves
-    // ntp_dns_found stores the IP and we send the request on the next tick
-    dns_gethostbyname("pool.ntp.org", &ntp_state.server_addr, ntp_dns_found, NULL);
-
-    ntp_state.initialized = true;
-}
-
-// Called from the main loop — handles the async DNS -> send -> (recv fires via callback) flow
-void ntp_tick() {
-    if (!ntp_state.initialized || ntp_state.synced || ntp_state.request_sent) return;
-
-    // DNS resolved? (ip will be non-zero once ntp_dns_found fires)
-    if (ip_addr_isany(&ntp_state.server_addr)) return;
-
-    // Got an IP, send the request
-    ntp_send_request();
+    if (ntp_started) return;
+    ntp_started = timesync_start(NTP_SERVERS, sizeof(NTP_SERVERS) / sizeof(NTP_SERVERS[0]));
 }
 
 void ntp_check_sync() {
     static bool notified = false;
-    if (ntp_state.synced && !notified) {
+    if (timesync_synced() && !notified) {
         notified = true;
         output_write("NTP time synced successfully!\n\n");
     }
 }
 
+#define CLOCK_SYNC_CHECK_MS 1000
+#define CLOCK_SHOW_WAIT_MS 15000    // 'show' waits this long for a first sync
+#define CLOCK_SHOW_POLL_MS 250
+
 static struct {
-    bool running;
-} clock_state = {false};
+    struct app_timer sync_check;
+} clock_state;
+
+static void clock_sync_check(void* arg) {
+    ntp_check_sync();
+}
 
 void clock_show_commands() {
     output_write("\nAvailable commands:\n");
@@ -327,10 +549,11 @@ void clock_show_commands() {
 }
 
 void clock_init() {
-    clock_state.running = true;
     output_write("\n=== CLOCK APP STARTED ===\n");
+    app_timer_start(&clock_state.sync_check, CLOCK_SYNC_CHECK_MS, CLOCK_SYNC_CHECK_MS,
+                    clock_sync_check, NULL, &clock_app);
     
-    if (!ntp_state.initialized) {
+    if (!ntp_started) {
         output_write("Initializing NTP time sync...\n");
         ntp_init();
         output_write("(Time sync may take 5-10 seconds)\n");
@@ -339,13 +562,29 @@ void clock_init() {
     clock_show_commands();
 }
 
+void clock_display();
+
+// Job step: 'show' before the first sync waits for it
+static void clock_show_wait(struct cmd_job* job) {
+    if (timesync_synced()) {
+        clock_display();
+    } else if (time_us_64() - job->started_us >= (uint64_t)CLOCK_SHOW_WAIT_MS * 1000) {
+        output_write("NTP time sync is taking longer than usual. Try again later.\n");
+        clock_show_commands();
+    } else {
+        cmd_continue(clock_show_wait, CLOCK_SHOW_POLL_MS);
+    }
+}
+
 void clock_display() {
     ntp_check_sync();
     
-    if (!ntp_state.synced) {
+    if (!timesync_synced()) {
         output_write("\nWaiting for NTP time sync...\n");
-        output_write("Please wait a few seconds and try again.\n");
-        clock_show_commands();
+        if (!cmd_continue(clock_show_wait, CLOCK_SHOW_POLL_MS)) {
+            output_write("Please wait a few seconds and try again.\n");
+            clock_show_commands();
+        }
         return;
     }
     
@@ -368,18 +607,40 @@ void clock_display() {
 }
 
 void clock_stop() {
-    clock_state.running = false;
     output_write("Clock stopped.\n");
 }
 
-void clock_tick() {
-    if (!clock_state.running) return;
-    ntp_check_sync();
+bool clock_command(const char* command, const char* arg) {
+    if (strcmp(command, "show") == 0) {
+        clock_display();
+        return true;
+    }
+    return false;
 }
 
+const struct app clock_app = {
+    "clock", "Real-time clock (NTP synced)", clock_init, clock_stop, clock_command
+};
+
 // ============== COMMAND PROCESSOR ==============
-enum AppType { APP_NONE, APP_TODO, APP_BLINK, APP_CLOCK };
-static enum AppType current_app = APP_NONE;
+static const struct app* const apps[] = { &todo_app, &blink_app, &clock_app };
+#define APP_COUNT (sizeof(apps) / sizeof(apps[0]))
+static const struct app* current_app = NULL;
+
+static void app_exit() {
+    current_app->stop();
+    app_timer_stop_owner(current_app);
+    current_app = NULL;
+}
+
+// Reboot from a timer, so the reply to the command still goes out
+#define REBOOT_DELAY_MS 500
+static struct app_timer reboot_timer;
+
+static void reboot_now(void* arg) {
+    watchdog_enable(1, 1);
+    while(1);
+}
 
 void process_command(const char* cmd) {
     char command[64] = {0};
@@ -405,8 +666,8 @@ void process_command(const char* cmd) {
     
     // ========== CLEAR COMMAND ==========
     if (strcmp(command, "clear") == 0) {
-        output_clear();
-        output_write("Terminal cleared.\n\n");
+        // The page empties its own view; the log is shared by every client
+        // and running job, so it is left alone
         return;
     }
     
@@ -416,7 +677,30 @@ void process_command(const char* cmd) {
         output_write("\n=== SYSTEM STATUS ===\n");
         output_printf("IP Address: %s\n", sys_state.ip_addr);
         output_printf("Uptime: %lld seconds\n", uptime);
-        output_printf("NTP Synced: %s\n", ntp_state.synced ? "Yes" : "No");
+        output_printf("NTP Synced: %s\n", timesync_synced() ? "Yes" : "No");
+        struct app_timer_stats timers;
+        app_timer_get_stats(&timers);
+        output_printf("Timers: %lu active, %lu fired, late avg %lu us, max %lu us, %lu skipped\n",
+                      (unsigned long)timers.active, (unsigned long)timers.fired,
+                      (unsigned long)timers.late_avg_us, (unsigned long)timers.late_max_us,
+                      (unsigned long)timers.skipped);
+        struct led_pattern_stats led;
+        led_pattern_get_stats(&led);
+        output_printf("LED: %lu bus writes/s, %lu total, %lu coalesced\n",
+                      (unsigned long)led.writes_per_s, (unsigned long)led.writes,
+                      (unsigned long)led.coalesced);
+        output_printf("Tasks: %lu (%lu done), %lu B flash\n",
+                      (unsigned long)todo_store.count, (unsigned long)todo_store.done,
+                      (unsigned long)(todo_store.snapshot_size + todo_store.journal_size));
+        output_printf("Jobs: %lu pending, %lu run, %lu rejected, longest step %lu us\n",
+                      (unsigned long)cmd_jobs.count, (unsigned long)cmd_jobs.run,
+                      (unsigned long)cmd_jobs.rejected, (unsigned long)cmd_jobs.step_max_us);
+        if (timesync_synced()) {
+            struct timesync_status ts;
+            timesync_get_status(&ts);
+            output_printf("Clock: offset %+lld us, delay %lld us, %+ld ppb\n",
+                          (long long)ts.offset_us, (long long)ts.delay_us, (long)ts.freq_ppb);
+        }
         output_write("Status: Running\n\n");
         return;
     }
@@ -424,26 +708,19 @@ void process_command(const char* cmd) {
     // ========== APPS COMMAND ==========
     if (strcmp(command, "apps") == 0) {
         output_write("\n=== AVAILABLE APPLICATIONS ===\n");
-        output_write("1. todo  - Task manager (max 2 tasks)\n");
-        output_write("2. blink - Control LED blinking\n");
-        output_write("3. clock - Real-time clock (NTP synced)\n");
+        for (size_t i = 0; i < APP_COUNT; i++) {
+            output_printf("%u. %-5s - %s\n", (unsigned)(i + 1), apps[i]->name, apps[i]->summary);
+        }
         output_write("\nUse 'run <app>' to start an application.\n\n");
         return;
     }
     
     // ========== CURRENT APP COMMAND ==========
     if (strcmp(command, "current") == 0) {
-        if (current_app == APP_NONE || 
-            (current_app == APP_TODO && !todo_state.running) ||
-            (current_app == APP_BLINK && !blink_state.running) ||
-            (current_app == APP_CLOCK && !clock_state.running)) {
+        if (!current_app) {
             output_write("No application currently running.\n");
         } else {
-            const char* app_name = "";
-            if (current_app == APP_TODO) app_name = "todo";
-            else if (current_app == APP_BLINK) app_name = "blink";
-            else if (current_app == APP_CLOCK) app_name = "clock";
-            output_printf("Current application: %s\n", app_name);
+            output_printf("Current application: %s\n", current_app->name);
         }
         return;
     }
@@ -457,105 +734,43 @@ void process_command(const char* cmd) {
         }
         
         // Stop current app first
-        if (current_app == APP_TODO && todo_state.running) todo_stop();
-        if (current_app == APP_BLINK && blink_state.running) blink_stop();
-        if (current_app == APP_CLOCK && clock_state.running) clock_stop();
+        if (current_app) app_exit();
         
         // Convert app name to lowercase
         for (char* p = arg1; *p; p++) *p = tolower(*p);
         
-        if (strcmp(arg1, "todo") == 0) {
-            current_app = APP_TODO;
-            todo_init();
-        } else if (strcmp(arg1, "blink") == 0) {
-            current_app = APP_BLINK;
-            blink_init();
-        } else if (strcmp(arg1, "clock") == 0) {
-            current_app = APP_CLOCK;
-            clock_init();
-        } else {
-            output_printf("Unknown app: %s\n", arg1);
-            output_write("Use 'apps' to see available applications.\n\n");
+        for (size_t i = 0; i < APP_COUNT; i++) {
+            if (strcmp(arg1, apps[i]->name) == 0) {
+                current_app = apps[i];
+                current_app->start();
+                return;
+            }
         }
+        output_printf("Unknown app: %s\n", arg1);
+        output_write("Use 'apps' to see available applications.\n\n");
         return;
     }
     
     // ========== STOP COMMAND ==========
     if (strcmp(command, "stop") == 0) {
-        bool stopped = false;
-        if (current_app == APP_TODO && todo_state.running) {
-            todo_stop();
-            stopped = true;
-        }
-        if (current_app == APP_BLINK && blink_state.running) {
-            blink_stop();
-            stopped = true;
-        }
-        if (current_app == APP_CLOCK && clock_state.running) {
-            clock_stop();
-            stopped = true;
-        }
-        
-        if (!stopped) {
+        if (current_app) {
+            app_exit();
+        } else {
             output_write("No application running.\n");
         }
-        current_app = APP_NONE;
         return;
     }
     
     // ========== REBOOT COMMAND ==========
     if (strcmp(command, "reboot") == 0) {
         output_write("Rebooting system...\n");
-        sleep_ms(500);
-        watchdog_enable(1, 1);
-        while(1);
-    }
-    
-    // ========== TODO APP COMMANDS ==========
-    if (current_app == APP_TODO && todo_state.running) {
-        if (strcmp(command, "list") == 0) {
-            todo_list();
-            return;
-        }
-        
-        if (strcmp(command, "add") == 0) {
-            if (strlen(arg1) == 0) {
-                output_write("Usage: add <task_name>\n");
-                todo_show_commands();
-                return;
-            }
-            todo_add(arg1);
-            return;
-        }
-        
-        if (strcmp(command, "done") == 0) {
-            int n = atoi(arg1);
-            todo_done(n);
-            return;
-        }
-        
-        if (strcmp(command, "del") == 0) {
-            int n = atoi(arg1);
-            todo_del(n);
-            return;
-        }
-    }
-    
-    // ========== BLINK APP COMMANDS ==========
-    if (current_app == APP_BLINK && blink_state.running) {
-        if (strcmp(command, "speed") == 0) {
-            uint32_t ms = atoi(arg1);
-            blink_set_speed(ms);
-            return;
-        }
+        app_timer_start(&reboot_timer, REBOOT_DELAY_MS, 0, reboot_now, NULL, NULL);
+        return;
     }
     
-    // ========== CLOCK APP COMMANDS ==========
-    if (current_app == APP_CLOCK && clock_state.running) {
-        if (strcmp(command, "show") == 0) {
-            clock_display();
-            return;
-        }
+    // ========== APP COMMANDS ==========
+    if (current_app && current_app->command(command, arg1)) {
+        return;
     }
     
     // Unknown command
@@ -596,9 +811,18 @@ const char *terminal_html =
     "<script>"
     "let cmdInput=document.getElementById('cmd');"
     "let output=document.getElementById('output');"
-    "function sendCmd(cmd){fetch('/cmd',{method:'POST',body:cmd||cmdInput.value}).then(r=>r.text()).then(t=>{output.textContent=t;output.scrollTop=output.scrollHeight});if(!cmd)cmdInput.value='';}"
+    "let seq=null,busy=false,again=false;"
+    "function add(t){if(!t)return;output.textContent=(output.textContent+t).slice(-20000);output.scrollTop=output.scrollHeight}"
+    "function poll(){if(busy){again=true;return}busy=true;"
+    "fetch('/output'+(seq===null?'':'?since='+seq)).then(r=>{seq=r.headers.get('X-Next');"
+    "let more=r.headers.get('X-More')==='1'||again,pending=+r.headers.get('X-Pending');"
+    "return r.text().then(t=>{add(t);busy=false;again=false;if(more)setTimeout(poll,0);else if(pending)setTimeout(poll,250)})"
+    "}).catch(()=>{busy=false})}"
+    "function sendCmd(cmd){let c=cmd||cmdInput.value;if(!cmd)cmdInput.value='';"
+    "if(c.trim().toLowerCase()==='clear')output.textContent='';"
+    "fetch('/cmd',{method:'POST',body:c}).then(r=>r.ok?poll():r.text().then(add))}"
     "cmdInput.addEventListener('keypress',e=>{if(e.key==='Enter')sendCmd()});"
-    "setInterval(()=>fetch('/output').then(r=>r.text()).then(t=>{if(t)output.textContent=t;output.scrollTop=output.scrollHeight}),1000);"
+    "setInterval(poll,1000);poll();"
     "</script></body></html>";
 
 static err_t tcp_close_client_connection(struct tcp_pcb *client_pcb) {
@@ -619,21 +843,48 @@ static err_t tcp_server_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
     return tcp_close_client_connection(pcb);
 }
 
-static void send_http_response(struct tcp_pcb *pcb, const char* content, const char* content_type) {
+// extra_headers: "" or complete header lines, each ending in \r\n
+static void send_http_response(struct tcp_pcb *pcb, const char* status, const char* extra_headers,
+                               const char* content, const char* content_type) {
     size_t content_len = strlen(content);
-    char header[256];
+    char header[320];
     snprintf(header, sizeof(header),
-        "HTTP/1.1 200 OK\r\n"
+        "HTTP/1.1 %s\r\n"
         "Content-Length: %zu\r\n"
         "Content-Type: %s\r\n"
+        "%s"
         "Connection: close\r\n\r\n",
-        content_len, content_type);
+        status, content_len, content_type, extra_headers);
     
     tcp_write(pcb, header, strlen(header), TCP_WRITE_FLAG_COPY);
     tcp_write(pcb, content, content_len, TCP_WRITE_FLAG_COPY);
     tcp_output(pcb);
 }
 
+// Numeric query parameter from the request line, e.g. since in
+// "GET /output?since=42 HTTP/1.1"
+static bool query_param(const char* request, const char* name, uint32_t* value) {
+    const char* target = strchr(request, ' ');
+    if (!target) {
+        return false;
+    }
+    const char* end = strpbrk(++target, " \r\n");
+    const char* p = strchr(target, '?');
+    size_t name_len = strlen(name);
+    while (p && (!end || p < end)) {
+        p++;
+        if (strncmp(p, name, name_len) == 0 && p[name_len] == '=') {
+            *value = strtoul(p + name_len + 1, NULL, 10);
+            return true;
+        }
+        p = strpbrk(p, "& \r\n");
+        if (p && *p != '&') {
+            break;
+        }
+    }
+    return false;
+}
+
 static err_t tcp_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
     if (!p) {
         return tcp_close_client_connection(pcb);
@@ -647,35 +898,48 @@ static err_t tcp_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err
             
             // Check request type - ORDER MATTERS!
             if (strncmp(request, "GET /output", 11) == 0) {
-                // Return terminal output only
-                char output[OUTPUT_BUFFER_SIZE];
-                output_read_all(output, sizeof(output));
-                send_http_response(pcb, output, "text/plain");
+                // Output after the client's cursor (all held output without
+                // one), optionally one job's only; X-Next is the new cursor
+                static char chunk[OUTPUT_CHUNK_SIZE];
+                uint32_t seq = output_buf.tail;
+                uint32_t job = 0;
+                bool more;
+                query_param(request, "since", &seq);
+                query_param(request, "job", &job);
+                output_read(&seq, (uint16_t)job, chunk, sizeof(chunk), &more);
+                char headers[128];
+                snprintf(headers, sizeof(headers),
+                    "X-Next: %lu\r\nX-More: %d\r\nX-Pending: %lu\r\nCache-Control: no-store\r\n",
+                    (unsigned long)seq, more ? 1 : 0, (unsigned long)cmd_pending());
+                send_http_response(pcb, "200 OK", headers, chunk, "text/plain");
             }
             else if (strncmp(request, "POST /cmd", 9) == 0) {
-                // Process command and return output
+                // Queue the command; its output arrives through /output
                 char *body = strstr(request, "\r\n\r\n");
-                if (body) {
-                    body += 4;
-                    process_command(body);
+                uint16_t id = body ? cmd_submit(body + 4) : 0;
+                if (id) {
+                    char headers[32], reply[32];
+                    snprintf(headers, sizeof(headers), "X-Job: %u\r\n", id);
+                    snprintf(reply, sizeof(reply), "job %u\n", id);
+                    send_http_response(pcb, "202 Accepted", headers, reply, "text/plain");
+                } else if (body) {
+                    send_http_response(pcb, "503 Service Unavailable", "",
+                                       "Busy: too many commands queued, try again.\n", "text/plain");
+                } else {
+                    send_http_response(pcb, "400 Bad Request", "", "No command.\n", "text/plain");
                 }
-                char output[OUTPUT_BUFFER_SIZE];
-                output_read_all(output, sizeof(output));
-                send_http_response(pcb, output, "text/plain");
             }
             else if (strncmp(request, "GET /", 5) == 0) {
                 // Serve terminal HTML page
-                char *html = (char*)malloc(strlen(terminal_html) + 20);
+                const char *ip_pos = strstr(terminal_html, "__IP__");
+                size_t prefix_len = ip_pos - terminal_html;
+                size_t ip_len = strlen(sys_state.ip_addr);
+                char *html = (char*)malloc(strlen(terminal_html) + ip_len + 1);
                 if (html) {
-                    strcpy(html, terminal_html);
-                    char *ip_pos = strstr(html, "__IP__");
-                    if (ip_pos) {
-                        char temp[2048];
-                        *ip_pos = '\0';
-                        snprintf(temp, sizeof(temp), "%s%s%s", html, sys_state.ip_addr, ip_pos + 6);
-                        strcpy(html, temp);
-                    }
-                    send_http_response(pcb, html, "text/html");
+                    memcpy(html, terminal_html, prefix_len);
+                    memcpy(html + prefix_len, sys_state.ip_addr, ip_len);
+                    strcpy(html + prefix_len + ip_len, ip_pos + 6);
+                    send_http_response(pcb, "200 OK", "", html, "text/html");
                     free(html);
                 }
             }
@@ -730,7 +994,10 @@ int main() {
     
     // Initialize system state
     sys_state.boot_time = get_absolute_time();
+    timesync_init();
+    app_timer_init();
     output_clear();
+    todo_storage_init();
     
     // Initialize WiFi
     if (cyw43_arch_init()) {
@@ -739,6 +1006,7 @@ int main() {
     }
 
     cyw43_arch_enable_sta_mode();
+    led_pattern_init();
     
     printf("Connecting to WiFi...\n");
     if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, 
@@ -754,13 +1022,8 @@ int main() {
     // Initialize NTP
     ntp_init();
     
-    // Startup blink
-    for (int i = 0; i < 3; i++) {
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-        sleep_ms(100);
-        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
-        sleep_ms(100);
-    }
+    // Startup blink, played while the server starts
+    led_pattern_blink(3, 100, 100);
     
     // Start web server
     tcp_server_state = (TCP_SERVER_T*)calloc(1, sizeof(TCP_SERVER_T));
@@ -782,18 +1045,22 @@ int main() {
     output_write("Type 'help' to see available commands.\n");
     output_write("Type 'apps' to see available applications.\n\n");
     
-    // Main loop
+    // Main loop: due app timers and a step of the current command job,
+    // then sleep until the next deadline or network event (network
+    // callbacks run from the WiFi interrupt)
     while (true) {
-        // Update background tasks
-        blink_tick();
-        clock_tick();
-        ntp_tick();
+        app_timer_run();
+        cmd_jobs_run();
         
         #if PICO_CYW43_ARCH_POLL
         cyw43_arch_poll();
-        sleep_ms(1);
+        if (!cmd_jobs_ready()) {
+            cyw43_arch_wait_for_work_until(app_timer_next());
+        }
         #else
-        sleep_ms(10);
+        if (!cmd_jobs_ready()) {
+            app_timer_wait();
+        }
         #endif
     }
 
@@ -22,6 +22,7 @@
 #define MEM_SIZE                    4000
 #define MEMP_NUM_TCP_SEG            32
 #define MEMP_NUM_ARP_QUEUE          10
+#define MEMP_NUM_TCP_PCB            12  // 4 clients, 4 connect scans, closing ones
 #define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
 #define LWIP_ETHERNET               1
@@ -40,12 +41,20 @@
 #define MEMP_STATS                  0
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
-#define LWIP_CHKSUM_ALGORITHM       3
+// Internet checksum from chksum.cpp (ADCS loop on the M33); TCP data is
+// checksummed while tcp_write() copies it
+#define LWIP_CHKSUM                 pico_chksum
+#define LWIP_CHKSUM_COPY(dst, src, len) pico_chksum_copy(dst, src, len)
+#define LWIP_CHECKSUM_ON_COPY       1
+#include "chksum.h"
 #define LWIP_DHCP                   1
 #define LWIP_IPV4                   1
 #define LWIP_TCP                    1
 #define LWIP_UDP                    1
 #define LWIP_DNS                    1
+// The shared DNS cache schedules its retries with sys_timeout(), the port
+// scan engine its pacing tick and the job server its scheduler tick
+#define MEMP_NUM_SYS_TIMEOUT        (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 3)
 #define LWIP_TCP_KEEPALIVE          1
 #define LWIP_NETIF_TX_SINGLE_PBUF   1
 #define DHCP_DOES_ARP_CHECK         0
@@ -8,6 +8,9 @@
 #include "lwip/tcp.h"
 #include "lwip/dns.h"
 #include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+#include "dns_cache.h"
+#include "port_scan.h"
 
 // WiFi credentials - CHANGE THESE!
 const char* WIFI_SSID = "YOUR_SSID";
@@ -17,254 +20,781 @@ const char* WIFI_PASSWORD = "YOUR_PASS";
 #define SERVER_PORT 9999
 #define SCAN_TIMEOUT_MS 500
 
-class PortScanner {
-private:
-    struct tcp_pcb* server_pcb;
-    struct tcp_pcb* client_pcb;
-    
-    ip_addr_t target_ip;
-    uint16_t current_port;
+// Job server: every client gets a session, every SCAN a job. Up to
+// MAX_ACTIVE_JOBS run at once; the rest wait in submission order.
+#define MAX_SESSIONS 4
+#define MAX_JOBS 16
+#define MAX_ACTIVE_JOBS 4
+#define MAX_LINE 128
+#define SESSION_OUT_MAX 4096    // Queued output; live results beyond it are dropped,
+                                // and commands wait until it drains
+#define SCHED_TICK_MS 20
+
+// Probe budget shared evenly by the running SYN/UDP jobs
+#define TOTAL_RATE_PPS PORT_SCAN_DEFAULT_RATE
+#define TOTAL_WINDOW PORT_SCAN_DEFAULT_WINDOW
+
+class PortScanner;
+
+enum job_kind { JOB_CONNECT, JOB_SYN, JOB_UDP };
+enum job_state { JOB_FREE, JOB_QUEUED, JOB_RESOLVING, JOB_RUNNING };
+
+struct Session {
+    PortScanner* server;
+    struct tcp_pcb* pcb;        // nullptr when the slot is free
+    std::string in;             // Partial command line
+    std::string unread;         // Received, not yet parsed or acknowledged
+    std::string out;            // Not yet taken by tcp_write()
+    uint32_t dropped;           // Live result lines lost to a slow reader
+    uint32_t number;            // Client number, for the log
+};
+
+struct Job {
+    PortScanner* server;
+    enum job_state state;
+    uint32_t id;                // Increasing, so also the queue order
+    int session;
+    enum job_kind kind;
+    char host[32];
+    ip_addr_t target;
     uint16_t start_port;
     uint16_t end_port;
     std::vector<uint16_t> open_ports;
-    bool scanning;
-    absolute_time_t scan_start_time;
-    
+    absolute_time_t start_time;
+
+    // Connect jobs: one attempt at a time
+    struct tcp_pcb* pcb;
+    uint16_t current_port;
+    absolute_time_t connect_deadline;
+
+    // SYN and UDP jobs run in the shared port scan engine
+    struct port_scan scan;
+    std::vector<uint8_t> states;
+};
+
+static const char* job_kind_name(enum job_kind kind) {
+    return kind == JOB_SYN ? "SYN" : kind == JOB_UDP ? "UDP" : "connect";
+}
+
+class PortScanner {
+private:
+    struct tcp_pcb* server_pcb;
+    Session sessions[MAX_SESSIONS];
+    Job jobs[MAX_JOBS];
+    uint32_t next_job_id;
+    uint32_t next_client;
+    bool ticking;
+
 public:
-    PortScanner() : server_pcb(nullptr), client_pcb(nullptr), 
-                    current_port(0), start_port(0), end_port(0), 
-                    scanning(false) {}
-    
-    void send_message(const char* msg) {
-        if (client_pcb && msg) {
-            tcp_write(client_pcb, msg, strlen(msg), TCP_WRITE_FLAG_COPY);
-            tcp_output(client_pcb);
+    PortScanner() : server_pcb(nullptr), next_job_id(1), next_client(1), ticking(false) {
+        for (int i = 0; i < MAX_SESSIONS; i++) {
+            sessions[i].server = this;
+            sessions[i].pcb = nullptr;
+            sessions[i].dropped = 0;
+            sessions[i].number = 0;
+        }
+        for (int i = 0; i < MAX_JOBS; i++) {
+            jobs[i].server = this;
+            jobs[i].state = JOB_FREE;
+            jobs[i].pcb = nullptr;
         }
     }
-    
-    void send_message(const std::string& msg) {
-        send_message(msg.c_str());
+
+    // ===== OUTPUT =====
+
+    // Queue text for a client. Live results (droppable) give way when the
+    // client is not reading; replies and summaries are always kept. Those
+    // only come from commands, which are not parsed while the queue is
+    // over SESSION_OUT_MAX (see parse_input()), so they stay bounded too.
+    void send_message(int session, const char* msg, bool droppable = false) {
+        Session* s = &sessions[session];
+        if (!s->pcb || !msg) {
+            return;
+        }
+        size_t len = strlen(msg);
+        if (droppable && s->out.size() + len > SESSION_OUT_MAX) {
+            s->dropped++;
+            return;
+        }
+        if (s->dropped && !droppable) {
+            char note[48];
+            snprintf(note, sizeof(note), "(%lu result lines dropped)\n", (unsigned long)s->dropped);
+            s->dropped = 0;
+            s->out += note;
+        }
+        s->out.append(msg, len);
+        flush_session(session);
+    }
+
+    void send_message(int session, const std::string& msg) {
+        send_message(session, msg.c_str());
+    }
+
+    // Give lwIP as much queued output as the send buffer has room for; the
+    // sent and poll callbacks bring the rest as the client reads it
+    void flush_session(int session) {
+        Session* s = &sessions[session];
+        if (!s->pcb || s->out.empty()) {
+            return;
+        }
+        size_t len = s->out.size();
+        size_t room = tcp_sndbuf(s->pcb);
+        if (len > room) {
+            len = room;
+        }
+        if (len > 0 && tcp_write(s->pcb, s->out.data(), (u16_t)len, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+            s->out.erase(0, len);
+            tcp_output(s->pcb);
+        }
     }
-    
+
     // Static callback wrappers
     static err_t static_accept_callback(void* arg, struct tcp_pcb* newpcb, err_t err) {
         return ((PortScanner*)arg)->accept_callback(newpcb, err);
     }
-    
+
     static err_t static_recv_callback(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
-        return ((PortScanner*)arg)->recv_callback(tpcb, p, err);
+        Session* s = (Session*)arg;
+        return s->server->recv_callback(s, tpcb, p, err);
+    }
+
+    static err_t static_sent_callback(void* arg, struct tcp_pcb* tpcb, u16_t len) {
+        Session* s = (Session*)arg;
+        s->server->flush_session(s->server->session_index(s));
+        s->server->parse_input(s->server->session_index(s));
+        return ERR_OK;
     }
-    
+
+    static err_t static_poll_callback(void* arg, struct tcp_pcb* tpcb) {
+        Session* s = (Session*)arg;
+        s->server->flush_session(s->server->session_index(s));
+        s->server->parse_input(s->server->session_index(s));
+        return ERR_OK;
+    }
+
+    static void static_session_error(void* arg, err_t err) {
+        Session* s = (Session*)arg;
+        s->server->session_error(s);
+    }
+
     static err_t static_scan_connected(void* arg, struct tcp_pcb* tpcb, err_t err) {
-        return ((PortScanner*)arg)->scan_connected_callback(tpcb, err);
+        Job* job = (Job*)arg;
+        return job->server->scan_connected_callback(job, tpcb, err);
     }
-    
+
     static void static_scan_error(void* arg, err_t err) {
-        ((PortScanner*)arg)->scan_error_callback(err);
+        Job* job = (Job*)arg;
+        job->server->scan_error_callback(job, err);
+    }
+
+    static void static_dns_found(const char* name, enum dns_result result, const ip_addr_t* addr, void* arg) {
+        Job* job = (Job*)arg;
+        job->server->dns_found(job, result, addr);
+    }
+
+    static void static_raw_event(struct port_scan* scan, enum port_scan_event event, uint16_t port, void* arg) {
+        Job* job = (Job*)arg;
+        job->server->raw_event(job, event, port);
+    }
+
+    static void static_tick(void* arg) {
+        ((PortScanner*)arg)->tick();
     }
-    
+
+    // ===== SESSIONS =====
+
+    int session_index(Session* s) {
+        return (int)(s - sessions);
+    }
+
     // Accept new client connection
     err_t accept_callback(struct tcp_pcb* newpcb, err_t err) {
         if (err != ERR_OK || newpcb == nullptr) {
             return ERR_VAL;
         }
-        
-        printf("Client connected\n");
-        client_pcb = newpcb;
-        tcp_arg(client_pcb, this);
-        tcp_recv(client_pcb, static_recv_callback);
-        
-        send_message("=== Pico Port Scanner v1.0 ===\n");
-        send_message("Usage: SCAN <target_ip> <start_port>-<end_port>\n");
-        send_message("Example: SCAN 192.168.1.1 1-1024\n");
-        send_message("> ");
-        
+
+        Session* s = nullptr;
+        for (int i = 0; i < MAX_SESSIONS; i++) {
+            if (!sessions[i].pcb) {
+                s = &sessions[i];
+                break;
+            }
+        }
+        if (!s) {
+            static const char busy[] = "Scanner busy: too many clients\n";
+            tcp_write(newpcb, busy, sizeof(busy) - 1, 0);
+            if (tcp_close(newpcb) != ERR_OK) {
+                tcp_abort(newpcb);
+                return ERR_ABRT;
+            }
+            return ERR_OK;
+        }
+
+        s->pcb = newpcb;
+        s->in.clear();
+        s->unread.clear();
+        s->out.clear();
+        s->dropped = 0;
+        s->number = next_client++;
+        printf("Client %lu connected\n", (unsigned long)s->number);
+        tcp_arg(newpcb, s);
+        tcp_recv(newpcb, static_recv_callback);
+        tcp_sent(newpcb, static_sent_callback);
+        tcp_poll(newpcb, static_poll_callback, 2);
+        tcp_err(newpcb, static_session_error);
+
+        int session = session_index(s);
+        send_message(session, "=== Pico Port Scanner v1.1 ===\n");
+        send_message(session, "Usage: SCAN <target_ip|host> <start_port>-<end_port> [SYN|UDP]\n");
+        send_message(session, "       STATUS [job], CANCEL <job>\n");
+        send_message(session, "Example: SCAN 192.168.1.1 1-1024 SYN\n");
+        send_message(session, "> ");
+
         return ERR_OK;
     }
-    
+
     // Receive data from client
-    err_t recv_callback(struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
+    err_t recv_callback(Session* s, struct tcp_pcb* tpcb, struct pbuf* p, err_t err) {
+        int session = session_index(s);
         if (!p) {
             // Connection closed
-            printf("Client disconnected\n");
-            tcp_close(tpcb);
-            client_pcb = nullptr;
-            scanning = false;
+            printf("Client %lu disconnected\n", (unsigned long)s->number);
+            end_session(session);
+            if (tcp_close(tpcb) != ERR_OK) {
+                tcp_abort(tpcb);
+                return ERR_ABRT;
+            }
             return ERR_OK;
         }
-        
-        if (p->tot_len > 0) {
-            char buffer[256] = {0};
-            pbuf_copy_partial(p, buffer, p->tot_len, 0);
-            buffer[p->tot_len] = '\0';
-            
-            printf("Received: %s\n", buffer);
-            parse_command(buffer);
-        }
-        
-        tcp_recved(tpcb, p->tot_len);
+
+        // Held unacknowledged until parsed: the receive window closes on a
+        // client that sends commands without reading the replies
+        for (struct pbuf* q = p; q; q = q->next) {
+            s->unread.append((const char*)q->payload, q->len);
+        }
         pbuf_free(p);
-        
+        parse_input(session);
+
         return ERR_OK;
     }
-    
+
+    // Run the commands received so far while the output queue has room,
+    // and open the window by what was used. A command may span segments,
+    // and a segment hold several.
+    void parse_input(int session) {
+        Session* s = &sessions[session];
+        size_t used = 0;
+        while (s->pcb && used < s->unread.size() && s->out.size() < SESSION_OUT_MAX) {
+            char c = s->unread[used++];
+            if (c == '\n' || c == '\r') {
+                if (!s->in.empty()) {
+                    std::string line;
+                    line.swap(s->in);
+                    printf("Client %lu: %s\n", (unsigned long)s->number, line.c_str());
+                    parse_command(session, line.c_str());
+                }
+            } else if (s->in.size() < MAX_LINE) {
+                s->in += c;
+            }
+        }
+        if (!s->pcb || used == 0) {
+            return;
+        }
+        s->unread.erase(0, used);
+        while (used > 0) {
+            u16_t n = used > 0xFFFF ? 0xFFFF : (u16_t)used;
+            tcp_recved(s->pcb, n);
+            used -= n;
+        }
+    }
+
+    // lwIP has already freed the PCB
+    void session_error(Session* s) {
+        printf("Client %lu lost\n", (unsigned long)s->number);
+        s->pcb = nullptr;
+        end_session(session_index(s));
+    }
+
+    // Cancel whatever the client left running or queued and free its slot
+    void end_session(int session) {
+        for (int i = 0; i < MAX_JOBS; i++) {
+            if (jobs[i].state != JOB_FREE && jobs[i].session == session) {
+                cancel_job(&jobs[i]);
+            }
+        }
+        Session* s = &sessions[session];
+        if (s->pcb) {
+            tcp_arg(s->pcb, nullptr);
+            tcp_recv(s->pcb, nullptr);
+            tcp_sent(s->pcb, nullptr);
+            tcp_poll(s->pcb, nullptr, 0);
+            tcp_err(s->pcb, nullptr);
+            s->pcb = nullptr;
+        }
+        s->in.clear();
+        s->unread.clear();
+        s->out.clear();
+        schedule();
+    }
+
+    // ===== COMMANDS =====
+
     // Parse command from client
-    void parse_command(const char* cmd) {
-        char command[16], ip_str[32], ports[32];
-        
-        if (sscanf(cmd, "%15s %31s %31s", command, ip_str, ports) != 3) {
-            send_message("Invalid format. Use: SCAN <ip> <start>-<end>\n> ");
+    void parse_command(int session, const char* cmd) {
+        char command[16], ip_str[32], ports[32], mode[16];
+
+        int fields = sscanf(cmd, "%15s %31s %31s %15s", command, ip_str, ports, mode);
+        if (fields < 1) {
+            send_message(session, "> ");
             return;
         }
-        
+
+        if (strcasecmp(command, "STATUS") == 0) {
+            status_command(session, fields >= 2 ? ip_str : nullptr);
+            send_message(session, "> ");
+            return;
+        }
+
+        if (strcasecmp(command, "CANCEL") == 0) {
+            cancel_command(session, fields >= 2 ? ip_str : nullptr);
+            send_message(session, "> ");
+            return;
+        }
+
         if (strcasecmp(command, "SCAN") != 0) {
-            send_message("Unknown command. Use SCAN\n> ");
+            send_message(session, "Unknown command. Use SCAN, STATUS or CANCEL\n> ");
             return;
         }
-        
-        // Parse IP address
-        if (!ipaddr_aton(ip_str, &target_ip)) {
-            send_message("Invalid IP address\n> ");
+
+        if (fields < 3) {
+            send_message(session, "Invalid format. Use: SCAN <ip|host> <start>-<end> [SYN|UDP]\n> ");
             return;
         }
-        
+
+        enum job_kind kind = JOB_CONNECT;
+        if (fields == 4) {
+            if (strcasecmp(mode, "SYN") == 0) {
+                kind = JOB_SYN;
+            } else if (strcasecmp(mode, "UDP") == 0) {
+                kind = JOB_UDP;
+            } else {
+                send_message(session, "Unknown scan mode. Use SYN, UDP or leave it out for connect\n> ");
+                return;
+            }
+        }
+
         // Parse port range
-        if (sscanf(ports, "%hu-%hu", &start_port, &end_port) != 2) {
-            send_message("Invalid port range. Use format: 1-1024\n> ");
+        unsigned start_port, end_port;
+        if (sscanf(ports, "%u-%u", &start_port, &end_port) != 2) {
+            send_message(session, "Invalid port range. Use format: 1-1024\n> ");
             return;
         }
-        
+
         if (start_port < 1 || end_port > 65535 || start_port > end_port) {
-            send_message("Invalid port range (1-65535)\n> ");
+            send_message(session, "Invalid port range (1-65535)\n> ");
             return;
         }
-        
-        // Start scanning
-        start_scan();
-    }
-    
-    void start_scan() {
-        scanning = true;
-        current_port = start_port;
-        open_ports.clear();
-        scan_start_time = get_absolute_time();
-        
-        char msg[128];
-        snprintf(msg, sizeof(msg), "Scanning %s ports %d-%d...\n", 
-                 ipaddr_ntoa(&target_ip), start_port, end_port);
-        send_message(msg);
-        
-        scan_next_port();
-    }
-    
-    void scan_next_port() {
-        if (!scanning || current_port > end_port) {
-            finish_scan();
+
+        Job* job = nullptr;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            if (jobs[i].state == JOB_FREE) {
+                job = &jobs[i];
+                break;
+            }
+        }
+        if (!job) {
+            send_message(session, "Job table full, try again later\n> ");
             return;
         }
-        
-        // Progress update every 100 ports
-        if ((current_port - start_port) % 100 == 0) {
-            float progress = ((float)(current_port - start_port) / 
-                            (end_port - start_port + 1)) * 100.0f;
+
+        int ahead = 0;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            ahead += jobs[i].state == JOB_QUEUED;
+        }
+
+        job->state = JOB_QUEUED;
+        job->id = next_job_id++;
+        job->session = session;
+        job->kind = kind;
+        snprintf(job->host, sizeof(job->host), "%s", ip_str);
+        job->start_port = (uint16_t)start_port;
+        job->end_port = (uint16_t)end_port;
+        job->open_ports.clear();
+        job->pcb = nullptr;
+
+        char msg[96];
+        if (ahead == 0 && active_jobs() < MAX_ACTIVE_JOBS) {
+            snprintf(msg, sizeof(msg), "Job %lu accepted\n", (unsigned long)job->id);
+        } else {
+            snprintf(msg, sizeof(msg), "Job %lu queued behind %d job(s)\n", (unsigned long)job->id, ahead);
+        }
+        send_message(session, msg);
+        schedule();
+        send_message(session, "> ");
+    }
+
+    // Every job, or one in detail
+    void status_command(int session, const char* arg) {
+        char msg[160];
+        uint32_t id = arg ? (uint32_t)strtoul(arg, nullptr, 10) : 0;
+        int shown = 0;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            Job* job = &jobs[i];
+            if (job->state == JOB_FREE || (id && job->id != id)) {
+                continue;
+            }
+            if (shown++ == 0) {
+                send_message(session, "JOB  OWNER  TYPE     STATE      TARGET              PORTS        DONE   OPEN\n");
+            }
+            uint32_t total = (uint32_t)job->end_port - job->start_port + 1;
+            snprintf(msg, sizeof(msg), "%-4lu %-6s %-8s %-10s %-19s %5u-%-5u %4lu%% %6u\n",
+                     (unsigned long)job->id, job->session == session ? "you" : "other", job_kind_name(job->kind),
+                     job->state == JOB_QUEUED ? "queued" : job->state == JOB_RESOLVING ? "resolving" : "running",
+                     job->host, job->start_port, job->end_port,
+                     (unsigned long)(100ull * job_progress(job) / total), (unsigned)job->open_ports.size());
+            send_message(session, msg);
+            if (id && job->kind != JOB_CONNECT && job->state == JOB_RUNNING) {
+                const struct port_scan_stats* stats = &job->scan.stats;
+                snprintf(msg, sizeof(msg), "     %lu probes, %lu retries, %lu/s, window %u\n",
+                         (unsigned long)stats->sent, (unsigned long)stats->retries,
+                         (unsigned long)stats->rate_pps, job->scan.options.window);
+                send_message(session, msg);
+            }
+        }
+        if (shown == 0) {
+            send_message(session, id ? "No such job\n" : "No jobs\n");
+        }
+    }
+
+    // Clients may only cancel their own jobs
+    void cancel_command(int session, const char* arg) {
+        uint32_t id = arg ? (uint32_t)strtoul(arg, nullptr, 10) : 0;
+        for (int i = 0; id && i < MAX_JOBS; i++) {
+            Job* job = &jobs[i];
+            if (job->state == JOB_FREE || job->id != id) {
+                continue;
+            }
+            if (job->session != session) {
+                send_message(session, "Job belongs to another client\n");
+                return;
+            }
+            cancel_job(job);
             char msg[64];
-            snprintf(msg, sizeof(msg), "Progress: %.1f%% (port %d)\r", 
-                    progress, current_port);
-            send_message(msg);
-        }
-        
-        // Create new TCP connection for port scan
-        struct tcp_pcb* scan_pcb = tcp_new();
-        if (!scan_pcb) {
-            current_port++;
-            scan_next_port();
+            snprintf(msg, sizeof(msg), "Job %lu cancelled\n", (unsigned long)id);
+            send_message(session, msg);
+            schedule();
             return;
         }
-        
-        tcp_arg(scan_pcb, this);
-        tcp_err(scan_pcb, static_scan_error);
-        
-        // Attempt to connect
-        err_t err = tcp_connect(scan_pcb, &target_ip, current_port, static_scan_connected);
-        
-        if (err != ERR_OK) {
-            tcp_abort(scan_pcb);
-            current_port++;
-            scan_next_port();
+        send_message(session, "Usage: CANCEL <job>; see STATUS for job numbers\n");
+    }
+
+    // ===== SCHEDULER =====
+
+    int active_jobs() {
+        int count = 0;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            count += jobs[i].state == JOB_RESOLVING || jobs[i].state == JOB_RUNNING;
+        }
+        return count;
+    }
+
+    uint32_t job_progress(Job* job) {
+        if (job->state != JOB_RUNNING) {
+            return 0;
+        }
+        if (job->kind == JOB_CONNECT) {
+            return (uint32_t)job->current_port - job->start_port;
+        }
+        return job->scan.stats.resolved;
+    }
+
+    // Start queued jobs, oldest first, while there is room, then share the
+    // probe budget between the engine jobs now running
+    void schedule() {
+        while (active_jobs() < MAX_ACTIVE_JOBS) {
+            Job* oldest = nullptr;
+            for (int i = 0; i < MAX_JOBS; i++) {
+                if (jobs[i].state == JOB_QUEUED && (!oldest || jobs[i].id < oldest->id)) {
+                    oldest = &jobs[i];
+                }
+            }
+            if (!oldest) {
+                break;
+            }
+            activate_job(oldest);
+        }
+        rebalance();
+
+        bool busy = active_jobs() > 0;
+        if (busy && !ticking) {
+            ticking = true;
+            sys_timeout(SCHED_TICK_MS, static_tick, this);
+        } else if (!busy && ticking) {
+            ticking = false;
+            sys_untimeout(static_tick, this);
+        }
+    }
+
+    // Equal shares of the rate and window for every running SYN/UDP job;
+    // the engine's tick serves them round-robin within those shares
+    void rebalance() {
+        int engine_jobs = 0;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            engine_jobs += jobs[i].state == JOB_RUNNING && jobs[i].kind != JOB_CONNECT;
+        }
+        if (engine_jobs == 0) {
+            return;
+        }
+        uint16_t rate = (uint16_t)(TOTAL_RATE_PPS / engine_jobs);
+        uint8_t window = (uint8_t)(TOTAL_WINDOW / engine_jobs);
+        for (int i = 0; i < MAX_JOBS; i++) {
+            Job* job = &jobs[i];
+            if (job->state == JOB_RUNNING && job->kind != JOB_CONNECT) {
+                port_scan_set_limits(&job->scan, rate ? rate : 1, window ? window : 1);
+            }
+        }
+    }
+
+    // Connect attempts still unanswered after SCAN_TIMEOUT_MS count as closed
+    void tick() {
+        ticking = false;
+        absolute_time_t now = get_absolute_time();
+        for (int i = 0; i < MAX_JOBS; i++) {
+            Job* job = &jobs[i];
+            if (job->state == JOB_RUNNING && job->kind == JOB_CONNECT && job->pcb &&
+                absolute_time_diff_us(job->connect_deadline, now) > 0) {
+                drop_connect_pcb(job);
+                advance_connect(job);
+            }
+        }
+        schedule();
+    }
+
+    void activate_job(Job* job) {
+        // Address or hostname (through the DNS cache, never blocking)
+        job->state = JOB_RESOLVING;
+        switch (dns_cache_lookup(job->host, &job->target, static_dns_found, job)) {
+            case DNS_RESULT_OK:
+                start_scan(job);
+                break;
+            case DNS_RESULT_PENDING:
+                break;
+            case DNS_RESULT_NXDOMAIN:
+                end_job(job, "Unknown host");
+                break;
+            default:
+                end_job(job, "Cannot resolve host");
+                break;
+        }
+    }
+
+    void dns_found(Job* job, enum dns_result result, const ip_addr_t* addr) {
+        if (result != DNS_RESULT_OK) {
+            end_job(job, result == DNS_RESULT_NXDOMAIN ? "Unknown host" : "Cannot resolve host");
+        } else {
+            job->target = *addr;
+            start_scan(job);
+        }
+        schedule();
+    }
+
+    // Free the job's slot, telling its client why if there is a reason
+    void end_job(Job* job, const char* why) {
+        if (why) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "\n[job %lu] %s\n> ", (unsigned long)job->id, why);
+            send_message(job->session, msg);
+        }
+        job->state = JOB_FREE;
+        job->open_ports.clear();
+        job->states = std::vector<uint8_t>();
+    }
+
+    void cancel_job(Job* job) {
+        if (job->state == JOB_RESOLVING) {
+            dns_cache_cancel(static_dns_found, job);
+        } else if (job->state == JOB_RUNNING) {
+            if (job->kind == JOB_CONNECT) {
+                drop_connect_pcb(job);
+            } else {
+                port_scan_stop(&job->scan);
+            }
+        }
+        end_job(job, nullptr);
+    }
+
+    // ===== SCANS =====
+
+    void start_scan(Job* job) {
+        job->state = JOB_RUNNING;
+        job->current_port = job->start_port;
+        job->start_time = get_absolute_time();
+
+        char msg[128];
+        snprintf(msg, sizeof(msg), "\n[job %lu] %s %s ports %d-%d...\n", (unsigned long)job->id,
+                 job->kind == JOB_CONNECT ? "Scanning" : job->kind == JOB_UDP ? "UDP scanning" : "SYN scanning",
+                 ipaddr_ntoa(&job->target), job->start_port, job->end_port);
+        send_message(job->session, msg);
+
+        if (job->kind != JOB_CONNECT) {
+            struct port_scan_options options;
+            port_scan_options_default(&options);
+            options.mode = job->kind == JOB_UDP ? PORT_SCAN_UDP : PORT_SCAN_SYN;
+            options.first_port = job->start_port;
+            options.last_port = job->end_port;
+            job->states.assign(PORT_SCAN_STATE_BYTES((uint32_t)job->end_port - job->start_port + 1), 0);
+            if (!port_scan_start(&job->scan, &job->target, &options, job->states.data(), static_raw_event, job)) {
+                end_job(job, "Cannot start scan");
+            }
+            return;
+        }
+
+        scan_next_port(job);
+    }
+
+    // Port scan engine events (lwIP context)
+    void raw_event(Job* job, enum port_scan_event event, uint16_t port) {
+        if (event == PORT_SCAN_EVENT_DONE) {
+            finish_scan(job);
+            schedule();
+            return;
+        }
+        char msg[64];
+        snprintf(msg, sizeof(msg), "[+] Job %lu: port %d OPEN\n", (unsigned long)job->id, port);
+        send_message(job->session, msg, true);
+        job->open_ports.push_back(port);
+    }
+
+    // Abort the attempt in progress without hearing about it in tcp_err
+    void drop_connect_pcb(Job* job) {
+        if (job->pcb) {
+            tcp_arg(job->pcb, nullptr);
+            tcp_err(job->pcb, nullptr);
+            tcp_abort(job->pcb);
+            job->pcb = nullptr;
         }
     }
-    
-    err_t scan_connected_callback(struct tcp_pcb* tpcb, err_t err) {
+
+    // Connect to current_port, or the first port after it a PCB can be had for
+    void scan_next_port(Job* job) {
+        while (true) {
+            // Progress update every 100 ports
+            if ((job->current_port - job->start_port) % 100 == 0) {
+                float progress = ((float)(job->current_port - job->start_port) /
+                                (job->end_port - job->start_port + 1)) * 100.0f;
+                char msg[64];
+                snprintf(msg, sizeof(msg), "Job %lu: %.1f%% (port %d)\r", (unsigned long)job->id,
+                        progress, job->current_port);
+                send_message(job->session, msg, true);
+            }
+
+            // Create new TCP connection for port scan
+            struct tcp_pcb* scan_pcb = tcp_new();
+            if (scan_pcb) {
+                tcp_arg(scan_pcb, job);
+                tcp_err(scan_pcb, static_scan_error);
+
+                // Attempt to connect
+                if (tcp_connect(scan_pcb, &job->target, job->current_port, static_scan_connected) == ERR_OK) {
+                    job->pcb = scan_pcb;
+                    job->connect_deadline = make_timeout_time_ms(SCAN_TIMEOUT_MS);
+                    return;
+                }
+                tcp_abort(scan_pcb);
+            }
+            if (job->current_port == job->end_port) {
+                finish_scan(job);
+                return;
+            }
+            job->current_port++;
+        }
+    }
+
+    err_t scan_connected_callback(Job* job, struct tcp_pcb* tpcb, err_t err) {
         if (err == ERR_OK) {
             // Port is open!
             char msg[64];
-            snprintf(msg, sizeof(msg), "\n[+] Port %d OPEN\n", current_port);
-            send_message(msg);
-            open_ports.push_back(current_port);
-        }
-        
-        tcp_abort(tpcb);
-        current_port++;
-        
-        // Small delay to avoid overwhelming
-        sleep_ms(5);
-        scan_next_port();
-        
-        return ERR_OK;
+            snprintf(msg, sizeof(msg), "\n[+] Job %lu: port %d OPEN\n", (unsigned long)job->id, job->current_port);
+            send_message(job->session, msg, true);
+            job->open_ports.push_back(job->current_port);
+        }
+
+        drop_connect_pcb(job);
+        advance_connect(job);
+        return ERR_ABRT;
+    }
+
+    // Port closed or unreachable; lwIP has already freed the PCB
+    void scan_error_callback(Job* job, err_t err) {
+        job->pcb = nullptr;
+        advance_connect(job);
     }
-    
-    void scan_error_callback(err_t err) {
-        // Port closed or unreachable
-        current_port++;
-        scan_next_port();
-    }
-    
-    void finish_scan() {
-        if (!scanning) return;
-        
-        scanning = false;
-        int64_t elapsed = absolute_time_diff_us(scan_start_time, get_absolute_time()) / 1000;
-        
+
+    void advance_connect(Job* job) {
+        if (job->current_port == job->end_port) {
+            finish_scan(job);
+            schedule();
+            return;
+        }
+        job->current_port++;
+        scan_next_port(job);
+    }
+
+    void finish_scan(Job* job) {
+        if (job->state != JOB_RUNNING) return;
+
+        int session = job->session;
+        int64_t elapsed = absolute_time_diff_us(job->start_time, get_absolute_time()) / 1000;
+
         char msg[256];
-        snprintf(msg, sizeof(msg), "\n\n=== Scan Complete ===\n");
-        send_message(msg);
-        
-        snprintf(msg, sizeof(msg), "Scanned %d ports in %lld ms\n", 
-                (end_port - start_port + 1), elapsed);
-        send_message(msg);
-        
-        snprintf(msg, sizeof(msg), "Found %zu open port(s)\n", open_ports.size());
-        send_message(msg);
-        
-        if (!open_ports.empty()) {
-            send_message("Open ports: ");
-            for (size_t i = 0; i < open_ports.size(); i++) {
-                snprintf(msg, sizeof(msg), "%d ", open_ports[i]);
-                send_message(msg);
+        snprintf(msg, sizeof(msg), "\n\n=== Job %lu Complete ===\n", (unsigned long)job->id);
+        send_message(session, msg);
+
+        snprintf(msg, sizeof(msg), "Scanned %d ports of %s in %lld ms\n",
+                (job->end_port - job->start_port + 1), job->host, elapsed);
+        send_message(session, msg);
+
+        snprintf(msg, sizeof(msg), "Found %zu open port(s)\n", job->open_ports.size());
+        send_message(session, msg);
+
+        if (job->kind != JOB_CONNECT) {
+            snprintf(msg, sizeof(msg), "%lu closed, %lu %s; %lu probes, %lu retries\n",
+                     (unsigned long)job->scan.stats.closed, (unsigned long)job->scan.stats.filtered,
+                     job->kind == JOB_UDP ? "open|filtered" : "filtered",
+                     (unsigned long)job->scan.stats.sent, (unsigned long)job->scan.stats.retries);
+            send_message(session, msg);
+        }
+
+        if (!job->open_ports.empty()) {
+            send_message(session, "Open ports: ");
+            for (size_t i = 0; i < job->open_ports.size(); i++) {
+                snprintf(msg, sizeof(msg), "%d ", job->open_ports[i]);
+                send_message(session, msg);
             }
-            send_message("\n");
+            send_message(session, "\n");
         }
-        
-        send_message("\n> ");
+
+        end_job(job, nullptr);
+        send_message(session, "\n> ");
     }
-    
+
     bool start_server() {
         server_pcb = tcp_new();
         if (!server_pcb) {
             printf("Failed to create server PCB\n");
             return false;
         }
-        
+
         err_t err = tcp_bind(server_pcb, IP_ADDR_ANY, SERVER_PORT);
         if (err != ERR_OK) {
             printf("Failed to bind to port %d\n", SERVER_PORT);
             return false;
         }
-        
+
         server_pcb = tcp_listen(server_pcb);
         tcp_arg(server_pcb, this);
         tcp_accept(server_pcb, static_accept_callback);
-        
+
         printf("Server listening on port %d\n", SERVER_PORT);
         return true;
     }
@@ -275,48 +805,51 @@ PortScanner* scanner = nullptr;
 
 int main() {
     stdio_init_all();
-    
+
     // Initialize Wi-Fi chip
     if (cyw43_arch_init()) {
         printf("Failed to initialize WiFi\n");
         return 1;
     }
-    
+
     // Blink LED once on startup
     cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
     sleep_ms(500);
     cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
-    
+
     printf("Pico Port Scanner Starting...\n");
-    
+
     // Enable station mode
     cyw43_arch_enable_sta_mode();
-    
+
     printf("Connecting to WiFi '%s'...\n", WIFI_SSID);
-    if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, 
+    if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD,
                                            CYW43_AUTH_WPA2_AES_PSK, 30000)) {
         printf("Failed to connect to WiFi\n");
         return 1;
     }
-    
+
     printf("Connected to WiFi!\n");
     printf("IP Address: %s\n", ip4addr_ntoa(netif_ip4_addr(netif_list)));
-    
+
     // Create and start scanner
     scanner = new PortScanner();
-    if (!scanner->start_server()) {
+    cyw43_arch_lwip_begin();
+    bool started = scanner->start_server();
+    cyw43_arch_lwip_end();
+    if (!started) {
         printf("Failed to start server\n");
         return 1;
     }
-    
-    printf("\nReady! Connect with: nc %s %d\n", 
+
+    printf("\nReady! Connect with: nc %s %d\n",
            ip4addr_ntoa(netif_ip4_addr(netif_list)), SERVER_PORT);
-    
+
     // Main loop
     while (true) {
         sleep_ms(100);
     }
-    
+
     cyw43_arch_deinit();
     return 0;
 }
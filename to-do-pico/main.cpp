@@ -1,83 +1,96 @@
 #include "pico/stdlib.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include "flash_fs.h"
+#include "todo_store.h"
 
-#define MAX 2
+// Tasks are kept in a to-do store (todo_store.h) in the last 512 KB of
+// flash, the same list pico-shell-based-os and pico_os use
 
-char t1[15] = "";
-char t2[15] = "";
-bool d1 = false;
-bool d2 = false;
-int cnt = 0;
+lfs_t fs;
+struct todo_store tasks;
+struct todo_item page[TODO_PAGE_SIZE];
+uint32_t next_id = 1;   // Where 5=Next carries on listing
+
+// One line, ended by Enter; blank lines (the \n after a \r) are skipped
+void read_line(char *buf, int max) {
+    int n = 0;
+    while (1) {
+        int c = getchar();
+        if (c == '\r' || c == '\n') {
+            if (n > 0) break;
+            continue;
+        }
+        if (n < max - 1) buf[n++] = (char)c;
+    }
+    buf[n] = '\0';
+}
+
+uint32_t read_id() {
+    char line[12];
+    printf("Which? ");
+    read_line(line, sizeof(line));
+    return strtoul(line, NULL, 10);
+}
+
+void list(uint32_t from) {
+    int n = todo_store_list(&tasks, from, page, TODO_PAGE_SIZE);
+    printf("\nTasks (%lu, %lu done):\n", (unsigned long)tasks.count, (unsigned long)tasks.done);
+    for (int i = 0; i < n; i++) {
+        printf("%lu. [%c] %s\n", (unsigned long)page[i].id, page[i].done ? 'X' : ' ', page[i].text);
+    }
+    if (n == 0) printf("None\n");
+    next_id = n == TODO_PAGE_SIZE ? page[n - 1].id + 1 : 1;
+}
+
+void save() {
+    printf(todo_store_commit(&tasks) ? "OK\n" : "SAVE FAILED\n");
+}
 
 int main() {
     stdio_init_all();
     sleep_ms(2000);
-    
+
+    if (!flash_fs_mount(&fs) || !todo_store_open(&tasks, &fs, "/todo")) {
+        printf("\nSTORAGE FAILED\n");
+        while (1) sleep_ms(1000);
+    }
+
     printf("\nREADY\n");
 
+    char line[TODO_TEXT_MAX];
     while (1) {
-        printf("\n1=List 2=Add 3=Done 4=Del\n>");
-        
-        char c = getchar();
-        getchar(); // consume newline
+        printf("\n1=List 2=Add 3=Done 4=Del 5=Next\n>");
+        read_line(line, sizeof(line));
+        char c = line[0];
 
         if (c == '1') {
-            // List
-            printf("\nTasks:\n");
-            if (cnt >= 1) printf("1. [%c] %s\n", d1?'X':' ', t1);
-            if (cnt >= 2) printf("2. [%c] %s\n", d2?'X':' ', t2);
-            if (cnt == 0) printf("None\n");
-            
+            list(1);
+
         } else if (c == '2') {
-            // Add
-            if (cnt == 0) {
-                printf("Task: ");
-                scanf("%14s", t1);
-                getchar();
-                d1 = false;
-                cnt = 1;
-                printf("OK\n");
-            } else if (cnt == 1) {
-                printf("Task: ");
-                scanf("%14s", t2);
-                getchar();
-                d2 = false;
-                cnt = 2;
-                printf("OK\n");
+            printf("Task: ");
+            read_line(line, sizeof(line));
+            if (todo_store_add(&tasks, line)) {
+                save();
             } else {
                 printf("FULL\n");
             }
-            
+
         } else if (c == '3') {
-            // Done
-            printf("Which? ");
-            char n = getchar();
-            getchar();
-            if (n == '1' && cnt >= 1) {
-                d1 = true;
-                printf("OK\n");
-            } else if (n == '2' && cnt >= 2) {
-                d2 = true;
-                printf("OK\n");
+            // Toggles
+            uint32_t id = read_id();
+            struct todo_item item;
+            if (todo_store_get(&tasks, id, &item) && todo_store_set_done(&tasks, id, !item.done)) {
+                save();
             }
-            
+
         } else if (c == '4') {
-            // Delete
-            printf("Which? ");
-            char n = getchar();
-            getchar();
-            if (n == '1' && cnt >= 1) {
-                if (cnt == 2) {
-                    // Move task 2 to task 1
-                    for (int i = 0; i < 15; i++) t1[i] = t2[i];
-                    d1 = d2;
-                }
-                cnt--;
-                printf("OK\n");
-            } else if (n == '2' && cnt == 2) {
-                cnt--;
-                printf("OK\n");
+            if (todo_store_delete(&tasks, read_id())) {
+                save();
             }
+
+        } else if (c == '5') {
+            list(next_id);
         }
     }
 }